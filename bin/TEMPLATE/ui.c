@@ -28,6 +28,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 
 #include <gnuastro/fits.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/timing.h>
 #include <gnuastro-internal/options.h>
@@ -360,6 +361,9 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct TEMPLATEparams *p)
 void
 ui_free_report(struct TEMPLATEparams *p, struct timeval *t1)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the allocated arrays: */
   free(p->cp.hdu);
   free(p->cp.output);
@@ -44,6 +44,8 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include "main.h"
 
+#include "filter.h"
+#include "fuse.h"
 #include "operands.h"
 #include "arithmetic.h"
 
@@ -175,27 +177,8 @@ pop_number_of_operands(struct arithmeticparams *p, int op, char *token_string,
 /**********************************************************************/
 /****************         Filtering operators         *****************/
 /**********************************************************************/
-#define ARITHMETIC_FILTER_DIM 10
-
-struct arithmetic_filter_p
-{
-  int           operator;       /* The type of filtering.                */
-  size_t          *fsize;       /* Filter size.                          */
-  size_t        *hpfsize;       /* Positive Half-filter size.            */
-  size_t        *hnfsize;       /* Negative Half-filter size.            */
-  float     sclip_multip;       /* Sigma multiple in sigma-clipping.     */
-  float      sclip_param;       /* Termination critera in sigma-cliping. */
-  gal_data_t      *input;       /* Input dataset.                        */
-  gal_data_t        *out;       /* Output dataset.                       */
-
-  int           hasblank;       /* If the dataset has blank values.      */
-};
-
-
-
-
-
-/* Main filtering work function. */
+/* Main filtering work function for the sigma-clipping filters (the
+   median and mean filters are done in 'filter.c'). */
 static void *
 arithmetic_filter(void *in_prm)
 {
@@ -269,16 +252,6 @@ arithmetic_filter(void *in_prm)
       /* Do the necessary calculation. */
       switch(afp->operator)
         {
-        case ARITHMETIC_OP_FILTER_MEDIAN:
-          result=gal_statistics_median(tile, 0);
-          break;
-
-
-        case ARITHMETIC_OP_FILTER_MEAN:
-          result=gal_statistics_mean(tile);
-          break;
-
-
         case ARITHMETIC_OP_FILTER_SIGCLIP_MEAN:
         case ARITHMETIC_OP_FILTER_SIGCLIP_MEDIAN:
           /* Find the sigma-clipped results. */
@@ -510,10 +483,18 @@ wrapper_for_filter(struct arithmeticparams *p, char *token, int operator)
                              NULL);
 
 
-      /* Spin off threads for each pixel. */
-      gal_threads_spin_off(arithmetic_filter, &afp, afp.input->size,
-                           p->cp.numthreads, p->cp.minmapsize,
-                           p->cp.quietmmap);
+      /* Do the filtering: the median and mean have dedicated functions
+         that don't treat each pixel independently. For the others, spin
+         off threads for each pixel. */
+      switch(operator)
+        {
+        case ARITHMETIC_OP_FILTER_MEDIAN: filter_median(p, &afp); break;
+        case ARITHMETIC_OP_FILTER_MEAN:   filter_mean(p, &afp);   break;
+        default:
+          gal_threads_spin_off(arithmetic_filter, &afp, afp.input->size,
+                               p->cp.numthreads, p->cp.minmapsize,
+                               p->cp.quietmmap);
+        }
     }
 
 
@@ -604,8 +585,12 @@ arithmetic_erode_dilate(struct arithmeticparams *p, char *token, int op)
   /* Do the operation. */
   switch(op)
     {
-    case ARITHMETIC_OP_ERODE:  gal_binary_erode(in,  1, conn_int, 1); break;
-    case ARITHMETIC_OP_DILATE: gal_binary_dilate(in, 1, conn_int, 1); break;
+    case ARITHMETIC_OP_ERODE:
+      gal_binary_erode_threaded(in,  1, conn_int, 1, p->cp.numthreads);
+      break;
+    case ARITHMETIC_OP_DILATE:
+      gal_binary_dilate_threaded(in, 1, conn_int, 1, p->cp.numthreads);
+      break;
     default:
       error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix the "
             "problem. The operator code %d not recognized", __func__,
@@ -634,7 +619,8 @@ arithmetic_connected_components(struct arithmeticparams *p, char *token)
   conn_int=arithmetic_binary_sanity_checks(in, conn, token);
 
   /* Do the connected components labeling. */
-  gal_binary_connected_components(in, &out, conn_int);
+  gal_binary_connected_components_threaded(in, &out, conn_int,
+                                           p->cp.numthreads);
 
   /* Push the result onto the stack. */
   operands_add(p, NULL, out);
@@ -789,7 +775,8 @@ arithmetic_interpolate_region(struct arithmeticparams *p,
   /* Build a binary image with the blank regions masked and label them,
      then free the flagged array. */
   flag=gal_blank_flag(in);
-  numlabs=gal_binary_connected_components(flag, &lab, con[0]);
+  numlabs=gal_binary_connected_components_threaded(flag, &lab, con[0],
+                                                   p->cp.numthreads);
   gal_data_free(flag);
 
   /* Allocate array to keep maximum values for each region. Just note that
@@ -1020,8 +1007,8 @@ arithmetic_tofile(struct arithmeticparams *p, char *token, int freeflag)
   /* Save it to a file. */
   popped->wcs=p->refdata.wcs;
   if(popped->ndim==1 && p->onedasimage==0)
-    gal_table_write(popped, NULL, NULL, p->cp.tableformat, filename,
-                    "ARITHMETIC", 0);
+    gal_table_write_threaded(popped, NULL, NULL, p->cp.tableformat, filename,
+                             "ARITHMETIC", 0, p->cp.numthreads);
   else
     gal_fits_img_write(popped, filename, NULL, PROGRAM_NAME);
   if(!p->cp.quiet)
@@ -1221,6 +1208,12 @@ arithmetic_operator_run(struct arithmeticparams *p, int operator,
   int flags = ( GAL_ARITHMETIC_INPLACE | GAL_ARITHMETIC_FREE
                 | GAL_ARITHMETIC_NUMOK );
 
+  /* Element-wise operators are fused with their operands (if they are
+     also element-wise operators) into one expression, see 'fuse.c'. */
+  if( num_operands
+      && fuse_operator(p, operator, operator_string, num_operands, flags) )
+    return;
+
   /* When 'num_operands!=0', the operator is in the library. */
   if(num_operands)
     {
@@ -1419,6 +1412,15 @@ reversepolish(struct arithmeticparams *p)
     error(EXIT_FAILURE, 0, "too many operands");
 
 
+  /* If the final operand is a fused expression, it hasn't been evaluated
+     yet. */
+  if(p->operands->fused)
+    {
+      p->operands->data=fuse_evaluate(p, p->operands->fused);
+      p->operands->fused=NULL;
+    }
+
+
   /* If the final operand has a filename, but its 'data' element is NULL,
      then the file hasn't actually be read yet. In this case, we need to
      read the contents of the file and put the resulting dataset into the
@@ -1433,9 +1435,10 @@ reversepolish(struct arithmeticparams *p)
       if( gal_fits_name_is_fits(filename) )
         {
           /* Read the data, note that the WCS has already been set. */
-          p->operands->data=gal_array_read_one_ch(filename, hdu, NULL,
-                                                  p->cp.minmapsize,
-                                                  p->cp.quietmmap);
+          p->operands->data=gal_array_read_one_ch_threaded(filename, hdu, NULL,
+                                                           p->cp.numthreads,
+                                                           p->cp.minmapsize,
+                                                           p->cp.quietmmap);
           data=p->operands->data;
           data->ndim=gal_dimension_remove_extra(data->ndim, data->dsize, NULL);
           if(!p->cp.quiet) printf(" - %s (hdu %s) is read.\n", filename, hdu);
@@ -1466,9 +1469,9 @@ reversepolish(struct arithmeticparams *p)
          will be freed while freeing 'data'. */
       data->wcs=p->refdata.wcs;
       if(data->ndim==1 && p->onedasimage==0)
-        gal_table_write(data, NULL, NULL, p->cp.tableformat,
-                        p->onedonstdout ? NULL : p->cp.output,
-                        "ARITHMETIC", 0);
+        gal_table_write_threaded(data, NULL, NULL, p->cp.tableformat,
+                                 p->onedonstdout ? NULL : p->cp.output,
+                                 "ARITHMETIC", 0, p->cp.numthreads);
       else
         gal_fits_img_write(data, p->cp.output, NULL, PROGRAM_NAME);
       if(!p->cp.quiet)
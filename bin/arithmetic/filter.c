@@ -0,0 +1,906 @@
+/*********************************************************************
+Arithmetic - Do arithmetic operations on images.
+Arithmetic is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2020, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <config.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <gnuastro/qsort.h>
+#include <gnuastro/blank.h>
+#include <gnuastro/threads.h>
+#include <gnuastro/pointer.h>
+#include <gnuastro/dimension.h>
+#include <gnuastro/statistics.h>
+
+#include "main.h"
+
+#include "filter.h"
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**********************************************************************/
+/****************          Window of each pixel        ****************/
+/**********************************************************************/
+/* Find the range of the window along dimension 'dim' for a pixel with
+   coordinate 'c' (in that dimension). The window is trimmed on the edges
+   of the input, so 'end' is one after the last pixel within the window. */
+static void
+filter_window_range(struct arithmetic_filter_p *afp, size_t dim, size_t c,
+                    size_t *start, size_t *end)
+{
+  size_t len=afp->input->dsize[dim];
+
+  /* Note that we are dealing with size_t (unsigned int) type here, so
+     there are no negatives. */
+  *start = c < afp->hnfsize[dim] ? 0 : c - afp->hnfsize[dim];
+  *end   = ( c + afp->hpfsize[dim] >= len
+             ? len
+             : c + afp->hpfsize[dim] + 1 );
+}
+
+
+
+
+
+/* The windows of all the pixels on a line (along the fastest dimension)
+   are composed of a set of "rows" that are parallel to that line. Here,
+   the index of the first element of each row (where the coordinate along
+   the fastest dimension is zero) is written into 'rows', and the number
+   of rows is returned. */
+static size_t
+filter_window_rows(struct arithmetic_filter_p *afp, size_t line,
+                   size_t *rows)
+{
+  size_t ndim=afp->input->ndim, *dsize=afp->input->dsize;
+  size_t j, nrows=0, coord[ARITHMETIC_FILTER_DIM];
+  size_t start[ARITHMETIC_FILTER_DIM], end[ARITHMETIC_FILTER_DIM];
+
+  /* Set the range of the window in the slower dimensions. */
+  gal_dimension_index_to_coord(line*dsize[ndim-1], ndim, dsize, coord);
+  for(j=0;j<ndim-1;++j)
+    {
+      filter_window_range(afp, j, coord[j], &start[j], &end[j]);
+      coord[j]=start[j];
+    }
+
+  /* Go over all the rows (like an odometer over the slower dimensions,
+     the fastest dimension's coordinate is already zero). */
+  do
+    {
+      rows[nrows++]=gal_dimension_coord_to_index(ndim, dsize, coord);
+      for(j=ndim-1; j>0; --j)
+        if( ++coord[j-1] < end[j-1] ) break;
+        else coord[j-1]=start[j-1];
+    }
+  while(j>0);
+
+  /* Return the number of rows. */
+  return nrows;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**********************************************************************/
+/****************             Median filter            ****************/
+/**********************************************************************/
+struct filter_median_p
+{
+  struct arithmetic_filter_p *afp; /* Filter parameters.                 */
+  size_t             numseg;       /* Number of segments in each line.   */
+  size_t            numbins;       /* Histogram bins (0: no histogram).  */
+  gal_data_t           *min;       /* Minimum value (for the histogram). */
+  gal_data_t         *ranks;       /* Rank of each element (or NULL).    */
+  gal_data_t        *sorted;       /* Sorted non-blank values.           */
+  size_t         minmapsize;       /* Minimum size to use memory-mapping.*/
+  int             quietmmap;       /* Don't report the memory-mapping.   */
+};
+
+
+
+
+
+/* The elements of the window in the rank-based median filter. */
+struct filter_median_window
+{
+  uint64_t            *bits;       /* One bit for each rank.             */
+  uint16_t          *counts;       /* Number of set bits in each block.  */
+  size_t                  n;       /* Number of elements in the window.  */
+  size_t               mblk;       /* Block of the last order statistic. */
+  size_t                 lt;       /* Number of elements before 'mblk'.  */
+};
+
+
+
+
+
+/* Number of set bits in a 64-bit word. */
+static size_t
+filter_median_popcount(uint64_t w)
+{
+  w = w - ( (w>>1) & 0x5555555555555555ULL );
+  w = ( w & 0x3333333333333333ULL ) + ( (w>>2) & 0x3333333333333333ULL );
+  w = ( w + (w>>4) ) & 0x0f0f0f0f0f0f0f0fULL;
+  return (w * 0x0101010101010101ULL) >> 56;
+}
+
+
+
+
+
+/* Position of the 'j'-th set bit (counting from zero) in a 64-bit
+   word. */
+static size_t
+filter_median_bit(uint64_t w, size_t j)
+{
+  size_t b=0;
+
+  /* Remove the 'j' lowest set bits, then find the lowest set bit. */
+  while(j--) w &= w-1;
+  if( (w & 0xffffffffULL)==0 ) { w>>=32; b+=32; }
+  if( (w & 0xffffULL)==0 )     { w>>=16; b+=16; }
+  if( (w & 0xffULL)==0 )       { w>>=8;  b+=8;  }
+  if( (w & 0xfULL)==0 )        { w>>=4;  b+=4;  }
+  if( (w & 0x3ULL)==0 )        { w>>=2;  b+=2;  }
+  if( (w & 0x1ULL)==0 )        {         b+=1;  }
+  return b;
+}
+
+
+
+
+
+/* Add (when 'add' is non-zero) or remove the column at 'x' (along the
+   fastest dimension) of the window in the rank-based median filter. */
+static void
+filter_median_window_column(struct filter_median_window *win,
+                            uint32_t *ranks, size_t *rows, size_t nrows,
+                            size_t x, int add)
+{
+  size_t r, blk;
+  uint32_t rank;
+  uint64_t bit;
+
+  for(r=0;r<nrows;++r)
+    if( (rank=ranks[ rows[r] + x ]) != FILTER_MEDIAN_RANK_BLANK )
+      {
+        bit=(uint64_t)1 << (rank%64);
+        blk=rank/(64*FILTER_MEDIAN_RANK_WORDS);
+        if(add)
+          {
+            win->bits[rank/64] |= bit;
+            ++win->counts[blk];
+            ++win->n;
+            if(blk<win->mblk) ++win->lt;
+          }
+        else
+          {
+            win->bits[rank/64] &= ~bit;
+            --win->counts[blk];
+            --win->n;
+            if(blk<win->mblk) --win->lt;
+          }
+      }
+}
+
+
+
+
+
+/* Return the 'k'-th smallest rank (counting from zero) in the window. The
+   block containing it is found by moving from the block of the previous
+   order statistic (which is usually close). Within the block, the number
+   of set bits in each word is used. */
+static size_t
+filter_median_window_kth(struct filter_median_window *win, size_t k)
+{
+  size_t c, j, w;
+
+  /* Find the block. */
+  while(win->lt>k) win->lt-=win->counts[--win->mblk];
+  while(win->lt+win->counts[win->mblk]<=k)
+    win->lt+=win->counts[win->mblk++];
+
+  /* Find the word within the block, then the bit within the word. */
+  j=k-win->lt;
+  w=win->mblk*FILTER_MEDIAN_RANK_WORDS;
+  while( (c=filter_median_popcount(win->bits[w])) <= j ) { j-=c; ++w; }
+  return w*64 + filter_median_bit(win->bits[w], j);
+}
+
+
+
+
+
+/* Add (when 'OP' is '+') or remove (when 'OP' is '-') the column at 'X'
+   (along the fastest dimension) of the window to the histogram. While
+   doing so, also keep the number of elements in the bins before the
+   current median bin. */
+#define FILTER_MEDIAN_HIST_COLUMN(X, OP) {                              \
+    for(r=0;r<nrows;++r)                                                \
+      {                                                                 \
+        v=in[ rows[r] + (X) ];                                          \
+        if( afp->hasblank==0 || v!=b )                                  \
+          {                                                             \
+            bin = v-min;                                                \
+            hist[bin] OP##= 1;                                          \
+            n OP##= 1;                                                  \
+            if(bin<mbin) lt OP##= 1;                                    \
+          }                                                             \
+      }                                                                 \
+  }
+
+/* For integer types with a small range of values, the median of each
+   window is found from a histogram of its values (Huang et al. 1979): as
+   the window slides along the line, only the column that leaves the
+   window and the column that enters it need to be updated in the
+   histogram. Since the median of neighboring pixels is usually close, the
+   bin of the median is also found from the bin of the previous median by
+   only moving a few bins. */
+#define FILTER_MEDIAN_HIST(IT) {                                        \
+    IT v, lo, b, *in=input->array;                                      \
+    IT min=*(IT *)(fmp->min->array), *o=(IT *)(afp->out->array)+line*L; \
+    size_t r, x, xx, bin, k, ws, we, mbin=0, lt=0, n=0;                 \
+                                                                        \
+    /* Put the window of the first pixel into the histogram. */         \
+    gal_blank_write(&b, input->type);                                   \
+    memset(hist, 0, fmp->numbins*sizeof *hist);                         \
+    filter_window_range(afp, ndim-1, xstart, &ws, &we);                 \
+    for(xx=ws;xx<we;++xx) FILTER_MEDIAN_HIST_COLUMN(xx, +);             \
+                                                                        \
+    /* Go over the pixels in this segment. */                           \
+    for(x=xstart;x<xend;++x)                                            \
+      {                                                                 \
+        /* Find the median bin, then write the median. Like the */      \
+        /* median of a sorted array, when the number of elements is */  \
+        /* even, the median is the mean of the two middle elements. */  \
+        if(n)                                                           \
+          {                                                             \
+            k=n/2;                                                      \
+            while(lt>k) lt-=hist[--mbin];                               \
+            while(lt+hist[mbin]<=k) lt+=hist[mbin++];                   \
+            if(n%2) o[x]=min+mbin;                                      \
+            else                                                        \
+              {                                                         \
+                bin=mbin;                                               \
+                if(lt>k-1) do --bin; while(hist[bin]==0);               \
+                lo=min+bin;                                             \
+                v=min+mbin;                                             \
+                o[x]=(v+lo)/2;                                          \
+              }                                                         \
+          }                                                             \
+        else o[x]=b;                                                    \
+                                                                        \
+        /* Slide the window to the next pixel. */                       \
+        if(x+1<xend)                                                    \
+          {                                                             \
+            if(x>=hn) FILTER_MEDIAN_HIST_COLUMN(x-hn, -);               \
+            if(x+hp+1<L) FILTER_MEDIAN_HIST_COLUMN(x+hp+1, +);          \
+          }                                                             \
+      }                                                                 \
+  }
+
+/* Write the median from the ranks of the middle element(s). */
+#define FILTER_MEDIAN_RANK_WRITE(IT) {                                  \
+    IT *v=fmp->sorted->array;                                           \
+    ((IT *)(afp->out->array))[line*L+x] = ( r1==r2                      \
+                                            ? v[r2]                     \
+                                            : (v[r2]+v[r1])/2 );        \
+  }
+
+/* For other types (with a large range of values), the median is found
+   from the ranks of the elements within the full dataset. The window
+   keeps one bit for each rank (all the ranks are unique), as well as the
+   number of set bits in blocks of ranks. So like the histogram, as the
+   window slides, only the columns that leave and enter the window need
+   to be updated, and the median can be found by moving from the block of
+   the previous median. */
+static void
+filter_median_rank(struct filter_median_p *fmp,
+                   struct filter_median_window *win, size_t line,
+                   size_t xstart, size_t xend, size_t *rows, size_t nrows)
+{
+  struct arithmetic_filter_p *afp=fmp->afp;
+  size_t ndim=afp->input->ndim, L=afp->input->dsize[ndim-1];
+  size_t hn=afp->hnfsize[ndim-1], hp=afp->hpfsize[ndim-1];
+
+  uint32_t *ranks=fmp->ranks->array;
+  size_t x, xx, ws, we, r1, r2, k;
+
+  /* Put the window of the first pixel into the window. */
+  filter_window_range(afp, ndim-1, xstart, &ws, &we);
+  for(xx=ws;xx<we;++xx)
+    filter_median_window_column(win, ranks, rows, nrows, xx, 1);
+
+  /* Go over the pixels of this segment. */
+  for(x=xstart;x<xend;++x)
+    {
+      /* Find the median. */
+      if(win->n)
+        {
+          k=win->n/2;
+          r2=filter_median_window_kth(win, k);
+          r1 = win->n%2 ? r2 : filter_median_window_kth(win, k-1);
+          switch(afp->out->type)
+            {
+            case GAL_TYPE_UINT8:   FILTER_MEDIAN_RANK_WRITE( uint8_t  ); break;
+            case GAL_TYPE_INT8:    FILTER_MEDIAN_RANK_WRITE( int8_t   ); break;
+            case GAL_TYPE_UINT16:  FILTER_MEDIAN_RANK_WRITE( uint16_t ); break;
+            case GAL_TYPE_INT16:   FILTER_MEDIAN_RANK_WRITE( int16_t  ); break;
+            case GAL_TYPE_UINT32:  FILTER_MEDIAN_RANK_WRITE( uint32_t ); break;
+            case GAL_TYPE_INT32:   FILTER_MEDIAN_RANK_WRITE( int32_t  ); break;
+            case GAL_TYPE_UINT64:  FILTER_MEDIAN_RANK_WRITE( uint64_t ); break;
+            case GAL_TYPE_INT64:   FILTER_MEDIAN_RANK_WRITE( int64_t  ); break;
+            case GAL_TYPE_FLOAT32: FILTER_MEDIAN_RANK_WRITE( float    ); break;
+            case GAL_TYPE_FLOAT64: FILTER_MEDIAN_RANK_WRITE( double   ); break;
+            default:
+              error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+                    __func__, afp->out->type);
+            }
+        }
+      else
+        gal_blank_write(gal_pointer_increment(afp->out->array, line*L+x,
+                                              afp->out->type),
+                        afp->out->type);
+
+      /* Slide the window to the next pixel. */
+      if(x+1<xend)
+        {
+          if(x>=hn)
+            filter_median_window_column(win, ranks, rows, nrows, x-hn, 0);
+          if(x+hp+1<L)
+            filter_median_window_column(win, ranks, rows, nrows, x+hp+1, 1);
+        }
+    }
+
+  /* Remove the window of the last pixel, so the window is empty for the
+     next segment. */
+  filter_window_range(afp, ndim-1, xend-1, &ws, &we);
+  for(xx=ws;xx<we;++xx)
+    filter_median_window_column(win, ranks, rows, nrows, xx, 0);
+}
+
+/* When the dataset is too large for 32-bit ranks, the non-blank elements
+   of each window are copied into an already allocated space, then the
+   median is found by selection (which doesn't sort the full window). */
+#define FILTER_MEDIAN_SELECT(IT) {                                      \
+    gal_data_t *result;                                                 \
+    size_t r, x, xx, n, ws, we;                                         \
+    IT v, b, *w=window->array, *in=input->array;                        \
+    IT *o=(IT *)(afp->out->array)+line*L;                               \
+                                                                        \
+    gal_blank_write(&b, input->type);                                   \
+    for(x=xstart;x<xend;++x)                                            \
+      {                                                                 \
+        /* Copy the non-blank elements of the window. */                \
+        n=0;                                                            \
+        filter_window_range(afp, ndim-1, x, &ws, &we);                  \
+        for(r=0;r<nrows;++r)                                            \
+          for(xx=ws;xx<we;++xx)                                         \
+            {                                                           \
+              v=in[ rows[r] + xx ];                                     \
+              if( afp->hasblank==0 || (b==b ? v!=b : v==v) ) w[n++]=v;  \
+            }                                                           \
+                                                                        \
+        /* Find the median (the window doesn't have any blanks). */     \
+        if(n)                                                           \
+          {                                                             \
+            window->size=window->dsize[0]=n;                            \
+            window->flag=GAL_DATA_FLAG_BLANK_CH;                        \
+            result=gal_statistics_median(window, 1);                    \
+            o[x]=*(IT *)(result->array);                                \
+            gal_data_free(result);                                      \
+          }                                                             \
+        else o[x]=b;                                                    \
+      }                                                                 \
+  }
+
+static void *
+filter_median_onthread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct filter_median_p *fmp=(struct filter_median_p *)tprm->params;
+  struct arithmetic_filter_p *afp=fmp->afp;
+  gal_data_t *input=afp->input;
+
+  uint32_t *hist=NULL;
+  gal_data_t *window=NULL;
+  struct filter_median_window win={0};
+  size_t ndim=input->ndim, L=input->dsize[ndim-1];
+  size_t hn=afp->hnfsize[ndim-1], hp=afp->hpfsize[ndim-1];
+  size_t i, ind, line, nrows, xstart, xend, wsize, nblocks, *rows;
+  size_t maxrows=1;
+
+  /* Allocate the space for the rows of the window and the histogram (or
+     the window's values). */
+  for(i=0;i<ndim-1;++i) maxrows*=afp->fsize[i];
+  rows=gal_pointer_allocate(GAL_TYPE_SIZE_T, maxrows, 0, __func__, "rows");
+  if(fmp->numbins)
+    hist=gal_pointer_allocate(GAL_TYPE_UINT32, fmp->numbins, 0, __func__,
+                              "hist");
+  else if(fmp->ranks)
+    {
+      nblocks=( fmp->sorted->size/(64*FILTER_MEDIAN_RANK_WORDS)
+                + (fmp->sorted->size%(64*FILTER_MEDIAN_RANK_WORDS)?1:0) );
+      win.counts=gal_pointer_allocate(GAL_TYPE_UINT16, nblocks, 1,
+                                      __func__, "win.counts");
+      win.bits=gal_pointer_allocate(GAL_TYPE_UINT64,
+                                    nblocks*FILTER_MEDIAN_RANK_WORDS, 1,
+                                    __func__, "win.bits");
+    }
+  else
+    {
+      wsize=maxrows*afp->fsize[ndim-1];
+      window=gal_data_alloc(NULL, input->type, 1, &wsize, NULL, 0,
+                            fmp->minmapsize, fmp->quietmmap, NULL, NULL,
+                            NULL);
+    }
+
+  /* Go over all the segments that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Find the line and the range of pixels in this segment. */
+      ind    = tprm->indexs[i];
+      line   = ind / fmp->numseg;
+      xstart = (ind % fmp->numseg) * FILTER_MEDIAN_SEGMENT;
+      xend   = ( xstart + FILTER_MEDIAN_SEGMENT < L
+                 ? xstart + FILTER_MEDIAN_SEGMENT
+                 : L );
+
+      /* Find the rows of the window. */
+      nrows=filter_window_rows(afp, line, rows);
+
+      /* Find the median of all the pixels. */
+      if(hist)
+        switch(input->type)
+          {
+          case GAL_TYPE_UINT8:   FILTER_MEDIAN_HIST( uint8_t  );   break;
+          case GAL_TYPE_INT8:    FILTER_MEDIAN_HIST( int8_t   );   break;
+          case GAL_TYPE_UINT16:  FILTER_MEDIAN_HIST( uint16_t );   break;
+          case GAL_TYPE_INT16:   FILTER_MEDIAN_HIST( int16_t  );   break;
+          case GAL_TYPE_UINT32:  FILTER_MEDIAN_HIST( uint32_t );   break;
+          case GAL_TYPE_INT32:   FILTER_MEDIAN_HIST( int32_t  );   break;
+          case GAL_TYPE_UINT64:  FILTER_MEDIAN_HIST( uint64_t );   break;
+          case GAL_TYPE_INT64:   FILTER_MEDIAN_HIST( int64_t  );   break;
+          default:
+            error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s "
+                  "to fix the problem. Type code %d is not recognized for "
+                  "the histogram", __func__, PACKAGE_BUGREPORT, input->type);
+          }
+      else if(fmp->ranks)
+        filter_median_rank(fmp, &win, line, xstart, xend, rows, nrows);
+      else
+        switch(input->type)
+          {
+          case GAL_TYPE_UINT8:   FILTER_MEDIAN_SELECT( uint8_t  ); break;
+          case GAL_TYPE_INT8:    FILTER_MEDIAN_SELECT( int8_t   ); break;
+          case GAL_TYPE_UINT16:  FILTER_MEDIAN_SELECT( uint16_t ); break;
+          case GAL_TYPE_INT16:   FILTER_MEDIAN_SELECT( int16_t  ); break;
+          case GAL_TYPE_UINT32:  FILTER_MEDIAN_SELECT( uint32_t ); break;
+          case GAL_TYPE_INT32:   FILTER_MEDIAN_SELECT( int32_t  ); break;
+          case GAL_TYPE_UINT64:  FILTER_MEDIAN_SELECT( uint64_t ); break;
+          case GAL_TYPE_INT64:   FILTER_MEDIAN_SELECT( int64_t  ); break;
+          case GAL_TYPE_FLOAT32: FILTER_MEDIAN_SELECT( float    ); break;
+          case GAL_TYPE_FLOAT64: FILTER_MEDIAN_SELECT( double   ); break;
+          default:
+            error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+                  __func__, input->type);
+          }
+    }
+
+  /* Clean up and wait for all the other threads to finish, then
+     return. */
+  free(rows);
+  if(hist) free(hist);
+  if(win.bits) { free(win.bits); free(win.counts); }
+  if(window) gal_data_free(window);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Find the rank of each element in the dataset (the position it would
+   have in the sorted array of non-blank elements). Equal elements will
+   have different ranks (based on their position in the sorted array). */
+static void
+filter_median_ranks(struct filter_median_p *fmp)
+{
+  struct arithmetic_filter_p *afp=fmp->afp;
+  gal_data_t *input=afp->input;
+
+  uint8_t *f;
+  uint32_t *ranks;
+  gal_data_t *flag=NULL;
+  size_t i, m=0, *indexs, width=gal_type_sizeof(input->type);
+  int (*compare)(const void *, const void *)=NULL;
+
+  /* Find the indexs of the non-blank elements. */
+  indexs=gal_pointer_allocate(GAL_TYPE_SIZE_T, input->size, 0, __func__,
+                              "indexs");
+  if(afp->hasblank)
+    {
+      flag=gal_blank_flag(input);
+      f=flag->array;
+      for(i=0;i<input->size;++i) if(f[i]==0) indexs[m++]=i;
+      gal_data_free(flag);
+    }
+  else
+    for(m=0;m<input->size;++m) indexs[m]=m;
+
+  /* If all the elements are blank, there is nothing to rank. */
+  if(m==0) { free(indexs); return; }
+
+  /* Sort the indexs based on the values. */
+  switch(input->type)
+    {
+    case GAL_TYPE_UINT8:   compare=gal_qsort_index_single_uint8_i;   break;
+    case GAL_TYPE_INT8:    compare=gal_qsort_index_single_int8_i;    break;
+    case GAL_TYPE_UINT16:  compare=gal_qsort_index_single_uint16_i;  break;
+    case GAL_TYPE_INT16:   compare=gal_qsort_index_single_int16_i;   break;
+    case GAL_TYPE_UINT32:  compare=gal_qsort_index_single_uint32_i;  break;
+    case GAL_TYPE_INT32:   compare=gal_qsort_index_single_int32_i;   break;
+    case GAL_TYPE_UINT64:  compare=gal_qsort_index_single_uint64_i;  break;
+    case GAL_TYPE_INT64:   compare=gal_qsort_index_single_int64_i;   break;
+    case GAL_TYPE_FLOAT32: compare=gal_qsort_index_single_float32_i; break;
+    case GAL_TYPE_FLOAT64: compare=gal_qsort_index_single_float64_i; break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, input->type);
+    }
+  gal_qsort_index_single=input->array;
+  qsort(indexs, m, sizeof *indexs, compare);
+
+  /* Allocate the ranks and sorted values, then fill them in. */
+  fmp->ranks=gal_data_alloc(NULL, GAL_TYPE_UINT32, input->ndim,
+                            input->dsize, NULL, 0, fmp->minmapsize,
+                            fmp->quietmmap, NULL, NULL, NULL);
+  fmp->sorted=gal_data_alloc(NULL, input->type, 1, &m, NULL, 0,
+                             fmp->minmapsize, fmp->quietmmap, NULL, NULL,
+                             NULL);
+  ranks=fmp->ranks->array;
+  if(afp->hasblank)
+    for(i=0;i<input->size;++i) ranks[i]=FILTER_MEDIAN_RANK_BLANK;
+  for(i=0;i<m;++i)
+    {
+      ranks[ indexs[i] ] = i;
+      memcpy(gal_pointer_increment(fmp->sorted->array, i, input->type),
+             gal_pointer_increment(input->array, indexs[i], input->type),
+             width);
+    }
+
+  /* Clean up. */
+  free(indexs);
+}
+
+
+
+
+
+/* Set the number of bins of the histogram if the range of values in the
+   integer dataset is small enough. Note that the range is first checked
+   in floating point to avoid overflows in the subtraction. */
+#define FILTER_MEDIAN_NUMBINS(IT) {                                     \
+    IT mn=*(IT *)(fmp.min->array), mx=*(IT *)(max->array);              \
+    if( (double)mx - (double)mn < 2.0f*FILTER_MEDIAN_HIST_MAXBINS       \
+        && (size_t)(mx-mn) < FILTER_MEDIAN_HIST_MAXBINS )               \
+      fmp.numbins = (size_t)(mx-mn) + 1;                                \
+  }
+
+void
+filter_median(struct arithmeticparams *p, struct arithmetic_filter_p *afp)
+{
+  int allblank=0;
+  gal_data_t *max=NULL;
+  struct filter_median_p fmp={0};
+  gal_data_t *input=afp->input;
+  size_t L=input->dsize[input->ndim-1];
+
+  /* Basic parameters. */
+  fmp.afp=afp;
+  fmp.minmapsize=p->cp.minmapsize;
+  fmp.quietmmap=p->cp.quietmmap;
+  fmp.numseg=L/FILTER_MEDIAN_SEGMENT + (L%FILTER_MEDIAN_SEGMENT ? 1 : 0);
+
+  /* For integer types, see if the range of values is small enough for a
+     histogram. Note that when all the elements are blank, the minimum
+     and maximum are both blank, so the histogram will have one bin. */
+  if(input->type!=GAL_TYPE_FLOAT32 && input->type!=GAL_TYPE_FLOAT64)
+    {
+      fmp.min=gal_statistics_minimum(input);
+      max=gal_statistics_maximum(input);
+      switch(input->type)
+        {
+        case GAL_TYPE_UINT8:   FILTER_MEDIAN_NUMBINS( uint8_t  );   break;
+        case GAL_TYPE_INT8:    FILTER_MEDIAN_NUMBINS( int8_t   );   break;
+        case GAL_TYPE_UINT16:  FILTER_MEDIAN_NUMBINS( uint16_t );   break;
+        case GAL_TYPE_INT16:   FILTER_MEDIAN_NUMBINS( int16_t  );   break;
+        case GAL_TYPE_UINT32:  FILTER_MEDIAN_NUMBINS( uint32_t );   break;
+        case GAL_TYPE_INT32:   FILTER_MEDIAN_NUMBINS( int32_t  );   break;
+        case GAL_TYPE_UINT64:  FILTER_MEDIAN_NUMBINS( uint64_t );   break;
+        case GAL_TYPE_INT64:   FILTER_MEDIAN_NUMBINS( int64_t  );   break;
+        default:
+          error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+                __func__, input->type);
+        }
+    }
+
+  /* When a histogram can't be used, use the ranks of the elements (if
+     they can be stored in 32-bits). When all the elements are blank,
+     'filter_median_ranks' will not allocate the ranks and the output
+     will be blank. */
+  if(fmp.numbins==0 && input->size<FILTER_MEDIAN_RANK_BLANK)
+    {
+      filter_median_ranks(&fmp);
+      allblank = fmp.ranks==NULL;
+    }
+
+  /* Spin-off the threads over the segments of each line. */
+  if(allblank)
+    gal_blank_initialize(afp->out);
+  else
+    gal_threads_spin_off(filter_median_onthread, &fmp,
+                         input->size/L*fmp.numseg, p->cp.numthreads,
+                         p->cp.minmapsize, p->cp.quietmmap);
+
+  /* Clean up. */
+  gal_data_free(max);
+  gal_data_free(fmp.min);
+  gal_data_free(fmp.ranks);
+  gal_data_free(fmp.sorted);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**********************************************************************/
+/****************              Mean filter             ****************/
+/**********************************************************************/
+struct filter_mean_p
+{
+  struct arithmetic_filter_p *afp; /* Filter parameters.                 */
+  size_t                dim;       /* Dimension to sum over.             */
+  size_t                len;       /* Length of the dimension.           */
+  size_t             stride;       /* Number of elements after 'dim'.    */
+  double                *in;       /* Sum over the previous dimensions.  */
+  double               *out;       /* Sum including this dimension.      */
+  double               *cin;       /* Counts over previous dimensions.   */
+  double              *cout;       /* Counts including this dimension.   */
+};
+
+
+
+
+
+/* Sum the elements within the window along one dimension. Each action is
+   one coordinate along 'dim' and all the coordinates in the faster
+   dimensions (with 'stride' elements that are contiguous in memory). */
+static void *
+filter_mean_onthread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct filter_mean_p *fmp=(struct filter_mean_p *)tprm->params;
+
+  double w, *o, *in, *co, *ci;
+  size_t i, j, k, ind, first, start, end;
+  size_t len=fmp->len, stride=fmp->stride;
+
+  /* Go over all the actions that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Find the range of the window along this dimension. */
+      ind=tprm->indexs[i];
+      first=ind - ind%len;
+      filter_window_range(fmp->afp, fmp->dim, ind%len, &start, &end);
+
+      /* Sum of the values. */
+      o=fmp->out + ind*stride;
+      memset(o, 0, stride*sizeof *o);
+      for(k=start;k<end;++k)
+        {
+          in=fmp->in + (first+k)*stride;
+          for(j=0;j<stride;++j) o[j]+=in[j];
+        }
+
+      /* When there are blank elements, also sum the number of used
+         elements, otherwise, the number of elements is the width of the
+         window, so we can just divide by it here. */
+      if(fmp->cin)
+        {
+          co=fmp->cout + ind*stride;
+          memset(co, 0, stride*sizeof *co);
+          for(k=start;k<end;++k)
+            {
+              ci=fmp->cin + (first+k)*stride;
+              for(j=0;j<stride;++j) co[j]+=ci[j];
+            }
+        }
+      else
+        {
+          w=end-start;
+          for(j=0;j<stride;++j) o[j]/=w;
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Copy the input into the first sum array (as double), blank elements
+   will be zero and have a count of zero. */
+#define FILTER_MEAN_INIT(IT) {                                          \
+    IT b, *a=afp->input->array, *af=a+afp->input->size;                 \
+    if(c)                                                               \
+      {                                                                 \
+        gal_blank_write(&b, afp->input->type);                          \
+        if(b==b)                                                        \
+          do { *c++ = *a==b ? 0 : 1; *s++ = *a==b ? 0 : *a; }           \
+          while(++a<af);                                                \
+        else                                                            \
+          do { *c++ = *a!=*a ? 0 : 1; *s++ = *a!=*a ? 0 : *a; }         \
+          while(++a<af);                                                \
+      }                                                                 \
+    else do *s++ = *a; while(++a<af);                                   \
+  }
+
+/* The mean filter is separable: the sum of the values in the window is
+   found by summing along each dimension separately and using the result
+   of the previous dimension as input for the next. So for each pixel,
+   only the sum of the widths of the window along each dimension are
+   necessary, not the product of the widths (which is the number of
+   pixels in the window). When there are blank values, the number of used
+   elements is found in the same way. */
+void
+filter_mean(struct arithmeticparams *p, struct arithmetic_filter_p *afp)
+{
+  size_t d, ndim=afp->input->ndim, *dsize=afp->input->dsize;
+  gal_data_t *tmp, *sum[2], *cnt[2]={NULL, NULL};
+  struct filter_mean_p fmp={0};
+  double *s, *c=NULL, *sf;
+
+  /* Allocate the space for the sums. The sum along each dimension is
+     written in the other array, so the first array is set such that the
+     final result is in the output. */
+  tmp=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, ndim, dsize, NULL, 0,
+                     p->cp.minmapsize, p->cp.quietmmap, NULL, NULL, NULL);
+  sum[0] = ndim%2 ? tmp       : afp->out;
+  sum[1] = ndim%2 ? afp->out  : tmp;
+  if(afp->hasblank)
+    for(d=0;d<2;++d)
+      cnt[d]=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, ndim, dsize, NULL, 0,
+                            p->cp.minmapsize, p->cp.quietmmap, NULL, NULL,
+                            NULL);
+
+  /* Initialize the first array. */
+  s=sum[0]->array;
+  if(cnt[0]) c=cnt[0]->array;
+  switch(afp->input->type)
+    {
+    case GAL_TYPE_UINT8:     FILTER_MEAN_INIT( uint8_t  );   break;
+    case GAL_TYPE_INT8:      FILTER_MEAN_INIT( int8_t   );   break;
+    case GAL_TYPE_UINT16:    FILTER_MEAN_INIT( uint16_t );   break;
+    case GAL_TYPE_INT16:     FILTER_MEAN_INIT( int16_t  );   break;
+    case GAL_TYPE_UINT32:    FILTER_MEAN_INIT( uint32_t );   break;
+    case GAL_TYPE_INT32:     FILTER_MEAN_INIT( int32_t  );   break;
+    case GAL_TYPE_UINT64:    FILTER_MEAN_INIT( uint64_t );   break;
+    case GAL_TYPE_INT64:     FILTER_MEAN_INIT( int64_t  );   break;
+    case GAL_TYPE_FLOAT32:   FILTER_MEAN_INIT( float    );   break;
+    case GAL_TYPE_FLOAT64:   FILTER_MEAN_INIT( double   );   break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, afp->input->type);
+    }
+
+  /* Sum along each dimension. */
+  fmp.afp=afp;
+  fmp.stride=afp->input->size;
+  for(d=0;d<ndim;++d)
+    {
+      fmp.dim=d;
+      fmp.len=dsize[d];
+      fmp.stride/=dsize[d];
+      fmp.in=sum[d%2]->array;
+      fmp.out=sum[(d+1)%2]->array;
+      if(cnt[0])
+        {
+          fmp.cin=cnt[d%2]->array;
+          fmp.cout=cnt[(d+1)%2]->array;
+        }
+      gal_threads_spin_off(filter_mean_onthread, &fmp,
+                           afp->input->size/fmp.stride, p->cp.numthreads,
+                           p->cp.minmapsize, p->cp.quietmmap);
+    }
+
+  /* When there were blank values, divide the sums by the number of used
+     elements (windows that only had blank elements will be NaN). */
+  if(cnt[0])
+    {
+      c=cnt[ndim%2]->array;
+      sf=(s=afp->out->array)+afp->out->size;
+      do { *s = *c ? *s / *c : NAN; ++c; } while(++s<sf);
+    }
+
+  /* Clean up. */
+  gal_data_free(tmp);
+  gal_data_free(cnt[0]);
+  gal_data_free(cnt[1]);
+}
@@ -0,0 +1,66 @@
+/*********************************************************************
+Arithmetic - Do arithmetic operations on images.
+Arithmetic is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2020, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef FILTER_H
+#define FILTER_H
+
+#define ARITHMETIC_FILTER_DIM 10
+
+/* Maximum number of bins for the histogram-based median filter (integer
+   datasets whose range of values is larger than this will use the ranks
+   of the elements). */
+#define FILTER_MEDIAN_HIST_MAXBINS 65536
+
+/* Length of each segment of a line (along the fastest dimension) that is
+   given to a thread in the median filter. */
+#define FILTER_MEDIAN_SEGMENT 2048
+
+/* Number of 64-bit words in each block of the rank-based median filter
+   (each block keeps the number of its set bits). */
+#define FILTER_MEDIAN_RANK_WORDS 16
+
+/* Rank of blank elements in the rank-based median filter. */
+#define FILTER_MEDIAN_RANK_BLANK UINT32_MAX
+
+
+struct arithmetic_filter_p
+{
+  int           operator;       /* The type of filtering.                */
+  size_t          *fsize;       /* Filter size.                          */
+  size_t        *hpfsize;       /* Positive Half-filter size.            */
+  size_t        *hnfsize;       /* Negative Half-filter size.            */
+  float     sclip_multip;       /* Sigma multiple in sigma-clipping.     */
+  float      sclip_param;       /* Termination critera in sigma-cliping. */
+  gal_data_t      *input;       /* Input dataset.                        */
+  gal_data_t        *out;       /* Output dataset.                       */
+
+  int           hasblank;       /* If the dataset has blank values.      */
+};
+
+
+void
+filter_median(struct arithmeticparams *p, struct arithmetic_filter_p *afp);
+
+void
+filter_mean(struct arithmeticparams *p, struct arithmetic_filter_p *afp);
+
+#endif
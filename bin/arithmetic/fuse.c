@@ -0,0 +1,591 @@
+/*********************************************************************
+Arithmetic - Do arithmetic operations on images.
+Arithmetic is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2020, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <config.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <gnuastro/blank.h>
+#include <gnuastro/threads.h>
+#include <gnuastro/pointer.h>
+#include <gnuastro/dimension.h>
+#include <gnuastro/arithmetic.h>
+
+#include "main.h"
+
+#include "fuse.h"
+#include "operands.h"
+
+
+
+
+
+/* A run of element-wise operators (where each output element only depends
+   on the elements with the same index in the operands) doesn't need to be
+   done one operator at a time over the full datasets, with a full-sized
+   temporary dataset for each intermediate step. Instead, when an
+   element-wise operator is called, its operands are kept in a tree of
+   operators (see 'struct fuse_node') and that tree is put on the operands
+   stack. It is only evaluated when its result is needed (by any other
+   operator or to be written). The evaluation is done in small chunks of
+   elements: all the operators in the tree are applied on one chunk (with
+   the same library functions as the normal operators, so the result is
+   identical), before going onto the next chunk. So the intermediate
+   results stay in the CPU cache and the chunks can be spread over the
+   threads. Since the leaves of a tree are kept in memory until it is
+   evaluated, a tree is also evaluated when its leaves become too large
+   (see 'FUSE_MAX_LEAVES'), so long chains of operands don't all stay in
+   memory. */
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**********************************************************************/
+/****************            Building the tree         ****************/
+/**********************************************************************/
+/* Operators that can be fused: their output element only depends on the
+   elements of the operands with the same index. */
+static int
+fuse_is_elementwise(int operator)
+{
+  switch(operator)
+    {
+    case GAL_ARITHMETIC_OP_PLUS:
+    case GAL_ARITHMETIC_OP_MINUS:
+    case GAL_ARITHMETIC_OP_MULTIPLY:
+    case GAL_ARITHMETIC_OP_DIVIDE:
+    case GAL_ARITHMETIC_OP_LT:
+    case GAL_ARITHMETIC_OP_LE:
+    case GAL_ARITHMETIC_OP_GT:
+    case GAL_ARITHMETIC_OP_GE:
+    case GAL_ARITHMETIC_OP_EQ:
+    case GAL_ARITHMETIC_OP_NE:
+    case GAL_ARITHMETIC_OP_AND:
+    case GAL_ARITHMETIC_OP_OR:
+    case GAL_ARITHMETIC_OP_NOT:
+    case GAL_ARITHMETIC_OP_ISBLANK:
+    case GAL_ARITHMETIC_OP_WHERE:
+    case GAL_ARITHMETIC_OP_SQRT:
+    case GAL_ARITHMETIC_OP_LOG:
+    case GAL_ARITHMETIC_OP_LOG10:
+    case GAL_ARITHMETIC_OP_ABS:
+    case GAL_ARITHMETIC_OP_POW:
+    case GAL_ARITHMETIC_OP_BITAND:
+    case GAL_ARITHMETIC_OP_BITOR:
+    case GAL_ARITHMETIC_OP_BITXOR:
+    case GAL_ARITHMETIC_OP_BITLSH:
+    case GAL_ARITHMETIC_OP_BITRSH:
+    case GAL_ARITHMETIC_OP_MODULO:
+    case GAL_ARITHMETIC_OP_BITNOT:
+    case GAL_ARITHMETIC_OP_TO_UINT8:
+    case GAL_ARITHMETIC_OP_TO_INT8:
+    case GAL_ARITHMETIC_OP_TO_UINT16:
+    case GAL_ARITHMETIC_OP_TO_INT16:
+    case GAL_ARITHMETIC_OP_TO_UINT32:
+    case GAL_ARITHMETIC_OP_TO_INT32:
+    case GAL_ARITHMETIC_OP_TO_UINT64:
+    case GAL_ARITHMETIC_OP_TO_INT64:
+    case GAL_ARITHMETIC_OP_TO_FLOAT32:
+    case GAL_ARITHMETIC_OP_TO_FLOAT64:
+      return 1;
+
+    /* The RA/Dec string conversions aren't thread-safe (and strings can't
+       be kept in chunks), the rest aren't element-wise. */
+    default:
+      return 0;
+    }
+  return 0;
+}
+
+
+
+
+
+static struct fuse_node *
+fuse_node_alloc(void)
+{
+  struct fuse_node *node;
+
+  errno=0;
+  node=calloc(1, sizeof *node);
+  if(node==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'node'",
+          __func__, sizeof *node);
+  node->operator=GAL_ARITHMETIC_OP_INVALID;
+  return node;
+}
+
+
+
+
+
+/* Put a dataset in a leaf node. */
+struct fuse_node *
+fuse_leaf(gal_data_t *data)
+{
+  struct fuse_node *node=fuse_node_alloc();
+  node->data=data;
+  node->ref=data->size>1 ? data : NULL;
+  node->bytes=node->maxbytes = ( node->ref
+                                 ? data->size*gal_type_sizeof(data->type)
+                                 : 0 );
+  return node;
+}
+
+
+
+
+
+/* Free the tree, the datasets of the leaves will also be freed, except
+   for 'keep'. */
+static void
+fuse_free(struct fuse_node *node, gal_data_t *keep)
+{
+  size_t i;
+
+  if(node->data)
+    { if(node->data!=keep) gal_data_free(node->data); }
+  else
+    for(i=0;i<node->num_operands;++i)
+      fuse_free(node->in[i], keep);
+  free(node);
+}
+
+
+
+
+
+/* Return 1 if any leaf in the tree has a string type. */
+static int
+fuse_has_string(struct fuse_node *node)
+{
+  size_t i;
+
+  if(node->data)
+    return node->data->type==GAL_TYPE_STRING;
+  for(i=0;i<node->num_operands;++i)
+    if( fuse_has_string(node->in[i]) ) return 1;
+  return 0;
+}
+
+
+
+
+
+/* See if the operator can be fused with its operands: at least one of
+   them must not be a single number (otherwise the operation is trivial)
+   and all the non-number operands must have the same size. */
+static gal_data_t *
+fuse_can_merge(int operator, struct fuse_node **in, size_t num_operands)
+{
+  size_t i;
+  gal_data_t *ref=NULL;
+
+  /* Find the first non-number operand. */
+  for(i=0;i<num_operands;++i)
+    if(in[i]->ref) { ref=in[i]->ref; break; }
+  if(ref==NULL) return NULL;
+
+  /* Check the other operands. */
+  for(i=0;i<num_operands;++i)
+    if( fuse_has_string(in[i])
+        || ( in[i]->ref && gal_dimension_is_different(ref, in[i]->ref) ) )
+      return NULL;
+
+  /* The 'where' operator writes into its first operand, so it shouldn't
+     be a number. */
+  if(operator==GAL_ARITHMETIC_OP_WHERE && in[0]->ref==NULL)
+    return NULL;
+
+  /* The operator can be fused. */
+  return ref;
+}
+
+
+
+
+
+/* Dataset of a node that has been popped from the operands. */
+static gal_data_t *
+fuse_to_data(struct arithmeticparams *p, struct fuse_node *node)
+{
+  gal_data_t *data;
+
+  if(node->data)
+    {
+      data=node->data;
+      free(node);
+      return data;
+    }
+  return fuse_evaluate(p, node);
+}
+
+
+
+
+
+/* If the operator is element-wise, add it to the tree of its operands and
+   return 1. Otherwise (if it should be done in the normal way), return 0
+   without touching the operands. */
+int
+fuse_operator(struct arithmeticparams *p, int operator, char *operator_string,
+              size_t num_operands, int flags)
+{
+  size_t i;
+  struct fuse_node *node, *in[FUSE_MAX_OPERANDS]={NULL, NULL, NULL};
+  gal_data_t *ref, *d[FUSE_MAX_OPERANDS]={NULL, NULL, NULL};
+
+  /* Only element-wise operators are fused. */
+  if( !fuse_is_elementwise(operator) || num_operands>FUSE_MAX_OPERANDS )
+    return 0;
+
+  /* Pop the operands (the first popped operand is the last one). */
+  for(i=num_operands; i>0; --i)
+    in[i-1]=operands_pop_fused(p, operator_string);
+
+  /* If the operator can be fused, make a new node and put it on the
+     stack. */
+  if( (ref=fuse_can_merge(operator, in, num_operands)) )
+    {
+      node=fuse_node_alloc();
+      node->ref=ref;
+      node->operator=operator;
+      node->num_operands=num_operands;
+      for(i=0;i<num_operands;++i)
+        {
+          node->in[i]=in[i];
+          node->bytes+=in[i]->bytes;
+          if(in[i]->maxbytes>node->maxbytes) node->maxbytes=in[i]->maxbytes;
+        }
+
+      /* All the leaves are in memory until the tree is evaluated. So if
+         they have become too large, evaluate the tree now (its result
+         will be a leaf for the next operators). */
+      if(node->bytes > FUSE_MAX_LEAVES*node->maxbytes)
+        operands_add(p, NULL, fuse_evaluate(p, node));
+      else
+        operands_add_fused(p, node);
+    }
+
+  /* Otherwise, do the operation directly. */
+  else
+    {
+      for(i=0;i<num_operands;++i) d[i]=fuse_to_data(p, in[i]);
+      operands_add(p, NULL, gal_arithmetic(operator, p->cp.numthreads,
+                                           flags, d[0], d[1], d[2]));
+    }
+
+  /* The operator has been used. */
+  return 1;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**********************************************************************/
+/****************           Evaluating the tree        ****************/
+/**********************************************************************/
+struct fuse_params
+{
+  struct fuse_node     *root;   /* Root of the tree.                     */
+  size_t           numleaves;   /* Number of leaves in the tree.         */
+  size_t           numchunks;   /* Number of chunks.                     */
+  gal_data_t            *out;   /* Output dataset.                       */
+};
+
+
+
+
+
+/* Give each leaf an index (for its views on each thread) and return the
+   number of leaves. */
+static size_t
+fuse_index_leaves(struct fuse_node *node, size_t counter)
+{
+  size_t i;
+
+  if(node->data)
+    node->leaf=counter++;
+  else
+    for(i=0;i<node->num_operands;++i)
+      counter=fuse_index_leaves(node->in[i], counter);
+  return counter;
+}
+
+
+
+
+
+/* Set 'view' to be a one-dimensional view into 'size' elements of 'in',
+   starting from 'start'. Single-element operands are used for all the
+   elements, so only their structure is copied. The view doesn't own its
+   array, so it shouldn't be freed. The temporary datasets made from it
+   are small, so they shouldn't be memory-mapped. */
+static void
+fuse_view(gal_data_t *in, gal_data_t *view, size_t start, size_t size)
+{
+  *view=*in;
+  view->ndim=1;
+  view->wcs=NULL;
+  view->next=NULL;
+  view->name=NULL;
+  view->unit=NULL;
+  view->block=NULL;
+  view->comment=NULL;
+  view->mmapname=NULL;
+  view->minmapsize=-1;
+  if(in->size>1)
+    {
+      view->size=size;
+      view->array=gal_pointer_increment(in->array, start, in->type);
+
+      /* When the full dataset has blank values, a chunk may not have any,
+         so let it be checked independently. */
+      if(in->flag & GAL_DATA_FLAG_HASBLANK)
+        view->flag &= ~(GAL_DATA_FLAG_BLANK_CH | GAL_DATA_FLAG_HASBLANK);
+    }
+  view->dsize=&view->size;
+}
+
+
+
+
+
+/* Apply the tree on one chunk. '*owned' will be set to 1 if the returned
+   dataset was allocated here (and should be freed by the caller) and 0 if
+   it is a view into a leaf. */
+static gal_data_t *
+fuse_evaluate_chunk(struct fuse_node *node, gal_data_t *views, size_t start,
+                    size_t size, int *owned)
+{
+  size_t i;
+  gal_data_t *out, *in[FUSE_MAX_OPERANDS]={NULL, NULL, NULL};
+  int inowned[FUSE_MAX_OPERANDS]={0, 0, 0};
+
+  /* A leaf. */
+  if(node->data)
+    {
+      fuse_view(node->data, &views[node->leaf], start, size);
+      *owned=0;
+      return &views[node->leaf];
+    }
+
+  /* Evaluate the operands, then the operator. Note that the inputs
+     shouldn't be freed or used for the output (they may be views). */
+  for(i=0;i<node->num_operands;++i)
+    in[i]=fuse_evaluate_chunk(node->in[i], views, start, size, &inowned[i]);
+  out=gal_arithmetic(node->operator, 1, GAL_ARITHMETIC_NUMOK,
+                     in[0], in[1], in[2]);
+
+  /* Clean up the intermediate results. Some operators (like 'where')
+     return one of their inputs. */
+  *owned=1;
+  for(i=0;i<node->num_operands;++i)
+    {
+      if(out==in[i])   *owned=inowned[i];
+      else if(inowned[i]) gal_data_free(in[i]);
+    }
+  return out;
+}
+
+
+
+
+
+/* Evaluate one chunk and put its values in the output. */
+static void
+fuse_chunk(struct fuse_params *fp, gal_data_t *views, size_t chunk)
+{
+  int owned;
+  void *oarr;
+  gal_data_t *res, *out=fp->out;
+  size_t start=chunk*FUSE_CHUNK_SIZE;
+  size_t size = ( chunk==fp->numchunks-1
+                  ? out->size-start
+                  : FUSE_CHUNK_SIZE );
+
+  /* Do the operations on this chunk. */
+  res=fuse_evaluate_chunk(fp->root, views, start, size, &owned);
+  if(res->type!=out->type)
+    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix "
+          "the problem. The type of chunk %zu ('%s') is different from "
+          "the output type ('%s')", __func__, PACKAGE_BUGREPORT, chunk,
+          gal_type_name(res->type, 1), gal_type_name(out->type, 1));
+
+  /* Copy the result into the output (if it isn't already there). */
+  oarr=gal_pointer_increment(out->array, start, out->type);
+  if(res->array!=oarr)
+    memcpy(oarr, res->array, size*gal_type_sizeof(out->type));
+  if(owned) gal_data_free(res);
+}
+
+
+
+
+
+static gal_data_t *
+fuse_views_alloc(size_t numleaves)
+{
+  gal_data_t *views;
+
+  errno=0;
+  views=malloc(numleaves * sizeof *views);
+  if(views==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'views'",
+          __func__, numleaves * sizeof *views);
+  return views;
+}
+
+
+
+
+
+/* Worker function on each thread. Note that the first chunk has already
+   been done. */
+static void *
+fuse_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct fuse_params *fp=(struct fuse_params *)tprm->params;
+
+  size_t i;
+  gal_data_t *views=fuse_views_alloc(fp->numleaves);
+
+  /* Go over all the chunks that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    fuse_chunk(fp, views, tprm->indexs[i]+1);
+
+  /* Clean up, wait for all the other threads to finish, then return. */
+  free(views);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Return the first leaf that can be used for the output: it should have
+   the same size and type as the output. */
+static gal_data_t *
+fuse_output_leaf(struct fuse_node *node, size_t size, uint8_t type)
+{
+  size_t i;
+  gal_data_t *out;
+
+  if(node->data)
+    return ( (node->data->size==size && node->data->type==type)
+             ? node->data : NULL );
+  for(i=0;i<node->num_operands;++i)
+    if( (out=fuse_output_leaf(node->in[i], size, type)) )
+      return out;
+  return NULL;
+}
+
+
+
+
+
+/* Evaluate the full tree and return its output dataset. */
+gal_data_t *
+fuse_evaluate(struct arithmeticparams *p, struct fuse_node *root)
+{
+  int owned;
+  gal_data_t *res, *views, *ref=root->ref;
+  struct fuse_params fp={root, 0, 0, NULL};
+  size_t size = ref->size<FUSE_CHUNK_SIZE ? ref->size : FUSE_CHUNK_SIZE;
+
+  /* Basic settings. The last chunk also contains the remainder of the
+     elements: it can't be a single element, because then the non-number
+     operands would be treated like numbers. */
+  fp.numleaves=fuse_index_leaves(root, 0);
+  fp.numchunks=ref->size/FUSE_CHUNK_SIZE;
+  if(fp.numchunks==0) fp.numchunks=1;
+  if(fp.numchunks==1) size=ref->size;
+
+  /* The output type depends on the operators and the input types, so the
+     first chunk is done here to find it. */
+  views=fuse_views_alloc(fp.numleaves);
+  res=fuse_evaluate_chunk(root, views, 0, size, &owned);
+
+  /* Each element of the leaves is only used for the output element with
+     the same index, so the output can be written into a leaf with the
+     same size and type (as with in-place operations). */
+  fp.out=fuse_output_leaf(root, ref->size, res->type);
+  if(fp.out) fp.out->flag=0;
+  else
+    fp.out=gal_data_alloc(NULL, res->type, ref->ndim, ref->dsize, ref->wcs,
+                          0, p->cp.minmapsize, p->cp.quietmmap, NULL, NULL,
+                          NULL);
+
+  /* Put the first chunk in the output. */
+  if(res->array!=fp.out->array)
+    memcpy(fp.out->array, res->array, size*gal_type_sizeof(res->type));
+  if(owned) gal_data_free(res);
+  free(views);
+
+  /* Do the rest of the chunks on the threads. */
+  if(fp.numchunks>1)
+    gal_threads_spin_off(fuse_on_thread, &fp, fp.numchunks-1,
+                         p->cp.numthreads, p->cp.minmapsize,
+                         p->cp.quietmmap);
+
+  /* Clean up and return. */
+  fuse_free(root, fp.out);
+  return fp.out;
+}
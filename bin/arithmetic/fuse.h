@@ -0,0 +1,66 @@
+/*********************************************************************
+Arithmetic - Do arithmetic operations on images.
+Arithmetic is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2020, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef FUSE_H
+#define FUSE_H
+
+/* Maximum number of operands to an element-wise operator. */
+#define FUSE_MAX_OPERANDS 3
+
+/* Number of elements in each chunk of a fused expression. All the
+   intermediate results of a chunk are kept in this size, so they should
+   fit in the CPU cache. */
+#define FUSE_CHUNK_SIZE 4096
+
+/* Maximum total size of the leaf datasets of a fused expression (in units
+   of its largest leaf). The leaves are kept in memory until the tree is
+   evaluated, so when this is passed, the tree is evaluated (and its leaves
+   are freed) before going onto the next operator. */
+#define FUSE_MAX_LEAVES 4
+
+
+/* Each node of a fused expression is either a leaf (when 'data!=NULL')
+   or an element-wise operator over the nodes in 'in'. */
+struct fuse_node
+{
+  int                    operator;  /* Operator code (if not a leaf).    */
+  size_t             num_operands;  /* Number of operands of 'operator'. */
+  struct fuse_node *in[FUSE_MAX_OPERANDS]; /* Operands of 'operator'.    */
+  gal_data_t                *data;  /* Dataset (only for leaves).        */
+  gal_data_t                 *ref;  /* A non-number leaf dataset.        */
+  size_t                     leaf;  /* Index of leaf (for its views).    */
+  size_t                    bytes;  /* Total size of non-number leaves.  */
+  size_t                 maxbytes;  /* Size of the largest leaf.         */
+};
+
+
+struct fuse_node *
+fuse_leaf(gal_data_t *data);
+
+int
+fuse_operator(struct arithmeticparams *p, int operator, char *operator_string,
+              size_t num_operands, int flags);
+
+gal_data_t *
+fuse_evaluate(struct arithmeticparams *p, struct fuse_node *root);
+
+#endif
@@ -51,15 +51,17 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
-/* In every node of the operand linked list, only one of the 'filename' or
-   'data' should be non-NULL. Otherwise it will be a bug and will cause
-   problems. All the operands operate on this premise. */
+/* In every node of the operand linked list, only one of the 'filename',
+   'data' or 'fused' should be non-NULL. Otherwise it will be a bug and
+   will cause problems. All the operands operate on this premise. */
+struct fuse_node;
 struct operand
 {
-  char       *filename;    /* !=NULL if the operand is a filename. */
-  char            *hdu;    /* !=NULL if the operand is a filename. */
-  gal_data_t     *data;    /* !=NULL if the operand is a dataset.  */
-  struct operand *next;    /* Pointer to next operand.             */
+  char         *filename;  /* !=NULL if the operand is a filename.  */
+  char              *hdu;  /* !=NULL if the operand is a filename.  */
+  gal_data_t       *data;  /* !=NULL if the operand is a dataset.   */
+  struct fuse_node *fused; /* !=NULL if not yet evaluated (fuse.c). */
+  struct operand   *next;  /* Pointer to next operand.              */
 };
 
 
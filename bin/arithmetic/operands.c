@@ -37,6 +37,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include "main.h"
 
+#include "fuse.h"
 #include "operands.h"
 
 
@@ -325,6 +326,7 @@ operands_add(struct arithmeticparams *p, char *filename, gal_data_t *data)
         }
 
       /* Make the link to the previous list. */
+      newnode->fused=NULL;
       newnode->next=p->operands;
       p->operands=newnode;
     }
@@ -334,6 +336,33 @@ operands_add(struct arithmeticparams *p, char *filename, gal_data_t *data)
 
 
 
+/* Put a fused expression (that hasn't been evaluated yet) on the
+   stack. */
+void
+operands_add_fused(struct arithmeticparams *p, struct fuse_node *node)
+{
+  struct operand *newnode;
+
+  /* Allocate space for the new operand. */
+  errno=0;
+  newnode=malloc(sizeof *newnode);
+  if(newnode==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'newnode'",
+          __func__, sizeof *newnode);
+
+  /* Set the values and make the link to the previous list. */
+  newnode->hdu=NULL;
+  newnode->data=NULL;
+  newnode->fused=node;
+  newnode->filename=NULL;
+  newnode->next=p->operands;
+  p->operands=newnode;
+}
+
+
+
+
+
 gal_data_t *
 operands_pop(struct arithmeticparams *p, char *operator)
 {
@@ -348,17 +377,21 @@ operands_pop(struct arithmeticparams *p, char *operator)
     error(EXIT_FAILURE, 0, "not enough operands for the '%s' operator",
           operator);
 
-  /* Set the dataset. If filename is present then read the file
-     and fill in the array, if not then just set the array. */
-  if(operands->filename)
+  /* Set the dataset. If it is a fused expression, evaluate it. If
+     filename is present then read the file and fill in the array, if not
+     then just set the array. */
+  if(operands->fused)
+    data=fuse_evaluate(p, operands->fused);
+  else if(operands->filename)
     {
       /* Set the HDU and filename */
       hdu=operands->hdu;
       filename=operands->filename;
 
       /* Read the dataset and remove possibly extra dimensions. */
-      data=gal_array_read_one_ch(filename, hdu, NULL, p->cp.minmapsize,
-                                 p->cp.quietmmap);
+      data=gal_array_read_one_ch_threaded(filename, hdu, NULL,
+                                          p->cp.numthreads, p->cp.minmapsize,
+                                          p->cp.quietmmap);
       data->ndim=gal_dimension_remove_extra(data->ndim, data->dsize, NULL);
 
       /* Arithmetic changes the contents of a dataset, so the existing name
@@ -408,3 +441,29 @@ operands_pop(struct arithmeticparams *p, char *operator)
   free(operands);
   return data;
 }
+
+
+
+
+
+/* Pop the top operand for an element-wise operator: if it is a fused
+   expression, it is returned without being evaluated. Otherwise, the
+   dataset is put in a leaf node. */
+struct fuse_node *
+operands_pop_fused(struct arithmeticparams *p, char *operator)
+{
+  struct fuse_node *node;
+  struct operand *operands=p->operands;
+
+  /* A fused expression: remove the node from the queue and return it. */
+  if(operands && operands->fused)
+    {
+      node=operands->fused;
+      p->operands=operands->next;
+      free(operands);
+      return node;
+    }
+
+  /* Any other operand. */
+  return fuse_leaf(operands_pop(p, operator));
+}
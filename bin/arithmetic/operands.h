@@ -32,6 +32,12 @@ operands_add(struct arithmeticparams *p, char *filename, gal_data_t *data);
 gal_data_t *
 operands_pop(struct arithmeticparams *p, char *operator);
 
+void
+operands_add_fused(struct arithmeticparams *p, struct fuse_node *node);
+
+struct fuse_node *
+operands_pop_fused(struct arithmeticparams *p, char *operator);
+
 void
 operands_set_name(struct arithmeticparams *p, char *token);
 
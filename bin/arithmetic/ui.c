@@ -143,6 +143,7 @@ ui_initialize_options(struct arithmeticparams *p,
 
         case GAL_OPTIONS_KEY_TYPE:
         case GAL_OPTIONS_KEY_SEARCHIN:
+        case GAL_OPTIONS_KEY_TABLECACHE:
         case GAL_OPTIONS_KEY_IGNORECASE:
         case GAL_OPTIONS_KEY_STDINTIMEOUT:
           cp->coptions[i].flags=OPTION_HIDDEN;
@@ -505,6 +506,9 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct arithmeticparams *p)
 void
 freeandreport(struct arithmeticparams *p, struct timeval *t1)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the simple strings. */
   free(p->cp.output);
   if(p->globalhdu) free(p->globalhdu);
@@ -39,6 +39,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/table.h>
 #include <gnuastro/blank.h>
 #include <gnuastro/arithmetic.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/timing.h>
 #include <gnuastro-internal/options.h>
@@ -145,6 +146,7 @@ ui_initialize_options(struct converttparams *p,
 
         case GAL_OPTIONS_KEY_TYPE:
         case GAL_OPTIONS_KEY_SEARCHIN:
+        case GAL_OPTIONS_KEY_TABLECACHE:
         case GAL_OPTIONS_KEY_IGNORECASE:
         case GAL_OPTIONS_KEY_TABLEFORMAT:
           cp->coptions[i].flags=OPTION_HIDDEN;
@@ -494,7 +496,8 @@ ui_make_channels_ll(struct converttparams *p)
   lines=gal_txt_stdin_read(p->cp.stdintimeout);
   if(lines)
     {
-      data=gal_txt_image_read(NULL, lines, p->cp.minmapsize, p->cp.quietmmap);
+      data=gal_txt_image_read_threaded(NULL, lines, p->cp.numthreads,
+                                       p->cp.minmapsize, p->cp.quietmmap);
       gal_list_data_add(&p->chll, data);
       gal_list_str_free(lines, 1);
       ++p->numch;
@@ -526,8 +529,8 @@ ui_make_channels_ll(struct converttparams *p)
                   "for each input FITS image (in the same order)");
 
           /* Read in the array and its WCS information. */
-          data=gal_fits_img_read(name->v, hdu, p->cp.minmapsize,
-                                 p->cp.quietmmap);
+          data=gal_fits_img_read_threaded(name->v, hdu, p->cp.numthreads,
+                                          p->cp.minmapsize, p->cp.quietmmap);
           data->wcs=gal_wcs_read(name->v, hdu, 0, 0, &data->nwcs);
           data->ndim=gal_dimension_remove_extra(data->ndim, data->dsize,
                                                 data->wcs);
@@ -597,8 +600,9 @@ ui_make_channels_ll(struct converttparams *p)
       /* Text: */
       else
         {
-          data=gal_txt_image_read(name->v, NULL, p->cp.minmapsize,
-                                  p->cp.quietmmap);
+          data=gal_txt_image_read_threaded(name->v, NULL, p->cp.numthreads,
+                                           p->cp.minmapsize,
+                                           p->cp.quietmmap);
           gal_list_data_add(&p->chll, data);
           ++p->numch;
         }
@@ -996,6 +1000,9 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct converttparams *p)
 void
 ui_free_report(struct converttparams *p)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   if(p->colormap)
     {
       if(p->colormap->next) gal_data_free(p->colormap->next);
@@ -27,7 +27,14 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <errno.h>
 #include <error.h>
 #include <stdlib.h>
+#include <string.h>
 #include <gsl/gsl_errno.h>
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_complex.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+#include <gsl/gsl_fft_real_float.h>
+#include <gsl/gsl_fft_complex_float.h>
+#include <gsl/gsl_fft_halfcomplex_float.h>
 
 #include <gnuastro/wcs.h>
 #include <gnuastro/tile.h>
@@ -39,6 +46,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro-internal/timing.h>
 
 #include "main.h"
+#include "ui.h"
 #include "convolve.h"
 
 
@@ -46,47 +54,72 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /******************************************************************/
 /*************           Complex numbers          *****************/
 /******************************************************************/
+/* The input image and kernel are real, so the Fourier transform of each
+   is conjugate-symmetric: F[k0][k1]=conj(F[-k0][-k1]). Therefore only the
+   non-negative frequencies along the second (fastest) axis are kept in
+   the frequency domain: each row has 'ps1/2+1' complex numbers, or
+   'ps1+2' real elements. In the spatial domain, the values of each row
+   are stored in the first 'ps1' elements of the same rows. All the
+   padded arrays are in the type of 'p->ffttype' (32-bit or 64-bit
+   floating point). */
+
+
+
+
 
 /* We have a complex (R+iI) array and we want to display it. But we
    can only do that either with the spectrum, or the phase:
 
    Spectrum: sqrt(R^2+I^2)
    Phase:    arctan(I/R)
-*/
+
+   The full 'ps0*ps1' array is returned, the frequencies that are not
+   stored are filled from the conjugate symmetry (see above). */
 void
-complextoreal(double *c, size_t size, int action, double **output)
+complextoreal(struct convolveparams *p, void *carr, int action,
+              double **output)
 {
-  double *out, *o, *of;
+  double r, im, *out;
+  size_t i, j, ci, cj, ps0=p->ps0, ps1=p->ps1, nc=ps1/2+1;
 
   /* Allocate the space for the real array. */
-  *output=out=gal_pointer_allocate(GAL_TYPE_FLOAT64, size, 0, __func__,
+  *output=out=gal_pointer_allocate(GAL_TYPE_FLOAT64, ps0*ps1, 0, __func__,
                                    "output");
 
   /* Fill the real array with the derived value from the complex array. */
-  of=(o=out)+size;
-  switch(action)
-    {
-    case COMPLEX_TO_REAL_SPEC:
-      do { *o++ = sqrt( *c**c + *(c+1)**(c+1) ); c+=2; } while(o<of);
-      break;
-    case COMPLEX_TO_REAL_PHASE:
-      do { *o++ = atan2( *(c+1), *c );           c+=2; } while(o<of);
-      break;
-    case COMPLEX_TO_REAL_REAL:
-      do { *o++ = *c;                            c+=2; } while(o<of);
-      break;
-    default:
-      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can "
-            "correct it. The 'action' code %d is not recognized", __func__,
-            PACKAGE_BUGREPORT, action);
-    }
+  for(i=0;i<ps0;++i)
+    for(j=0;j<ps1;++j)
+      {
+        /* Position of this frequency (or its conjugate) in 'carr'. */
+        if(j<nc) { ci=i;             cj=j;     }
+        else     { ci=(ps0-i)%ps0;   cj=ps1-j; }
+        if(p->ffttype==GAL_TYPE_FLOAT32)
+          { r  = ((float *)carr)[ 2*(ci*nc+cj)   ];
+            im = ((float *)carr)[ 2*(ci*nc+cj)+1 ]; }
+        else
+          { r  = ((double *)carr)[ 2*(ci*nc+cj)   ];
+            im = ((double *)carr)[ 2*(ci*nc+cj)+1 ]; }
+        if(j>=nc) im=-im;
+
+        switch(action)
+          {
+          case COMPLEX_TO_REAL_SPEC:  out[i*ps1+j]=sqrt(r*r+im*im); break;
+          case COMPLEX_TO_REAL_PHASE: out[i*ps1+j]=atan2(im, r);     break;
+          case COMPLEX_TO_REAL_REAL:  out[i*ps1+j]=r;                break;
+          default:
+            error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so "
+                  "we can correct it. The 'action' code %d is not "
+                  "recognized", __func__, PACKAGE_BUGREPORT, action);
+          }
+      }
 }
 
 
 
 
 
-/* Multily two complex arrays and save the result in the first:
+/* Multily the complex array 'arr' by the transformed kernel ('p->pker')
+   and save the result in 'arr':
 
    (a+ib)*(c+id)=ac+iad+ibc-bd=(ac-bd)+i(ad-bc)
 
@@ -99,28 +132,32 @@ complextoreal(double *c, size_t size, int action, double **output)
    output. Then we find and replace the imaginary component, finally,
    we put the new real component in the image.
  */
+#define COMPLEX_ARRAY_MULTIPLY(IT) {                                    \
+    IT r, *a=arr, *b=p->pker, *af=a+2*size;                             \
+    do                                                                  \
+      {                                                                 \
+        r      = (*a * *b) - (*(a+1) * *(b+1));                         \
+        *(a+1) = (*(a+1) * *b) + (*a * *(b+1));                         \
+        *a=r;                                                           \
+        a+=2;                                                           \
+        b+=2;                                                           \
+      }                                                                 \
+    while(a<af);  /* Go onto the next complex number. */                \
+  }
+
 void
-complexarraymultiply(double *a, double *b, size_t size)
+complexarraymultiply(struct convolveparams *p, void *arr, size_t size)
 {
-  double r, *af;
-
-  af=a+2*size;
-  do
-    {
-      r      = (*a * *b) - (*(a+1) * *(b+1));
-      *(a+1) = (*(a+1) * *b) + (*a * *(b+1));
-      *a++=r;            /* Go onto (set) the imaginary part of a. */
-      b+=2;
-    }
-  while(++a<af);  /* Go onto the next complex number. */
+  if(p->ffttype==GAL_TYPE_FLOAT32) COMPLEX_ARRAY_MULTIPLY(float)
+  else                             COMPLEX_ARRAY_MULTIPLY(double)
 }
 
 
 
 
 
-/* Divide the elements of the first array by the elements of the second
-   array and put the result into the elements of the first array.
+/* Divide the elements of the complex array 'arr' by the elements of
+   'p->pker' and put the result into the elements of 'arr'.
 
    (a+ib)/(c+id)=[(a+ib)*(c-id)]/[(c+id)*(c-id)]
                 =(ac-iad+ibc+bd)/(c^2+d^2)
@@ -129,37 +166,40 @@ complexarraymultiply(double *a, double *b, size_t size)
    See the explanations above complexarraymultiply for an explanation
    on the loop.
  */
+#define COMPLEX_ARRAY_DIVIDE(IT) {                                      \
+    IT r, *a=arr, *b=p->pker, *af=a+2*size;                             \
+    do                                                                  \
+      {                                                                 \
+        if (sqrt(*b**b + *(b+1)**(b+1))>p->minsharpspec)                \
+          {                                                             \
+            r      = ( ( (*a * *b) + (*(a+1) * *(b+1)) )                \
+                       / ( *b * *b + *(b+1) * *(b+1) ) );               \
+            *(a+1) = ( ( (*(a+1) * *b) - (*a * *(b+1)) )                \
+                       / ( *b * *b + *(b+1) * *(b+1) ) );               \
+            *a=r;                                                       \
+                                                                        \
+            /* Just as a sanity check (the result should never be */    \
+            /* larger than one. */                                      \
+            if(sqrt(*a**a + *(a+1)**(a+1))>1.00001f)                    \
+              *a=*(a+1)=0.0f;                                           \
+          }                                                             \
+        else                                                            \
+          {                                                             \
+            *a=0;                                                       \
+            *(a+1)=0;                                                   \
+          }                                                             \
+                                                                        \
+        a+=2;                                                           \
+        b+=2;                                                           \
+      }                                                                 \
+    while(a<af);  /* Go onto the next complex number. */                \
+  }
+
 void
-complexarraydivide(double *a, double *b, size_t size, double minsharpspec)
+complexarraydivide(struct convolveparams *p, void *arr, size_t size)
 {
-  double r, *af;
-
-  af=a+2*size;
-  do
-    {
-      if (sqrt(*b**b + *(b+1)**(b+1))>minsharpspec)
-        {
-          r      = ( ( (*a * *b) + (*(a+1) * *(b+1)) )
-                     / ( *b * *b + *(b+1) * *(b+1) ) );
-          *(a+1) = ( ( (*(a+1) * *b) - (*a * *(b+1)) )
-                     / ( *b * *b + *(b+1) * *(b+1) ) );
-          *a=r;
-
-          /* Just as a sanity check (the result should never be larger than
-             one. */
-          if(sqrt(*a**a + *(a+1)**(a+1))>1.00001f)
-            *a=*(a+1)=0.0f;
-        }
-      else
-        {
-          *a=0;
-          *(a+1)=0;
-        }
-
-      a+=2;
-      b+=2;
-    }
-  while(a<af);  /* Go onto the next complex number. */
+  if(p->ffttype==GAL_TYPE_FLOAT32) COMPLEX_ARRAY_DIVIDE(float)
+  else                             COMPLEX_ARRAY_DIVIDE(double)
 }
 
 
@@ -184,57 +224,138 @@ complexarraydivide(double *a, double *b, size_t size, double minsharpspec)
 /******************************************************************/
 /*************      Padding and initializing      *****************/
 /******************************************************************/
-void
-frequency_make_padded_complex(struct convolveparams *p)
+/* Return the smallest even number that is not smaller than 'n' and has
+   no prime factors other than 2, 3 and 5. GSL's mixed-radix FFT has
+   optimized modules for these radices, but any other prime factor is
+   transformed with a general (and much slower) module. */
+static size_t
+frequency_fast_size(size_t n)
 {
-  size_t i, ps0, ps1;
-  double *o, *op, *pimg, *pker;
-  size_t is0=p->input->dsize[0],  is1=p->input->dsize[1];
-  size_t ks0=p->kernel->dsize[0], ks1=p->kernel->dsize[1];
-  float *f, *ff, *input=p->input->array, *kernel=p->kernel->array;
+  size_t m, out;
 
+  for(out=n+n%2; ; out+=2)
+    {
+      m=out;
+      while(m%2==0) m/=2;
+      while(m%3==0) m/=3;
+      while(m%5==0) m/=5;
+      if(m==1) return out;
+    }
+}
 
-  /* Find the sizes of the padded image, note that since the kernel
-     sizes are always odd, the extra padding on the input image is
-     always going to be an even number (clearly divisable). */
-  ps0=p->ps0 = p->makekernel ? is0 : is0 + ks0 - 1;
-  ps1=p->ps1 = p->makekernel ? is1 : is1 + ks1 - 1;
 
 
-  /* The Discrete Fourier transforms operate faster on even-sized
-     arrays. So if the padded sides are not even, make them so: */
-  if(ps0%2) ps0=p->ps0=ps0+1;
-  if(ps1%2) ps1=p->ps1=ps1+1;
 
 
-  /* Allocate the space for the padded input image and fill it. */
-  pimg=p->pimg=gal_pointer_allocate(GAL_TYPE_FLOAT64, 2*ps0*ps1, 0,
-                                    __func__, "pimg");
-  for(i=0;i<ps0;++i)
+/* Copy the 's0*s1' elements of the 'float32' array 'in' into the first
+   elements of the rows of the padded array (that are 'ps1+2' elements
+   wide, see the comments at the start of the file). The rest of the
+   padded array is already zero. */
+static void
+frequency_pad_fill(struct convolveparams *p, void *padded, float *in,
+                   size_t s0, size_t s1)
+{
+  double *d;
+  float *f, *ff;
+  size_t i, pw=p->ps1+2;
+
+  for(i=0;i<s0;++i)
     {
-      op=(o=pimg+i*2*ps1)+2*ps1; /* pimg is complex.            */
-      if(i<is0)
-        {
-          ff=(f=input+i*is1)+is1;
-          do {*o++=*f; *o++=0.0f;} while(++f<ff);
-        }
-      do *o++=0.0f; while(o<op);
+      ff=(f=in+i*s1)+s1;
+      if(p->ffttype==GAL_TYPE_FLOAT32)
+        memcpy((float *)padded+i*pw, f, s1*sizeof *f);
+      else
+        { d=(double *)padded+i*pw; do *d++=*f; while(++f<ff); }
     }
+}
 
 
-  /* Allocate the space for the padded Kernel and fill it. */
-  pker=p->pker=gal_pointer_allocate(GAL_TYPE_FLOAT64, 2*ps0*ps1, 0,
-                                    __func__, "pker");
-  for(i=0;i<ps0;++i)
+
+
+
+/* Copy the spatial domain values of a padded array into a contiguous
+   'ps0*ps1' array of 64-bit floating points. When 'absolute' is
+   non-zero, the absolute value of each element will be stored. */
+static double *
+frequency_padded_to_real(struct convolveparams *p, void *padded,
+                         int absolute)
+{
+  size_t i, j, pw=p->ps1+2;
+  double *o, *out, *d;
+  float *f;
+
+  o=out=gal_pointer_allocate(GAL_TYPE_FLOAT64, p->ps0*p->ps1, 0,
+                             __func__, "out");
+  for(i=0;i<p->ps0;++i)
+    if(p->ffttype==GAL_TYPE_FLOAT32)
+      {
+        f=(float *)padded+i*pw;
+        for(j=0;j<p->ps1;++j) *o++ = absolute ? fabs(f[j]) : f[j];
+      }
+    else
+      {
+        d=(double *)padded+i*pw;
+        for(j=0;j<p->ps1;++j) *o++ = absolute ? fabs(d[j]) : d[j];
+      }
+  return out;
+}
+
+
+
+
+
+/* Allocate the space for the padded kernel and fill it. */
+static void
+frequency_make_padded_kernel(struct convolveparams *p)
+{
+  size_t ks0=p->kernel->dsize[0], ks1=p->kernel->dsize[1];
+
+  p->pker=gal_pointer_allocate(p->ffttype, p->ps0*(p->ps1+2), 1, __func__,
+                               "p->pker");
+  frequency_pad_fill(p, p->pker, p->kernel->array, ks0, ks1);
+}
+
+
+
+
+
+void
+frequency_make_padded(struct convolveparams *p)
+{
+  size_t ps0, ps1;
+  size_t is0=p->input->dsize[0],  is1=p->input->dsize[1];
+  size_t ks0=p->kernel->dsize[0], ks1=p->kernel->dsize[1];
+
+
+  /* Find the sizes of the padded image. In convolution, the padding only
+     has to be large enough for the kernel's footprint not to wrap
+     around, so we go up to the next size that the FFT can operate on
+     fast (see 'frequency_fast_size'). In deconvolution ('--makekernel')
+     the full input is used and the final image is centered based on the
+     padded size, so it is only made even (the Discrete Fourier transforms
+     operate faster on even-sized arrays). */
+  if(p->makekernel)
     {
-      op=(o=pker+i*2*ps1)+2*ps1; /* pker is complex.            */
-      if(i<ks0)
-        {
-          ff=(f=kernel+i*ks1)+ks1;
-          do {*o++=*f; *o++=0.0f;} while(++f<ff);
-        }
-      do *o++=0.0f; while(o<op);
+      ps0 = is0 + is0%2;
+      ps1 = is1 + is1%2;
     }
+  else
+    {
+      ps0 = frequency_fast_size(is0 + ks0 - 1);
+      ps1 = frequency_fast_size(is1 + ks1 - 1);
+    }
+  p->ps0=ps0;
+  p->ps1=ps1;
+
+
+  /* Allocate the space for the padded input image and fill it. */
+  p->pimg=gal_pointer_allocate(p->ffttype, ps0*(ps1+2), 1, __func__,
+                               "p->pimg");
+  frequency_pad_fill(p, p->pimg, p->input->array, is0, is1);
+
+
+  /* The padded kernel. */
+  frequency_make_padded_kernel(p);
 }
 
 
@@ -245,8 +366,10 @@ frequency_make_padded_complex(struct convolveparams *p)
     roundoff errors.
 
     NOTE: The padding to the input image (on the first axis for example)
-          was 'p->kernel->dsize[0]-1'. Since 'p->kernel->dsize[0]' is
-          always odd, the padding will always be even.  */
+          was at least 'p->kernel->dsize[0]-1' and the kernel sides are
+          always odd, so the first pixel of the convolved image is
+          '(p->kernel->dsize[0]-1)/2' pixels after the padded image's
+          start.  */
 void
 removepaddingcorrectroundoff(struct convolveparams *p)
 {
@@ -298,7 +421,11 @@ removepaddingcorrectroundoff(struct convolveparams *p)
    first element of the fftonthreadparams structure array. All the
    other elements will point to this one later. This structure will be
    given to threads to run two times with a fixed set of parameters,
-   that is why we are doing this here to facilitate the job. */
+   that is why we are doing this here to facilitate the job.
+
+   The rows are transformed with GSL's real (forward) and halfcomplex
+   (backward) routines which need 'ps1' elements, and the columns with
+   its complex routines on 'ps0' elements. */
 void
 fftinitializer(struct convolveparams *p, struct fftonthreadparams **outfp)
 {
@@ -314,17 +441,36 @@ fftinitializer(struct convolveparams *p, struct fftonthreadparams **outfp)
 
   /* Initialize the gsl_fft_wavetable structures (these are thread
      safe): */
-  fp[0].ps0wave=gsl_fft_complex_wavetable_alloc(p->ps0);
-  fp[0].ps1wave=gsl_fft_complex_wavetable_alloc(p->ps1);
+  if(p->ffttype==GAL_TYPE_FLOAT32)
+    {
+      fp[0].rwave  = gsl_fft_real_wavetable_float_alloc(p->ps1);
+      fp[0].hcwave = gsl_fft_halfcomplex_wavetable_float_alloc(p->ps1);
+      fp[0].cwave  = gsl_fft_complex_wavetable_float_alloc(p->ps0);
+    }
+  else
+    {
+      fp[0].rwave  = gsl_fft_real_wavetable_alloc(p->ps1);
+      fp[0].hcwave = gsl_fft_halfcomplex_wavetable_alloc(p->ps1);
+      fp[0].cwave  = gsl_fft_complex_wavetable_alloc(p->ps0);
+    }
 
   /* Set the values for all the other threads: */
   for(i=0;i<p->cp.numthreads;++i)
     {
       fp[i].p=p;
-      fp[i].ps0wave=fp[0].ps0wave;
-      fp[i].ps1wave=fp[0].ps1wave;
-      fp[i].ps0work=gsl_fft_complex_workspace_alloc(p->ps0);
-      fp[i].ps1work=gsl_fft_complex_workspace_alloc(p->ps1);
+      fp[i].rwave=fp[0].rwave;
+      fp[i].hcwave=fp[0].hcwave;
+      fp[i].cwave=fp[0].cwave;
+      if(p->ffttype==GAL_TYPE_FLOAT32)
+        {
+          fp[i].rwork=gsl_fft_real_workspace_float_alloc(p->ps1);
+          fp[i].cwork=gsl_fft_complex_workspace_float_alloc(p->ps0);
+        }
+      else
+        {
+          fp[i].rwork=gsl_fft_real_workspace_alloc(p->ps1);
+          fp[i].cwork=gsl_fft_complex_workspace_alloc(p->ps0);
+        }
     }
 }
 
@@ -336,12 +482,27 @@ void
 freefp(struct fftonthreadparams *fp)
 {
   size_t i;
-  gsl_fft_complex_wavetable_free(fp[0].ps0wave);
-  gsl_fft_complex_wavetable_free(fp[0].ps1wave);
-  for(i=0;i<fp->p->cp.numthreads;++i)
+  if(fp->p->ffttype==GAL_TYPE_FLOAT32)
     {
-      gsl_fft_complex_workspace_free(fp[i].ps0work);
-      gsl_fft_complex_workspace_free(fp[i].ps1work);
+      gsl_fft_real_wavetable_float_free(fp[0].rwave);
+      gsl_fft_halfcomplex_wavetable_float_free(fp[0].hcwave);
+      gsl_fft_complex_wavetable_float_free(fp[0].cwave);
+      for(i=0;i<fp->p->cp.numthreads;++i)
+        {
+          gsl_fft_real_workspace_float_free(fp[i].rwork);
+          gsl_fft_complex_workspace_float_free(fp[i].cwork);
+        }
+    }
+  else
+    {
+      gsl_fft_real_wavetable_free(fp[0].rwave);
+      gsl_fft_halfcomplex_wavetable_free(fp[0].hcwave);
+      gsl_fft_complex_wavetable_free(fp[0].cwave);
+      for(i=0;i<fp->p->cp.numthreads;++i)
+        {
+          gsl_fft_real_workspace_free(fp[i].rwork);
+          gsl_fft_complex_workspace_free(fp[i].cwork);
+        }
     }
   free(fp);
 }
@@ -353,11 +514,13 @@ freefp(struct fftonthreadparams *fp)
 /* Unfortunately I don't understand why the division operation in
    deconvolution (makekernel) does not produce a centered image, the
    image is translated by half the input size in both dimensions. So I
-   am correcting this in the spatial domain here. */
+   am correcting this in the spatial domain here. On input, '*spatial'
+   should contain the absolute value of the padded spatial domain
+   image, it will be freed and replaced by the corrected image. */
 void
 correctdeconvolve(struct convolveparams *p, double **spatial)
 {
-  double r, *s, *n, *d, *df, sum=0.0f;
+  double r, *s=*spatial, *n, *d, *df, sum=0.0f;
   size_t i, j, ps0=p->ps0, ps1=p->ps1;
   int ii, jj, ci=p->ps0/2-1, cj=p->ps1/2-1;
 
@@ -366,9 +529,6 @@ correctdeconvolve(struct convolveparams *p, double **spatial)
     error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s. The padded "
           "image sides are not an even number", __func__, PACKAGE_BUGREPORT);
 
-  /* First convert the complex image to a real image: */
-  complextoreal(p->pimg, ps0*ps1, COMPLEX_TO_REAL_SPEC, &s);
-
   /* Allocate the array to keep the new values */
   errno=0;
   n=malloc(ps0*ps1*sizeof *n);
@@ -438,44 +598,131 @@ correctdeconvolve(struct convolveparams *p, double **spatial)
 /******************************************************************/
 /*************    Frequency domain convolution    *****************/
 /******************************************************************/
-/* The indexs array specifies the row or column numbers for this
-  thread to work on. If forward1backwardn1 is one, then this is the
-  forward transform, meaning that in convolution there are two
-  images. If it is -1, then this is the final backward transform and
-  there is only one image to run FFTW on and the values in indexs will
-  always be smaller than p->s0 and p->s1. When there are two images,
-  then the index numbers are going to be at most double p->s0 and
-  p->s1. In this case, those index values which are smaller than p->s0
-  or p->s1 belong to the input image and those which are equal or
-  larger than larger belong to the kernel image (after subtraction for
-  p->s0 or p->s1).*/
-void *
-onedimensionfft(void *inparam)
+/* Transform one row (when 'fp->stride==1') or column of a padded array
+   (see the comments at the start of this file for the layout).
+
+   On the rows, the forward transform is real-to-halfcomplex. GSL's
+   halfcomplex format for an even 'n' is: r0, r1, i1, ..., r(n/2), so the
+   result is then unpacked (in place) into the complex numbers of the row
+   (from the end, so no value is over-written before it is moved). The
+   backward transform on the rows packs them again and does the inverse
+   halfcomplex-to-real transform. On the columns, we have complex
+   transforms with a stride of 'ps1/2+1' (complex numbers). GSL's inverse
+   transforms are normalized, so no further normalization is necessary
+   after the backward transforms. */
+static void
+onedimensionfft_f64(struct fftonthreadparams *fp, double *d)
 {
-  struct fftonthreadparams *fp = (struct fftonthreadparams *)inparam;
-  struct convolveparams *p=fp->p;
+  size_t k, n=fp->p->ps1;
+
+  if(fp->stride==1)
+    {
+      if(fp->forward1backwardn1==1)
+        {
+          gsl_fft_real_transform(d, 1, n, fp->rwave, fp->rwork);
+          d[n+1]=0.0f;
+          d[n]=d[n-1];
+          for(k=n/2-1;k>0;--k) { d[2*k+1]=d[2*k]; d[2*k]=d[2*k-1]; }
+          d[1]=0.0f;
+        }
+      else
+        {
+          for(k=1;k<n/2;++k) { d[2*k-1]=d[2*k]; d[2*k]=d[2*k+1]; }
+          d[n-1]=d[n];
+          gsl_fft_halfcomplex_inverse(d, 1, n, fp->hcwave, fp->rwork);
+        }
+    }
+  else
+    {
+      if(fp->forward1backwardn1==1)
+        gsl_fft_complex_forward(d, n/2+1, fp->p->ps0, fp->cwave, fp->cwork);
+      else
+        gsl_fft_complex_inverse(d, n/2+1, fp->p->ps0, fp->cwave, fp->cwork);
+    }
+}
 
-  double *d, *df;
-  size_t indmultip, maxindex;
-  gsl_fft_complex_workspace *work;
-  gsl_fft_complex_wavetable *wavetable;
-  double *data, *pimg=p->pimg, *pker=p->pker;
-  int forward1backwardn1=fp->forward1backwardn1;
-  size_t i, size, stride=fp->stride, *indexs=fp->indexs;
 
-  /* Set the number of points to transform,
 
-     indmultip: The value to be multiplied by the value in indexs to
-     specify the first pixel of the row or column.
-   */
-  if(stride==1)
-    { size=p->ps1; wavetable=fp->ps1wave; work=fp->ps1work;
-      maxindex=p->ps0; indmultip=p->ps1; }
+
+
+/* Similar to 'onedimensionfft_f64', but for 32-bit floating points. */
+static void
+onedimensionfft_f32(struct fftonthreadparams *fp, float *d)
+{
+  size_t k, n=fp->p->ps1;
+
+  if(fp->stride==1)
+    {
+      if(fp->forward1backwardn1==1)
+        {
+          gsl_fft_real_float_transform(d, 1, n, fp->rwave, fp->rwork);
+          d[n+1]=0.0f;
+          d[n]=d[n-1];
+          for(k=n/2-1;k>0;--k) { d[2*k+1]=d[2*k]; d[2*k]=d[2*k-1]; }
+          d[1]=0.0f;
+        }
+      else
+        {
+          for(k=1;k<n/2;++k) { d[2*k-1]=d[2*k]; d[2*k]=d[2*k+1]; }
+          d[n-1]=d[n];
+          gsl_fft_halfcomplex_float_inverse(d, 1, n, fp->hcwave,
+                                            fp->rwork);
+        }
+    }
   else
-    { size=p->ps0; wavetable=fp->ps0wave; work=fp->ps0work;
-      maxindex=p->ps1; indmultip=1;      }
+    {
+      if(fp->forward1backwardn1==1)
+        gsl_fft_complex_float_forward(d, n/2+1, fp->p->ps0, fp->cwave,
+                                      fp->cwork);
+      else
+        gsl_fft_complex_float_inverse(d, n/2+1, fp->p->ps0, fp->cwave,
+                                      fp->cwork);
+    }
+}
+
+
 
 
+
+/* Transform row (when 'fp->stride==1') or column number 'ind' of the
+   padded array 'data'. The first element of each row is 'ps1+2' elements
+   after the previous one and the first element of each column is 2
+   elements (one complex number) after the previous one. */
+static void
+onedimensionfft_one(struct fftonthreadparams *fp, void *data, size_t ind)
+{
+  size_t indmultip = fp->stride==1 ? fp->p->ps1+2 : 2;
+
+  if(fp->p->ffttype==GAL_TYPE_FLOAT32)
+    onedimensionfft_f32(fp, (float *)data + ind*indmultip);
+  else
+    onedimensionfft_f64(fp, (double *)data + ind*indmultip);
+}
+
+
+
+
+
+/* The indexs array specifies the row or column numbers for this thread
+  to work on. When the forward transform is done on both the input and
+  kernel, the index numbers are going to be at most double the number of
+  rows (or columns). In this case, those index values which are smaller
+  than the number of rows (or columns) belong to the input image and
+  those which are equal or larger belong to the kernel image (after
+  subtraction of the number of rows or columns). When the kernel's
+  transform is already available, or in the backward transform, there
+  is only one image (the input).*/
+void *
+onedimensionfft(void *inparam)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct fftonthreadparams *fp=(struct fftonthreadparams *)(tprm->params)
+                               + tprm->id;
+  struct convolveparams *p=fp->p;
+
+  size_t i, *indexs=tprm->indexs;
+  size_t maxindex = fp->stride==1 ? p->ps0 : p->ps1/2+1;
+
   /* Go over all the rows or columns given for this thread.
 
      NOTE: The final array (after the two FFT'd arrays are multiplied
@@ -483,25 +730,13 @@ onedimensionfft(void *inparam)
      both in the forward and the backward transformation.
   */
   for(i=0; indexs[i]!=GAL_BLANK_SIZE_T; ++i)
-    {
-      data = ( indexs[i]<maxindex
-               ? &pimg[ 2*indexs[i]*indmultip ]   /* *2 because complex. */
-               : &pker[ 2*(indexs[i]-maxindex)*indmultip ] );
-
-      gsl_fft_complex_transform(data, stride, size, wavetable, work,
-                                forward1backwardn1);
-
-      /* Normalize in the backward transform: */
-      if(forward1backwardn1==-1)
-        {
-          df=(d=data)+2*size*stride;
-          do {*d/=size; *(d+1)/=size; d+=2*stride;} while(d<df);
-        }
-    }
+    if(indexs[i]<maxindex)
+      onedimensionfft_one(fp, p->pimg, indexs[i]);
+    else
+      onedimensionfft_one(fp, p->pker, indexs[i]-maxindex);
 
   /* Wait until all other threads finish. */
-  if(p->cp.numthreads>1)
-    pthread_barrier_wait(fp->b);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
 }
 
@@ -509,125 +744,60 @@ onedimensionfft(void *inparam)
 
 
 
-/* Do the forward Fast Fourier Transform either on two input images
-   (the padded image and kernel) or on one image (the multiplication
-   of the FFT of the two). In the second case, it is assumed that we
-   are looking at the complex conjugate of the array so in practice
-   this will be a backward transform. */
-void
-twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
-                int forward1backwardn1)
+/* Do the 1D transforms on all the rows ('stride==1') or columns of the
+   'numimgs' padded images. */
+static void
+twodimensionfft_onaxis(struct convolveparams *p, struct fftonthreadparams *fp,
+                       size_t stride, size_t numimgs)
 {
-  int err;
-  pthread_t t;          /* All thread ids saved in this, not used. */
-  char *mmapname=NULL;
-  pthread_attr_t attr;
-  pthread_barrier_t b;
-  size_t i, nb, *indexs, thrdcols;
-  size_t nt=p->cp.numthreads, multiple=0;
-
-  /* First we are going to get the 1D fourier transform on the rows of
-     both images. */
-  if(forward1backwardn1==1)       multiple=2;
-  else if(forward1backwardn1==-1) multiple=1;
-  else
-    error(EXIT_FAILURE, 0, "%s: a bug! The value of the variable "
-          "'forward1backwardn1' is %d not 1 or 2. Please contact us at %s "
-          "so we can find the cause of the problem and fix it", __func__,
-          forward1backwardn1, PACKAGE_BUGREPORT);
-
+  size_t i, nt=p->cp.numthreads;
+
+  /* Each thread will use the element of 'fp' that corresponds to its ID
+     (for its own GSL workspace). */
+  for(i=0;i<nt;++i) fp[i].stride=stride;
+  gal_threads_spin_off(onedimensionfft, fp,
+                       numimgs * (stride==1 ? p->ps0 : p->ps1/2+1), nt,
+                       p->input->minmapsize, p->cp.quietmmap);
+}
 
-  /* ==================== */
-  /* 1D FFT on each row. */
-  /* ==================== */
-  mmapname=gal_threads_dist_in_threads(multiple*p->ps0, nt,
-                                       p->input->minmapsize,
-                                       p->cp.quietmmap,
-                                       &indexs, &thrdcols);
-  if(nt==1)
-    {
-      fp[0].stride=1;
-      fp[0].indexs=&indexs[0];
-      fp[0].forward1backwardn1=forward1backwardn1;
-      onedimensionfft(&fp[0]);
-    }
-  else
-    {
-      /* Initialize the attributes. Note that this running thread
-         (that spinns off the nt threads) is also a thread, so the
-         number the barrier should be one more than the number of
-         threads spinned off. */
-      if( multiple*p->ps0 < nt ) nb=multiple*p->ps0+1;
-      else nb=nt+1;
-      gal_threads_attr_barrier_init(&attr, &b, nb);
-
-      /* Spin off the threads: */
-      for(i=0;i<nt;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            fp[i].id=i;
-            fp[i].b=&b;
-            fp[i].stride=1; /* On each row, stride=1 */
-            fp[i].indexs=&indexs[i*thrdcols];
-            fp[i].forward1backwardn1=forward1backwardn1;
-            err=pthread_create(&t, &attr, onedimensionfft, &fp[i]);
-            if(err)
-              error(EXIT_FAILURE, 0, "%s: can't create thread %zu for rows",
-                    __func__, i);
-          }
 
-      /* Wait for all threads to finish and free the spaces. */
-      pthread_barrier_wait(&b);
-      pthread_attr_destroy(&attr);
-      pthread_barrier_destroy(&b);
-    }
 
-  /* Clean up. */
-  if(mmapname) gal_pointer_mmap_free(&mmapname, p->cp.quietmmap);
-  else         free(indexs);
 
 
+/* Do the forward Fast Fourier Transform either on two input images (the
+   padded image and kernel) or only on the padded image (when 'numimgs' is
+   1). The backward transform is only done on the padded image (that
+   keeps the multiplication of the FFT of the two). */
+void
+twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
+                int forward1backwardn1, size_t numimgs)
+{
+  size_t i;
 
-  /* ====================== */
-  /* 1D FFT on each column. */
-  /* ====================== */
-  /* No comments, exact duplicate of above, except the p->ps1s! */
-  mmapname=gal_threads_dist_in_threads(multiple*p->ps1, nt,
-                                       p->input->minmapsize,
-                                       p->cp.quietmmap,
-                                       &indexs, &thrdcols);
-  if(nt==1)
+  /* Sanity check. */
+  if(forward1backwardn1!=1 && forward1backwardn1!=-1)
+    error(EXIT_FAILURE, 0, "%s: a bug! The value of the variable "
+          "'forward1backwardn1' is %d not 1 or -1. Please contact us at %s "
+          "so we can find the cause of the problem and fix it", __func__,
+          forward1backwardn1, PACKAGE_BUGREPORT);
+  for(i=0;i<p->cp.numthreads;++i)
+    fp[i].forward1backwardn1=forward1backwardn1;
+
+  /* The real-to-halfcomplex transforms are done on the rows (to keep only
+     half of the frequencies, see the comments at the start of this
+     file). So in the forward transform, we first transform the rows, then
+     the columns. The backward transform is done in the opposite
+     order. */
+  if(forward1backwardn1==1)
     {
-      fp[0].stride=p->ps1;
-      fp[0].indexs=indexs;
-      fp[0].forward1backwardn1=forward1backwardn1;
-      onedimensionfft(&fp[0]);
+      twodimensionfft_onaxis(p, fp, 1,       numimgs);
+      twodimensionfft_onaxis(p, fp, p->ps1,  numimgs);
     }
   else
     {
-      if( multiple*p->ps1 < nt ) nb=multiple*p->ps1+1;
-      else nb=nt+1;
-      gal_threads_attr_barrier_init(&attr, &b, nb);
-      for(i=0;i<nt;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            fp[i].b=&b;
-            fp[i].stride=p->ps1; /* On each column, stride is p->ps1 */
-            fp[i].indexs=&indexs[i*thrdcols];
-            fp[i].forward1backwardn1=forward1backwardn1;
-            err=pthread_create(&t, &attr, onedimensionfft, &fp[i]);
-            if(err)
-              error(EXIT_FAILURE, 0, "%s: can't create thread %zu for columns",
-                    __func__, i);
-          }
-      pthread_barrier_wait(&b);
-      pthread_attr_destroy(&attr);
-      pthread_barrier_destroy(&b);
+      twodimensionfft_onaxis(p, fp, p->ps1,  numimgs);
+      twodimensionfft_onaxis(p, fp, 1,       numimgs);
     }
-
-  /* Clean up, note that 'indexs' may be memory-mapped. */
-  if(mmapname) gal_pointer_mmap_free(&mmapname, p->cp.quietmmap);
-  else         free(indexs);
 }
 
 
@@ -646,7 +816,7 @@ convolve_frequency(struct convolveparams *p)
 
   /* Make the padded arrays. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  frequency_make_padded_complex(p);
+  frequency_make_padded(p);
   if(!p->cp.quiet)
     gal_timing_report(&t1, "Input and Kernel images padded.", 1);
   if(p->checkfreqsteps)
@@ -660,13 +830,13 @@ convolve_frequency(struct convolveparams *p)
       free(data->array);
 
       /* Save the padded input image. */
-      complextoreal(p->pimg, p->ps0*p->ps1, COMPLEX_TO_REAL_REAL, &tmp);
+      tmp=frequency_padded_to_real(p, p->pimg, 0);
       data->array=tmp; data->name="input padded";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
 
       /* Save the padded kernel image. */
-      complextoreal(p->pker, p->ps0*p->ps1, COMPLEX_TO_REAL_REAL, &tmp);
+      tmp=frequency_padded_to_real(p, p->pker, 0);
       data->array=tmp; data->name="kernel padded";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
@@ -679,17 +849,17 @@ convolve_frequency(struct convolveparams *p)
 
   /* Forward 2D FFT on each image. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  twodimensionfft(p, fp, 1);
+  twodimensionfft(p, fp, 1, 2);
   if(!p->cp.quiet)
     gal_timing_report(&t1, "Images converted to frequency domain.", 1);
   if(p->checkfreqsteps)
     {
-      complextoreal(p->pimg, p->ps0*p->ps1, COMPLEX_TO_REAL_SPEC, &tmp);
+      complextoreal(p, p->pimg, COMPLEX_TO_REAL_SPEC, &tmp);
       data->array=tmp; data->name="input transformed";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
 
-      complextoreal(p->pker, p->ps0*p->ps1, COMPLEX_TO_REAL_SPEC, &tmp);
+      complextoreal(p, p->pker, COMPLEX_TO_REAL_SPEC, &tmp);
       data->array=tmp; data->name="kernel transformed";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
@@ -699,31 +869,30 @@ convolve_frequency(struct convolveparams *p)
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
   if(p->makekernel)
     {
-      complexarraydivide(p->pimg, p->pker, p->ps0*p->ps1, p->minsharpspec);
+      complexarraydivide(p, p->pimg, p->ps0*(p->ps1/2+1));
       if(!p->cp.quiet)
         gal_timing_report(&t1, "Divided in the frequency domain.", 1);
     }
   else
     {
-      complexarraymultiply(p->pimg, p->pker, p->ps0*p->ps1);
+      complexarraymultiply(p, p->pimg, p->ps0*(p->ps1/2+1));
       if(!p->cp.quiet)
         gal_timing_report(&t1, "Multiplied in the frequency domain.", 1);
     }
   if(p->checkfreqsteps)
     {
-      complextoreal(p->pimg, p->ps0*p->ps1, COMPLEX_TO_REAL_SPEC, &tmp);
+      complextoreal(p, p->pimg, COMPLEX_TO_REAL_SPEC, &tmp);
       data->array=tmp; data->name=p->makekernel ? "Divided" : "Multiplied";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
     }
 
-  /* Forward (in practice inverse) 2D FFT on each image. */
+  /* Backward 2D FFT on the multiplied (or divided) image. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  twodimensionfft(p, fp, -1);
+  twodimensionfft(p, fp, -1, 1);
+  p->rpad=frequency_padded_to_real(p, p->pimg, p->makekernel);
   if(p->makekernel)
     correctdeconvolve(p, &p->rpad);
-  else
-    complextoreal(p->pimg, p->ps0*p->ps1, COMPLEX_TO_REAL_REAL, &p->rpad);
   if(!p->cp.quiet)
     gal_timing_report(&t1, "Converted back to the spatial domain.", 1);
   if(p->checkfreqsteps)
@@ -733,11 +902,11 @@ convolve_frequency(struct convolveparams *p)
       data->name=NULL; data->array=NULL;
     }
 
-  /* Free the padded arrays (they are no longer needed) and put the
-     converted array (that is real, not complex) in p->pimg. */
+  /* Free the padded arrays (they are no longer needed). */
   gal_data_free(data);
   free(p->pimg);
   free(p->pker);
+  p->pimg=p->pker=NULL;
 
   /* Crop out the center, numbers smaller than 10^{-17} are errors,
      remove them. */
@@ -747,6 +916,8 @@ convolve_frequency(struct convolveparams *p)
 
 
   /* Free all the allocated space. */
+  free(p->rpad);
+  p->rpad=NULL;
   freefp(fp);
 }
 
@@ -754,6 +925,102 @@ convolve_frequency(struct convolveparams *p)
 
 
 
+/* Convolve the input image in strips that are read from the input file
+   and written into the output file one by one, so the full image is never
+   kept in memory. Each strip has enough rows of blocks for all the
+   threads to work on and also a halo of half the kernel's height, so its
+   own rows can be convolved independently. The next strip is read in the
+   background while the current one is being convolved. */
+static void
+convolve_frequency_strips(struct convolveparams *p)
+{
+  char *msg;
+  int status=0;
+  fitsfile *fptr;
+  struct timeval t1;
+  size_t ostart[2]={0,0};
+  gal_fits_list_key_t *keys=NULL;
+  struct gal_fits_img_strips *strips;
+  gal_data_t *strip, *tile, *conv, *input=p->input;
+  size_t nb1, height, start, first, number, minmax[4], numstrips=0;
+  size_t bs=p->blocksize, h0=(p->kernel->dsize[0]-1)/2;
+
+  /* Open the input strips and the output image. */
+  if(!p->cp.quiet) gettimeofday(&t1, NULL);
+  nb1=(input->dsize[1]+bs-1)/bs;
+  height=bs*( (p->cp.numthreads+nb1-1)/nb1 );
+  strips=gal_fits_img_strips_open(p->filename, p->cp.hdu, INPUT_USE_TYPE,
+                                  height, h0, 1, p->cp.minmapsize,
+                                  p->cp.quietmmap);
+  fptr=gal_fits_img_write_empty(p->cp.output, p->cp.type, 2, input->dsize,
+                                input->wcs, NULL, input->unit);
+
+  /* Convolve the rows of each strip (the tile over its own rows) and
+     write them into the output. */
+  while( (strip=gal_fits_img_strips_next(strips, &start, &first, &number)) )
+    {
+      if(numstrips++==0 && gal_blank_present(strip, 1))
+        ui_blank_warning(p);
+      minmax[0]=first-start;           minmax[1]=0;
+      minmax[2]=first-start+number-1;  minmax[3]=input->dsize[1]-1;
+      tile=gal_tile_series_from_minmax(strip, minmax, 1);
+      conv=gal_convolve_frequency_blocks(tile, p->kernel, bs, p->ffttype,
+                                         p->cp.numthreads, p->cp.minmapsize,
+                                         p->cp.quietmmap);
+      conv=gal_data_copy_to_new_type_free(conv, p->cp.type);
+      ostart[0]=first;
+      gal_fits_img_write_tile(fptr, conv, ostart);
+      gal_data_array_free(tile, 1, 0);
+      gal_data_free(strip);
+      gal_data_free(conv);
+    }
+
+  /* Clean up. */
+  gal_fits_img_strips_close(strips);
+  gal_fits_key_write_version_in_ptr(&keys, PROGRAM_NAME, fptr);
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+  if(!p->cp.quiet)
+    {
+      if( asprintf(&msg, "Convolved in %zu strip%s of %zu rows.",
+                   numstrips, numstrips==1 ? "" : "s", height)<0 )
+        error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+      gal_timing_report(&t1, msg, 1);
+      free(msg);
+    }
+}
+
+
+
+
+
+/* Convolve the input in separate blocks (of 'p->blocksize' pixels on
+   each side) in the frequency domain (see
+   'gal_convolve_frequency_blocks'). If the input wasn't read into memory
+   (it is a FITS image), it is convolved in strips. */
+static void
+convolve_frequency_blocks(struct convolveparams *p)
+{
+  gal_data_t *out;
+  struct timeval t1;
+
+  if(p->input->array)
+    {
+      if(!p->cp.quiet) gettimeofday(&t1, NULL);
+      out=gal_convolve_frequency_blocks(p->input, p->kernel, p->blocksize,
+                                        p->ffttype, p->cp.numthreads,
+                                        p->cp.minmapsize, p->cp.quietmmap);
+      gal_data_free(p->input);
+      p->input=out;
+      if(!p->cp.quiet) gal_timing_report(&t1, "Convolved in blocks.", 1);
+    }
+  else
+    convolve_frequency_strips(p);
+}
+
+
+
+
 
 
 
@@ -809,15 +1076,23 @@ convolve(struct convolveparams *p)
       p->input=out;
     }
   else
-    convolve_frequency(p);
+    {
+      if(p->blocksize) convolve_frequency_blocks(p);
+      else             convolve_frequency(p);
+    }
 
-  /* Save the output (which is in p->input) array. */
-  if(p->input->ndim==1)
-    gal_table_write(p->input, NULL, NULL, p->cp.tableformat, p->cp.output,
-                    "CONVOLVED", 0);
-  else
-    gal_fits_img_write_to_type(p->input, cp->output, NULL, PROGRAM_NAME,
-                               cp->type);
+  /* Save the output (which is in p->input) array. When the input was
+     convolved in strips, the output has already been written. */
+  if(p->input->array)
+    {
+      if(p->input->ndim==1)
+        gal_table_write_threaded(p->input, NULL, NULL, p->cp.tableformat,
+                                 p->cp.output, "CONVOLVED", 0,
+                                 p->cp.numthreads);
+      else
+        gal_fits_img_write_to_type(p->input, cp->output, NULL, PROGRAM_NAME,
+                                   cp->type);
+    }
 
   /* Write Convolve's parameters as keywords into the first extension of
      the output. */
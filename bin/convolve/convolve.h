@@ -24,25 +24,21 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #define CONVOLVE_H
 
 #include <gnuastro/threads.h>
-#include <gsl/gsl_fft_complex.h>
 
 struct fftonthreadparams
 {
   /* Operating info: */
-  size_t                id; /* The number of this thread.               */
   struct convolveparams *p; /* Pointer to main program structure.       */
-  int   forward1backwardn1; /* Operate on one or two images.            */
+  int   forward1backwardn1; /* Forward or backward transform.           */
   size_t            stride; /* 1D FFT on rows or columns?               */
 
-  /* Pointers to GSL FFT structures: */
-  gsl_fft_complex_wavetable *ps0wave;
-  gsl_fft_complex_wavetable *ps1wave;
-  gsl_fft_complex_workspace *ps0work;
-  gsl_fft_complex_workspace *ps1work;
-
-  /* Thread parameters. */
-  size_t          *indexs;  /* Indexs to be used in this thread.        */
-  pthread_barrier_t    *b;  /* Barrier to keep threads waiting.         */
+  /* Pointers to GSL FFT structures. They are either the 'float' or
+     'double' versions (based on 'p->ffttype'). */
+  void              *rwave; /* Real wavetable (forward on rows).        */
+  void             *hcwave; /* Halfcomplex wavetable (backward on rows).*/
+  void              *cwave; /* Complex wavetable (columns).             */
+  void              *rwork; /* Real workspace (rows).                   */
+  void              *cwork; /* Complex workspace (columns).             */
 };
 
 
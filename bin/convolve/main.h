@@ -83,6 +83,8 @@ struct convolveparams
   char            *domainstr;  /* String value specifying domain.         */
   size_t          makekernel;  /* Make a kernel to create input.          */
   uint8_t   noedgecorrection;  /* Do not correct spatial edge effects.    */
+  uint8_t    singleprecision;  /* Frequency domain: 32-bit floats in FFT. */
+  size_t           blocksize;  /* Frequency domain: side of blocks.       */
 
   /* Internal */
   int                 isfits;  /* Input is a FITS file.                   */
@@ -90,8 +92,9 @@ struct convolveparams
   int                 domain;  /* Frequency or spatial domain conv.       */
   gal_data_t          *input;  /* Input image array.                      */
   gal_data_t         *kernel;  /* Input Kernel array.                     */
-  double               *pimg;  /* Padded image array.                     */
-  double               *pker;  /* Padded kernel array.                    */
+  uint8_t            ffttype;  /* Type of padded arrays (32 or 64-bit).   */
+  void                 *pimg;  /* Padded image array.                     */
+  void                 *pker;  /* Padded kernel array.                    */
   double               *rpad;  /* Real final image before removing pad'd. */
   size_t                 ps0;  /* Padded size along first C axis.         */
   size_t                 ps1;  /* Padded size along second C axis.        */
@@ -221,6 +221,23 @@ ui_read_check_only_options(struct convolveparams *p)
           "either 'spatial' or 'frequency'", p->domainstr);
 
 
+  /* Type of the arrays used in the frequency domain. */
+  p->ffttype = p->singleprecision ? GAL_TYPE_FLOAT32 : GAL_TYPE_FLOAT64;
+
+
+  /* When the frequency domain convolution is done in blocks, there is no
+     full padded image to deconvolve or to show the steps of. */
+  if(p->blocksize && p->domain==CONVOLVE_DOMAIN_FREQUENCY)
+    {
+      if(p->makekernel)
+        error(EXIT_FAILURE, 0, "'--blocksize' cannot be used with "
+              "'--makekernel'");
+      if(p->checkfreqsteps)
+        error(EXIT_FAILURE, 0, "'--blocksize' cannot be used with "
+              "'--checkfreqsteps'");
+    }
+
+
   /* If we are in the spatial domain, make sure that the necessary
      parameters are set. */
   if( p->domain==CONVOLVE_DOMAIN_SPATIAL )
@@ -375,9 +392,7 @@ ui_read_column(struct convolveparams *p, int i0k1)
   gal_list_str_add(&column, columnname, 0);
 
   /* Read the desired column(s). */
-  out=gal_table_read(filename, hdu, lines, column, p->cp.searchin,
-                     p->cp.ignorecase, p->cp.minmapsize, p->cp.quietmmap,
-                     NULL);
+  out=gal_options_table_read(&p->cp, filename, hdu, lines, column, NULL);
   gal_list_str_free(lines, 1);
 
   /* Confirm if only one column was read (it is possible to match more than
@@ -422,6 +437,54 @@ ui_read_column(struct convolveparams *p, int i0k1)
 
 
 
+/* When the input is a 2D FITS image that should be convolved in blocks
+   in the frequency domain (and the output is also a FITS file), it will be
+   read (and convolved) in strips. So only its size, WCS and units are
+   read here and its array will be NULL. Return 1 if the image was
+   prepared in this way, otherwise 0. */
+static int
+ui_read_input_strips(struct convolveparams *p)
+{
+  int type;
+  fitsfile *fptr;
+  int status=0;
+  gal_data_t *in;
+  size_t i, ndim, *dsize;
+
+  /* See if the input can be convolved in strips. */
+  if( p->blocksize==0
+      || p->domain!=CONVOLVE_DOMAIN_FREQUENCY
+      || ( p->cp.output && gal_fits_name_is_fits(p->cp.output)==0 ) )
+    return 0;
+
+  /* Read the image information, only 2D images are convolved in
+     strips. */
+  fptr=gal_fits_hdu_open_format(p->filename, p->cp.hdu, 0);
+  in=gal_data_alloc(NULL, INPUT_USE_TYPE, 0, NULL, NULL, 0, -1, 1, NULL,
+                    NULL, NULL);
+  gal_fits_img_info(fptr, &type, &ndim, &dsize, NULL, &in->unit);
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+  if(ndim!=2)
+    {
+      free(dsize);
+      gal_data_free(in);
+      return 0;
+    }
+
+  /* Set the size and WCS of the input. */
+  in->ndim=ndim;
+  in->dsize=dsize;
+  for(in->size=1, i=0; i<ndim; ++i) in->size*=dsize[i];
+  in->wcs=gal_wcs_read(p->filename, p->cp.hdu, 0, 0, &in->nwcs);
+  p->input=in;
+  return 1;
+}
+
+
+
+
+
 /* Read the input dataset. */
 static void
 ui_read_input(struct convolveparams *p)
@@ -432,12 +495,14 @@ ui_read_input(struct convolveparams *p)
   /* If the input is a FITS image or any recognized array file format, then
      read it as an array, otherwise, as a table. */
   if( p->filename && gal_array_name_recognized(p->filename) )
-    if (p->isfits && p->hdu_type==IMAGE_HDU)
+    if (p->isfits && p->hdu_type==IMAGE_HDU
+        && ui_read_input_strips(p)==0)
       {
-        p->input=gal_array_read_one_ch_to_type(p->filename, p->cp.hdu, NULL,
-                                               INPUT_USE_TYPE,
-                                               p->cp.minmapsize,
-                                               p->cp.quietmmap);
+        p->input=gal_array_read_one_ch_to_type_threaded(p->filename, p->cp.hdu,
+                                                        NULL, INPUT_USE_TYPE,
+                                                        p->cp.numthreads,
+                                                        p->cp.minmapsize,
+                                                        p->cp.quietmmap);
         p->input->wcs=gal_wcs_read(p->filename, p->cp.hdu, 0, 0,
                                    &p->input->nwcs);
         p->input->ndim=gal_dimension_remove_extra(p->input->ndim,
@@ -465,10 +530,12 @@ ui_read_kernel(struct convolveparams *p)
       && p->input->ndim>1
       && gal_array_name_recognized(p->kernelname)  )
     {
-      p->kernel = gal_array_read_one_ch_to_type(p->kernelname, p->khdu,
-                                                NULL, INPUT_USE_TYPE,
-                                                p->cp.minmapsize,
-                                                p->cp.quietmmap);
+      p->kernel = gal_array_read_one_ch_to_type_threaded(p->kernelname,
+                                                         p->khdu, NULL,
+                                                         INPUT_USE_TYPE,
+                                                         p->cp.numthreads,
+                                                         p->cp.minmapsize,
+                                                         p->cp.quietmmap);
       p->kernel->ndim=gal_dimension_remove_extra(p->kernel->ndim,
                                                  p->kernel->dsize,
                                                  p->kernel->wcs);
@@ -487,6 +554,28 @@ ui_read_kernel(struct convolveparams *p)
 
 
 
+/* Warn the user that there are blank pixels in the input of frequency
+   domain convolution. */
+void
+ui_blank_warning(struct convolveparams *p)
+{
+  fprintf(stderr, "\n----------------------------------------\n"
+          "######## %s WARNING ########\n"
+          "There are blank pixels in '%s' (hdu: '%s') and you have "
+          "asked for frequency domain convolution. As a result, all "
+          "the pixels in the output ('%s') will be blank. Only "
+          "spatial domain convolution can account for blank pixels "
+          "in the input data. You can run %s again with "
+          "'--domain=spatial'\n"
+          "----------------------------------------\n\n",
+          PROGRAM_NAME, p->filename, p->cp.hdu, p->cp.output,
+          PROGRAM_NAME);
+}
+
+
+
+
+
 static void
 ui_preparations(struct convolveparams *p)
 {
@@ -520,19 +609,10 @@ ui_preparations(struct convolveparams *p)
               "domain convolution currently only operates on 2D images",
               p->filename, cp->hdu, p->input->ndim);
 
-      /* Blank values. */
-      if( gal_blank_present(p->input, 1) )
-        fprintf(stderr, "\n----------------------------------------\n"
-                "######## %s WARNING ########\n"
-                "There are blank pixels in '%s' (hdu: '%s') and you have "
-                "asked for frequency domain convolution. As a result, all "
-                "the pixels in the output ('%s') will be blank. Only "
-                "spatial domain convolution can account for blank pixels "
-                "in the input data. You can run %s again with "
-                "'--domain=spatial'\n"
-                "----------------------------------------\n\n",
-                PROGRAM_NAME, p->filename, cp->hdu, cp->output,
-                PROGRAM_NAME);
+      /* Blank values (when the input is read in strips, each strip is
+         checked separately). */
+      if( p->input->array && gal_blank_present(p->input, 1) )
+        ui_blank_warning(p);
 
       /* Frequency domain is only implemented in 2D. */
       if( p->input->ndim==1 )
@@ -783,6 +863,9 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct convolveparams *p)
 void
 ui_free_report(struct convolveparams *p, struct timeval *t1)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the allocated arrays: */
   free(p->khdu);
   free(p->cp.hdu);
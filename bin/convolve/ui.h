@@ -65,6 +65,8 @@ enum option_keys_enum
   UI_KEY_NOKERNELFLIP,
   UI_KEY_NOKERNELNORM,
   UI_KEY_NOEDGECORRECTION,
+  UI_KEY_SINGLEPRECISION,
+  UI_KEY_BLOCKSIZE,
 };
 
 
@@ -74,6 +76,9 @@ enum option_keys_enum
 void
 ui_read_check_inputs_setup(int argc, char *argv[], struct convolveparams *p);
 
+void
+ui_blank_warning(struct convolveparams *p);
+
 void
 ui_free_report(struct convolveparams *p, struct timeval *t1);
 
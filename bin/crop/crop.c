@@ -198,13 +198,17 @@ crop_write_to_log(struct onecropparams *crp)
 static void *
 crop_mode_img(void *inparam)
 {
-  struct onecropparams *crp=(struct onecropparams *)inparam;
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct onecropparams *crp=(struct onecropparams *)(tprm->params)+tprm->id;
   struct cropparams *p=crp->p;
 
   size_t i;
   int status;
   struct inputimgs *img;
 
+  /* Set the indexs of this thread. */
+  crp->indexs=tprm->indexs;
+
   /* In image mode, we always only have one image. */
   crp->in_ind=0;
 
@@ -265,9 +269,7 @@ crop_mode_img(void *inparam)
     gal_fits_io_error(status, "could not close FITS file");
 
   /* Wait until all other threads finish. */
-  if(p->cp.numthreads>1)
-    pthread_barrier_wait(crp->b);
-
+  if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
 }
 
@@ -278,7 +280,8 @@ crop_mode_img(void *inparam)
 static void *
 crop_mode_wcs(void *inparam)
 {
-  struct onecropparams *crp=(struct onecropparams *)inparam;
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct onecropparams *crp=(struct onecropparams *)(tprm->params)+tprm->id;
   struct cropparams *p=crp->p;
 
   size_t i;
@@ -286,6 +289,7 @@ crop_mode_wcs(void *inparam)
 
 
   /* Go over all the output objects for this thread. */
+  crp->indexs=tprm->indexs;
   for(i=0; crp->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
     {
       /* Set all the output parameters: */
@@ -368,8 +372,7 @@ crop_mode_wcs(void *inparam)
     }
 
   /* Wait until all other threads finish, then return. */
-  if(p->cp.numthreads>1)
-    pthread_barrier_wait(crp->b);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
 }
 
@@ -402,16 +405,11 @@ crop_mode_wcs(void *inparam)
 void
 crop(struct cropparams *p)
 {
-  int err=0;
+  size_t i;
   char *tmp;
-  pthread_t t; /* We don't use the thread id, so all are saved here. */
-  char *mmapname;
-  pthread_attr_t attr;
-  pthread_barrier_t b;
   struct onecropparams *crp;
-  size_t i, *indexs, thrdcols;
   gal_list_str_t *comments=NULL;
-  size_t nt=p->cp.numthreads, nb;
+  size_t nt=p->cp.numthreads;
   void *(*modefunction)(void *)=NULL;
 
 
@@ -428,49 +426,15 @@ crop(struct cropparams *p)
           __func__, nt*sizeof *crp);
 
 
-  /* Distribute the indexs into the threads (for clarity, this is needed
-     even if we only have one object). */
-  mmapname=gal_threads_dist_in_threads(p->catname ? p->numout : 1, nt,
-                                       p->cp.minmapsize, p->cp.quietmmap,
-                                       &indexs, &thrdcols);
+  /* All threads need the main program structure. */
+  for(i=0;i<nt;++i) crp[i].p=p;
 
 
-  /* Run the job, if there is only one thread, don't go through the
-     trouble of spinning off a thread! */
-  if(nt==1)
-    {
-      crp[0].p=p;
-      crp[0].indexs=indexs;
-      modefunction(&crp[0]);
-    }
-  else
-    {
-      /* Initialize the attributes. Note that this running thread
-         (that spinns off the nt threads) is also a thread, so the
-         number the barrier should be one more than the number of
-         threads spinned off. */
-      if(p->numout<nt) nb=p->numout+1;
-      else             nb=nt+1;
-      gal_threads_attr_barrier_init(&attr, &b, nb);
-
-      /* Spin off the threads: */
-      for(i=0;i<nt;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            crp[i].p=p;
-            crp[i].b=&b;
-            crp[i].indexs=&indexs[i*thrdcols];
-            err=pthread_create(&t, &attr, modefunction, &crp[i]);
-            if(err)
-              error(EXIT_FAILURE, 0, "%s: can't create thread %zu",
-                    __func__, i);
-          }
-
-      /* Wait for all threads to finish and free the spaces. */
-      pthread_barrier_wait(&b);
-      pthread_attr_destroy(&attr);
-      pthread_barrier_destroy(&b);
-    }
+  /* Do the job on multiple threads. Note that each thread will use the
+     element of 'crp' corresponding to its ID. For clarity, this is
+     needed even if we only have one object. */
+  gal_threads_spin_off(modefunction, crp, p->catname ? p->numout : 1, nt,
+                       p->cp.minmapsize, p->cp.quietmmap);
 
 
   /* Print the log file. */
@@ -490,8 +454,6 @@ crop(struct cropparams *p)
     }
 
   /* Print the final verbose info, save log, and clean up: */
-  if(mmapname) gal_pointer_mmap_free(&mmapname, p->cp.quietmmap);
-  else         free(indexs);
   crop_verbose_final(p);
   free(crp);
 }
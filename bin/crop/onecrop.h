@@ -56,7 +56,6 @@ struct onecropparams
 
   /* Thread parameters. */
   size_t             *indexs;  /* Indexs to be used in this thread.        */
-  pthread_barrier_t       *b;  /* pthread barrier to keep threads waiting. */
 };
 
 void
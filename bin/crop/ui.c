@@ -35,6 +35,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/table.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/dimension.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/timing.h>
 #include <gnuastro-internal/options.h>
@@ -143,6 +144,7 @@ ui_initialize_options(struct cropparams *p,
           break;
 
         case GAL_OPTIONS_KEY_SEARCHIN:
+        case GAL_OPTIONS_KEY_TABLECACHE:
         case GAL_OPTIONS_KEY_IGNORECASE:
           cp->coptions[i].group=UI_GROUP_CENTER_CATALOG;
           break;
@@ -692,9 +694,8 @@ ui_read_cols(struct cropparams *p)
 
 
   /* Read the desired columns from the file. */
-  cols=gal_table_read(p->catname, p->cathdu, NULL, colstrs, p->cp.searchin,
-                      p->cp.ignorecase, p->cp.minmapsize, p->cp.quietmmap,
-                      NULL);
+  cols=gal_options_table_read(&p->cp, p->catname, p->cathdu, NULL, colstrs,
+                              NULL);
   if(cols==NULL)
     error(EXIT_FAILURE, 0, "%s: is empty! No usable information "
           "(un-commented lines) could be read from this file",
@@ -1109,6 +1110,9 @@ ui_free_report(struct cropparams *p, struct timeval *t1)
 {
   size_t i;
 
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the simple arrays (if they were set). */
   free(p->blankptrread);
   free(p->blankptrwrite);
@@ -246,7 +246,8 @@ fits_print_extension_info(struct fitsparams *p)
       printf(" Column 4: Size of data in HDU.\n");
       printf("-----\n");
     }
-  gal_table_write(cols, NULL, NULL, GAL_TABLE_FORMAT_TXT, NULL, NULL, 0);
+  gal_table_write_threaded(cols, NULL, NULL, GAL_TABLE_FORMAT_TXT, NULL, NULL,
+                           0, p->cp.numthreads);
   gal_list_data_free(cols);
 }
 
@@ -458,8 +458,9 @@ keywords_distortion_wcs(struct fitsparams *p)
       /* If the number of dimensions is two, then read the dataset,
          otherwise, ignore it. */
       if(ndim==2)
-        data=gal_fits_img_read(p->filename, p->cp.hdu, p->cp.minmapsize,
-                               p->cp.quietmmap);
+        data=gal_fits_img_read_threaded(p->filename, p->cp.hdu,
+                                        p->cp.numthreads, p->cp.minmapsize,
+                                        p->cp.quietmmap);
     }
 
   /* Read the input's WCS and make sure one exists. */
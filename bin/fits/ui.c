@@ -30,6 +30,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include <gnuastro/wcs.h>
 #include <gnuastro/fits.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/options.h>
 #include <gnuastro-internal/checkset.h>
@@ -118,6 +119,7 @@ ui_initialize_options(struct fitsparams *p,
       switch(cp->coptions[i].key)
         {
         case GAL_OPTIONS_KEY_SEARCHIN:
+        case GAL_OPTIONS_KEY_TABLECACHE:
         case GAL_OPTIONS_KEY_IGNORECASE:
         case GAL_OPTIONS_KEY_TYPE:
         case GAL_OPTIONS_KEY_TABLEFORMAT:
@@ -726,6 +728,9 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct fitsparams *p)
 void
 ui_free_and_report(struct fitsparams *p)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the allocated arrays: */
   free(p->cp.output);
 }
@@ -156,6 +156,45 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_SET,
       gal_options_parse_csv_float64
     },
+    {
+      "kdtree",
+      UI_KEY_KDTREE,
+      0,
+      0,
+      "Find matches with a k-d tree (not a sweep).",
+      UI_GROUP_CATALOGMATCH,
+      &p->kdtree,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "kdtreefile",
+      UI_KEY_KDTREEFILE,
+      "FITS",
+      0,
+      "Read/write k-d tree of first input (implies --kdtree).",
+      UI_GROUP_CATALOGMATCH,
+      &p->kdtreefile,
+      GAL_TYPE_STRING,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "kdtreehdu",
+      UI_KEY_KDTREEHDU,
+      "STR",
+      0,
+      "HDU of k-d tree in '--kdtreefile'.",
+      UI_GROUP_CATALOGMATCH,
+      &p->kdtreehdu,
+      GAL_TYPE_STRING,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
 
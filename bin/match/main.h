@@ -58,6 +58,9 @@ struct matchparams
   gal_data_t           *coord;  /* Array of manual coordinate values.   */
   gal_data_t         *outcols;  /* Array of second input column names.  */
   gal_data_t        *aperture;  /* Acceptable matching aperture.        */
+  uint8_t              kdtree;  /* Use a k-d tree to find the matches.  */
+  char            *kdtreefile;  /* File to keep the k-d tree of input 1.*/
+  char             *kdtreehdu;  /* HDU of the k-d tree in its file.     */
   uint8_t         logasoutput;  /* Don't rearrange inputs, out is log.  */
   uint8_t          notmatched;  /* Output is rows that don't match.     */
 
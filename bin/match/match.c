@@ -28,8 +28,10 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <string.h>
 
+#include <gnuastro/fits.h>
 #include <gnuastro/match.h>
 #include <gnuastro/table.h>
+#include <gnuastro/kdtree.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/permutation.h>
 
@@ -203,9 +205,9 @@ match_catalog_read_write_all(struct matchparams *p, size_t *permutation,
   /* Read the full table. NOTE that with '--coord', for the second input,
      both 'filename' and 'p->stdinlines' will be NULL. */
   if(filename || p->stdinlines)
-    cat=gal_table_read(filename, hdu, filename ? NULL : p->stdinlines, cols,
-                       p->cp.searchin, p->cp.ignorecase, p->cp.minmapsize,
-                       p->cp.quietmmap, *numcolmatch);
+    cat=gal_options_table_read(&p->cp, filename, hdu,
+                               filename ? NULL : p->stdinlines, cols,
+                               *numcolmatch);
   else
     cat=match_cat_from_coord(p, cols, *numcolmatch);
   origsize = cat ? cat->size : 0;
@@ -259,8 +261,8 @@ match_catalog_read_write_all(struct matchparams *p, size_t *permutation,
   else if(cat)
     {
       /* Write the catalog to a file. */
-      gal_table_write(cat, NULL, NULL, p->cp.tableformat, outname,
-                      extname, 0);
+      gal_table_write_threaded(cat, NULL, NULL, p->cp.tableformat, outname,
+                               extname, 0, p->cp.numthreads);
 
       /* Correct arrays and sizes (when 'notmatched' was called). The
          'array' element has to be corrected for later freeing.
@@ -341,8 +343,80 @@ match_catalog_write_one(struct matchparams *p, gal_data_t *a, gal_data_t *b,
 
   /* Reverse the table and write it out. */
   gal_list_data_reverse(&cat);
-  gal_table_write(cat, NULL, NULL, p->cp.tableformat, p->out1name,
-                  "MATCHED", 0);
+  gal_table_write_threaded(cat, NULL, NULL, p->cp.tableformat, p->out1name,
+                           "MATCHED", 0, p->cp.numthreads);
+}
+
+
+
+
+
+/* Remove the HDU of the k-d tree from '--kdtreefile' (if it exists), so
+   the new tree can be written in its place. The other HDUs of the file
+   are not touched. Return 1 if the HDU existed. */
+static int
+match_catalog_kdtree_remove(struct matchparams *p)
+{
+  char *ffname;
+  fitsfile *fptr;
+  int hdutype, status=0;
+
+  /* See if the HDU exists (the file may not exist at all). */
+  if( asprintf(&ffname, "%s[%s#]", p->kdtreefile, p->kdtreehdu)<0 )
+    error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+  fits_open_file(&fptr, ffname, READWRITE, &status);
+  free(ffname);
+  if(status) return 0;
+
+  /* Remove it. */
+  if(p->cp.dontdelete)
+    error(EXIT_FAILURE, 0, "%s (hdu %s): the k-d tree has to be written "
+          "again, but '--dontdelete' has been called", p->kdtreefile,
+          p->kdtreehdu);
+  fits_delete_hdu(fptr, &hdutype, &status);
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+  return 1;
+}
+
+
+
+
+
+/* Read the k-d tree of the first input from '--kdtreefile'. If the file
+   or its HDU don't exist, or the first input has changed since the tree
+   was written, build the tree and write it in the file (replacing only
+   its HDU) to be used in the next runs. This has to be done before the
+   matching, because the columns are sorted during the matching. */
+static gal_data_t *
+match_catalog_kdtree(struct matchparams *p, size_t *root)
+{
+  gal_data_t *kdtree;
+
+  /* Read the tree. */
+  kdtree=gal_kdtree_read(p->cols1, p->kdtreefile, p->kdtreehdu, root,
+                         p->cp.minmapsize, p->cp.quietmmap);
+  if(kdtree)
+    {
+      if(!p->cp.quiet)
+        printf("  - k-d tree read from %s (hdu %s).\n", p->kdtreefile,
+               p->kdtreehdu);
+      return kdtree;
+    }
+
+  /* The tree has to be built: remove the old one (if it exists). */
+  if( match_catalog_kdtree_remove(p) && !p->cp.quiet )
+    printf("  - %s (hdu %s): first input has changed, k-d tree will be "
+           "built again.\n", p->kdtreefile, p->kdtreehdu);
+
+  /* Build the tree and write it. */
+  kdtree=gal_kdtree_create(p->cols1, root);
+  gal_kdtree_write(p->cols1, kdtree, *root, p->kdtreefile, p->kdtreehdu,
+                   p->cp.numthreads);
+  if(!p->cp.quiet)
+    printf("  - k-d tree written in %s (hdu %s).\n", p->kdtreefile,
+           p->kdtreehdu);
+  return kdtree;
 }
 
 
@@ -354,13 +428,25 @@ match_catalog(struct matchparams *p)
 {
   uint32_t *u, *uf;
   gal_data_t *tmp, *mcols;
-  gal_data_t *a=NULL, *b=NULL;
-  size_t nummatched, *acolmatch=NULL, *bcolmatch=NULL;
+  gal_data_t *a=NULL, *b=NULL, *kdtree=NULL;
+  size_t kdroot=0, nummatched, *acolmatch=NULL, *bcolmatch=NULL;
+
+  /* If a k-d tree file is given, get the tree of the first input. */
+  if(p->kdtreefile) kdtree=match_catalog_kdtree(p, &kdroot);
 
   /* Find the matching coordinates. We are doing the processing in
      place, */
-  mcols=gal_match_coordinates(p->cols1, p->cols2, p->aperture->array, 0, 1,
-                              p->cp.minmapsize, p->cp.quietmmap, &nummatched);
+  mcols = ( p->kdtree
+            ? gal_match_kdtree(p->cols1, p->cols2, kdtree, kdroot,
+                               p->aperture->array, 0, 1, p->cp.numthreads,
+                               p->cp.minmapsize, p->cp.quietmmap,
+                               &nummatched)
+            : gal_match_coordinates_threaded(p->cols1, p->cols2,
+                                             p->aperture->array, 0, 1,
+                                             p->cp.numthreads,
+                                             p->cp.minmapsize,
+                                             p->cp.quietmmap,
+                                             &nummatched) );
 
   /* If the output is to be taken from the input columns (it isn't just the
      log), then do the job. */
@@ -425,8 +511,8 @@ match_catalog(struct matchparams *p)
         "from 1).";
 
       /* Write them into the table. */
-      gal_table_write(mcols, NULL, NULL, p->cp.tableformat, p->logname,
-                      "LOG_INFO", 0);
+      gal_table_write_threaded(mcols, NULL, NULL, p->cp.tableformat,
+                               p->logname, "LOG_INFO", 0, p->cp.numthreads);
 
       /* Set the comment pointer to NULL: they weren't allocated. */
       mcols->comment=NULL;
@@ -434,6 +520,7 @@ match_catalog(struct matchparams *p)
     }
 
   /* Clean up. */
+  gal_list_data_free(kdtree);
   gal_list_data_free(mcols);
 
   /* Print the number of matches if not in quiet mode. */
@@ -26,8 +26,10 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <errno.h>
 #include <error.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <gnuastro/fits.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/timing.h>
 #include <gnuastro-internal/options.h>
@@ -119,7 +121,6 @@ ui_initialize_options(struct matchparams *p,
           cp->coptions[i].doc="Extension name or number of first input.";
           break;
         case GAL_OPTIONS_KEY_TYPE:
-        case GAL_OPTIONS_KEY_NUMTHREADS:
           cp->coptions[i].flags=OPTION_HIDDEN;
           break;
         }
@@ -281,6 +282,27 @@ ui_check_options_and_arguments(struct matchparams *p)
           "the '--hdu2' ('-H') option and give it the HDU number "
           "(starting from zero), extension name, or anything "
           "acceptable by CFITSIO");
+
+
+  /* The k-d tree file is only used in the k-d tree mode. When the first
+     input has changed, the HDU of the tree is written again, so it can't
+     be one of the inputs. */
+  if(p->kdtreefile)
+    {
+      if( (p->input1name && !strcmp(p->kdtreefile, p->input1name))
+          || (p->input2name && !strcmp(p->kdtreefile, p->input2name)) )
+        error(EXIT_FAILURE, 0, "%s: the value to '--kdtreefile' can't be "
+              "one of the inputs. It is a separate file that only keeps "
+              "the k-d tree of the first input", p->kdtreefile);
+      if( gal_fits_name_is_fits(p->kdtreefile)==0 )
+        error(EXIT_FAILURE, 0, "%s: the k-d tree file must be a FITS file "
+              "(have a '.fits' suffix for example)", p->kdtreefile);
+      if(p->kdtreehdu==NULL)
+        error(EXIT_FAILURE, 0, "no HDU for the k-d tree file. Please use "
+              "the '--kdtreehdu' option and give it the extension name "
+              "of the k-d tree in '%s'", p->kdtreefile);
+      p->kdtree=1;
+    }
 }
 
 
@@ -690,9 +712,8 @@ ui_read_columns_to_double(struct matchparams *p, char *filename, char *hdu,
   if(p->stdinlines==NULL)
     p->stdinlines=gal_options_check_stdin(filename, p->cp.stdintimeout,
                                           "input");
-  tout=gal_table_read(filename, hdu, filename ? NULL : p->stdinlines,
-                      cols, cp->searchin, cp->ignorecase, cp->minmapsize,
-                      p->cp.quietmmap, NULL);
+  tout=gal_options_table_read(cp, filename, hdu,
+                              filename ? NULL : p->stdinlines, cols, NULL);
 
   /* A small sanity check. */
   if(gal_list_data_number(tout)!=numcols)
@@ -1075,12 +1096,17 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct matchparams *p)
 void
 ui_free_report(struct matchparams *p, struct timeval *t1)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the allocated arrays: */
   free(p->cp.hdu);
   free(p->aperture);
   free(p->out1name);
   free(p->out2name);
   free(p->cp.output);
+  free(p->kdtreehdu);
+  free(p->kdtreefile);
   gal_data_free(p->ccol1);
   gal_data_free(p->ccol2);
   gal_list_data_free(p->cols1);
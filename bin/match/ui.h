@@ -57,6 +57,9 @@ enum option_keys_enum
      automatically). */
   UI_KEY_NOTMATCHED      = 1000,
   UI_KEY_OUTCOLS,
+  UI_KEY_KDTREE,
+  UI_KEY_KDTREEFILE,
+  UI_KEY_KDTREEHDU,
 };
 
 
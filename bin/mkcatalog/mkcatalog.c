@@ -143,17 +143,16 @@ mkcatalog_single_object(void *in_prm)
     pp.up_vals=NULL;
 
 
-  /* Fill the desired columns for all the objects given to this thread. */
-  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+  /* Fill the desired columns for all the objects given to this thread
+     (objects are given to the threads dynamically, see 'mkcatalog'). */
+  while( (i=gal_threads_index_next(tprm)) != GAL_BLANK_SIZE_T )
     {
       /* For easy reading. Note that the object IDs start from one while
          the array positions start from 0. */
       pp.ci       = NULL;
-      pp.object   = ( p->outlabs
-                      ? p->outlabs[ tprm->indexs[i] ]
-                      : tprm->indexs[i] + 1 );
-      pp.tile     = &p->tiles[   tprm->indexs[i] ];
-      pp.spectrum = &p->spectra[ tprm->indexs[i] ];
+      pp.object   = p->outlabs ? p->outlabs[i] : i + 1;
+      pp.tile     = &p->tiles[i];
+      pp.spectrum = &p->spectra[i];
 
       /* Initialize the parameters for this object/tile. */
       parse_initialize(&pp);
@@ -659,8 +658,9 @@ mkcatalog_write_outputs(struct mkcatalogparams *p)
       /* Reverse the comments list (so it is printed in the same order
          here), write the objects catalog and free the comments. */
       gal_list_str_reverse(&comments);
-      gal_table_write(p->objectcols, NULL, comments, p->cp.tableformat,
-                      p->objectsout, "OBJECTS", 0);
+      gal_table_write_threaded(p->objectcols, NULL, comments,
+                               p->cp.tableformat, p->objectsout, "OBJECTS", 0,
+                               p->cp.numthreads);
       gal_list_str_free(comments, 1);
 
 
@@ -676,8 +676,9 @@ mkcatalog_write_outputs(struct mkcatalogparams *p)
              Reverse the comments list (so it is printed in the same order
              here), write the objects catalog and free the comments. */
           gal_list_str_reverse(&comments);
-          gal_table_write(p->clumpcols, NULL, comments, p->cp.tableformat,
-                          p->clumpsout, "CLUMPS", 0);
+          gal_table_write_threaded(p->clumpcols, NULL, comments,
+                                   p->cp.tableformat, p->clumpsout, "CLUMPS",
+                                   0, p->cp.numthreads);
           gal_list_str_free(comments, 1);
         }
     }
@@ -706,17 +707,18 @@ mkcatalog_write_outputs(struct mkcatalogparams *p)
               {
                 /* Write the table. */
                 sprintf(str, "SPECTRUM_%zu", i+1);
-                gal_table_write(&p->spectra[i], NULL, NULL,
-                                GAL_TABLE_FORMAT_BFITS,
-                                p->objectsout, str, 0);
+                gal_table_write_threaded(&p->spectra[i], NULL, NULL,
+                                         GAL_TABLE_FORMAT_BFITS, p->objectsout,
+                                         str, 0, p->cp.numthreads);
               }
             else
               {
                 sprintf(str, "-spec-%zu.txt", i+1);
                 fname=gal_checkset_automatic_output(&p->cp, p->objectsout,
                                                     str);
-                gal_table_write(&p->spectra[i], NULL, NULL, GAL_TABLE_FORMAT_TXT,
-                                fname, NULL, 0);
+                gal_table_write_threaded(&p->spectra[i], NULL, NULL,
+                                         GAL_TABLE_FORMAT_TXT, fname, NULL, 0,
+                                         p->cp.numthreads);
                 free(fname);
               }
           }
@@ -790,14 +792,23 @@ mkcatalog_write_outputs(struct mkcatalogparams *p)
 void
 mkcatalog(struct mkcatalogparams *p)
 {
+  size_t i, *costs;
+
   /* When more than one thread is to be used, initialize the mutex: we need
      it to assign a column to the clumps in the final catalog. */
   if( p->cp.numthreads > 1 ) pthread_mutex_init(&p->mutex, NULL);
 
-  /* Do the processing on each thread. */
-  gal_threads_spin_off(mkcatalog_single_object, p, p->numobjects,
-                       p->cp.numthreads, p->cp.minmapsize,
-                       p->cp.quietmmap);
+  /* Do the processing on each thread. The processing time of each object
+     is roughly proportional to its area (the size of its tile), and in
+     crowded fields, a few very large objects can take much longer than
+     all the rest. So the objects are given to the threads dynamically
+     with the largest objects first. */
+  costs=gal_pointer_allocate(GAL_TYPE_SIZE_T, p->numobjects, 0, __func__,
+                             "costs");
+  for(i=0;i<p->numobjects;++i) costs[i]=p->tiles[i].size;
+  gal_threads_spin_off_dynamic(mkcatalog_single_object, p, p->numobjects,
+                               p->cp.numthreads, costs);
+  free(costs);
 
   /* Post-thread processing, for example to convert image coordinates to RA
      and Dec. */
@@ -422,8 +422,9 @@ parse_spectrum(struct mkcatalog_passparams *pp, gal_data_t *xybin)
   free(tsize);
 
   /* For a check.
-  gal_table_write(pp->spectrum, NULL, NULL, GAL_TABLE_FORMAT_BFITS,
-                  "spectrum.fits", "SPECTRUM", 0);
+  gal_table_write_threaded(pp->spectrum, NULL, NULL, GAL_TABLE_FORMAT_BFITS,
+                           "spectrum.fits", "SPECTRUM", 0,
+                           pp->p->cp.numthreads);
   */
 }
 
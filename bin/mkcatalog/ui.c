@@ -143,6 +143,7 @@ ui_initialize_options(struct mkcatalogparams *p,
         case GAL_OPTIONS_KEY_LOG:
         case GAL_OPTIONS_KEY_TYPE:
         case GAL_OPTIONS_KEY_SEARCHIN:
+        case GAL_OPTIONS_KEY_TABLECACHE:
         case GAL_OPTIONS_KEY_IGNORECASE:
         case GAL_OPTIONS_KEY_WORKOVERCH:
         case GAL_OPTIONS_KEY_STDINTIMEOUT:
@@ -814,8 +815,10 @@ ui_read_labels(struct mkcatalogparams *p)
   gal_data_t *tmp, *keys=gal_data_array_calloc(2);
 
   /* Read it into memory. */
-  p->objects = gal_array_read_one_ch(p->objectsfile, p->cp.hdu, NULL,
-                                     p->cp.minmapsize, p->cp.quietmmap);
+  p->objects = gal_array_read_one_ch_threaded(p->objectsfile, p->cp.hdu, NULL,
+                                              p->cp.numthreads,
+                                              p->cp.minmapsize,
+                                              p->cp.quietmmap);
   p->objects->ndim=gal_dimension_remove_extra(p->objects->ndim,
                                               p->objects->dsize, NULL);
 
@@ -891,9 +894,11 @@ ui_read_labels(struct mkcatalogparams *p)
               "configuration file", p->usedclumpsfile);
 
       /* Read the clumps image. */
-      p->clumps = gal_array_read_one_ch(p->usedclumpsfile, p->clumpshdu,
-                                        NULL, p->cp.minmapsize,
-                                        p->cp.quietmmap);
+      p->clumps = gal_array_read_one_ch_threaded(p->usedclumpsfile,
+                                                 p->clumpshdu, NULL,
+                                                 p->cp.numthreads,
+                                                 p->cp.minmapsize,
+                                                 p->cp.quietmmap);
       p->clumps->ndim=gal_dimension_remove_extra(p->clumps->ndim,
                                                  p->clumps->dsize, NULL);
 
@@ -1243,10 +1248,12 @@ ui_preparations_read_inputs(struct mkcatalogparams *p)
               "give the filename", p->usedvaluesfile);
 
       /* Read the values dataset. */
-      p->values=gal_array_read_one_ch_to_type(p->usedvaluesfile, p->valueshdu,
-                                              NULL, GAL_TYPE_FLOAT32,
-                                              p->cp.minmapsize,
-                                              p->cp.quietmmap);
+      p->values=gal_array_read_one_ch_to_type_threaded(p->usedvaluesfile,
+                                                       p->valueshdu, NULL,
+                                                       GAL_TYPE_FLOAT32,
+                                                       p->cp.numthreads,
+                                                       p->cp.minmapsize,
+                                                       p->cp.quietmmap);
       p->values->ndim=gal_dimension_remove_extra(p->values->ndim,
                                                  p->values->dsize, NULL);
 
@@ -1295,10 +1302,12 @@ ui_preparations_read_inputs(struct mkcatalogparams *p)
                   "give the filename", p->usedskyfile);
 
           /* Read the Sky dataset. */
-          p->sky=gal_array_read_one_ch_to_type(p->usedskyfile, p->skyhdu,
-                                               NULL, GAL_TYPE_FLOAT32,
-                                               p->cp.minmapsize,
-                                               p->cp.quietmmap);
+          p->sky=gal_array_read_one_ch_to_type_threaded(p->usedskyfile,
+                                                        p->skyhdu, NULL,
+                                                        GAL_TYPE_FLOAT32,
+                                                        p->cp.numthreads,
+                                                        p->cp.minmapsize,
+                                                        p->cp.quietmmap);
           p->sky->ndim=gal_dimension_remove_extra(p->sky->ndim,
                                                   p->sky->dsize, NULL);
 
@@ -1327,9 +1336,11 @@ ui_preparations_read_inputs(struct mkcatalogparams *p)
               p->usedstdfile);
 
       /* Read the Sky standard deviation image into memory. */
-      p->std=gal_array_read_one_ch_to_type(p->usedstdfile, p->stdhdu,
-                                           NULL, GAL_TYPE_FLOAT32,
-                                           p->cp.minmapsize, p->cp.quietmmap);
+      p->std=gal_array_read_one_ch_to_type_threaded(p->usedstdfile, p->stdhdu,
+                                                    NULL, GAL_TYPE_FLOAT32,
+                                                    p->cp.numthreads,
+                                                    p->cp.minmapsize,
+                                                    p->cp.quietmmap);
       p->std->ndim=gal_dimension_remove_extra(p->std->ndim,
                                               p->std->dsize, NULL);
 
@@ -1363,9 +1374,11 @@ ui_preparations_read_inputs(struct mkcatalogparams *p)
                   p->upmaskfile);
 
           /* Read the mask image. */
-          p->upmask = gal_array_read_one_ch(p->upmaskfile, p->upmaskhdu,
-                                            NULL, p->cp.minmapsize,
-                                            p->cp.quietmmap);
+          p->upmask = gal_array_read_one_ch_threaded(p->upmaskfile,
+                                                     p->upmaskhdu, NULL,
+                                                     p->cp.numthreads,
+                                                     p->cp.minmapsize,
+                                                     p->cp.quietmmap);
           p->upmask->ndim=gal_dimension_remove_extra(p->upmask->ndim,
                                                      p->upmask->dsize,
                                                      NULL);
@@ -1670,8 +1683,9 @@ ui_preparations_spectrum_wcs(struct mkcatalogparams *p)
   p->specsliceinfo->next=gal_data_copy_to_new_type(z, GAL_TYPE_FLOAT32);
 
   /* For a final check.
-  gal_table_write(p->specsliceinfo, NULL, NULL, GAL_TABLE_FORMAT_BFITS,
-                  "specsliceinfo.fits", "test-debug", 0);
+  gal_table_write_threaded(p->specsliceinfo, NULL, NULL,
+                           GAL_TABLE_FORMAT_BFITS, "specsliceinfo.fits",
+                           "test-debug", 0, p->cp.numthreads);
   */
 
   /* Clean up. */
@@ -1962,6 +1976,9 @@ ui_free_report(struct mkcatalogparams *p, struct timeval *t1)
 {
   size_t d, i;
 
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* The temporary arrays for WCS coordinates. */
   if(p->wcs_vo ) gal_list_data_free(p->wcs_vo);
   if(p->wcs_vc ) gal_list_data_free(p->wcs_vc);
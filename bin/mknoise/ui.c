@@ -32,6 +32,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/fits.h>
 #include <gnuastro/array.h>
 #include <gnuastro/table.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/timing.h>
 #include <gnuastro-internal/options.h>
@@ -132,6 +133,7 @@ ui_initialize_options(struct mknoiseparams *p,
           break;
 
         case GAL_OPTIONS_KEY_SEARCHIN:
+        case GAL_OPTIONS_KEY_TABLECACHE:
         case GAL_OPTIONS_KEY_TABLEFORMAT:
         case GAL_OPTIONS_KEY_STDINTIMEOUT:
           cp->coptions[i].flags=OPTION_HIDDEN;
@@ -308,9 +310,11 @@ void
 ui_preparations(struct mknoiseparams *p)
 {
   /* Read the input image as a double type */
-  p->input=gal_array_read_one_ch_to_type(p->inputname, p->cp.hdu, NULL,
-                                         GAL_TYPE_FLOAT64, p->cp.minmapsize,
-                                         p->cp.quietmmap);
+  p->input=gal_array_read_one_ch_to_type_threaded(p->inputname, p->cp.hdu,
+                                                  NULL, GAL_TYPE_FLOAT64,
+                                                  p->cp.numthreads,
+                                                  p->cp.minmapsize,
+                                                  p->cp.quietmmap);
   p->input->wcs=gal_wcs_read(p->inputname, p->cp.hdu, 0, 0, &p->input->nwcs);
   p->input->ndim=gal_dimension_remove_extra(p->input->ndim, p->input->dsize,
                                             p->input->wcs);
@@ -449,6 +453,9 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct mknoiseparams *p)
 void
 ui_free_report(struct mknoiseparams *p, struct timeval *t1)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the allocated arrays: */
   free(p->cp.hdu);
   free(p->cp.output);
@@ -35,6 +35,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/blank.h>
 #include <gnuastro/table.h>
 #include <gnuastro/pointer.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/timing.h>
 #include <gnuastro-internal/options.h>
@@ -674,9 +675,8 @@ ui_read_cols_2d(struct mkprofparams *p)
 
   /* Read the desired columns from the file. */
   lines=gal_options_check_stdin(p->catname, p->cp.stdintimeout, "input");
-  cols=gal_table_read(p->catname, p->cp.hdu, lines, colstrs, p->cp.searchin,
-                      p->cp.ignorecase, p->cp.minmapsize, p->cp.quietmmap,
-                      NULL);
+  cols=gal_options_table_read(&p->cp, p->catname, p->cp.hdu, lines,
+                              colstrs, NULL);
   gal_list_str_free(lines, 1);
 
   /* The name of the input catalog is only for informative steps from now
@@ -914,9 +914,8 @@ ui_read_cols_3d(struct mkprofparams *p)
 
   /* Read the desired columns from the file. */
   lines=gal_options_check_stdin(p->catname, p->cp.stdintimeout, "input");
-  cols=gal_table_read(p->catname, p->cp.hdu, lines, colstrs, p->cp.searchin,
-                      p->cp.ignorecase, p->cp.minmapsize, p->cp.quietmmap,
-                      NULL);
+  cols=gal_options_table_read(&p->cp, p->catname, p->cp.hdu, lines,
+                              colstrs, NULL);
   gal_list_str_free(lines, 1);
 
   /* Set the number of objects. */
@@ -1683,9 +1682,8 @@ ui_read_custom_table(struct mkprofparams *p)
   double *min, *max;
 
   /* Read the input radial table. */
-  cols=gal_table_read(p->customname, p->customhdu,
-                      NULL, NULL, p->cp.searchin, p->cp.ignorecase,
-                      p->cp.minmapsize, p->cp.quietmmap, NULL);
+  cols=gal_options_table_read(&p->cp, p->customname, p->customhdu, NULL,
+                              NULL, NULL);
 
   /* Make sure the table only has three columns. */
   if(gal_list_data_number(cols) != 3 )
@@ -1787,10 +1785,12 @@ ui_read_ndim(struct mkprofparams *p)
           else
             {
               /* Read the image. */
-              p->out=gal_array_read_one_ch_to_type(p->backname, p->backhdu,
-                                                   NULL, GAL_TYPE_FLOAT32,
-                                                   p->cp.minmapsize,
-                                                   p->cp.quietmmap);
+              p->out=gal_array_read_one_ch_to_type_threaded(p->backname,
+                                                            p->backhdu, NULL,
+                                                            GAL_TYPE_FLOAT32,
+                                                            p->cp.numthreads,
+                                                            p->cp.minmapsize,
+                                                            p->cp.quietmmap);
               p->out->ndim=gal_dimension_remove_extra(p->out->ndim,
                                                       p->out->dsize, NULL);
               p->ndim=p->out->ndim;
@@ -2039,6 +2039,9 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct mkprofparams *p)
 void
 ui_free_report(struct mkprofparams *p, struct timeval *t1)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free all the allocated arrays. */
   free(p->cat);
   free(p->cp.hdu);
@@ -92,7 +92,8 @@ detection_initial(struct noisechiselparams *p)
 
   /* Erode the image. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  gal_binary_erode(p->binary, p->erode, p->erodengb==4 ? 1 : 2, 1);
+  gal_binary_erode_threaded(p->binary, p->erode, p->erodengb==4 ? 1 : 2, 1,
+                            p->cp.numthreads);
   if(!p->cp.quiet)
     {
       if( asprintf(&msg, "Eroded %zu time%s (%zu-connected).", p->erode,
@@ -116,7 +117,8 @@ detection_initial(struct noisechiselparams *p)
 
   /* Do the opening. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  gal_binary_open(p->binary, p->opening, p->openingngb==4 ? 1 : 2, 1);
+  gal_binary_open_threaded(p->binary, p->opening, p->openingngb==4 ? 1 : 2,
+                           1, p->cp.numthreads);
   if(!p->cp.quiet)
     {
       if( asprintf(&msg, "Opened (depth: %zu, %zu-connected).",
@@ -137,8 +139,9 @@ detection_initial(struct noisechiselparams *p)
 
 
   /* Label the connected components. */
-  p->numinitialdets=gal_binary_connected_components(p->binary, &p->olabel,
-                                                    p->binary->ndim);
+  p->numinitialdets=gal_binary_connected_components_threaded(
+                                          p->binary, &p->olabel,
+                                          p->binary->ndim, p->cp.numthreads);
   if(p->detectionname)
     {
       p->olabel->name="OPENED_AND_LABELED";
@@ -444,7 +447,8 @@ detection_pseudo_find(struct noisechiselparams *p, gal_data_t *workbin,
       do if(*b==GAL_BLANK_UINT8) *b = !s0d1; while(++b<bf);
     }
   */
-  return gal_binary_connected_components(workbin, &worklab, con);
+  return gal_binary_connected_components_threaded(workbin, &worklab, con,
+                                                  p->cp.numthreads);
 }
 
 
@@ -1042,12 +1046,13 @@ detection_quantile_expand(struct noisechiselparams *p, gal_data_t *workbin)
       o=p->olabel->array;
       bf=(b=workbin->array)+workbin->size;
       do *b = (*o++ == 1); while(++b<bf);
-      workbin=gal_binary_dilate(workbin, 1, 1, 1);
+      workbin=gal_binary_dilate_threaded(workbin, 1, 1, 1, p->cp.numthreads);
       gal_binary_holes_fill(workbin, 1, p->detgrowmaxholesize);
 
       /* Get the labeled image. */
-      numexpanded=gal_binary_connected_components(workbin, &p->olabel,
-                                                  workbin->ndim);
+      numexpanded=gal_binary_connected_components_threaded(
+                                          workbin, &p->olabel,
+                                          workbin->ndim, p->cp.numthreads);
 
       /* Set all the input's blank pixels to blank in the labeled and
          binary arrays. */
@@ -225,8 +225,8 @@ threshold_write_sn_table(struct noisechiselparams *p, gal_data_t *insn,
      because when the output is a FITS table, we want all the tables in one
      FITS file. We have already deleted any existing file with the same
      name in 'ui_set_output_names'.*/
-  gal_table_write(cols, NULL, comments, p->cp.tableformat, filename,
-                  extname, 0);
+  gal_table_write_threaded(cols, NULL, comments, p->cp.tableformat, filename,
+                           extname, 0, p->cp.numthreads);
 
 
   /* Clean up (if necessary). */
@@ -398,8 +398,18 @@ qthresh_on_tile(void *in_prm)
   void *tarray=NULL;
   int type=qprm->erode_th->type;
   gal_data_t *meanconv = p->wconv ? p->wconv : p->conv;
+  double *q;
   size_t i, tind, twidth=gal_type_sizeof(type), ndim=p->input->ndim;
+  size_t numq = qprm->expand_th ? 3 : 2;
   gal_data_t *tile, *mean, *num, *meanquant, *qvalue, *usage, *tblock=NULL;
+  gal_data_t *quants=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &numq, NULL,
+                                    0, -1, 1, NULL, NULL, NULL);
+
+  /* The quantiles to find on each tile (all are found together). */
+  q=quants->array;
+  q[0]=p->qthresh;
+  q[1]=p->noerodequant;
+  if(qprm->expand_th) q[2]=p->detgrowquant;
 
   /* Put the temporary usage space for this thread into a data set for easy
      processing. */
@@ -467,28 +477,19 @@ qthresh_on_tile(void *in_prm)
               tile->array=tarray; tile->block=tblock;
             }
 
-          /* Get the erosion quantile for this tile and save it. Note that
-             the type of 'qvalue' is the same as the input dataset. */
-          qvalue=gal_statistics_quantile(usage, p->qthresh, 1);
+          /* Get the erosion, no-erode and expansion quantiles for this
+             tile (in this order) and save them. Note that the type of
+             'qvalue' is the same as the input dataset. */
+          qvalue=gal_statistics_quantile_multi(usage, quants, 1);
           memcpy(gal_pointer_increment(qprm->erode_th->array, tind, type),
                  qvalue->array, twidth);
-          gal_data_free(qvalue);
-
-          /* Same for the no-erode quantile. */
-          qvalue=gal_statistics_quantile(usage, p->noerodequant, 1);
           memcpy(gal_pointer_increment(qprm->noerode_th->array, tind, type),
-                 qvalue->array, twidth);
-          gal_data_free(qvalue);
-
-          /* Same for the expansion quantile. */
+                 gal_pointer_increment(qvalue->array, 1, type), twidth);
           if(qprm->expand_th)
-            {
-              qvalue=gal_statistics_quantile(usage, p->detgrowquant, 1);
-              memcpy(gal_pointer_increment(qprm->expand_th->array, tind,
-                                            type),
-                     qvalue->array, twidth);
-              gal_data_free(qvalue);
-            }
+            memcpy(gal_pointer_increment(qprm->expand_th->array, tind,
+                                          type),
+                   gal_pointer_increment(qvalue->array, 2, type), twidth);
+          gal_data_free(qvalue);
         }
       else
         {
@@ -510,6 +511,7 @@ qthresh_on_tile(void *in_prm)
   /* Clean up and wait for the other threads to finish, then return. */
   usage->array=NULL;  /* Not allocated here. */
   gal_data_free(usage);
+  gal_data_free(quants);
   if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
 }
@@ -128,6 +128,7 @@ ui_initialize_options(struct noisechiselparams *p,
         case GAL_OPTIONS_KEY_LOG:
         case GAL_OPTIONS_KEY_TYPE:
         case GAL_OPTIONS_KEY_SEARCHIN:
+        case GAL_OPTIONS_KEY_TABLECACHE:
         case GAL_OPTIONS_KEY_IGNORECASE:
         case GAL_OPTIONS_KEY_STDINTIMEOUT:
           cp->coptions[i].flags=OPTION_HIDDEN;
@@ -563,10 +564,11 @@ ui_preparations_read_input(struct noisechiselparams *p)
   /* Read the input as a single precision floating point dataset, also load
      the WCS and finally remove any possibly existing extra dimensions
      (with a length of 1). */
-  p->input = gal_array_read_one_ch_to_type(p->inputname, p->cp.hdu,
-                                           NULL, GAL_TYPE_FLOAT32,
-                                           p->cp.minmapsize,
-                                           p->cp.quietmmap);
+  p->input = gal_array_read_one_ch_to_type_threaded(p->inputname, p->cp.hdu,
+                                                    NULL, GAL_TYPE_FLOAT32,
+                                                    p->cp.numthreads,
+                                                    p->cp.minmapsize,
+                                                    p->cp.quietmmap);
   p->input->wcs = gal_wcs_read(p->inputname, p->cp.hdu, 0, 0,
                                &p->input->nwcs);
   p->input->ndim=gal_dimension_remove_extra(p->input->ndim,
@@ -634,10 +636,12 @@ ui_preparations(struct noisechiselparams *p)
   if(p->convolvedname)
     {
       /* Read the input convolved image. */
-      p->conv = gal_array_read_one_ch_to_type(p->convolvedname, p->chdu,
-                                              NULL, GAL_TYPE_FLOAT32,
-                                              p->cp.minmapsize,
-                                              p->cp.quietmmap);
+      p->conv = gal_array_read_one_ch_to_type_threaded(p->convolvedname,
+                                                       p->chdu, NULL,
+                                                       GAL_TYPE_FLOAT32,
+                                                       p->cp.numthreads,
+                                                       p->cp.minmapsize,
+                                                       p->cp.quietmmap);
 
       /* Make sure the convolved image is the same size as the input. */
       if( gal_dimension_is_different(p->input, p->conv) )
@@ -843,6 +847,9 @@ ui_abort_after_check(struct noisechiselparams *p, char *filename,
 void
 ui_free_report(struct noisechiselparams *p, struct timeval *t1)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the simply allocated spaces. */
   free(p->cp.hdu);
   free(p->maxtsize);
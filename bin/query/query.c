@@ -59,12 +59,13 @@ query_check_download(struct queryparams *p)
 
       /* Read the table and write it into a clean output (in case the
          downloaded table is compressed in any special FITS way). */
-      table=gal_table_read(p->downloadname, "1", NULL, NULL,
-                           GAL_TABLE_SEARCH_NAME, 1, p->cp.minmapsize,
-                           p->cp.quietmmap, NULL);
-      gal_table_write(table, NULL, NULL, p->cp.tableformat,
-                      p->cp.output ? p->cp.output : p->processedname,
-                      "QUERY", 0);
+      table=gal_table_read_threaded(p->downloadname, "1", NULL, NULL,
+                                    GAL_TABLE_SEARCH_NAME, 1,
+                                    p->cp.numthreads, p->cp.minmapsize,
+                                    p->cp.quietmmap, NULL);
+      gal_table_write_threaded(table, NULL, NULL, p->cp.tableformat,
+                               p->cp.output ? p->cp.output : p->processedname,
+                               "QUERY", 0, p->cp.numthreads);
 
       /* Delete the raw downloaded file. */
       remove(p->downloadname);
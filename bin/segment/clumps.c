@@ -298,7 +298,7 @@ clumps_find_make_sn_table(void *in_prm)
   gal_data_t *tile, *tblock, *tmp;
   uint8_t *binary=p->binary->array;
   struct clumps_thread_params cltprm;
-  size_t i, c, ind, tind, num, numsky, *indarr;
+  size_t c, ind, tind, num, numsky, *indarr;
   size_t *scoord=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__,
                                        "scoord");
   size_t *icoord=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__,
@@ -311,10 +311,10 @@ clumps_find_make_sn_table(void *in_prm)
 
 
   /* Go over all the tiles/detections given to this thread. */
-  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+  while( (tind=gal_threads_index_next(tprm)) != GAL_BLANK_SIZE_T )
     {
       /* IDs. */
-      cltprm.id = tind  = tprm->indexs[i];
+      cltprm.id = tind;
       tile = &p->ltl.tiles[tind];
 
 
@@ -539,8 +539,8 @@ clumps_write_sn_table(struct segmentparams *p, gal_data_t *insn,
   gal_table_comments_add_intro(&comments, PROGRAM_STRING, &p->rawtime);
 
   /* write the table. */
-  gal_table_write(cols, NULL, comments, p->cp.tableformat, filename,
-                  "SKY_CLUMP_SN", 0);
+  gal_table_write_threaded(cols, NULL, comments, p->cp.tableformat, filename,
+                           "SKY_CLUMP_SN", 0, p->cp.numthreads);
 
   /* Clean up (if necessary). */
   if(sn!=insn) gal_data_free(sn);
@@ -625,9 +625,9 @@ clumps_true_find_sn_thresh(struct segmentparams *p)
                    claborig->size*gal_type_sizeof(claborig->type));
 
           /* Do this step. */
-          gal_threads_spin_off(clumps_find_make_sn_table, &clprm,
-                               p->ltl.tottiles, p->cp.numthreads,
-                               p->cp.minmapsize, p->cp.quietmmap);
+          gal_threads_spin_off_dynamic(clumps_find_make_sn_table, &clprm,
+                                       p->ltl.tottiles, p->cp.numthreads,
+                                       NULL);
 
           /* Set the extension name. */
           switch(clprm.step)
@@ -658,9 +658,9 @@ clumps_true_find_sn_thresh(struct segmentparams *p)
   else
     {
       clprm.step=0;
-      gal_threads_spin_off(clumps_find_make_sn_table, &clprm,
-                           p->ltl.tottiles, p->cp.numthreads,
-                           p->cp.minmapsize, p->cp.quietmmap);
+      gal_threads_spin_off_dynamic(clumps_find_make_sn_table, &clprm,
+                                   p->ltl.tottiles, p->cp.numthreads,
+                                   NULL);
     }
 
 
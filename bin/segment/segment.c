@@ -541,12 +541,12 @@ segment_on_threads(void *in_prm)
   cltprm.clprm = clprm;
 
   /* Go over all the detections given to this thread (counting from zero.) */
-  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+  while( (i=gal_threads_index_next(tprm)) != GAL_BLANK_SIZE_T )
     {
       /* Set the ID of this detection, note that for the threads, we
          counted from zero, but the IDs start from 1, so we'll add a 1 to
          the ID given to this thread. */
-      cltprm.id     = tprm->indexs[i]+1;
+      cltprm.id     = i+1;
       cltprm.indexs = &clprm->labindexs[ cltprm.id ];
       cltprm.numinitclumps = cltprm.numtrueclumps = cltprm.numobjects = 0;
 
@@ -801,8 +801,9 @@ segment_save_sn_table(struct clumps_params *clprm)
   /* Set the column pointers and write them into a table.. */
   clumpinobj->next=sn;
   objind->next=clumpinobj;
-  gal_table_write(objind, NULL, comments, p->cp.tableformat, p->clumpsn_d_name,
-                  "DET_CLUMP_SN", 0);
+  gal_table_write_threaded(objind, NULL, comments, p->cp.tableformat,
+                           p->clumpsn_d_name, "DET_CLUMP_SN", 0,
+                           p->cp.numthreads);
 
 
   /* Clean up. */
@@ -877,6 +878,7 @@ static void
 segment_detections(struct segmentparams *p)
 {
   char *msg;
+  size_t i, *costs;
   struct clumps_params clprm;
   gal_data_t *labindexs, *claborig, *demo=NULL;
 
@@ -886,6 +888,14 @@ segment_detections(struct segmentparams *p)
                              p->cp.quietmmap);
 
 
+  /* The detections are given to the threads dynamically (largest first),
+     since a few very large detections can take much longer than all the
+     others. The cost of each detection is its number of pixels. */
+  costs=gal_pointer_allocate(GAL_TYPE_SIZE_T, p->numdetections, 0, __func__,
+                             "costs");
+  for(i=0;i<p->numdetections;++i) costs[i]=labindexs[i+1].size;
+
+
   /* Initialize the necessary thread parameters. Note that since the object
      labels begin from one, the 'sn' array will have one extra element.*/
   clprm.p=p;
@@ -933,9 +943,9 @@ segment_detections(struct segmentparams *p)
                    claborig->size*gal_type_sizeof(claborig->type));
 
           /* (Re-)do everything until this step. */
-          gal_threads_spin_off(segment_on_threads, &clprm,
-                               p->numdetections, p->cp.numthreads,
-                               p->cp.minmapsize, p->cp.quietmmap);
+          gal_threads_spin_off_dynamic(segment_on_threads, &clprm,
+                                       p->numdetections, p->cp.numthreads,
+                                       costs);
 
           /* Set the extension name. */
           switch(clprm.step)
@@ -1061,9 +1071,9 @@ segment_detections(struct segmentparams *p)
   else
     {
       clprm.step=0;
-      gal_threads_spin_off(segment_on_threads, &clprm, p->numdetections,
-                           p->cp.numthreads, p->cp.minmapsize,
-                           p->cp.quietmmap);
+      gal_threads_spin_off_dynamic(segment_on_threads, &clprm,
+                                   p->numdetections, p->cp.numthreads,
+                                   costs);
     }
 
 
@@ -1086,6 +1096,7 @@ segment_detections(struct segmentparams *p)
 
 
   /* Clean up allocated structures and destroy the mutex. */
+  free(costs);
   gal_data_array_free(clprm.sn, p->numdetections+1, 1);
   gal_data_array_free(labindexs, p->numdetections+1, 1);
   if( p->cp.numthreads>1 ) pthread_mutex_destroy(&clprm.labmutex);
@@ -135,6 +135,7 @@ ui_initialize_options(struct segmentparams *p,
         case GAL_OPTIONS_KEY_LOG:
         case GAL_OPTIONS_KEY_TYPE:
         case GAL_OPTIONS_KEY_SEARCHIN:
+        case GAL_OPTIONS_KEY_TABLECACHE:
         case GAL_OPTIONS_KEY_IGNORECASE:
         case GAL_OPTIONS_KEY_STDINTIMEOUT:
           cp->coptions[i].flags=OPTION_HIDDEN;
@@ -409,9 +410,11 @@ ui_prepare_inputs(struct segmentparams *p)
   gal_data_t *maxd, *ccin, *blankflag, *ccout=NULL;
 
   /* Read the input as a single precision floating point dataset. */
-  p->input = gal_array_read_one_ch_to_type(p->inputname, p->cp.hdu,
-                                           NULL, GAL_TYPE_FLOAT32,
-                                           p->cp.minmapsize, p->cp.quietmmap);
+  p->input = gal_array_read_one_ch_to_type_threaded(p->inputname, p->cp.hdu,
+                                                    NULL, GAL_TYPE_FLOAT32,
+                                                    p->cp.numthreads,
+                                                    p->cp.minmapsize,
+                                                    p->cp.quietmmap);
   p->input->wcs = gal_wcs_read(p->inputname, p->cp.hdu, 0, 0,
                                &p->input->nwcs);
   p->input->ndim=gal_dimension_remove_extra(p->input->ndim,
@@ -438,10 +441,12 @@ ui_prepare_inputs(struct segmentparams *p)
   if(p->convolvedname)
     {
       /* Read the input convolved image. */
-      p->conv = gal_array_read_one_ch_to_type(p->convolvedname, p->chdu,
-                                              NULL, GAL_TYPE_FLOAT32,
-                                              p->cp.minmapsize,
-                                              p->cp.quietmmap);
+      p->conv = gal_array_read_one_ch_to_type_threaded(p->convolvedname,
+                                                       p->chdu, NULL,
+                                                       GAL_TYPE_FLOAT32,
+                                                       p->cp.numthreads,
+                                                       p->cp.minmapsize,
+                                                       p->cp.quietmmap);
       p->conv->ndim=gal_dimension_remove_extra(p->conv->ndim,
                                                p->conv->dsize,
                                                p->conv->wcs);
@@ -461,9 +466,10 @@ ui_prepare_inputs(struct segmentparams *p)
   if( strcmp(p->useddetectionname, DETECTION_ALL) )
     {
       /* Read the dataset into memory. */
-      p->olabel = gal_array_read_one_ch(p->useddetectionname, p->dhdu,
-                                        NULL, p->cp.minmapsize,
-                                        p->cp.quietmmap);
+      p->olabel = gal_array_read_one_ch_threaded(p->useddetectionname, p->dhdu,
+                                                 NULL, p->cp.numthreads,
+                                                 p->cp.minmapsize,
+                                                 p->cp.quietmmap);
       p->olabel->ndim=gal_dimension_remove_extra(p->olabel->ndim,
                                                  p->olabel->dsize, NULL);
       if( gal_dimension_is_different(p->input, p->olabel) )
@@ -505,8 +511,9 @@ ui_prepare_inputs(struct segmentparams *p)
       if( p->numdetections == 1 )
         {
           ccin=gal_data_copy_to_new_type_free(p->olabel, GAL_TYPE_UINT8);
-          p->numdetections=gal_binary_connected_components(ccin, &ccout,
-                                                           ccin->ndim);
+          p->numdetections=gal_binary_connected_components_threaded(ccin,
+                                                 &ccout, ccin->ndim,
+                                                 p->cp.numthreads);
           gal_data_free(ccin);
           p->olabel=ccout;
         }
@@ -756,9 +763,11 @@ ui_read_std_and_sky(struct segmentparams *p)
               "option)");
 
       /* Read the STD image. */
-      p->std=gal_array_read_one_ch_to_type(p->usedstdname, p->stdhdu,
-                                           NULL, GAL_TYPE_FLOAT32,
-                                           p->cp.minmapsize, p->cp.quietmmap);
+      p->std=gal_array_read_one_ch_to_type_threaded(p->usedstdname, p->stdhdu,
+                                                    NULL, GAL_TYPE_FLOAT32,
+                                                    p->cp.numthreads,
+                                                    p->cp.minmapsize,
+                                                    p->cp.quietmmap);
       p->std->ndim=gal_dimension_remove_extra(p->std->ndim,
                                               p->std->dsize, NULL);
 
@@ -816,9 +825,11 @@ ui_read_std_and_sky(struct segmentparams *p)
                   "HDU will be necessary");
 
           /* Read the Sky dataset. */
-          sky=gal_array_read_one_ch_to_type(p->skyname, p->skyhdu,
-                                            NULL, GAL_TYPE_FLOAT32,
-                                            p->cp.minmapsize, p->cp.quietmmap);
+          sky=gal_array_read_one_ch_to_type_threaded(p->skyname, p->skyhdu,
+                                                     NULL, GAL_TYPE_FLOAT32,
+                                                     p->cp.numthreads,
+                                                     p->cp.minmapsize,
+                                                     p->cp.quietmmap);
           sky->ndim=gal_dimension_remove_extra(sky->ndim, sky->dsize,
                                                NULL);
 
@@ -1062,6 +1073,9 @@ ui_abort_after_check(struct segmentparams *p, char *filename,
 void
 ui_free_report(struct segmentparams *p, struct timeval *t1)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the allocated arrays: */
   free(p->cp.hdu);
   free(p->cp.output);
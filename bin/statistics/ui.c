@@ -862,9 +862,8 @@ ui_read_columns(struct statisticsparams *p)
   else           columnlist=incols;
 
   /* Read the desired column(s). */
-  cols=gal_table_read(p->inputname, p->cp.hdu, lines, columnlist,
-                      p->cp.searchin, p->cp.ignorecase, p->cp.minmapsize,
-                      p->cp.quietmmap, NULL);
+  cols=gal_options_table_read(&p->cp, p->inputname, p->cp.hdu, lines,
+                              columnlist, NULL);
   gal_list_str_free(lines, 1);
 
   /* If the input was from standard input, we'll set the input name to be
@@ -959,8 +958,9 @@ ui_preparations(struct statisticsparams *p)
   if(p->isfits && p->hdu_type==IMAGE_HDU)
     {
       p->inputformat=INPUT_FORMAT_IMAGE;
-      p->input=gal_array_read_one_ch(p->inputname, cp->hdu, NULL,
-                                     cp->minmapsize, p->cp.quietmmap);
+      p->input=gal_array_read_one_ch_threaded(p->inputname, cp->hdu, NULL,
+                                              cp->numthreads, cp->minmapsize,
+                                              p->cp.quietmmap);
       p->input->wcs=gal_wcs_read(p->inputname, cp->hdu, 0, 0,
                                  &p->input->nwcs);
       p->input->ndim=gal_dimension_remove_extra(p->input->ndim,
@@ -1008,8 +1008,9 @@ ui_preparations(struct statisticsparams *p)
             {
               gal_checkset_writable_remove(tl->tilecheckname, 0,
                                            cp->dontdelete);
-              gal_table_write(check, NULL, NULL, cp->tableformat, tl->tilecheckname,
-                              "TABLE", 0);
+              gal_table_write_threaded(check, NULL, NULL, cp->tableformat,
+                                       tl->tilecheckname, "TABLE", 0,
+                                       cp->numthreads);
             }
           gal_data_free(check);
         }
@@ -1179,6 +1180,9 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct statisticsparams *p)
 void
 ui_free_report(struct statisticsparams *p)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the allocated arrays: */
   free(p->cp.hdu);
   free(p->cp.output);
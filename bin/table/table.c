@@ -635,9 +635,8 @@ table_catcolumn(struct tableparams *p)
       else hdu=NULL;
 
       /* Read the catcolumn table. */
-      tocat=gal_table_read(filell->v, hdu, NULL, p->catcolumns, cp->searchin,
-                           cp->ignorecase, cp->minmapsize, p->cp.quietmmap,
-                           NULL);
+      tocat=gal_options_table_read(cp, filell->v, hdu, NULL, p->catcolumns,
+                                   NULL);
 
       /* Check the number of rows. */
       if(tocat->dsize[0]!=p->table->dsize[0])
@@ -869,6 +868,7 @@ table(struct tableparams *p)
   if(p->noblank) table_noblank(p);
 
   /* Write the output. */
-  gal_table_write(p->table, NULL, NULL, p->cp.tableformat, p->cp.output,
-                  "TABLE", p->colinfoinstdout);
+  gal_table_write_threaded(p->table, NULL, NULL, p->cp.tableformat,
+                           p->cp.output, "TABLE", p->colinfoinstdout,
+                           p->cp.numthreads);
 }
@@ -127,6 +127,7 @@ ui_initialize_options(struct warpparams *p,
           break;
 
         case GAL_OPTIONS_KEY_SEARCHIN:
+        case GAL_OPTIONS_KEY_TABLECACHE:
         case GAL_OPTIONS_KEY_TABLEFORMAT:
         case GAL_OPTIONS_KEY_STDINTIMEOUT:
           cp->coptions[i].flags=OPTION_HIDDEN;
@@ -346,10 +347,11 @@ ui_check_options_and_arguments(struct warpparams *p)
               "by CFITSIO)");
 
       /* Read the input image as double type and its WCS structure. */
-      p->input=gal_array_read_one_ch_to_type(p->inputname, p->cp.hdu,
-                                             NULL, GAL_TYPE_FLOAT64,
-                                             p->cp.minmapsize,
-                                             p->cp.quietmmap);
+      p->input=gal_array_read_one_ch_to_type_threaded(p->inputname, p->cp.hdu,
+                                                      NULL, GAL_TYPE_FLOAT64,
+                                                      p->cp.numthreads,
+                                                      p->cp.minmapsize,
+                                                      p->cp.quietmmap);
 
       /* Read the WCS and remove one-element wide dimension(s). */
       p->input->wcs=gal_wcs_read(p->inputname, p->cp.hdu, p->hstartwcs,
@@ -1049,6 +1051,9 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct warpparams *p)
 void
 ui_free_report(struct warpparams *p, struct timeval *t1)
 {
+  /* Stop the threads of the pool (if any were used). */
+  gal_threads_pool_free();
+
   /* Free the allocated arrays: */
   free(p->cp.hdu);
   free(p->cp.output);
@@ -32,6 +32,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/fits.h>
 #include <gnuastro/polygon.h>
 #include <gnuastro/pointer.h>
+#include <gnuastro/threads.h>
 
 #include "main.h"
 #include "warp.h"
@@ -115,8 +116,8 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 static void *
 warp_onthread(void *inparam)
 {
-  struct iwpparams *iwp=(struct iwpparams*)inparam;
-  struct warpparams *p=iwp->p;
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct warpparams *p=(struct warpparams *)(tprm->params);
 
   size_t *extinds=p->extinds, *ordinds=p->ordinds;
   long is0=p->input->dsize[0], is1=p->input->dsize[1];
@@ -126,7 +127,7 @@ warp_onthread(void *inparam)
   double ocrn[8], icrn_base[8], icrn[8], *output=p->output->array;
   double pcrn[8], *outfpixval=p->outfpixval, ccrn[GAL_POLYGON_MAX_CORNERS];
 
-  for(i=0; (ind=iwp->indexs[i])!=GAL_BLANK_SIZE_T; ++i)
+  for(i=0; (ind=tprm->indexs[i])!=GAL_BLANK_SIZE_T; ++i)
     {
       /* Initialize the output pixel value: */
       numinput=0;
@@ -253,9 +254,7 @@ warp_onthread(void *inparam)
 
 
   /* Wait until all other threads finish. */
-  if(p->cp.numthreads>1)
-    pthread_barrier_wait(iwp->b);
-
+  if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
 }
 
@@ -519,69 +518,13 @@ correct_wcs_save_output(struct warpparams *p)
 void
 warp(struct warpparams *p)
 {
-  int err;
-  pthread_t t;          /* All thread ids saved in this, not used. */
-  char *mmapname;
-  pthread_attr_t attr;
-  pthread_barrier_t b;
-  struct iwpparams *iwp;
-  size_t nt=p->cp.numthreads;
-  size_t i, nb, *indexs, thrdcols;
-
-
-  /* Array keeping thread parameters for each thread. */
-  errno=0;
-  iwp=malloc(nt*sizeof *iwp);
-  if(iwp==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for iwp",
-          __func__, nt*sizeof *iwp);
-
-
   /* Prepare the output array and all the necessary things: */
   warp_preparations(p);
 
 
-  /* Distribute the output pixels into the threads: */
-  mmapname=gal_threads_dist_in_threads(p->output->size, nt,
-                                       p->cp.minmapsize, p->cp.quietmmap,
-                                       &indexs, &thrdcols);
-
-
-  /* Start the warp. */
-  if(nt==1)
-    {
-      iwp[0].p=p;
-      iwp[0].indexs=indexs;
-      warp_onthread(&iwp[0]);
-    }
-  else
-    {
-      /* Initialize the attributes. Note that this running thread
-         (that spinns off the nt threads) is also a thread, so the
-         number the barrier should be one more than the number of
-         threads spinned off. */
-      if(p->output->size<nt) nb=p->output->size+1;
-      else                   nb=nt+1;
-      gal_threads_attr_barrier_init(&attr, &b, nb);
-
-      /* Spin off the threads: */
-      for(i=0;i<nt;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            iwp[i].p=p;
-            iwp[i].b=&b;
-            iwp[i].indexs=&indexs[i*thrdcols];
-            err=pthread_create(&t, &attr, warp_onthread, &iwp[i]);
-            if(err)
-              error(EXIT_FAILURE, 0, "%s: can't create thread %zu",
-                    __func__, i);
-          }
-
-      /* Wait for all threads to finish and free the spaces. */
-      pthread_barrier_wait(&b);
-      pthread_attr_destroy(&attr);
-      pthread_barrier_destroy(&b);
-    }
+  /* Do the warping on multiple threads. */
+  gal_threads_spin_off(warp_onthread, p, p->output->size, p->cp.numthreads,
+                       p->cp.minmapsize, p->cp.quietmmap);
 
 
   /* Save the output. */
@@ -590,9 +533,6 @@ warp(struct warpparams *p)
     printf(" Output: %s\n", p->cp.output);
 
 
-  /* Free the allocated spaces, note that 'indexs' may be memory-mapped. */
-  free(iwp);
+  /* Free the allocated spaces. */
   gal_data_free(p->output);
-  if(mmapname) gal_pointer_mmap_free(&mmapname, p->cp.quietmmap);
-  else         free(indexs);
 }
@@ -31,18 +31,6 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #define RELATIVEFLTERROR 1e-6
 
 
-/* Internal structure. */
-struct iwpparams
-{
-  /* General input parameters: */
-  struct warpparams *p;
-
-  /* Thread parameters. */
-  size_t          *indexs;    /* Indexs to be used in this thread.     */
-  pthread_barrier_t    *b;    /* Barrier to keep threads waiting.      */
-};
-
-
 /* Extenal functions. */
 void
 warp(struct warpparams *p);
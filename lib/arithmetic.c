@@ -39,6 +39,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/statistics.h>
 #include <gnuastro/arithmetic.h>
 
+#include <gnuastro-internal/arithmetic-binary.h>
 #include <gnuastro-internal/arithmetic-internal.h>
 
 /* Headers for each binary operator. Since they heavily involve macros,
@@ -121,6 +122,144 @@ arithmetic_check_float_input(gal_data_t *in, int operator, char *numstr)
 
 
 
+/***********************************************************************/
+/***************        Element-wise multi-threading      **************/
+/***********************************************************************/
+/* Minimum number of elements in each chunk of an element-wise operation
+   and the number of chunks to aim for on each thread. */
+#define ARITHMETIC_CHUNK_MIN        65536
+#define ARITHMETIC_CHUNK_PER_THREAD 4
+
+/* Parameters for element-wise operators on threads: the output is broken
+   into chunks of contiguous elements and the operator is applied on each
+   chunk independently (through 'func'). */
+struct arithmetic_elementwise_p
+{
+  int          operator;   /* Operator code.                             */
+  int             param;   /* Operator-specific parameter.               */
+  size_t      chunksize;   /* Number of elements in each chunk.          */
+  gal_data_t         *o;   /* Output dataset.                            */
+  gal_data_t         *a;   /* First operand.                             */
+  gal_data_t         *b;   /* Second operand (can be NULL).              */
+  void  (*func)(struct arithmetic_elementwise_p *, gal_data_t *,
+                gal_data_t *, gal_data_t *);  /* Operation on a chunk.   */
+};
+
+
+
+
+
+/* Set 'chunk' to be a one-dimensional view into 'size' elements of 'in',
+   starting from 'start'. Single-element operands are used for all the
+   elements, so they are kept untouched. Note that 'chunk' doesn't own its
+   array, it shouldn't be freed. */
+static void
+arithmetic_elementwise_chunk(gal_data_t *in, gal_data_t *chunk,
+                             size_t start, size_t size)
+{
+  *chunk=*in;
+  chunk->ndim=1;
+  chunk->next=NULL;
+  chunk->block=NULL;
+  if(in->size>1)
+    {
+      chunk->size=size;
+      chunk->array=gal_pointer_increment(in->array, start, in->type);
+
+      /* When the full dataset has blank values, a chunk may not have any,
+         so let it be checked independently. */
+      if(in->flag & GAL_DATA_FLAG_HASBLANK)
+        chunk->flag &= ~(GAL_DATA_FLAG_BLANK_CH | GAL_DATA_FLAG_HASBLANK);
+    }
+  chunk->dsize=&chunk->size;
+}
+
+
+
+
+
+/* Worker function on each thread. */
+static void *
+arithmetic_elementwise_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct arithmetic_elementwise_p *p=
+    (struct arithmetic_elementwise_p *)tprm->params;
+
+  size_t i, start, size;
+  gal_data_t o, a, b;
+
+  /* Go over all the chunks that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Set the range of this chunk (the last one may be smaller). */
+      start=tprm->indexs[i]*p->chunksize;
+      size = ( start+p->chunksize > p->o->size
+               ? p->o->size-start : p->chunksize );
+
+      /* Set the views into the datasets and do the operation. */
+      arithmetic_elementwise_chunk(p->o, &o, start, size);
+      arithmetic_elementwise_chunk(p->a, &a, start, size);
+      if(p->b) arithmetic_elementwise_chunk(p->b, &b, start, size);
+      p->func(p, &o, &a, p->b ? &b : NULL);
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Apply the element-wise operation in 'p' over the given number of
+   threads. Small datasets (where the overhead of threads is larger than
+   the operation itself) are done directly. */
+static void
+arithmetic_elementwise(struct arithmetic_elementwise_p *p,
+                       size_t numthreads)
+{
+  size_t numchunks;
+
+  /* If the dataset is small or only one thread is requested, just call
+     the function on the full dataset. */
+  if(numthreads<=1 || p->o->size < 2*ARITHMETIC_CHUNK_MIN)
+    {
+      p->func(p, p->o, p->a, p->b);
+      return;
+    }
+
+  /* A few chunks per thread keep the threads balanced when some are
+     slower (for example, when their chunk has blank values). */
+  p->chunksize = p->o->size / (ARITHMETIC_CHUNK_PER_THREAD*numthreads);
+  if(p->chunksize<ARITHMETIC_CHUNK_MIN) p->chunksize=ARITHMETIC_CHUNK_MIN;
+  numchunks = (p->o->size + p->chunksize - 1) / p->chunksize;
+
+  /* Spin-off the threads. */
+  gal_threads_spin_off(arithmetic_elementwise_on_thread, p, numchunks,
+                       numthreads, p->o->minmapsize, p->o->quietmmap);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /***********************************************************************/
 /***************        Unary functions/operators         **************/
 /***********************************************************************/
@@ -489,12 +628,61 @@ arithmetic_units_degree_to_dec(double decimal)
     do *oa++ = OP(*ia++); while(ia<iaf);                                \
 }
 
+/* Apply the unary function on one chunk of the input ('in' may also be
+   the full dataset). */
+static void
+arithmetic_unary_function_chunk(struct arithmetic_elementwise_p *p,
+                                gal_data_t *o, gal_data_t *in,
+                                gal_data_t *unused)
+{
+  switch(p->operator)
+    {
+    case GAL_ARITHMETIC_OP_SQRT:
+      UNIARY_FUNCTION_ON_ELEMENT( sqrt );
+      break;
+
+    case GAL_ARITHMETIC_OP_LOG:
+      UNIARY_FUNCTION_ON_ELEMENT( log );
+      break;
+
+    case GAL_ARITHMETIC_OP_LOG10:
+      UNIARY_FUNCTION_ON_ELEMENT( log10 );
+      break;
+
+    case GAL_ARITHMETIC_OP_RA_TO_DEGREE:
+      UNIFUNC_RUN_FUNCTION_ON_ELEMENT_STRING(double, gal_units_ra_to_degree);
+      break;
+
+    case GAL_ARITHMETIC_OP_DEC_TO_DEGREE:
+      UNIFUNC_RUN_FUNCTION_ON_ELEMENT_STRING(double, gal_units_dec_to_degree);
+      break;
+
+    case GAL_ARITHMETIC_OP_DEGREE_TO_RA:
+      UNIARY_FUNCTION_ON_ELEMENT_OUTPUT_STRING(arithmetic_units_degree_to_ra);
+      break;
+
+    case GAL_ARITHMETIC_OP_DEGREE_TO_DEC:
+      UNIARY_FUNCTION_ON_ELEMENT_OUTPUT_STRING(arithmetic_units_degree_to_dec);
+      break;
+
+    default:
+      error(EXIT_FAILURE, 0, "%s: operator code %d not recognized",
+            __func__, p->operator);
+    }
+}
+
+
+
+
+
 static gal_data_t *
-arithmetic_unary_function(int operator, int flags, gal_data_t *in)
+arithmetic_unary_function(int operator, int flags, gal_data_t *in,
+                          size_t numthreads)
 {
   uint8_t otype;
   int inplace=0;
   gal_data_t *o;
+  struct arithmetic_elementwise_p ep;
 
   /* See if the operation should be done in place. Note that so far, the
      output of these operators is defined in the real space (floating
@@ -533,41 +721,15 @@ arithmetic_unary_function(int operator, int flags, gal_data_t *in)
                          NULL, NULL, NULL);
     }
 
-  /* Start setting the operator and operands. */
-  switch(operator)
-    {
-    case GAL_ARITHMETIC_OP_SQRT:
-      UNIARY_FUNCTION_ON_ELEMENT( sqrt );
-      break;
-
-    case GAL_ARITHMETIC_OP_LOG:
-      UNIARY_FUNCTION_ON_ELEMENT( log );
-      break;
-
-    case GAL_ARITHMETIC_OP_LOG10:
-      UNIARY_FUNCTION_ON_ELEMENT( log10 );
-      break;
-
-    case GAL_ARITHMETIC_OP_RA_TO_DEGREE:
-      UNIFUNC_RUN_FUNCTION_ON_ELEMENT_STRING(double, gal_units_ra_to_degree);
-      break;
-
-    case GAL_ARITHMETIC_OP_DEC_TO_DEGREE:
-      UNIFUNC_RUN_FUNCTION_ON_ELEMENT_STRING(double, gal_units_dec_to_degree);
-      break;
-
-    case GAL_ARITHMETIC_OP_DEGREE_TO_RA:
-      UNIARY_FUNCTION_ON_ELEMENT_OUTPUT_STRING(arithmetic_units_degree_to_ra);
-      break;
-
-    case GAL_ARITHMETIC_OP_DEGREE_TO_DEC:
-      UNIARY_FUNCTION_ON_ELEMENT_OUTPUT_STRING(arithmetic_units_degree_to_dec);
-      break;
-
-    default:
-      error(EXIT_FAILURE, 0, "%s: operator code %d not recognized",
-            __func__, operator);
-    }
+  /* Do the operation. The string conversions use non-reentrant
+     functions of the C library, so they are only done on one thread. */
+  ep.operator=operator;
+  ep.o=o; ep.a=in; ep.b=NULL;
+  ep.func=arithmetic_unary_function_chunk;
+  arithmetic_elementwise(&ep, ( operator==GAL_ARITHMETIC_OP_SQRT
+                                || operator==GAL_ARITHMETIC_OP_LOG
+                                || operator==GAL_ARITHMETIC_OP_LOG10 )
+                         ? numthreads : 1);
 
 
   /* Clean up. Note that if the input arrays can be freed, and any of right
@@ -771,12 +933,42 @@ arithmetic_size(int operator, int flags, gal_data_t *in, gal_data_t *arg)
 
 
 
+/* Apply the 'where' operator on one chunk of the datasets. */
+static void
+arithmetic_where_chunk(struct arithmetic_elementwise_p *p, gal_data_t *out,
+                       gal_data_t *cond, gal_data_t *iftrue)
+{
+  int chb=p->param;    /* Read as: "Condition-Has-Blank" */
+  unsigned char *c=cond->array, cb=GAL_BLANK_UINT8;
+
+  switch(out->type)
+    {
+    case GAL_TYPE_UINT8:         WHERE_OUT_SET( uint8_t  );      break;
+    case GAL_TYPE_INT8:          WHERE_OUT_SET( int8_t   );      break;
+    case GAL_TYPE_UINT16:        WHERE_OUT_SET( uint16_t );      break;
+    case GAL_TYPE_INT16:         WHERE_OUT_SET( int16_t  );      break;
+    case GAL_TYPE_UINT32:        WHERE_OUT_SET( uint32_t );      break;
+    case GAL_TYPE_INT32:         WHERE_OUT_SET( int32_t  );      break;
+    case GAL_TYPE_UINT64:        WHERE_OUT_SET( uint64_t );      break;
+    case GAL_TYPE_INT64:         WHERE_OUT_SET( int64_t  );      break;
+    case GAL_TYPE_FLOAT32:       WHERE_OUT_SET( float    );      break;
+    case GAL_TYPE_FLOAT64:       WHERE_OUT_SET( double   );      break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized for the 'out'",
+            __func__, out->type);
+    }
+}
+
+
+
+
+
 static void
 arithmetic_where(int flags, gal_data_t *out, gal_data_t *cond,
-                 gal_data_t *iftrue)
+                 gal_data_t *iftrue, size_t numthreads)
 {
   int chb;    /* Read as: "Condition-Has-Blank" */
-  unsigned char *c=cond->array, cb=GAL_BLANK_UINT8;
+  struct arithmetic_elementwise_p ep;
 
   /* The condition operator has to be unsigned char. */
   if(cond->type!=GAL_TYPE_UINT8)
@@ -794,22 +986,10 @@ arithmetic_where(int flags, gal_data_t *out, gal_data_t *cond,
   chb=gal_blank_present(cond, 0);
 
   /* Do the operation. */
-  switch(out->type)
-    {
-    case GAL_TYPE_UINT8:         WHERE_OUT_SET( uint8_t  );      break;
-    case GAL_TYPE_INT8:          WHERE_OUT_SET( int8_t   );      break;
-    case GAL_TYPE_UINT16:        WHERE_OUT_SET( uint16_t );      break;
-    case GAL_TYPE_INT16:         WHERE_OUT_SET( int16_t  );      break;
-    case GAL_TYPE_UINT32:        WHERE_OUT_SET( uint32_t );      break;
-    case GAL_TYPE_INT32:         WHERE_OUT_SET( int32_t  );      break;
-    case GAL_TYPE_UINT64:        WHERE_OUT_SET( uint64_t );      break;
-    case GAL_TYPE_INT64:         WHERE_OUT_SET( int64_t  );      break;
-    case GAL_TYPE_FLOAT32:       WHERE_OUT_SET( float    );      break;
-    case GAL_TYPE_FLOAT64:       WHERE_OUT_SET( double   );      break;
-    default:
-      error(EXIT_FAILURE, 0, "%s: type code %d not recognized for the 'out'",
-            __func__, out->type);
-    }
+  ep.param=chb;
+  ep.o=out; ep.a=cond; ep.b=iftrue;
+  ep.func=arithmetic_where_chunk;
+  arithmetic_elementwise(&ep, numthreads);
 
   /* Clean up if necessary. */
   if(flags & GAL_ARITHMETIC_FREE)
@@ -1528,8 +1708,109 @@ arithmetic_binary_out_type(int operator, gal_data_t *l, gal_data_t *r)
 
 
 
+/* Same-type floating point operands have a fast path for the basic
+   operators (see the description of 'BINARY_FLT_OP_OT_IT_SET'). */
+#define BINARY_FLT_SET(IT)                                              \
+  switch(operator)                                                      \
+    {                                                                   \
+    case GAL_ARITHMETIC_OP_PLUS:                                        \
+      BINARY_FLT_OP_OT_IT_SET(+,  IT,      IT);   break;                \
+    case GAL_ARITHMETIC_OP_MINUS:                                       \
+      BINARY_FLT_OP_OT_IT_SET(-,  IT,      IT);   break;                \
+    case GAL_ARITHMETIC_OP_MULTIPLY:                                    \
+      BINARY_FLT_OP_OT_IT_SET(*,  IT,      IT);   break;                \
+    case GAL_ARITHMETIC_OP_DIVIDE:                                      \
+      BINARY_FLT_OP_OT_IT_SET(/,  IT,      IT);   break;                \
+    case GAL_ARITHMETIC_OP_LT:                                          \
+      BINARY_FLT_OP_OT_IT_SET(<,  uint8_t, IT);   break;                \
+    case GAL_ARITHMETIC_OP_LE:                                          \
+      BINARY_FLT_OP_OT_IT_SET(<=, uint8_t, IT);   break;                \
+    case GAL_ARITHMETIC_OP_GT:                                          \
+      BINARY_FLT_OP_OT_IT_SET(>,  uint8_t, IT);   break;                \
+    case GAL_ARITHMETIC_OP_GE:                                          \
+      BINARY_FLT_OP_OT_IT_SET(>=, uint8_t, IT);   break;                \
+    case GAL_ARITHMETIC_OP_EQ:                                          \
+      BINARY_FLT_OP_OT_IT_SET(==, uint8_t, IT);   break;                \
+    case GAL_ARITHMETIC_OP_NE:                                          \
+      BINARY_FLT_OP_OT_IT_SET(!=, uint8_t, IT);   break;                \
+    default:                                                            \
+      return 0;                                                         \
+    }
+
+/* If the operator and inputs can use the fast path, do the operation and
+   return 1, otherwise return 0. */
+static int
+arithmetic_binary_flt(int operator, gal_data_t *l, gal_data_t *r,
+                      gal_data_t *o)
+{
+  /* Both inputs should have the same floating point type. The output's
+     type is also checked because it is possible to call this function
+     with a pre-allocated output. */
+  if( l->type!=r->type
+      || (l->type!=GAL_TYPE_FLOAT32 && l->type!=GAL_TYPE_FLOAT64)
+      || o->type!=arithmetic_binary_out_type(operator, l, r) )
+    return 0;
+
+  /* Do the operation. */
+  switch(l->type)
+    {
+    case GAL_TYPE_FLOAT32: BINARY_FLT_SET( float  );   break;
+    case GAL_TYPE_FLOAT64: BINARY_FLT_SET( double );   break;
+    }
+  return 1;
+}
+
+
+
+
+
+/* Apply the binary operator on one chunk of the operands ('l' and 'r' may
+   also be the full datasets). */
+static void
+arithmetic_binary_chunk(struct arithmetic_elementwise_p *p, gal_data_t *o,
+                        gal_data_t *l, gal_data_t *r)
+{
+  /* Use the floating point fast path if possible. */
+  if( arithmetic_binary_flt(p->operator, l, r, o) ) return;
+
+  /* Call the proper function for the operator. Since they heavily involve
+     macros, their compilation can be very large if they are in a single
+     function and file. So there is a separate C source and header file for
+     each of these functions. */
+  switch(p->operator)
+    {
+    case GAL_ARITHMETIC_OP_PLUS:     arithmetic_plus(l, r, o);     break;
+    case GAL_ARITHMETIC_OP_MINUS:    arithmetic_minus(l, r, o);    break;
+    case GAL_ARITHMETIC_OP_MULTIPLY: arithmetic_multiply(l, r, o); break;
+    case GAL_ARITHMETIC_OP_DIVIDE:   arithmetic_divide(l, r, o);   break;
+    case GAL_ARITHMETIC_OP_LT:       arithmetic_lt(l, r, o);       break;
+    case GAL_ARITHMETIC_OP_LE:       arithmetic_le(l, r, o);       break;
+    case GAL_ARITHMETIC_OP_GT:       arithmetic_gt(l, r, o);       break;
+    case GAL_ARITHMETIC_OP_GE:       arithmetic_ge(l, r, o);       break;
+    case GAL_ARITHMETIC_OP_EQ:       arithmetic_eq(l, r, o);       break;
+    case GAL_ARITHMETIC_OP_NE:       arithmetic_ne(l, r, o);       break;
+    case GAL_ARITHMETIC_OP_AND:      arithmetic_and(l, r, o);      break;
+    case GAL_ARITHMETIC_OP_OR:       arithmetic_or(l, r, o);       break;
+    case GAL_ARITHMETIC_OP_BITAND:   arithmetic_bitand(l, r, o);   break;
+    case GAL_ARITHMETIC_OP_BITOR:    arithmetic_bitor(l, r, o);    break;
+    case GAL_ARITHMETIC_OP_BITXOR:   arithmetic_bitxor(l, r, o);   break;
+    case GAL_ARITHMETIC_OP_BITLSH:   arithmetic_bitlsh(l, r, o);   break;
+    case GAL_ARITHMETIC_OP_BITRSH:   arithmetic_bitrsh(l, r, o);   break;
+    case GAL_ARITHMETIC_OP_MODULO:   arithmetic_modulo(l, r, o);   break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! please contact us at %s to address "
+            "the problem. %d is not a valid operator code", __func__,
+            PACKAGE_BUGREPORT, p->operator);
+    }
+}
+
+
+
+
+
 static gal_data_t *
-arithmetic_binary(int operator, int flags, gal_data_t *l, gal_data_t *r)
+arithmetic_binary(int operator, int flags, gal_data_t *l, gal_data_t *r,
+                  size_t numthreads)
 {
   /* Read the variable arguments. 'lo' and 'ro' keep the original data, in
      case their type isn't built (based on configure options are configure
@@ -1537,6 +1818,7 @@ arithmetic_binary(int operator, int flags, gal_data_t *l, gal_data_t *r)
   int32_t otype;
   gal_data_t *o=NULL;
   size_t out_size, minmapsize;
+  struct arithmetic_elementwise_p ep;
   int quietmmap=l->quietmmap && r->quietmmap;
 
 
@@ -1586,35 +1868,11 @@ arithmetic_binary(int operator, int flags, gal_data_t *l, gal_data_t *r)
                        0, minmapsize, quietmmap, NULL, NULL, NULL );
 
 
-  /* Call the proper function for the operator. Since they heavily involve
-     macros, their compilation can be very large if they are in a single
-     function and file. So there is a separate C source and header file for
-     each of these functions. */
-  switch(operator)
-    {
-    case GAL_ARITHMETIC_OP_PLUS:     arithmetic_plus(l, r, o);     break;
-    case GAL_ARITHMETIC_OP_MINUS:    arithmetic_minus(l, r, o);    break;
-    case GAL_ARITHMETIC_OP_MULTIPLY: arithmetic_multiply(l, r, o); break;
-    case GAL_ARITHMETIC_OP_DIVIDE:   arithmetic_divide(l, r, o);   break;
-    case GAL_ARITHMETIC_OP_LT:       arithmetic_lt(l, r, o);       break;
-    case GAL_ARITHMETIC_OP_LE:       arithmetic_le(l, r, o);       break;
-    case GAL_ARITHMETIC_OP_GT:       arithmetic_gt(l, r, o);       break;
-    case GAL_ARITHMETIC_OP_GE:       arithmetic_ge(l, r, o);       break;
-    case GAL_ARITHMETIC_OP_EQ:       arithmetic_eq(l, r, o);       break;
-    case GAL_ARITHMETIC_OP_NE:       arithmetic_ne(l, r, o);       break;
-    case GAL_ARITHMETIC_OP_AND:      arithmetic_and(l, r, o);      break;
-    case GAL_ARITHMETIC_OP_OR:       arithmetic_or(l, r, o);       break;
-    case GAL_ARITHMETIC_OP_BITAND:   arithmetic_bitand(l, r, o);   break;
-    case GAL_ARITHMETIC_OP_BITOR:    arithmetic_bitor(l, r, o);    break;
-    case GAL_ARITHMETIC_OP_BITXOR:   arithmetic_bitxor(l, r, o);   break;
-    case GAL_ARITHMETIC_OP_BITLSH:   arithmetic_bitlsh(l, r, o);   break;
-    case GAL_ARITHMETIC_OP_BITRSH:   arithmetic_bitrsh(l, r, o);   break;
-    case GAL_ARITHMETIC_OP_MODULO:   arithmetic_modulo(l, r, o);   break;
-    default:
-      error(EXIT_FAILURE, 0, "%s: a bug! please contact us at %s to address "
-            "the problem. %d is not a valid operator code", __func__,
-            PACKAGE_BUGREPORT, operator);
-    }
+  /* Do the operation (possibly over multiple threads). */
+  ep.operator=operator;
+  ep.o=o; ep.a=l; ep.b=r;
+  ep.func=arithmetic_binary_chunk;
+  arithmetic_elementwise(&ep, numthreads);
 
 
   /* Clean up if necessary. Note that if the operation was requested to be
@@ -2135,7 +2393,7 @@ gal_arithmetic(int operator, size_t numthreads, int flags, ...)
     case GAL_ARITHMETIC_OP_OR:
       d1 = va_arg(va, gal_data_t *);
       d2 = va_arg(va, gal_data_t *);
-      out=arithmetic_binary(operator, flags, d1, d2);
+      out=arithmetic_binary(operator, flags, d1, d2, numthreads);
       break;
 
     case GAL_ARITHMETIC_OP_NOT:
@@ -2153,7 +2411,7 @@ gal_arithmetic(int operator, size_t numthreads, int flags, ...)
       d1 = va_arg(va, gal_data_t *);    /* To modify value/array.     */
       d2 = va_arg(va, gal_data_t *);    /* Condition (unsigned char). */
       d3 = va_arg(va, gal_data_t *);    /* If true value/array.       */
-      arithmetic_where(flags, d1, d2, d3);
+      arithmetic_where(flags, d1, d2, d3, numthreads);
       out=d1;
       break;
 
@@ -2167,7 +2425,7 @@ gal_arithmetic(int operator, size_t numthreads, int flags, ...)
     case GAL_ARITHMETIC_OP_DEGREE_TO_RA:
     case GAL_ARITHMETIC_OP_DEGREE_TO_DEC:
       d1 = va_arg(va, gal_data_t *);
-      out=arithmetic_unary_function(operator, flags, d1);
+      out=arithmetic_unary_function(operator, flags, d1, numthreads);
       break;
 
     /* Statistical operators that return one value. */
@@ -2224,7 +2482,7 @@ gal_arithmetic(int operator, size_t numthreads, int flags, ...)
     case GAL_ARITHMETIC_OP_MODULO:
       d1 = va_arg(va, gal_data_t *);
       d2 = va_arg(va, gal_data_t *);
-      out=arithmetic_binary(operator, flags, d1, d2);
+      out=arithmetic_binary(operator, flags, d1, d2, numthreads);
       break;
 
     case GAL_ARITHMETIC_OP_BITNOT:
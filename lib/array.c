@@ -88,12 +88,29 @@ gal_array_name_recognized_multiext(char *name)
 gal_data_t *
 gal_array_read(char *filename, char *extension, gal_list_str_t *lines,
                size_t minmapsize, int quietmmap)
+{
+  return gal_array_read_threaded(filename, extension, lines, 1, minmapsize,
+                                 quietmmap);
+}
+
+
+
+
+
+/* Similar to 'gal_array_read', but 'numthreads' threads may be used to
+   read the file. It is currently only used for tile-compressed FITS
+   images and plain text images. */
+gal_data_t *
+gal_array_read_threaded(char *filename, char *extension,
+                        gal_list_str_t *lines, size_t numthreads,
+                        size_t minmapsize, int quietmmap)
 {
   size_t ext;
 
   /* FITS  */
   if( gal_fits_name_is_fits(filename) )
-    return gal_fits_img_read(filename, extension, minmapsize, quietmmap);
+    return gal_fits_img_read_threaded(filename, extension, numthreads,
+                                      minmapsize, quietmmap);
 
   /* TIFF */
   else if ( gal_tiff_name_is_tiff(filename) )
@@ -108,7 +125,8 @@ gal_array_read(char *filename, char *extension, gal_list_str_t *lines,
 
   /* Default: plain text. */
   else
-    return gal_txt_image_read(filename, lines, minmapsize, quietmmap);
+    return gal_txt_image_read_threaded(filename, lines, numthreads,
+                                       minmapsize, quietmmap);
 
   /* Control should not get to here, but just to avoid compiler warnings,
      we'll return a NULL. */
@@ -127,10 +145,27 @@ gal_data_t *
 gal_array_read_to_type(char *filename, char *extension,
                        gal_list_str_t *lines, uint8_t type,
                        size_t minmapsize, int quietmmap)
+{
+  return gal_array_read_to_type_threaded(filename, extension, lines, type,
+                                         1, minmapsize, quietmmap);
+}
+
+
+
+
+
+/* Similar to 'gal_array_read_to_type', but using 'numthreads' threads to
+   read the file (see 'gal_array_read_threaded'). */
+gal_data_t *
+gal_array_read_to_type_threaded(char *filename, char *extension,
+                                gal_list_str_t *lines, uint8_t type,
+                                size_t numthreads, size_t minmapsize,
+                                int quietmmap)
 {
   gal_data_t *out=NULL;
-  gal_data_t *next, *in=gal_array_read(filename, extension, lines,
-                                       minmapsize, quietmmap);
+  gal_data_t *next, *in=gal_array_read_threaded(filename, extension, lines,
+                                                numthreads, minmapsize,
+                                                quietmmap);
 
   /* Go over all the channels. */
   while(in)
@@ -154,10 +189,26 @@ gal_array_read_to_type(char *filename, char *extension,
 gal_data_t *
 gal_array_read_one_ch(char *filename, char *extension, gal_list_str_t *lines,
                       size_t minmapsize, int quietmmap)
+{
+  return gal_array_read_one_ch_threaded(filename, extension, lines, 1,
+                                        minmapsize, quietmmap);
+}
+
+
+
+
+
+/* Similar to 'gal_array_read_one_ch', but using 'numthreads' threads to
+   read the file (see 'gal_array_read_threaded'). */
+gal_data_t *
+gal_array_read_one_ch_threaded(char *filename, char *extension,
+                               gal_list_str_t *lines, size_t numthreads,
+                               size_t minmapsize, int quietmmap)
 {
   char *fname;
   gal_data_t *out;
-  out=gal_array_read(filename, extension, lines, minmapsize, quietmmap);
+  out=gal_array_read_threaded(filename, extension, lines, numthreads,
+                              minmapsize, quietmmap);
 
   if(out->next)
     {
@@ -191,8 +242,26 @@ gal_array_read_one_ch_to_type(char *filename, char *extension,
                               gal_list_str_t *lines, uint8_t type,
                               size_t minmapsize, int quietmmap)
 {
-  gal_data_t *out=gal_array_read_one_ch(filename, extension, lines,
-                                        minmapsize, quietmmap);
+  return gal_array_read_one_ch_to_type_threaded(filename, extension, lines,
+                                                type, 1, minmapsize,
+                                                quietmmap);
+}
+
+
+
+
+
+/* Similar to 'gal_array_read_one_ch_to_type', but using 'numthreads'
+   threads to read the file (see 'gal_array_read_threaded'). */
+gal_data_t *
+gal_array_read_one_ch_to_type_threaded(char *filename, char *extension,
+                                       gal_list_str_t *lines, uint8_t type,
+                                       size_t numthreads, size_t minmapsize,
+                                       int quietmmap)
+{
+  gal_data_t *out=gal_array_read_one_ch_threaded(filename, extension, lines,
+                                                 numthreads, minmapsize,
+                                                 quietmmap);
 
   return gal_data_copy_to_new_type_free(out, type);
 }
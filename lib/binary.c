@@ -32,6 +32,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/tile.h>
 #include <gnuastro/blank.h>
 #include <gnuastro/binary.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/dimension.h>
 
@@ -46,175 +47,406 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /*********************************************************************/
 /*****************      Erosion and dilation      ********************/
 /*********************************************************************/
+/* In 2D, the erosion and dilation are done on bit-packed copies of the
+   input: each row is kept as 'nw' 64-bit words (one bit per pixel, the
+   extra bits in the last word are always zero). Two such "planes" are
+   necessary: the pixels with the value that is spreading ('f', one for
+   dilation, zero for erosion) and the pixels that can change ('b'); any
+   other value (for example blank) is in neither plane, so it is left
+   unchanged and doesn't spread (like the non-packed function below).
+
+   In each iteration, a 'b' pixel that has an 'f' neighbor becomes 'f'.
+   The 'f' neighbors of all the pixels in a word are found with a few
+   shifts, ANDs and ORs over the word and its two neighboring words (in
+   the row and in the rows above and below).
+
+   The rows are divided into strips for the threads. Several iterations
+   are done on each strip in one pass (without going back to the full
+   image): each strip is copied into a thread-local buffer with
+   'numiter' extra rows (halo) on each side and after 'numiter' iterations
+   within the buffer, the rows of the strip are correct (any error from
+   the missing rows beyond the halo can only move one row in each
+   iteration).
+
+   When the number of iterations is large and the dataset only has 0s and
+   1s, a distance transform is used instead: a pixel is changed when its
+   distance to the nearest 'f' pixel is not larger than the number of
+   iterations (the city-block distance for 4-connectivity and the
+   chessboard distance for 8-connectivity). */
+#define BINARY_ED_WORD         64  /* Number of pixels in a word.       */
+#define BINARY_ED_BATCH         8  /* Max iterations in one pass.       */
+#define BINARY_ED_STRIP_ROWS  128  /* Max rows in a strip.              */
+#define BINARY_ED_STRIPS_PER_THREAD 4
+#define BINARY_ED_DT_MIN       32  /* Min iterations for distances.     */
+#define BINARY_ED_COL_BLOCK    64  /* Columns in one distance action.   */
+
+enum binary_ed_steps
+{
+  BINARY_ED_PACK,
+  BINARY_ED_ITERATE,
+  BINARY_ED_UNPACK,
+  BINARY_ED_DT_COLUMNS,
+  BINARY_ED_DT_ROWS,
+};
+
+struct binary_ed_params
+{
+  int                 step;  /* Step to do (from 'binary_ed_steps').     */
+  int         connectivity;  /* Connectivity (1 or 2).                   */
+  uint8_t             f, b;  /* Spreading and changing values.           */
+  uint8_t             *byt;  /* Input/output array.                      */
+  size_t            nr, nc;  /* Number of rows and columns.              */
+  size_t                nw;  /* Number of words in each row.             */
+  size_t         striprows;  /* Number of rows in each strip.            */
+  size_t           numiter;  /* Number of iterations (in this pass).     */
+  uint64_t         *fi, *bi; /* Input 'f' and 'b' planes.                */
+  uint64_t         *fo, *bo; /* Output 'f' and 'b' planes.               */
+  uint64_t              *f0; /* Initial 'f' plane.                       */
+  uint64_t            *fsp;  /* Spare 'f' plane (to keep 'f0').          */
+  uint32_t           *dist;  /* Distances (for the distance transform).  */
+  uint32_t             cap;  /* Largest distance that is kept.           */
+};
+
+
+
+
+
+/* Put the pixels of one row (with 'f' or 'b' values) in their planes. */
 static void
-binary_erode_dilate_2d_4con(gal_data_t *input, int dilate0_erode1)
+binary_ed_pack_row(struct binary_ed_params *p, size_t row)
 {
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-  size_t i, j, ind, nr=input->dsize[0], nc=input->dsize[1];
+  uint8_t f=p->f, b=p->b, *byt=p->byt+row*p->nc;
+  size_t j, w, k, nc=p->nc, nw=p->nw;
+  uint64_t fw, bw, *frow=p->fi+row*nw, *brow=p->bi+row*nw;
 
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can "
-          "fix this problem. The value to 'dilate0_erode1' is %u while it "
-          "should be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
+  for(w=0;w<nw;++w)
+    {
+      fw=bw=0;
+      k = (w+1)*BINARY_ED_WORD < nc ? BINARY_ED_WORD : nc-w*BINARY_ED_WORD;
+      for(j=0;j<k;++j)
+        {
+          fw |= (uint64_t)(byt[j]==f) << j;
+          bw |= (uint64_t)(byt[j]==b) << j;
+        }
+      frow[w]=fw;
+      brow[w]=bw;
+      byt+=k;
+    }
+}
 
-  /* Set the foreground and background values. */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else                  {f=0; b=1;}
 
-  /* Check the 4 corners: */
-  if(byt[0]==b && (byt[1]==f || byt[nc]==f) )
-    byt[0]=GAL_BINARY_TMP_VALUE;
 
-  if(byt[nc-1]==b && (byt[nc-2]==f || byt[2*nc-1]==f))
-    byt[nc-1]=GAL_BINARY_TMP_VALUE;
 
-  if(byt[(nr-1)*nc]==b
-     && (byt[(nr-2)*nc]==f || byt[(nr-1)*nc+1]==f) )
-    byt[(nr-1)*nc]=GAL_BINARY_TMP_VALUE;
 
-  if(byt[nr*nc-1]==b
-     && (byt[nr*nc-2]==f || byt[nr*nc-1-nc]==f) )
-    byt[nr*nc-1]=GAL_BINARY_TMP_VALUE;
+/* Write the changed pixels of one row into the output: they are the
+   pixels that are now in the 'f' plane, but weren't initially. */
+static void
+binary_ed_unpack_row(struct binary_ed_params *p, size_t row)
+{
+  size_t j, w, nw=p->nw;
+  uint8_t *byt=p->byt+row*p->nc;
+  uint64_t cw, *frow=p->fi+row*nw, *f0row=p->f0+row*nw;
+
+  for(w=0;w<nw;++w)
+    if( (cw = frow[w] & ~f0row[w]) )
+      for(j=0;j<BINARY_ED_WORD;++j)
+        if( cw>>j & 1 )
+          byt[w*BINARY_ED_WORD+j]=p->f;
+}
 
-  /* Check the 4 sides: */
-  for(j=1;j<nc-1;++j)
-    if(byt[j]==b
-       && (byt[j+1]==f || byt[j-1]==f || byt[j+nc]==f) )
-      byt[j]=GAL_BINARY_TMP_VALUE;
 
-  for(j=1;j<nc-1;++j)
-    {
-      ind=(nr-1)*nc+j;
-      if(byt[ind]==b
-         && (byt[ind+1]==f || byt[ind-1]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
 
-  for(i=1;i<nr-1;++i)
-    {
-      ind=i*nc;
-      if(byt[ind]==b
-         && (byt[ind+1]==f || byt[ind+nc]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
 
-  for(i=1;i<nr-1;++i)
+
+/* Horizontal neighborhood of a row (every pixel or its left/right
+   neighbor). */
+static inline uint64_t
+binary_ed_horizontal(uint64_t *row, size_t w, size_t nw)
+{
+  uint64_t out = row[w] | row[w]<<1 | row[w]>>1;
+  if(w)      out |= row[w-1] >> (BINARY_ED_WORD-1);
+  if(w<nw-1) out |= row[w+1] << (BINARY_ED_WORD-1);
+  return out;
+}
+
+
+
+
+
+/* Do 'p->numiter' iterations on one strip of rows. 'work' has space for
+   the strip (with its halo) in both planes and two extra rows. */
+static void
+binary_ed_strip(struct binary_ed_params *p, size_t strip, uint64_t *work)
+{
+  uint64_t n, change, *tmp;
+  size_t i, w, it, nw=p->nw, h=p->numiter;
+  size_t r0=strip*p->striprows;
+  size_t r1= r0+p->striprows < p->nr ? r0+p->striprows : p->nr;
+  size_t a = r0>h ? r0-h : 0, c = r1+h < p->nr ? r1+h : p->nr;
+  uint64_t *F=work, *B=work+(c-a)*nw, *prev=B+(c-a)*nw, *save=prev+nw;
+  uint64_t *up, *down;
+
+  /* Copy the strip and its halo into the work buffer. */
+  memcpy(F, p->fi+a*nw, (c-a)*nw*sizeof *F);
+  memcpy(B, p->bi+a*nw, (c-a)*nw*sizeof *B);
+
+  /* Do the iterations. Rows are updated in place, so the original 'f'
+     plane of the previous row is kept in 'prev'. */
+  for(it=0;it<h;++it)
     {
-      ind=(i+1)*nc-1;
-      if(byt[ind]==b
-         && (byt[ind-1]==f || byt[ind+nc]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+      for(i=0;i<c-a;++i)
+        {
+          up   = i ? prev : NULL;
+          down = i<c-a-1 ? F+(i+1)*nw : NULL;
+          memcpy(save, F+i*nw, nw*sizeof *save);
+          for(w=0;w<nw;++w)
+            {
+              if(B[i*nw+w]==0) continue;
+              if(p->connectivity==1)
+                {
+                  n=binary_ed_horizontal(save, w, nw);
+                  if(up)   n |= up[w];
+                  if(down) n |= down[w];
+                }
+              else
+                {
+                  n=binary_ed_horizontal(save, w, nw);
+                  if(up)   n |= binary_ed_horizontal(up, w, nw);
+                  if(down) n |= binary_ed_horizontal(down, w, nw);
+                }
+              change = B[i*nw+w] & n;
+              F[i*nw+w] |= change;
+              B[i*nw+w] &= ~change;
+            }
+          tmp=prev; prev=save; save=tmp;
+        }
     }
 
-  /* Check the body: */
-  for(i=1;i<nr-1;++i)
-    for(j=1;j<nc-1;++j)
-      {
-        ind=i*nc+j;
-        if(byt[ind]==b
-           && (byt[ind-1]==f     || byt[ind+1]==f
-               || byt[ind+nc]==f || byt[ind-nc]==f) )
-          byt[ind]=GAL_BINARY_TMP_VALUE;
-      }
+  /* Write the strip's rows into the output planes. */
+  memcpy(p->fo+r0*nw, F+(r0-a)*nw, (r1-r0)*nw*sizeof *F);
+  memcpy(p->bo+r0*nw, B+(r0-a)*nw, (r1-r0)*nw*sizeof *B);
+}
 
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+nr*nc;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
+
+
+
+
+/* Distance of the pixels in a block of columns to the nearest 'f' pixel
+   in the same column (limited to 'p->cap'). */
+static void
+binary_ed_dt_columns(struct binary_ed_params *p, size_t block)
+{
+  uint32_t *d=p->dist, cap=p->cap;
+  size_t i, j, nr=p->nr, nc=p->nc, j0=block*BINARY_ED_COL_BLOCK;
+  size_t j1 = j0+BINARY_ED_COL_BLOCK < nc ? j0+BINARY_ED_COL_BLOCK : nc;
+
+  /* From the top. */
+  for(j=j0;j<j1;++j)
+    d[j] = p->byt[j]==p->f ? 0 : cap;
+  for(i=1;i<nr;++i)
+    for(j=j0;j<j1;++j)
+      d[i*nc+j] = ( p->byt[i*nc+j]==p->f
+                    ? 0
+                    : ( d[(i-1)*nc+j] < cap ? d[(i-1)*nc+j]+1 : cap ) );
+
+  /* From the bottom. */
+  for(i=nr-1;i>0;--i)
+    for(j=j0;j<j1;++j)
+      if( d[i*nc+j]+1 < d[(i-1)*nc+j] )
+        d[(i-1)*nc+j] = d[i*nc+j]+1;
 }
 
 
 
 
 
-/* 8 connected dilation and erosion. b0_f1==0: Dilate the
-   foreground. b0_f1==1: Erode the foreground. */
+/* Using the distances within each column, find the distance of every
+   pixel in a row to the nearest 'f' pixel and change the row's pixels. */
 static void
-binary_erode_dilate_2d_8con(gal_data_t *input, unsigned char dilate0_erode1)
+binary_ed_dt_rows(struct binary_ed_params *p, size_t row)
 {
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-  size_t i, j, ind, nr=input->dsize[0], nc=input->dsize[1];
+  size_t j, nc=p->nc;
+  uint32_t *d=p->dist+row*nc, cap=p->cap;
+  uint8_t *byt=p->byt+row*nc;
+
+  /* For the chessboard distance, we only need to know if there is an 'f'
+     pixel within the column's range. */
+  if(p->connectivity==2)
+    for(j=0;j<nc;++j)
+      d[j] = d[j]<=p->numiter ? 0 : cap;
+
+  /* From the left and from the right. */
+  for(j=1;j<nc;++j)
+    if( d[j-1]+1 < d[j] ) d[j]=d[j-1]+1;
+  for(j=nc-1;j>0;--j)
+    if( d[j]+1 < d[j-1] ) d[j-1]=d[j]+1;
+
+  /* Change the pixels. */
+  for(j=0;j<nc;++j)
+    if( byt[j]==p->b && d[j]<=p->numiter )
+      byt[j]=p->f;
+}
 
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can fix "
-          "this problem. The value to dilate0_erode1 is %u while it should "
-          "be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
 
-  /* Set the foreground and background values: */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else                  {f=0; b=1;}
 
-  /* Check the 4 corners: */
-  if(byt[0]==b && (byt[1]==f
-                   || byt[nc]==f || byt[nc+1]==f) )
-    byt[0]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[nc-1]==b && (byt[nc-2]==f
-                      || byt[2*nc-1]==f
-                      || byt[2*nc-2]==f) )
-    byt[nc-1]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[(nr-1)*nc]==b
-     && ( byt[(nr-2)*nc]==f || byt[(nr-1)*nc+1]==f
-          || byt[(nr-2)*nc+1]==f) )
-    byt[(nr-1)*nc]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[nr*nc-1]==b
-     && ( byt[nr*nc-2]==f || byt[nr*nc-1-nc]==f
-          || byt[nr*nc-2-nc]==f) )
-    byt[nr*nc-1]=GAL_BINARY_TMP_VALUE;
-
-  /* Check the 4 sides: */
-  for(j=1;j<nc-1;++j)
-    if(byt[j]==b
-       && ( byt[j+1]==f || byt[j-1]==f || byt[j+nc]==f
-            || byt[j-1+nc]==f || byt[j+1+nc]==f) )
-      byt[j]=GAL_BINARY_TMP_VALUE;
-
-  for(j=1;j<nc-1;++j)
-    {
-      ind=(nr-1)*nc+j;
-      if(byt[ind]==b
-         && ( byt[ind+1]==f || byt[ind-1]==f || byt[ind-nc]==f
-              || byt[ind-1-nc]==f || byt[ind+1-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
 
-  for(i=1;i<nr-1;++i)
+
+/* Worker function on each thread. */
+static void *
+binary_ed_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_ed_params *p=(struct binary_ed_params *)tprm->params;
+
+  size_t i, r, r1;
+  uint64_t *work=NULL;
+
+  /* The work buffer for the iterations. */
+  if(p->step==BINARY_ED_ITERATE)
+    work=gal_pointer_allocate(GAL_TYPE_UINT64,
+                              2*(p->striprows+2*p->numiter+1)*p->nw, 0,
+                              __func__, "work");
+
+  /* Go over all the actions that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    switch(p->step)
+      {
+      case BINARY_ED_PACK:
+      case BINARY_ED_UNPACK:
+        r=tprm->indexs[i]*p->striprows;
+        r1= r+p->striprows < p->nr ? r+p->striprows : p->nr;
+        for(;r<r1;++r)
+          if(p->step==BINARY_ED_PACK) binary_ed_pack_row(p, r);
+          else                        binary_ed_unpack_row(p, r);
+        break;
+
+      case BINARY_ED_ITERATE:
+        binary_ed_strip(p, tprm->indexs[i], work);
+        break;
+
+      case BINARY_ED_DT_COLUMNS:
+        binary_ed_dt_columns(p, tprm->indexs[i]);
+        break;
+
+      case BINARY_ED_DT_ROWS:
+        binary_ed_dt_rows(p, tprm->indexs[i]);
+        break;
+
+      default:
+        error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to "
+              "fix the problem. The step code %d is not recognized",
+              __func__, PACKAGE_BUGREPORT, p->step);
+      }
+
+  /* Clean up, wait for all the other threads to finish, then return. */
+  if(work) free(work);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Erosion or dilation of a 2D dataset with 4 or 8 connectivity. */
+static void
+binary_erode_dilate_2d(gal_data_t *input, size_t num, int connectivity,
+                       int dilate0_erode1, size_t numthreads)
+{
+  uint8_t *pt, *fpt;
+  char *mmapname=NULL;
+  struct binary_ed_params p;
+  size_t numstrips, planesize;
+  uint64_t *planes, *tmp;
+
+  /* Set the basic parameters. */
+  p.byt=input->array;
+  p.nr=input->dsize[0];
+  p.nc=input->dsize[1];
+  p.connectivity=connectivity;
+  p.nw=(p.nc+BINARY_ED_WORD-1)/BINARY_ED_WORD;
+  if(dilate0_erode1==0) {p.f=1; p.b=0;}
+  else                  {p.f=0; p.b=1;}
+
+  /* When there are many iterations and the dataset only has 0s and 1s,
+     use the distance transform. */
+  if(num>=BINARY_ED_DT_MIN)
     {
-      ind=i*nc;
-      if(byt[ind]==b
-         && ( byt[ind+1]==f || byt[ind+nc]==f || byt[ind-nc]==f
-              || byt[ind+1-nc]==f || byt[ind+1+nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+      fpt=(pt=p.byt)+input->size;
+      do if(*pt>1) break; while(++pt<fpt);
+      if(pt==fpt)
+        {
+          p.numiter=num;
+          p.cap = num < UINT32_MAX-1 ? num+1 : UINT32_MAX-1;
+          p.dist=gal_pointer_allocate_ram_or_mmap(GAL_TYPE_UINT32,
+                                                  input->size, 0,
+                                                  input->minmapsize,
+                                                  &mmapname,
+                                                  input->quietmmap,
+                                                  __func__, "p.dist");
+          p.step=BINARY_ED_DT_COLUMNS;
+          gal_threads_spin_off(binary_ed_on_thread, &p,
+                               (p.nc+BINARY_ED_COL_BLOCK-1)
+                               /BINARY_ED_COL_BLOCK,
+                               numthreads, input->minmapsize,
+                               input->quietmmap);
+          p.step=BINARY_ED_DT_ROWS;
+          gal_threads_spin_off(binary_ed_on_thread, &p, p.nr, numthreads,
+                               input->minmapsize, input->quietmmap);
+          if(mmapname) gal_pointer_mmap_free(&mmapname, input->quietmmap);
+          else         free(p.dist);
+          return;
+        }
     }
 
-  for(i=1;i<nr-1;++i)
+  /* Set the strips of rows: a few for each thread, but not too large (to
+     stay in the CPU cache) and not too small (compared to the halo). */
+  p.striprows = ( p.nr + BINARY_ED_STRIPS_PER_THREAD*numthreads - 1 )
+                / (BINARY_ED_STRIPS_PER_THREAD*numthreads);
+  if(p.striprows>BINARY_ED_STRIP_ROWS)   p.striprows=BINARY_ED_STRIP_ROWS;
+  if(p.striprows<4*BINARY_ED_BATCH)      p.striprows=4*BINARY_ED_BATCH;
+  numstrips=(p.nr+p.striprows-1)/p.striprows;
+
+  /* Allocate the input and output planes. The initial 'f' plane is kept
+   (to find the changed pixels in the end), so a spare 'f' plane is
+   necessary. */
+  planesize=p.nr*p.nw;
+  planes=gal_pointer_allocate_ram_or_mmap(GAL_TYPE_UINT64, 5*planesize, 0,
+                                          input->minmapsize, &mmapname,
+                                          input->quietmmap, __func__,
+                                          "planes");
+  p.f0=p.fi=planes;
+  p.bi=planes+planesize;
+  p.fo=planes+2*planesize;
+  p.bo=planes+3*planesize;
+  p.fsp=planes+4*planesize;
+
+  /* Pack the input into the planes. */
+  p.step=BINARY_ED_PACK;
+  gal_threads_spin_off(binary_ed_on_thread, &p, numstrips, numthreads,
+                       input->minmapsize, input->quietmmap);
+
+  /* Do the iterations in batches, after each batch, the output planes are
+     the input of the next. */
+  p.step=BINARY_ED_ITERATE;
+  while(num)
     {
-      ind=(i+1)*nc-1;
-      if(byt[ind]==b
-         && (byt[ind-1]==f || byt[ind+nc]==f || byt[ind-nc]==f
-             || byt[ind-1-nc]==f || byt[ind-1+nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+      p.numiter = num<BINARY_ED_BATCH ? num : BINARY_ED_BATCH;
+      gal_threads_spin_off(binary_ed_on_thread, &p, numstrips, numthreads,
+                           input->minmapsize, input->quietmmap);
+      tmp=p.fi; p.fi=p.fo; p.fo = tmp==p.f0 ? p.fsp : tmp;
+      tmp=p.bi; p.bi=p.bo; p.bo=tmp;
+      num-=p.numiter;
     }
 
-  /* Check the body: */
-  for(i=1;i<nr-1;++i)
-    for(j=1;j<nc-1;++j)
-      {
-        ind=i*nc+j;
-        if(byt[ind]==b
-           && (byt[ind-1]==f        || byt[ind+1]==f
-               || byt[ind+nc]==f    || byt[ind-nc]==f
-               || byt[ind-1-nc]==f  || byt[ind+1+nc]==f
-               || byt[ind-1+nc]==f  || byt[ind+1-nc]==f) )
-          byt[ind]=GAL_BINARY_TMP_VALUE;
-      }
+  /* Write the changed pixels into the input. */
+  p.step=BINARY_ED_UNPACK;
+  gal_threads_spin_off(binary_ed_on_thread, &p, numstrips, numthreads,
+                       input->minmapsize, input->quietmmap);
 
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+nr*nc;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
+  /* Clean up. */
+  if(mmapname) gal_pointer_mmap_free(&mmapname, input->quietmmap);
+  else         free(planes);
 }
 
 
@@ -270,11 +502,10 @@ binary_erode_dilate_general(gal_data_t *input, unsigned char dilate0_erode1,
    when the input's type isn't 'uint8_t', 'inplace' is irrelevant. */
 static gal_data_t *
 binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
-                    int inplace, int d0e1)
+                    int inplace, int d0e1, size_t numthreads)
 {
   size_t counter;
   gal_data_t *binary;
-  size_t *dinc=gal_dimension_increment(input->ndim, input->dsize);
 
   /* Currently this only works on blocks. */
   if(input->block)
@@ -291,15 +522,12 @@ binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
   switch(binary->ndim)
     {
     case 2:
-      for(counter=0;counter<num;++counter)
-        switch(connectivity)
-          {
-          case 1: binary_erode_dilate_2d_4con(binary, d0e1); break;
-          case 2: binary_erode_dilate_2d_8con(binary, d0e1); break;
-          default:
-            error(EXIT_FAILURE, 0, "%s: %d not acceptable for connectivity "
-                  "in a 2D dataset", __func__, connectivity);
-          }
+      if(connectivity!=1 && connectivity!=2)
+        error(EXIT_FAILURE, 0, "%s: %d not acceptable for connectivity "
+              "in a 2D dataset", __func__, connectivity);
+      if(num)
+        binary_erode_dilate_2d(binary, num, connectivity, d0e1,
+                               numthreads);
       break;
 
     case 3:
@@ -312,8 +540,7 @@ binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
             "dimensional datasets", __func__, binary->ndim);
     }
 
-  /* Clean up and return. */
-  free(dinc);
+  /* Return the output. */
   return binary;
 }
 
@@ -325,7 +552,19 @@ gal_data_t *
 gal_binary_erode(gal_data_t *input, size_t num, int connectivity,
                  int inplace)
 {
-  return binary_erode_dilate(input, num, connectivity, inplace, 1);
+  return binary_erode_dilate(input, num, connectivity, inplace, 1, 1);
+}
+
+
+
+
+
+gal_data_t *
+gal_binary_erode_threaded(gal_data_t *input, size_t num, int connectivity,
+                          int inplace, size_t numthreads)
+{
+  return binary_erode_dilate(input, num, connectivity, inplace, 1,
+                             numthreads);
 }
 
 
@@ -336,7 +575,19 @@ gal_data_t *
 gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
                   int inplace)
 {
-  return binary_erode_dilate(input, num, connectivity, inplace, 0);
+  return binary_erode_dilate(input, num, connectivity, inplace, 0, 1);
+}
+
+
+
+
+
+gal_data_t *
+gal_binary_dilate_threaded(gal_data_t *input, size_t num, int connectivity,
+                           int inplace, size_t numthreads)
+{
+  return binary_erode_dilate(input, num, connectivity, inplace, 0,
+                             numthreads);
 }
 
 
@@ -346,16 +597,28 @@ gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
 gal_data_t *
 gal_binary_open(gal_data_t *input, size_t num, int connectivity,
                 int inplace)
+{
+  return gal_binary_open_threaded(input, num, connectivity, inplace, 1);
+}
+
+
+
+
+
+gal_data_t *
+gal_binary_open_threaded(gal_data_t *input, size_t num, int connectivity,
+                         int inplace, size_t numthreads)
 {
   gal_data_t *out;
 
   /* First do the necessary number of erosions. */
-  out=gal_binary_erode(input, num, connectivity, inplace);
+  out=gal_binary_erode_threaded(input, num, connectivity, inplace,
+                                numthreads);
 
   /* If 'inplace' was called, then 'out' is the same as 'input', if it
      wasn't, then 'out' is a newly allocated array. In any case, we should
      dilate in the same allocated space. */
-  gal_binary_dilate(input, num, connectivity, 1);
+  gal_binary_dilate_threaded(out, num, connectivity, 1, numthreads);
 
   /* Return the output dataset. */
   return out;
@@ -383,6 +646,14 @@ gal_binary_open(gal_data_t *input, size_t num, int connectivity,
 /*********************************************************************/
 /*****************      Connected components      ********************/
 /*********************************************************************/
+/* Initial number of elements in the queues of the connected components
+   (they will grow when necessary). */
+#define BINARY_QUEUE_INIT 1024
+
+
+
+
+
 /* Find connected components in an intput dataset. */
 size_t
 gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
@@ -392,7 +663,7 @@ gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
   uint8_t *b, *bf;
   gal_data_t *lab;
   size_t p, i, curlab=1;
-  gal_list_sizet_t *Q=NULL;
+  gal_list_sizet_ring_t *Q;
   size_t *dinc=gal_dimension_increment(binary->ndim, binary->dsize);
 
   /* Two small sanity checks. */
@@ -442,9 +713,12 @@ gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
 
   /* Go over all the pixels and do a breadth-first: any pixel that is not
      labeled is used to label the full object by checking neighbors before
-     going onto the next pixels. */
+     going onto the next pixels. The queue is array-based to avoid an
+     allocation for every pixel. */
   l=lab->array;
   b=binary->array;
+  Q=gal_list_sizet_ring_alloc(BINARY_QUEUE_INIT, binary->minmapsize,
+                              binary->quietmmap);
   for(i=0;i<binary->size;++i)
     /* Check if this pixel is already labeled. */
     if( b[i] && l[i]==0 )
@@ -454,14 +728,14 @@ gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
         l[i]=curlab;
 
         /* Add this pixel to the queue of pixels to work with. */
-        gal_list_sizet_add(&Q, i);
+        gal_list_sizet_ring_add(Q, i);
 
         /* While a pixel remains in the queue, continue labelling and
            searching for neighbors. */
-        while(Q!=NULL)
+        while(Q->num)
           {
             /* Pop an element from the queue. */
-            p=gal_list_sizet_pop(&Q);
+            p=gal_list_sizet_ring_pop_last(Q);
 
             /* Go over all its neighbors and add them to the list if they
                haven't already been labeled. */
@@ -471,7 +745,7 @@ gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
                 if( b[ nind ] && l[ nind ]==0 )
                   {
                     l[ nind ] = curlab;
-                    gal_list_sizet_add(&Q, nind);
+                    gal_list_sizet_ring_add(Q, nind);
                   }
               } );
           }
@@ -483,6 +757,7 @@ gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
 
 
   /* Clean up and return the total number. */
+  gal_list_sizet_ring_free(Q);
   free(dinc);
   return curlab-1;
 }
@@ -491,6 +766,415 @@ gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
 
 
 
+/* Parameters of the threads in 'gal_binary_connected_components_threaded'.
+
+   The input is divided into slabs along its slowest dimension (with
+   'gal_tile_full'), so each tile covers a contiguous range of indexs and
+   a pixel is in a tile when its index is within the tile's range. The
+   labeling is done in the following steps (each one a separate spin-off
+   of the threads):
+
+     BINARY_CC_LOCAL: each tile is labeled independently with the same
+          breadth-first search as 'gal_binary_connected_components'. The
+          'parent' of every pixel in a local region is set to the region's
+          first pixel (its 'seed'). Pairs of neighbors that cross into a
+          previous tile are kept for the next step.
+
+     BINARY_CC_MERGE: the regions that touch across the tile borders are
+          merged with a lock-free union-find: the root of a region is
+          always linked to a root with a smaller index. So the final root
+          of a connected component is its first pixel in the scan order.
+
+     BINARY_CC_COUNT: count the number of roots (seeds that are still
+          their own parent) in each tile.
+
+     BINARY_CC_ROOTS: give each root its label from the cumulative number
+          of roots in the previous tiles (so labels are in the scan order,
+          identical to 'gal_binary_connected_components').
+
+     BINARY_CC_LABEL: Give every other pixel the label of its root. */
+enum binary_cc_steps
+{
+  BINARY_CC_LOCAL,
+  BINARY_CC_MERGE,
+  BINARY_CC_COUNT,
+  BINARY_CC_ROOTS,
+  BINARY_CC_LABEL,
+};
+
+struct binary_cc_params
+{
+  int                       step;  /* Step to do (from 'binary_cc_steps'). */
+  int               connectivity;  /* Connectivity of the neighbors.       */
+  int                   hasblank;  /* Input has blank values.              */
+  uint8_t                     *b;  /* Array of input binary dataset.       */
+  int32_t                     *l;  /* Array of output labels.              */
+  size_t                 *parent;  /* Parent of each pixel (union-find).   */
+  size_t                   *dinc;  /* Increments along each dimension.     */
+  size_t                  *start;  /* Index of first pixel in each tile.   */
+  size_t                    *end;  /* Index of last pixel in each tile.    */
+  size_t                  *count;  /* Number of roots/labels before tile.  */
+  gal_data_t             *binary;  /* Input binary dataset.                */
+  gal_list_sizet_ring_t  **seeds;  /* First pixel of local regions.        */
+  gal_list_sizet_ring_t  **pairs;  /* Neighbors across previous tiles.     */
+};
+
+/* Number of tiles for each thread (for a better balance when some tiles
+   have more foreground pixels) and the minimum number of elements for the
+   threads to be used. */
+#define BINARY_CC_TILES_PER_THREAD 4
+#define BINARY_CC_MIN_SIZE         100000
+
+/* In the merge step, different threads can change the parent of a root
+   at the same time, so atomic operations are necessary. When the compiler
+   doesn't have the GNU atomic built-in functions, the merging will be
+   done on one thread (and the paths will not be shortened while setting
+   the roots). */
+#ifdef __GNUC__
+#define BINARY_CC_ATOMIC 1
+#define BINARY_CC_LOAD(P)       __atomic_load_n((P), __ATOMIC_RELAXED)
+#define BINARY_CC_STORE(P,V)    __atomic_store_n((P), (V), __ATOMIC_RELAXED)
+#define BINARY_CC_CAS(P,OLD,NEW) __sync_bool_compare_and_swap((P), (OLD), \
+                                                              (NEW))
+#else
+#define BINARY_CC_ATOMIC 0
+#define BINARY_CC_LOAD(P)       (*(P))
+#define BINARY_CC_STORE(P,V)
+#define BINARY_CC_CAS(P,OLD,NEW) ( *(P)==(OLD) ? (*(P)=(NEW), 1) : 0 )
+#endif
+
+/* Element 'I' of a ring that has only been added to. */
+#define BINARY_CC_RING(R,I) (R)->array[ ( (R)->first+(I) ) % (R)->alloc ]
+
+
+
+
+
+/* Find the root of the given index. */
+static size_t
+binary_cc_find(size_t *parent, size_t i)
+{
+  size_t p;
+  while( (p=BINARY_CC_LOAD(&parent[i])) != i ) i=p;
+  return i;
+}
+
+
+
+
+
+/* Merge the regions of the two given pixels. The root with the larger
+   index is always linked to the one with the smaller index, so when the
+   compare-and-swap fails (another thread has changed the root in the
+   meantime), the roots are found again and we try again. */
+static void
+binary_cc_union(size_t *parent, size_t a, size_t b)
+{
+  size_t tmp;
+
+  while(1)
+    {
+      a=binary_cc_find(parent, a);
+      b=binary_cc_find(parent, b);
+      if(a==b) return;
+      if(a<b) { tmp=a; a=b; b=tmp; }
+      if( BINARY_CC_CAS(&parent[a], a, b) ) return;
+    }
+}
+
+
+
+
+
+/* Label the pixels of one tile independently of the others. */
+static void
+binary_cc_local(struct binary_cc_params *p, size_t tind,
+                gal_list_sizet_ring_t *Q)
+{
+  int32_t *l=p->l;
+  uint8_t *b=p->b;
+  size_t *parent=p->parent;
+  gal_data_t *binary=p->binary;
+  gal_list_sizet_ring_t *seeds=p->seeds[tind], *pairs=p->pairs[tind];
+  size_t i, q, s=p->start[tind], e=p->end[tind];
+
+  /* Initialize the labels and parents of the pixels in this tile. */
+  for(i=s;i<=e;++i)
+    {
+      parent[i]=GAL_BLANK_SIZE_T;
+      l[i] = p->hasblank && b[i]==GAL_BLANK_UINT8 ? GAL_BLANK_INT32 : 0;
+    }
+
+  /* Breadth-first search from every unlabeled foreground pixel, but only
+     within this tile. */
+  for(i=s;i<=e;++i)
+    if( b[i] && l[i]==0 && parent[i]==GAL_BLANK_SIZE_T )
+      {
+        parent[i]=i;
+        gal_list_sizet_ring_add(seeds, i);
+        gal_list_sizet_ring_add(Q, i);
+        while(Q->num)
+          {
+            q=gal_list_sizet_ring_pop_last(Q);
+            GAL_DIMENSION_NEIGHBOR_OP(q, binary->ndim, binary->dsize,
+                                      p->connectivity, p->dinc,
+              {
+                if( b[nind]
+                    && !(p->hasblank && b[nind]==GAL_BLANK_UINT8) )
+                  {
+                    if(nind<s)
+                      {
+                        gal_list_sizet_ring_add(pairs, i);
+                        gal_list_sizet_ring_add(pairs, nind);
+                      }
+                    else if( nind<=e && parent[nind]==GAL_BLANK_SIZE_T )
+                      {
+                        parent[nind]=i;
+                        gal_list_sizet_ring_add(Q, nind);
+                      }
+                  }
+              } );
+          }
+      }
+}
+
+
+
+
+
+/* Worker function on each thread. */
+static void *
+binary_cc_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_cc_params *p=(struct binary_cc_params *)tprm->params;
+
+  int32_t *l=p->l;
+  size_t *parent=p->parent;
+  gal_list_sizet_ring_t *Q=NULL, *seeds, *pairs;
+  size_t i, j, r, s, t, label, numroots;
+
+  /* Queue of the breadth-first search (same for all the tiles). */
+  if(p->step==BINARY_CC_LOCAL)
+    Q=gal_list_sizet_ring_alloc(BINARY_QUEUE_INIT, p->binary->minmapsize,
+                                p->binary->quietmmap);
+
+  /* Go over all the tiles that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      t=tprm->indexs[i];
+      seeds=p->seeds[t];
+      pairs=p->pairs[t];
+      switch(p->step)
+        {
+        case BINARY_CC_LOCAL:
+          binary_cc_local(p, t, Q);
+          break;
+
+        case BINARY_CC_MERGE:
+          for(j=0;j<pairs->num;j+=2)
+            binary_cc_union(parent, BINARY_CC_RING(pairs, j),
+                            BINARY_CC_RING(pairs, j+1));
+          break;
+
+        case BINARY_CC_COUNT:
+          numroots=0;
+          for(j=0;j<seeds->num;++j)
+            {
+              r=BINARY_CC_RING(seeds, j);
+              if(parent[r]==r) ++numroots;
+            }
+          p->count[t]=numroots;
+          break;
+
+        /* Since a root can only be in a previous tile, the parent of the
+           seeds can also be set to their root here to have shorter paths
+           in the next step. */
+        case BINARY_CC_ROOTS:
+          label=p->count[t];
+          for(j=0;j<seeds->num;++j)
+            {
+              s=BINARY_CC_RING(seeds, j);
+              r=binary_cc_find(parent, s);
+              if(r==s) l[s]=++label;
+              else     BINARY_CC_STORE(&parent[s], r);
+            }
+          break;
+
+        case BINARY_CC_LABEL:
+          for(j=p->start[t];j<=p->end[t];++j)
+            if( parent[j]!=GAL_BLANK_SIZE_T && parent[j]!=j )
+              l[j] = l[ binary_cc_find(parent, j) ];
+          break;
+
+        default:
+          error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to "
+                "fix the problem. The step code %d is not recognized",
+                __func__, PACKAGE_BUGREPORT, p->step);
+        }
+    }
+
+  /* Clean up, wait for all the other threads to finish, then return. */
+  if(Q) gal_list_sizet_ring_free(Q);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Find connected components like 'gal_binary_connected_components', but
+   on multiple threads. The output labels are identical to that function:
+   labels are given in the order that each connected component's first
+   pixel is found in the scan order. */
+size_t
+gal_binary_connected_components_threaded(gal_data_t *binary,
+                                         gal_data_t **out, int connectivity,
+                                         size_t numthreads)
+{
+  gal_data_t *lab;
+  gal_data_t *tiles=NULL;
+  struct binary_cc_params p;
+  char *mmapname=NULL;
+  size_t i, *tsize, *first, numtiles, numroots, se[2], total;
+  size_t *regular=gal_pointer_allocate(GAL_TYPE_SIZE_T, binary->ndim, 0,
+                                       __func__, "regular");
+
+  /* When the threads are not useful (or the dataset's dimensions can't
+     be parsed in tiles), use the single-threaded function. */
+  if( numthreads<=1 || binary->size<BINARY_CC_MIN_SIZE
+      || binary->ndim>3 || binary->dsize[0]<2 )
+    {
+      free(regular);
+      return gal_binary_connected_components(binary, out, connectivity);
+    }
+
+  /* Same sanity checks as 'gal_binary_connected_components'. */
+  if(binary->type!=GAL_TYPE_UINT8)
+    error(EXIT_FAILURE, 0, "%s: the input data set type must be 'uint8'",
+          __func__);
+  if(binary->block)
+    error(EXIT_FAILURE, 0, "%s: currently, the input data structure to "
+          "must not be a tile", __func__);
+
+  /* Prepare the dataset for the labels (all its elements will be set in
+     the first step, so it doesn't need to be cleared). */
+  if(*out)
+    {
+      lab=*out;
+      if( gal_dimension_is_different(binary, lab) )
+        error(EXIT_FAILURE, 0, "%s: the 'binary' and 'out' datasets must "
+              "have the same size", __func__);
+      if( lab->type!=GAL_TYPE_INT32 )
+        error(EXIT_FAILURE, 0, "%s: the 'out' dataset must have 'int32' type"
+              "but the array you have given is '%s' type", __func__,
+              gal_type_name(lab->type, 1));
+    }
+  else
+    lab=*out=gal_data_alloc(NULL, GAL_TYPE_INT32, binary->ndim,
+                            binary->dsize, binary->wcs, 0,
+                            binary->minmapsize, binary->quietmmap,
+                            NULL, "labels", NULL);
+
+  /* Cover the dataset with slabs along the slowest dimension. */
+  regular[0]=binary->dsize[0]/(BINARY_CC_TILES_PER_THREAD*numthreads);
+  if(regular[0]==0) regular[0]=1;
+  for(i=1;i<binary->ndim;++i) regular[i]=binary->dsize[i];
+  tsize=gal_tile_full(binary, regular, 0.5, &tiles, 1, &first);
+  numtiles=gal_dimension_total_size(binary->ndim, tsize);
+
+  /* Set the parameters. */
+  p.b=binary->array;
+  p.l=lab->array;
+  p.binary=binary;
+  p.connectivity=connectivity;
+  p.hasblank=gal_blank_present(binary, 0);
+  p.dinc=gal_dimension_increment(binary->ndim, binary->dsize);
+  p.parent=gal_pointer_allocate_ram_or_mmap(GAL_TYPE_SIZE_T, binary->size,
+                                            0, binary->minmapsize,
+                                            &mmapname, binary->quietmmap,
+                                            __func__, "p.parent");
+  p.start=gal_pointer_allocate(GAL_TYPE_SIZE_T, numtiles, 0, __func__,
+                               "p.start");
+  p.end=gal_pointer_allocate(GAL_TYPE_SIZE_T, numtiles, 0, __func__,
+                             "p.end");
+  p.count=gal_pointer_allocate(GAL_TYPE_SIZE_T, numtiles, 0, __func__,
+                               "p.count");
+  errno=0;
+  p.seeds=malloc(numtiles*sizeof *p.seeds);
+  p.pairs=malloc(numtiles*sizeof *p.pairs);
+  if(p.seeds==NULL || p.pairs==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate the lists of tiles",
+          __func__);
+  for(i=0;i<numtiles;++i)
+    {
+      gal_tile_start_end_ind_inclusive(&tiles[i], binary, se);
+      p.start[i]=se[0];
+      p.end[i]=se[1];
+      p.seeds[i]=gal_list_sizet_ring_alloc(BINARY_QUEUE_INIT,
+                                           binary->minmapsize,
+                                           binary->quietmmap);
+      p.pairs[i]=gal_list_sizet_ring_alloc(BINARY_QUEUE_INIT,
+                                           binary->minmapsize,
+                                           binary->quietmmap);
+    }
+
+  /* Label each tile and merge the regions across the tiles. */
+  p.step=BINARY_CC_LOCAL;
+  gal_threads_spin_off(binary_cc_on_thread, &p, numtiles, numthreads,
+                       binary->minmapsize, binary->quietmmap);
+  p.step=BINARY_CC_MERGE;
+  gal_threads_spin_off(binary_cc_on_thread, &p, numtiles,
+                       BINARY_CC_ATOMIC ? numthreads : 1,
+                       binary->minmapsize, binary->quietmmap);
+
+  /* Count the roots in each tile and convert them to the number of
+     labels before each tile. */
+  p.step=BINARY_CC_COUNT;
+  gal_threads_spin_off(binary_cc_on_thread, &p, numtiles, numthreads,
+                       binary->minmapsize, binary->quietmmap);
+  total=0;
+  for(i=0;i<numtiles;++i)
+    {
+      numroots=p.count[i];
+      p.count[i]=total;
+      total+=numroots;
+    }
+
+  /* Label the roots, then all the other pixels. */
+  p.step=BINARY_CC_ROOTS;
+  gal_threads_spin_off(binary_cc_on_thread, &p, numtiles, numthreads,
+                       binary->minmapsize, binary->quietmmap);
+  p.step=BINARY_CC_LABEL;
+  gal_threads_spin_off(binary_cc_on_thread, &p, numtiles, numthreads,
+                       binary->minmapsize, binary->quietmmap);
+
+  /* Clean up and return the total number. */
+  for(i=0;i<numtiles;++i)
+    {
+      gal_list_sizet_ring_free(p.seeds[i]);
+      gal_list_sizet_ring_free(p.pairs[i]);
+    }
+  if(mmapname) gal_pointer_mmap_free(&mmapname, binary->quietmmap);
+  else         free(p.parent);
+  gal_data_array_free(tiles, numtiles, 0);
+  free(p.seeds);
+  free(p.pairs);
+  free(p.start);
+  free(p.count);
+  free(p.dinc);
+  free(p.end);
+  free(regular);
+  free(first);
+  free(tsize);
+  return total;
+}
+
+
+
+
+
 /* Put the indexs of connected labels in a list of 'gal_data_t's, each with
    a one-dimensional array that has the indexs of that connected
    component.*/
@@ -501,7 +1185,7 @@ gal_binary_connected_indexs(gal_data_t *binary, int connectivity)
   uint8_t *b, *bf;
   gal_data_t *lines=NULL;
   size_t p, i, onelabnum, *onelabarr;
-  gal_list_sizet_t *Q=NULL, *onelab=NULL;
+  gal_list_sizet_ring_t *Q, *onelab;
   size_t *dinc=gal_dimension_increment(binary->ndim, binary->dsize);
 
   /* Small sanity checks. */
@@ -512,8 +1196,14 @@ gal_binary_connected_indexs(gal_data_t *binary, int connectivity)
     error(EXIT_FAILURE, 0, "%s: currently, the input data structure to "
           "must not be a tile", __func__);
 
-  /* Go over all the pixels and do a breadth-first search. */
+  /* Go over all the pixels and do a breadth-first search. The queue and
+     the indexs of each connected region are kept in array-based lists to
+     avoid an allocation for every pixel. */
   b=binary->array;
+  Q=gal_list_sizet_ring_alloc(BINARY_QUEUE_INIT, binary->minmapsize,
+                              binary->quietmmap);
+  onelab=gal_list_sizet_ring_alloc(BINARY_QUEUE_INIT, binary->minmapsize,
+                                   binary->quietmmap);
   for(i=0;i<binary->size;++i)
     /* A pixel that has already been recorded is given a value of
        'BINARY_CONINDEX_VAL'. */
@@ -521,15 +1211,15 @@ gal_binary_connected_indexs(gal_data_t *binary, int connectivity)
       {
         /* Add this pixel to the queue of pixels to work with. */
 	b[i]=BINARY_CONINDEX_VAL;
-        gal_list_sizet_add(&Q, i);
-        gal_list_sizet_add(&onelab, i);
+        gal_list_sizet_ring_add(Q, i);
+        gal_list_sizet_ring_add(onelab, i);
 
         /* While a pixel remains in the queue, continue labelling and
            searching for neighbors. */
-        while(Q!=NULL)
+        while(Q->num)
           {
             /* Pop an element from the queue. */
-            p=gal_list_sizet_pop(&Q);
+            p=gal_list_sizet_ring_pop_last(Q);
 
             /* Go over all its neighbors and add them to the list if they
                haven't already been labeled. */
@@ -539,21 +1229,22 @@ gal_binary_connected_indexs(gal_data_t *binary, int connectivity)
                 if( b[nind]==1 )
                   {
 		    b[nind]=BINARY_CONINDEX_VAL;
-                    gal_list_sizet_add(&Q, nind);
-		    gal_list_sizet_add(&onelab, nind);
+                    gal_list_sizet_ring_add(Q, nind);
+		    gal_list_sizet_ring_add(onelab, nind);
                   }
               } );
           }
 
 	/* Parsing has finished, put all the indexs into an array. */
-	onelabarr=gal_list_sizet_to_array(onelab, 1, &onelabnum);
+	onelabarr=gal_list_sizet_ring_to_array(onelab, &onelabnum);
 	gal_list_data_add_alloc(&lines, onelabarr, GAL_TYPE_SIZE_T, 1,
 				&onelabnum, NULL, 0, -1, 1, NULL, NULL, NULL);
 
-	/* Clean up. */
-	gal_list_sizet_free(onelab);
-	onelab=NULL;
+	/* Empty the list for the next region. */
+	onelab->num=onelab->first=0;
       }
+  gal_list_sizet_ring_free(onelab);
+  gal_list_sizet_ring_free(Q);
 
   /* Reverse the order. */
   gal_list_data_reverse(&lines);
@@ -590,7 +1281,7 @@ gal_binary_connected_adjacency_matrix(gal_data_t *adjacency,
                                       size_t *numconnected)
 {
   gal_data_t *newlabs_d;
-  gal_list_sizet_t *Q=NULL;
+  gal_list_sizet_ring_t *Q;
   int32_t *newlabs, curlab=1;
   uint8_t *adj=adjacency->array;
   size_t i, j, p, num=adjacency->dsize[0];
@@ -622,17 +1313,19 @@ gal_binary_connected_adjacency_matrix(gal_data_t *adjacency,
   /* Go over the input matrix and apply the same principle as we used to
      identify connected components in an image: through a queue, find those
      elements that are connected. */
+  Q=gal_list_sizet_ring_alloc(num, adjacency->minmapsize,
+                              adjacency->quietmmap);
   for(i=1;i<num;++i)
     if(newlabs[i]==0)
       {
         /* Add this old label to the list that must be corrected. */
-        gal_list_sizet_add(&Q, i);
+        gal_list_sizet_ring_add(Q, i);
 
         /* Continue while the list has elements. */
-        while(Q!=NULL)
+        while(Q->num)
           {
             /* Pop the top old-label from the list. */
-            p=gal_list_sizet_pop(&Q);
+            p=gal_list_sizet_ring_pop_last(Q);
 
             /* If it has already been labeled then ignore it. */
             if( newlabs[p]!=curlab )
@@ -645,13 +1338,14 @@ gal_binary_connected_adjacency_matrix(gal_data_t *adjacency,
                    that are touching it. */
                 for(j=1;j<num;++j)
                   if( adj[ p*num+j ] && newlabs[j]==0 )
-                    gal_list_sizet_add(&Q, j);
+                    gal_list_sizet_ring_add(Q, j);
               }
           }
 
         /* Increment the current label. */
         ++curlab;
       }
+  gal_list_sizet_ring_free(Q);
 
 
   /* For a check.
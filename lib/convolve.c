@@ -22,14 +22,22 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
 #include <string.h>
 #include <stdlib.h>
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_complex.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+#include <gsl/gsl_fft_real_float.h>
+#include <gsl/gsl_fft_complex_float.h>
+#include <gsl/gsl_fft_halfcomplex_float.h>
 
 #include <gnuastro/list.h>
 #include <gnuastro/tile.h>
+#include <gnuastro/blank.h>
 #include <gnuastro/threads.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/convolve.h>
@@ -45,6 +53,10 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /*********************************************************************/
 /********************          Utilities          ********************/
 /*********************************************************************/
+/* Maximum difference (relative to the kernel's largest value) between a
+   kernel element and the product of its separated factors. */
+#define CONVOLVE_SEPARABLE_TOLERANCE 1e-6
+
 /* See if the tile is on the edge of the hosted region or not. It doesn't
    matter if the host is the allocated block of memory or a region in it (a
    channel). */
@@ -70,6 +82,55 @@ convolve_tile_is_on_edge(size_t *h, size_t *start_end_coord, size_t *k,
 
 
 
+/* If the 2D kernel is separable (the outer product of two 1D kernels,
+   for example a box or a Gaussian made from 1D profiles), return the two
+   1D kernels (along the slow and fast dimensions), otherwise, return
+   NULL. The two factors are found from the row and column of the
+   kernel's largest absolute value and every element is checked against
+   their product (within floating point precision of the kernel), so the
+   result of convolving with the factors is the same as the kernel. */
+static double *
+convolve_kernel_separable(gal_data_t *kernel, double **kff)
+{
+  double max=0.0, *kfs;
+  float *k=kernel->array;
+  size_t i, j, pi=0, pj=0, ns, nf;
+
+  /* Only 2D kernels with an odd width are currently considered. */
+  if(kernel->ndim!=2 || kernel->dsize[0]%2==0 || kernel->dsize[1]%2==0)
+    return NULL;
+  ns=kernel->dsize[0];
+  nf=kernel->dsize[1];
+
+  /* Find the pivot (largest absolute value). */
+  for(i=0;i<ns*nf;++i)
+    {
+      if( isnan(k[i]) ) return NULL;
+      if( fabs(k[i])>max ) { max=fabs(k[i]); pi=i/nf; pj=i%nf; }
+    }
+  if(max==0.0) return NULL;
+
+  /* Set the two factors. */
+  kfs=gal_pointer_allocate(GAL_TYPE_FLOAT64, ns, 0, __func__, "kfs");
+  *kff=gal_pointer_allocate(GAL_TYPE_FLOAT64, nf, 0, __func__, "kff");
+  for(i=0;i<ns;++i) kfs[i]=k[i*nf+pj];
+  for(j=0;j<nf;++j) (*kff)[j]=(double)(k[pi*nf+j])/k[pi*nf+pj];
+
+  /* Check all the elements. */
+  for(i=0;i<ns;++i)
+    for(j=0;j<nf;++j)
+      if( fabs(k[i*nf+j]-kfs[i]*(*kff)[j])
+          > CONVOLVE_SEPARABLE_TOLERANCE*max )
+        { free(kfs); free(*kff); *kff=NULL; return NULL; }
+
+  /* The kernel is separable. */
+  return kfs;
+}
+
+
+
+
+
 
 
 
@@ -120,6 +181,11 @@ struct spatial_params
   gal_data_t *tocorrect;     /* (possible) convolved image to correct.   */
   int        convoverch;     /* Ignore channel edges in convolution.     */
   int    edgecorrection;     /* Correct convolution's edge effects.      */
+  double           *kfs;     /* Kernel factor on slow dim. (separable).  */
+  double           *kff;     /* Kernel factor on fast dim. (separable).  */
+  size_t          *koff;     /* Offset of kernel elements in block.      */
+  size_t       kcenter;      /* Offset of kernel center in block.        */
+  double       kernelsum;    /* Sum of kernel (for edge correction).     */
   struct per_thread_spatial_prm *pprm; /* Array of per-thread parameters.*/
 };
 
@@ -291,6 +357,79 @@ convolve_spatial_overlap(struct per_thread_spatial_prm *pprm, int tocorrect)
 
 
 
+/* Convolve a contiguous segment of 'num' pixels (along the fastest
+   dimension) that starts at index 'start' of the block, when the kernel
+   fully overlaps with all of them. The sums for all the pixels are
+   accumulated together (one kernel element at a time), so there is no
+   overlap or blank checking and the inner loop can be vectorized by the
+   compiler. For each pixel, the kernel elements are added in the same
+   order as 'GAL_TILE_PO_OISET' in 'convolve_spatial_tile', so the result
+   is identical.
+
+   If there is a blank value under the kernel, the sum of that pixel will
+   be NaN, so the caller should use the general method for it. */
+static void
+convolve_spatial_segment(struct spatial_params *cprm, size_t start,
+                         size_t num, double *sum)
+{
+  size_t e, j;
+  float kv, *in, *k=cprm->kernel->array;
+  float *base=(float *)(cprm->block->array) + start - cprm->kcenter;
+
+  /* Initialize the sums. */
+  for(j=0;j<num;++j) sum[j]=0.0;
+
+  /* Add the contribution of each kernel element. */
+  for(e=0;e<cprm->kernel->size;++e)
+    {
+      kv=k[e];
+      in=base+cprm->koff[e];
+      for(j=0;j<num;++j) sum[j] += in[j] * kv;
+    }
+}
+
+
+
+
+
+/* See if there is any blank value under the kernel for the pixels of a
+   tile that isn't on the edge: the tile is expanded by the half-kernel
+   width on each side (within the block) and checked for blank values. */
+static int
+convolve_spatial_tile_blank(struct per_thread_spatial_prm *pprm)
+{
+  int hasblank;
+  gal_data_t region;
+  gal_data_t *tile=pprm->tile;
+  struct spatial_params *cprm=pprm->cprm;
+  size_t d, ndim=tile->ndim, *kdsize=cprm->kernel->dsize;
+  size_t *dsize=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__,
+                                     "dsize");
+
+  /* Define the region as a tile over the block. */
+  region=*tile;
+  region.size=1;
+  region.flag=0;
+  region.next=NULL;
+  region.dsize=dsize;
+  region.block=cprm->block;
+  region.array=(float *)(tile->array) - cprm->kcenter;
+  for(d=0;d<ndim;++d)
+    {
+      dsize[d] = tile->dsize[d] + kdsize[d] - 1;
+      region.size *= dsize[d];
+    }
+
+  /* Check for blank values, clean up and return. */
+  hasblank=gal_blank_present(&region, 0);
+  free(dsize);
+  return hasblank;
+}
+
+
+
+
+
 /* Convolve over one tile that is not touching the edge. */
 static void
 convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
@@ -298,7 +437,7 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
   gal_data_t *tile=pprm->tile;
 
   int full_overlap;
-  double sum, ksum;
+  double sum, ksum, *segsum=NULL;
   struct spatial_params *cprm=pprm->cprm;
   gal_data_t *block=cprm->block, *kernel=cprm->kernel;
   size_t j, ndim=block->ndim, csize=tile->dsize[ndim-1];
@@ -340,6 +479,15 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
   if(cprm->tocorrect && pprm->on_edge==0) return;
 
 
+  /* When the tile isn't on the edge, the kernel fully overlaps with all
+     its pixels, so if there is no blank value under the kernel for any
+     of its pixels, the sums can be found for each contiguous segment of
+     the tile at once. */
+  if( pprm->on_edge==0 && convolve_spatial_tile_blank(pprm)==0 )
+    segsum=gal_pointer_allocate(GAL_TYPE_FLOAT64, csize, 0, __func__,
+                                "segsum");
+
+
   /* Parse over all the tile elements. */
   i_inc=0; i_ninc=1;
   i_start=gal_tile_start_end_ind_inclusive(tile, block, i_st_en);
@@ -349,16 +497,28 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
          incremented during 'gal_tile_block_increment'). */
       pprm->pix[ndim-1]=start_fastdim;
 
+      /* Sums of the segment's pixels (when the tile isn't on the edge). */
+      if(segsum)
+        convolve_spatial_segment(cprm, i_st_en[0]+i_inc, csize, segsum);
+
       /* Go over each pixel to convolve. */
       for(j=0;j<csize;++j)
         {
           /* Pointer to the pixel under consideration. */
           in_v = i_start + i_inc + j;
 
+          /* If the segment's sum for this pixel isn't NaN, there was no
+             blank value under the kernel (including the pixel itself). */
+          if( segsum && !isnan(segsum[j]) )
+            {
+              ksum = cprm->edgecorrection ? cprm->kernelsum : 1.0L;
+              out[ in_v - in ] = ksum==0.0L ? NAN : segsum[j]/ksum;
+            }
+
           /* If the input on this pixel is a NaN, then just set the output
              to NaN too and go onto the next pixel. 'in_v' is the pointer
              on this pixel. */
-          if( isnan(*in_v) )
+          else if( isnan(*in_v) )
             out[ in_v - in ]=NAN;
           else
             {
@@ -403,6 +563,7 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
       i_inc += gal_tile_block_increment(block, tile->dsize, i_ninc++,
                                         pprm->pix);
     }
+  if(segsum) free(segsum);
   /*
   if(pprm->id==2053)
     printf("... done.\n");
@@ -413,6 +574,97 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
 
 
 
+/* Convolve over one tile with a separable 2D kernel: the kernel is the
+   outer product of 'kfs' (along the slow dimension) and 'kff' (along the
+   fast dimension), so convolution can be done with two 1D passes. The
+   first pass (along the fast dimension) is done on all the rows of the
+   tile and the half-kernel rows on either side of it (within the host).
+   The second pass is done over the first pass's result.
+
+   Pixels outside of the host and blank pixels don't contribute to the
+   sums. With edge correction, the same two passes are done on the kernel
+   values that were used (one for a usable pixel and zero for others), so
+   the result is identical to the general case. */
+static void
+convolve_spatial_tile_separable(struct per_thread_spatial_prm *pprm)
+{
+  gal_data_t *tile=pprm->tile;
+  struct spatial_params *cprm=pprm->cprm;
+  gal_data_t *block=cprm->block, *kernel=cprm->kernel;
+
+  float x, *in=block->array, *out=cprm->out->array;
+  int ec=cprm->edgecorrection;
+  double sum, ksum, *rs, *rk=NULL, *kfs=cprm->kfs, *kff=cprm->kff;
+  size_t r, c, q, a, ncol, nrow, qmin, qmax, amin, amax, fr, lr;
+  size_t nc=block->dsize[1], hs=kernel->dsize[0]/2, hf=kernel->dsize[1]/2;
+  size_t *se=pprm->pix, *hst=pprm->host_start, *hsz;
+
+  /* The host of this tile and the tile's range, both relative to the
+     block (the ending coordinates in 'se' are not inclusive). */
+  pprm->host=cprm->convoverch ? block : tile->block;
+  gal_tile_start_coord(pprm->host, hst);
+  gal_tile_start_end_coord(tile, se, 1);
+  hsz=pprm->host->dsize;
+
+  /* The rows necessary for the first pass. */
+  fr = se[0] > hst[0]+hs ? se[0]-hs : hst[0];
+  lr = se[2]+hs < hst[0]+hsz[0] ? se[2]+hs : hst[0]+hsz[0];
+  nrow=lr-fr;
+  ncol=se[3]-se[1];
+
+  /* Allocate space for the first pass. */
+  rs=gal_pointer_allocate(GAL_TYPE_FLOAT64, nrow*ncol, 0, __func__, "rs");
+  if(ec)
+    rk=gal_pointer_allocate(GAL_TYPE_FLOAT64, nrow*ncol, 0, __func__,
+                            "rk");
+
+  /* First pass: along the fast dimension. */
+  for(r=fr;r<lr;++r)
+    for(c=se[1];c<se[3];++c)
+      {
+        sum=ksum=0.0;
+        qmin = c > hst[1]+hf ? c-hf : hst[1];
+        qmax = c+hf < hst[1]+hsz[1] ? c+hf : hst[1]+hsz[1]-1;
+        for(q=qmin;q<=qmax;++q)
+          if( !isnan( x=in[r*nc+q] ) )
+            {
+              sum += kff[q+hf-c] * x;
+              if(ec) ksum += kff[q+hf-c];
+            }
+        rs[(r-fr)*ncol+c-se[1]]=sum;
+        if(ec) rk[(r-fr)*ncol+c-se[1]]=ksum;
+      }
+
+  /* Second pass: along the slow dimension, writing the output. */
+  for(r=se[0];r<se[2];++r)
+    {
+      amin = r-fr > hs ? r-hs : fr;
+      amax = r+hs < lr ? r+hs : lr-1;
+      for(c=se[1];c<se[3];++c)
+        if( isnan(in[r*nc+c]) )
+          out[r*nc+c]=NAN;
+        else
+          {
+            sum=0.0;
+            ksum = ec ? 0.0 : 1.0;
+            for(a=amin;a<=amax;++a)
+              {
+                sum += kfs[a+hs-r] * rs[(a-fr)*ncol+c-se[1]];
+                if(ec) ksum += kfs[a+hs-r] * rk[(a-fr)*ncol+c-se[1]];
+              }
+            out[r*nc+c] = ksum==0.0 ? NAN : sum/ksum;
+          }
+    }
+
+  /* Clean up. */
+  free(rs);
+  if(rk) free(rk);
+}
+
+
+
+
+
 /* Do spatial convolution on each mesh. */
 static void *
 convolve_spatial_on_thread(void *inparam)
@@ -462,7 +714,8 @@ convolve_spatial_on_thread(void *inparam)
       pprm->tile = &cprm->tiles[ pprm->id ];
 
       /* Do the convolution on this tile. */
-      convolve_spatial_tile(pprm);
+      if(cprm->kfs) convolve_spatial_tile_separable(pprm);
+      else          convolve_spatial_tile(pprm);
     }
 
 
@@ -482,6 +735,41 @@ convolve_spatial_on_thread(void *inparam)
 
 
 
+/* Set the offset of each kernel element within the block (relative to
+   the element under the kernel's first element), the offset of the
+   kernel's center and the sum of the kernel (in the same order as the
+   general method). */
+static void
+convolve_spatial_kernel_offsets(struct spatial_params *cprm)
+{
+  float *k=cprm->kernel->array;
+  gal_data_t *block=cprm->block, *kernel=cprm->kernel;
+  size_t e, d, ndim=block->ndim;
+  size_t *binc=gal_dimension_increment(ndim, block->dsize);
+  size_t *coord=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__,
+                                     "coord");
+
+  cprm->kcenter=0;
+  cprm->kernelsum=0.0L;
+  cprm->koff=gal_pointer_allocate(GAL_TYPE_SIZE_T, kernel->size, 0,
+                                  __func__, "cprm->koff");
+  for(d=0;d<ndim;++d) cprm->kcenter += kernel->dsize[d]/2 * binc[d];
+  for(e=0;e<kernel->size;++e)
+    {
+      gal_dimension_index_to_coord(e, ndim, kernel->dsize, coord);
+      cprm->koff[e]=0;
+      for(d=0;d<ndim;++d) cprm->koff[e] += coord[d]*binc[d];
+      cprm->kernelsum += k[e];
+    }
+
+  free(coord);
+  free(binc);
+}
+
+
+
+
+
 /* General spatial convolve function. This function is called by both
    'gal_convolve_spatial' and */
 static gal_data_t *
@@ -539,6 +827,18 @@ gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
   params.edgecorrection=edgecorrection;
 
 
+  /* When the kernel is separable, use two 1D passes (currently not when
+     correcting the channel edges). */
+  params.kff=NULL;
+  params.kfs = ( tocorrect
+                 ? NULL
+                 : convolve_kernel_separable(kernel, &params.kff) );
+
+
+  /* Offsets of the kernel elements (for tiles that aren't on the edge). */
+  convolve_spatial_kernel_offsets(&params);
+
+
   /* Allocate the per-thread parameters. */
   errno=0;
   params.pprm=malloc(numthreads * sizeof *params.pprm);
@@ -554,6 +854,8 @@ gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
 
 
   /* Clean up and return the output array. */
+  if(params.kfs) { free(params.kfs); free(params.kff); }
+  free(params.koff);
   free(params.pprm);
   return out;
 }
@@ -611,3 +913,420 @@ gal_convolve_spatial_correct_ch_edge(gal_data_t *tiles, gal_data_t *kernel,
   gal_convolve_spatial_general(tiles, kernel, numthreads,
                                edgecorrection, 0, tocorrect);
 }
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*********************************************************************/
+/********************    Frequency convolution    ********************/
+/*********************************************************************/
+/* Values with a smaller absolute value in the convolved image are
+   floating point errors of the Fourier transforms. */
+#define CONVOLVE_FREQUENCY_ROUNDOFF 1e-10
+
+/* Parameters for convolution in blocks in the frequency domain. The input
+   and kernel are real, so their Fourier transforms are
+   conjugate-symmetric and only the non-negative frequencies along the
+   second (fastest) axis are kept. Each padded array thus has 'ps0' rows
+   of 'ps1+2' elements (of type 'ffttype'): in the spatial domain, the
+   values of each row are in its first 'ps1' elements and in the frequency
+   domain, each row has 'ps1/2+1' complex numbers. */
+struct frequency_params
+{
+  gal_data_t       *input;  /* Input dataset (can be a tile).          */
+  gal_data_t      *kernel;  /* Kernel to convolve with.                */
+  gal_data_t         *out;  /* Output dataset.                         */
+  uint8_t         ffttype;  /* Type of padded arrays (32 or 64-bit).   */
+  size_t        blocksize;  /* Side of each block (in pixels).         */
+  size_t              ps0;  /* Padded size along first C axis.         */
+  size_t              ps1;  /* Padded size along second C axis.        */
+  void              *pker;  /* Fourier transform of the kernel.        */
+  void             *rwave;  /* Real wavetable (forward on rows).       */
+  void            *hcwave;  /* Halfcomplex wavetable (backward rows).  */
+  void             *cwave;  /* Complex wavetable (columns).            */
+};
+
+
+
+
+
+/* Return the smallest even number that is not smaller than 'n' and has
+   no prime factors other than 2, 3 and 5. GSL's mixed-radix FFT has
+   optimized modules for these radices, but any other prime factor is
+   transformed with a general (and much slower) module. */
+static size_t
+convolve_frequency_fast_size(size_t n)
+{
+  size_t m, out;
+
+  for(out=n+n%2; ; out+=2)
+    {
+      m=out;
+      while(m%2==0) m/=2;
+      while(m%3==0) m/=3;
+      while(m%5==0) m/=5;
+      if(m==1) return out;
+    }
+}
+
+
+
+
+
+/* 2D Fourier transform of the padded array 'd' with the workspaces of this
+   thread. The forward transform is done on the rows first (with GSL's
+   real-to-halfcomplex transform), then the columns (with complex
+   transforms and a stride of 'ps1/2+1' complex numbers). GSL's
+   halfcomplex format for an even 'n' is: r0, r1, i1, ..., r(n/2). So after
+   the forward transform of each row, it is unpacked in place into the
+   complex numbers of the row (from the end, so no value is over-written
+   before it is moved). The backward transform is done in the opposite
+   order and GSL's inverse transforms are normalized. */
+#define CONVOLVE_FREQUENCY_FFT(IT, REAL, HALFCOMPLEX, FORWARD, INVERSE) { \
+    IT *r;                                                              \
+    if(forward)                                                         \
+      {                                                                 \
+        for(i=0;i<ps0;++i)                                              \
+          {                                                             \
+            r=(IT *)d+i*(n+2);                                          \
+            REAL(r, 1, n, fprm->rwave, rwork);                          \
+            r[n+1]=0.0f;                                                \
+            r[n]=r[n-1];                                                \
+            for(k=n/2-1;k>0;--k) { r[2*k+1]=r[2*k]; r[2*k]=r[2*k-1]; }  \
+            r[1]=0.0f;                                                  \
+          }                                                             \
+        for(i=0;i<nc;++i)                                               \
+          FORWARD((IT *)d+2*i, nc, ps0, fprm->cwave, cwork);            \
+      }                                                                 \
+    else                                                                \
+      {                                                                 \
+        for(i=0;i<nc;++i)                                               \
+          INVERSE((IT *)d+2*i, nc, ps0, fprm->cwave, cwork);            \
+        for(i=0;i<ps0;++i)                                              \
+          {                                                             \
+            r=(IT *)d+i*(n+2);                                          \
+            for(k=1;k<n/2;++k) { r[2*k-1]=r[2*k]; r[2*k]=r[2*k+1]; }    \
+            r[n-1]=r[n];                                                \
+            HALFCOMPLEX(r, 1, n, fprm->hcwave, rwork);                  \
+          }                                                             \
+      }                                                                 \
+  }
+
+static void
+convolve_frequency_fft(struct frequency_params *fprm, void *d, void *rwork,
+                       void *cwork, int forward)
+{
+  size_t i, k, ps0=fprm->ps0, n=fprm->ps1, nc=n/2+1;
+
+  if(fprm->ffttype==GAL_TYPE_FLOAT32)
+    CONVOLVE_FREQUENCY_FFT(float, gsl_fft_real_float_transform,
+                           gsl_fft_halfcomplex_float_inverse,
+                           gsl_fft_complex_float_forward,
+                           gsl_fft_complex_float_inverse)
+  else
+    CONVOLVE_FREQUENCY_FFT(double, gsl_fft_real_transform,
+                           gsl_fft_halfcomplex_inverse,
+                           gsl_fft_complex_forward,
+                           gsl_fft_complex_inverse)
+}
+
+
+
+
+
+/* Allocate the workspaces of GSL's Fourier transforms (on one thread). */
+static void
+convolve_frequency_workspaces(struct frequency_params *fprm, void **rwork,
+                              void **cwork, int alloc1freen1)
+{
+  if(fprm->ffttype==GAL_TYPE_FLOAT32)
+    {
+      if(alloc1freen1==1)
+        {
+          *rwork=gsl_fft_real_workspace_float_alloc(fprm->ps1);
+          *cwork=gsl_fft_complex_workspace_float_alloc(fprm->ps0);
+        }
+      else
+        {
+          gsl_fft_real_workspace_float_free(*rwork);
+          gsl_fft_complex_workspace_float_free(*cwork);
+        }
+    }
+  else
+    {
+      if(alloc1freen1==1)
+        {
+          *rwork=gsl_fft_real_workspace_alloc(fprm->ps1);
+          *cwork=gsl_fft_complex_workspace_alloc(fprm->ps0);
+        }
+      else
+        {
+          gsl_fft_real_workspace_free(*rwork);
+          gsl_fft_complex_workspace_free(*cwork);
+        }
+    }
+}
+
+
+
+
+
+/* Allocate the padded kernel, with its values in the first rows and
+   columns (all other elements are zero). */
+static void *
+convolve_frequency_pad_kernel(struct frequency_params *fprm)
+{
+  double *d;
+  float *f, *ff;
+  void *padded;
+  size_t i, pw=fprm->ps1+2;
+  size_t k0=fprm->kernel->dsize[0], k1=fprm->kernel->dsize[1];
+
+  padded=gal_pointer_allocate(fprm->ffttype, fprm->ps0*pw, 1, __func__,
+                              "padded");
+  for(i=0;i<k0;++i)
+    {
+      ff=(f=(float *)fprm->kernel->array+i*k1)+k1;
+      if(fprm->ffttype==GAL_TYPE_FLOAT32)
+        memcpy((float *)padded+i*pw, f, k1*sizeof *f);
+      else
+        { d=(double *)padded+i*pw; do *d++=*f; while(++f<ff); }
+    }
+  return padded;
+}
+
+
+
+
+
+/* Multiply the complex numbers of the padded array 'arr' by those of the
+   kernel's transform ('fprm->pker'). The real component of each product
+   is kept until the imaginary component is found, then it is put in.
+
+   (a+ib)*(c+id)=(ac-bd)+i(ad+bc)  */
+#define CONVOLVE_FREQUENCY_MULTIPLY(IT) {                               \
+    IT r, *a=arr, *b=fprm->pker, *af=a+2*fprm->ps0*(fprm->ps1/2+1);     \
+    do                                                                  \
+      {                                                                 \
+        r      = (*a * *b) - (*(a+1) * *(b+1));                         \
+        *(a+1) = (*(a+1) * *b) + (*a * *(b+1));                         \
+        *a=r;                                                           \
+        a+=2;                                                           \
+        b+=2;                                                           \
+      }                                                                 \
+    while(a<af);                                                        \
+  }
+
+/* Copy the input pixels that contribute to a block into the padded array
+   (see 'convolve_frequency_on_thread'). */
+#define CONVOLVE_FREQUENCY_FILL(IT) {                                   \
+    IT *d=(IT *)buf + r*pw + (cs+h1-c1);                                \
+    for(j=cs;j<ce;++j) *d++=f[j];                                       \
+  }
+
+/* Copy the final (not wrapped-around) pixels of one row of the block into
+   the output and remove floating point round-off errors. */
+#define CONVOLVE_FREQUENCY_EXTRACT(IT) {                                \
+    IT *d=(IT *)buf + (r+2*h0)*pw + 2*h1;                               \
+    for(j=0;j<b1;++j)                                                   \
+      o[j] = ( d[j]<-CONVOLVE_FREQUENCY_ROUNDOFF                        \
+               || d[j]>CONVOLVE_FREQUENCY_ROUNDOFF                      \
+               ? d[j]                                                   \
+               : 0.0f );                                                \
+  }
+
+/* Convolve the blocks assigned to this thread with the overlap-save
+   method. The output block number 'b' covers 'b0' rows after row 'o0'
+   and 'b1' columns after column 'o1' of the input (that can be a tile),
+   which start at 'c0' and 'c1' in its allocated block. The input pixels
+   that contribute to it are the block with a halo of half the kernel
+   width on each side ('h0' and 'h1'): they are used from the allocated
+   block (even if they are outside the tile), and any pixel outside the
+   allocated block is zero. This region is placed at the start of the
+   padded array and convolved with the kernel in the frequency
+   domain. The first 'k0-1' rows and 'k1-1' columns of the result are
+   corrupted by the wrap-around of the circular convolution, but the
+   padded size is large enough for the rest to be the correct (linear)
+   convolution, so the output block starts after them. Each thread only
+   writes into its own output blocks, so no locking is necessary. */
+static void *
+convolve_frequency_on_thread(void *inparam)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct frequency_params *fprm=(struct frequency_params *)tprm->params;
+
+  uint8_t type=fprm->ffttype;
+  void *buf, *arr, *rwork, *cwork;
+  gal_data_t *block=gal_tile_block(fprm->input);
+  float *f, *o, *in=block->array, *out=fprm->out->array;
+  size_t i, j, r, b, o0, o1, b0, b1, c0, c1, cs, ce, start[2];
+  size_t pw=fprm->ps1+2, bs=fprm->blocksize;
+  size_t s0=fprm->input->dsize[0], s1=fprm->input->dsize[1];
+  size_t bl0=block->dsize[0], bl1=block->dsize[1];
+  size_t h0=(fprm->kernel->dsize[0]-1)/2, h1=(fprm->kernel->dsize[1]-1)/2;
+  size_t nb1=(s1+bs-1)/bs, bsize=fprm->ps0*pw*gal_type_sizeof(type);
+
+  /* Allocate the padded array and the workspaces of this thread. */
+  arr=buf=gal_pointer_allocate(type, fprm->ps0*pw, 0, __func__, "buf");
+  convolve_frequency_workspaces(fprm, &rwork, &cwork, 1);
+  gal_tile_start_coord(fprm->input, start);
+
+  /* Go over all the blocks given to this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Position and size of this block in the output and its position
+         in the allocated block of the input. */
+      b=tprm->indexs[i];
+      o0=(b/nb1)*bs;    b0 = o0+bs<s0 ? bs : s0-o0;
+      o1=(b%nb1)*bs;    b1 = o1+bs<s1 ? bs : s1-o1;
+      c0=start[0]+o0;
+      c1=start[1]+o1;
+
+      /* Range of input columns that are necessary for this block. */
+      cs = c1>h1          ? c1-h1    : 0;
+      ce = c1+b1+h1<bl1   ? c1+b1+h1 : bl1;
+
+      /* Fill the padded array, row 'r' of the padded array corresponds
+         to row 'c0+r-h0' of the allocated block. */
+      memset(buf, 0, bsize);
+      for(r=0;r<b0+2*h0;++r)
+        if(c0+r>=h0 && c0+r-h0<bl0)
+          {
+            f=in+(c0+r-h0)*bl1;
+            if(type==GAL_TYPE_FLOAT32) CONVOLVE_FREQUENCY_FILL(float)
+            else                       CONVOLVE_FREQUENCY_FILL(double)
+          }
+
+      /* Convolve in the frequency domain. */
+      convolve_frequency_fft(fprm, buf, rwork, cwork, 1);
+      if(type==GAL_TYPE_FLOAT32) CONVOLVE_FREQUENCY_MULTIPLY(float)
+      else                       CONVOLVE_FREQUENCY_MULTIPLY(double)
+      convolve_frequency_fft(fprm, buf, rwork, cwork, 0);
+
+      /* Write the convolved block into the output. */
+      for(r=0;r<b0;++r)
+        {
+          o=out+(o0+r)*s1+o1;
+          if(type==GAL_TYPE_FLOAT32) CONVOLVE_FREQUENCY_EXTRACT(float)
+          else                       CONVOLVE_FREQUENCY_EXTRACT(double)
+        }
+    }
+
+  /* Clean up and wait until all other threads finish. */
+  free(buf);
+  convolve_frequency_workspaces(fprm, &rwork, &cwork, -1);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Convolve a 2D dataset with a kernel in the frequency domain, in
+   separate blocks of 'blocksize' pixels on each side (with the
+   overlap-save method). The padded arrays only have the size of a block
+   (plus the kernel), so the memory necessary for the Fourier transforms
+   doesn't depend on the size of the input. The input can be a tile: the
+   output will have the size of the tile, but the pixels of the allocated
+   block around it will also be used. */
+gal_data_t *
+gal_convolve_frequency_blocks(gal_data_t *input, gal_data_t *kernel,
+                              size_t blocksize, uint8_t ffttype,
+                              size_t numthreads, size_t minmapsize,
+                              int quietmmap)
+{
+  size_t nb, s0, s1;
+  void *rwork, *cwork;
+  struct frequency_params fprm;
+  gal_data_t *block=gal_tile_block(input);
+
+  /* Sanity checks. */
+  if(input->ndim!=2 || kernel->ndim!=2)
+    error(EXIT_FAILURE, 0, "%s: the input and kernel must be 2D (they have "
+          "%zu and %zu dimensions)", __func__, input->ndim, kernel->ndim);
+  if( block->type!=GAL_TYPE_FLOAT32 || kernel->type!=GAL_TYPE_FLOAT32 )
+    error(EXIT_FAILURE, 0, "%s: only accepts 'float32' type input and "
+          "kernel currently", __func__);
+  if( kernel->dsize[0]%2==0 || kernel->dsize[1]%2==0 )
+    error(EXIT_FAILURE, 0, "%s: the kernel must have an odd number of "
+          "pixels along both dimensions", __func__);
+  if(blocksize==0)
+    error(EXIT_FAILURE, 0, "%s: 'blocksize' must not be zero", __func__);
+  if(ffttype!=GAL_TYPE_FLOAT32 && ffttype!=GAL_TYPE_FLOAT64)
+    error(EXIT_FAILURE, 0, "%s: 'ffttype' must be 'GAL_TYPE_FLOAT32' or "
+          "'GAL_TYPE_FLOAT64'", __func__);
+
+  /* Basic parameters, the padded size of each block is large enough for
+     the kernel's footprint not to wrap around. */
+  s0=input->dsize[0];
+  s1=input->dsize[1];
+  fprm.input=input;
+  fprm.kernel=kernel;
+  fprm.ffttype=ffttype;
+  fprm.blocksize=blocksize;
+  fprm.ps0=convolve_frequency_fast_size( (blocksize<s0 ? blocksize : s0)
+                                         + kernel->dsize[0] - 1 );
+  fprm.ps1=convolve_frequency_fast_size( (blocksize<s1 ? blocksize : s1)
+                                         + kernel->dsize[1] - 1 );
+
+  /* The GSL wavetables (that can be shared between threads). */
+  if(ffttype==GAL_TYPE_FLOAT32)
+    {
+      fprm.rwave  = gsl_fft_real_wavetable_float_alloc(fprm.ps1);
+      fprm.hcwave = gsl_fft_halfcomplex_wavetable_float_alloc(fprm.ps1);
+      fprm.cwave  = gsl_fft_complex_wavetable_float_alloc(fprm.ps0);
+    }
+  else
+    {
+      fprm.rwave  = gsl_fft_real_wavetable_alloc(fprm.ps1);
+      fprm.hcwave = gsl_fft_halfcomplex_wavetable_alloc(fprm.ps1);
+      fprm.cwave  = gsl_fft_complex_wavetable_alloc(fprm.ps0);
+    }
+
+  /* Pad and transform the kernel (it is used in all the blocks). */
+  fprm.pker=convolve_frequency_pad_kernel(&fprm);
+  convolve_frequency_workspaces(&fprm, &rwork, &cwork, 1);
+  convolve_frequency_fft(&fprm, fprm.pker, rwork, cwork, 1);
+  convolve_frequency_workspaces(&fprm, &rwork, &cwork, -1);
+
+  /* Allocate the output and convolve the blocks on separate threads. */
+  fprm.out=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 2, input->dsize,
+                          input==block ? block->wcs : NULL, 0, minmapsize,
+                          quietmmap, NULL, block->unit, NULL);
+  nb = ( (s0+blocksize-1)/blocksize ) * ( (s1+blocksize-1)/blocksize );
+  gal_threads_spin_off(convolve_frequency_on_thread, &fprm, nb, numthreads,
+                       minmapsize, quietmmap);
+
+  /* Clean up and return. */
+  free(fprm.pker);
+  if(ffttype==GAL_TYPE_FLOAT32)
+    {
+      gsl_fft_real_wavetable_float_free(fprm.rwave);
+      gsl_fft_halfcomplex_wavetable_float_free(fprm.hcwave);
+      gsl_fft_complex_wavetable_float_free(fprm.cwave);
+    }
+  else
+    {
+      gsl_fft_real_wavetable_free(fprm.rwave);
+      gsl_fft_halfcomplex_wavetable_free(fprm.hcwave);
+      gsl_fft_complex_wavetable_free(fprm.cwave);
+    }
+  return fprm.out;
+}
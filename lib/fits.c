@@ -30,6 +30,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include <gsl/gsl_version.h>
 
@@ -39,6 +40,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/fits.h>
 #include <gnuastro/tile.h>
 #include <gnuastro/blank.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/pointer.h>
 
 #include <gnuastro-internal/checkset.h>
@@ -1991,10 +1993,174 @@ gal_fits_img_info_dim(char *filename, char *hdu, size_t *ndim)
 
 
 
+/* Return 1 if the CFITSIO library can be used on multiple threads (when
+   it was built with '--enable-reentrant'). */
+static int
+fits_is_reentrant_safe(void)
+{
+#if GAL_CONFIG_HAVE_FITS_IS_REENTRANT == 1
+  return fits_is_reentrant();
+#else
+  return 0;
+#endif
+}
+
+
+
+
+
+/* Parameters for reading a tile-compressed image on multiple threads. */
+struct fits_img_read_threaded_params
+{
+  char       *filename;  /* Name of the input file.                    */
+  char            *hdu;  /* HDU of the input image.                    */
+  gal_data_t      *img;  /* Already allocated output dataset.          */
+  size_t     stripsize;  /* Number of elements in each strip.          */
+  size_t      striplen;  /* Length of strip along slowest dimension.   */
+};
+
+
+
+
+
+/* Each strip is a group of full tile-rows (along the slowest dimension),
+   so every compressed tile is only decompressed by one thread. Each
+   thread opens the file independently (CFITSIO requires this for reading
+   the same file from multiple threads). */
+static void *
+fits_img_read_threaded_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct fits_img_read_threaded_params *p=tprm->params;
+
+  long *fpixel;
+  gal_data_t *img=p->img;
+  fitsfile *fptr=NULL;
+  void *blank=NULL;
+  size_t d, i, start, size;
+  int status=0, anyblank, datatype=gal_fits_type_to_datatype(img->type);
+
+  /* Allocate the first pixel array (see 'gal_fits_img_read'). */
+  fpixel=gal_pointer_allocate(GAL_TYPE_INT64, img->ndim, 0, __func__,
+                              "fpixel");
+
+  /* Go over all the strips that are assigned to this thread. */
+  while( (i=gal_threads_index_next(tprm)) != GAL_BLANK_SIZE_T )
+    {
+      /* Only open the file when this thread actually has a strip. */
+      if(fptr==NULL)
+        {
+          fptr=gal_fits_hdu_open(p->filename, p->hdu, READONLY);
+          blank=gal_blank_alloc_write(img->type);
+        }
+
+      /* Elements of this strip (the last one may be shorter). Note that
+         in the FITS standard, the slowest dimension is the last. */
+      start = i * p->stripsize;
+      size  = ( start + p->stripsize > img->size
+                ? img->size - start : p->stripsize );
+      for(d=0;d<img->ndim;++d) fpixel[d]=1;
+      fpixel[img->ndim-1] = i * p->striplen + 1;
+
+      /* Decompress the tiles straight into the output array. */
+      fits_read_pix(fptr, datatype, fpixel, size, blank,
+                    gal_pointer_increment(img->array, start, img->type),
+                    &anyblank, &status);
+      gal_fits_io_error(status, NULL);
+    }
+
+  /* Clean up. */
+  if(fptr)
+    {
+      fits_close_file(fptr, &status);
+      gal_fits_io_error(status, NULL);
+    }
+  free(fpixel);
+  free(blank);
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* If the image in 'fptr' is tile-compressed (for example with 'fpack'),
+   read it into the already allocated 'img' on 'numthreads' threads and
+   return 1. If it can't be read in parallel (it isn't compressed, or
+   CFITSIO wasn't built to be reentrant), return 0 so the caller reads it
+   serially. */
+static int
+fits_img_read_threaded(fitsfile *fptr, char *filename, char *hdu,
+                       gal_data_t *img, size_t numthreads)
+{
+  long ztile;
+  int status=0;
+  char keyname[FLEN_KEYWORD];
+  size_t numtilerows, tilesperstrip;
+  struct fits_img_read_threaded_params p;
+
+  /* Basic checks. */
+  if( numthreads<2
+      || fits_is_reentrant_safe()==0
+      || fits_is_compressed_image(fptr, &status)==0 )
+    return 0;
+
+  /* Size of each tile along the slowest dimension (that is the last FITS
+     dimension). When the keyword doesn't exist, the tiles are one row. */
+  sprintf(keyname, "ZTILE%zu", img->ndim);
+  if( fits_read_key(fptr, TLONG, keyname, &ztile, NULL, &status) )
+    {
+      if(status!=KEY_NO_EXIST) gal_fits_io_error(status, NULL);
+      status=0;
+      ztile=1;
+    }
+  if(ztile<1 || (size_t)ztile>img->dsize[0]) ztile=img->dsize[0];
+
+  /* Each thread should get about four strips of tile-rows: too many
+     strips will waste time in the many calls to 'fits_read_pix' and too
+     few will not balance the load between the threads. */
+  numtilerows = ( img->dsize[0] + ztile - 1 ) / ztile;
+  if(numtilerows<2) return 0;
+  tilesperstrip = numtilerows / ( 4 * numthreads );
+  if(tilesperstrip==0) tilesperstrip=1;
+
+  /* Read the strips. */
+  p.img=img;
+  p.hdu=hdu;
+  p.filename=filename;
+  p.striplen=tilesperstrip*ztile;
+  p.stripsize=p.striplen*(img->size/img->dsize[0]);
+  gal_threads_spin_off_dynamic(fits_img_read_threaded_worker, &p,
+                               (img->dsize[0]+p.striplen-1)/p.striplen,
+                               numthreads, NULL);
+  return 1;
+}
+
+
+
+
+
 /* Read a FITS image HDU into a Gnuastro data structure. */
 gal_data_t *
-gal_fits_img_read(char *filename, char *hdu, size_t minmapsize,
-                  int quietmmap)
+gal_fits_img_read(char *filename, char *hdu, size_t minmapsize, int quietmmap)
+{
+  return gal_fits_img_read_threaded(filename, hdu, 1, minmapsize,
+                                    quietmmap);
+}
+
+
+
+
+
+/* Similar to 'gal_fits_img_read', but when the image is tile-compressed
+   and 'numthreads>1', the tiles will be decompressed on multiple
+   threads. */
+gal_data_t *
+gal_fits_img_read_threaded(char *filename, char *hdu, size_t numthreads,
+                           size_t minmapsize, int quietmmap)
 {
   void *blank;
   long *fpixel;
@@ -2045,9 +2211,12 @@ gal_fits_img_read(char *filename, char *hdu, size_t minmapsize,
 
 
   /* Read the image into the allocated array: */
-  fits_read_pix(fptr, gal_fits_type_to_datatype(type), fpixel,
-                img->size, blank, img->array, &anyblank, &status);
-  if(status) gal_fits_io_error(status, NULL);
+  if( fits_img_read_threaded(fptr, filename, hdu, img, numthreads)==0 )
+    {
+      fits_read_pix(fptr, gal_fits_type_to_datatype(type), fpixel,
+                    img->size, blank, img->array, &anyblank, &status);
+      if(status) gal_fits_io_error(status, NULL);
+    }
   free(fpixel);
   free(blank);
 
@@ -2071,11 +2240,28 @@ gal_fits_img_read(char *filename, char *hdu, size_t minmapsize,
 gal_data_t *
 gal_fits_img_read_to_type(char *inputname, char *hdu, uint8_t type,
                           size_t minmapsize, int quietmmap)
+{
+  return gal_fits_img_read_to_type_threaded(inputname, hdu, type, 1,
+                                            minmapsize, quietmmap);
+}
+
+
+
+
+
+/* Similar to 'gal_fits_img_read_to_type', but tile-compressed images are
+   decompressed on 'numthreads' threads (see
+   'gal_fits_img_read_threaded'). */
+gal_data_t *
+gal_fits_img_read_to_type_threaded(char *inputname, char *hdu, uint8_t type,
+                                   size_t numthreads, size_t minmapsize,
+                                   int quietmmap)
 {
   gal_data_t *in, *converted;
 
   /* Read the specified input image HDU. */
-  in=gal_fits_img_read(inputname, hdu, minmapsize, quietmmap);
+  in=gal_fits_img_read_threaded(inputname, hdu, numthreads, minmapsize,
+                                quietmmap);
 
   /* If the input had another type, convert it to float. */
   if(in->type!=type)
@@ -2417,6 +2603,392 @@ gal_fits_img_write_corr_wcs_str(gal_data_t *input, char *filename,
 
 
 
+/* Fill CFITSIO's first and last pixel arrays (that are 1-based and in the
+   FITS order of dimensions) for a region that starts at the (0-based, C
+   order) coordinates 'start' and has 'size' elements along each
+   dimension. */
+static void
+fits_img_region_to_pixels(size_t ndim, size_t *start, size_t *size,
+                          long *fpixel, long *lpixel)
+{
+  size_t i;
+  for(i=0;i<ndim;++i)
+    {
+      fpixel[ndim-1-i] = start[i] + 1;
+      lpixel[ndim-1-i] = start[i] + size[i];
+    }
+}
+
+
+
+
+
+/* Read a region of an already opened image HDU into a dataset. The region
+   starts at the (0-based, C order) coordinates 'start' and has 'tsize'
+   elements along each dimension, it must be fully within the image. If
+   'type' is 'GAL_TYPE_INVALID', the output will have the type of the HDU,
+   otherwise CFITSIO will convert the values to 'type' while reading. */
+gal_data_t *
+gal_fits_img_read_tile(fitsfile *fptr, size_t *start, size_t *tsize,
+                       uint8_t type, size_t minmapsize, int quietmmap)
+{
+  void *blank;
+  gal_data_t *out;
+  size_t i, ndim, *dsize;
+  char *name=NULL, *unit=NULL;
+  int status=0, hdutype, anyblank;
+  long fpixel[GAL_FITS_MAX_NDIM], lpixel[GAL_FITS_MAX_NDIM];
+  long inc[GAL_FITS_MAX_NDIM];
+
+  /* Get the image information. */
+  gal_fits_img_info(fptr, &hdutype, &ndim, &dsize, &name, &unit);
+  if(type==GAL_TYPE_INVALID) type=hdutype;
+
+  /* Make sure the region is within the image. */
+  for(i=0;i<ndim;++i)
+    if(tsize[i]==0 || start[i]+tsize[i]>dsize[i])
+      error(EXIT_FAILURE, 0, "%s: the requested region (%zu elements "
+            "from element %zu along dimension %zu, in C order) is not "
+            "within the image (that has %zu elements along that "
+            "dimension)", __func__, tsize[i], start[i], i, dsize[i]);
+
+  /* Read the region into the allocated dataset. */
+  for(i=0;i<ndim;++i) inc[i]=1;
+  fits_img_region_to_pixels(ndim, start, tsize, fpixel, lpixel);
+  out=gal_data_alloc(NULL, type, ndim, tsize, NULL, 0, minmapsize,
+                     quietmmap, name, unit, NULL);
+  blank=gal_blank_alloc_write(type);
+  fits_read_subset(fptr, gal_fits_type_to_datatype(type), fpixel, lpixel,
+                   inc, blank, out->array, &anyblank, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Clean up and return. */
+  if(name) free(name);
+  if(unit) free(unit);
+  free(dsize);
+  free(blank);
+  return out;
+}
+
+
+
+
+
+/* Parameters to read an image in strips (see
+   'gal_fits_img_strips_open'). */
+struct gal_fits_img_strips
+{
+  fitsfile             *fptr;   /* Pointer to the opened HDU.          */
+  uint8_t               type;   /* Type of the returned strips.        */
+  size_t                ndim;   /* Number of dimensions of the image.  */
+  size_t              *dsize;   /* Size of the image (C order).        */
+  size_t              height;   /* Number of rows in each strip.       */
+  size_t                halo;   /* Rows of halo on each side.          */
+  int               prefetch;   /* Read next strip in the background.  */
+  size_t          minmapsize;   /* Minimum size to use mmap.           */
+  int              quietmmap;   /* Don't print mmap warnings.          */
+  size_t                next;   /* First row of the next strip.        */
+  gal_data_t     *prefetched;   /* Strip read in the background.       */
+  pthread_t           thread;   /* Thread reading the next strip.      */
+  int                running;   /* ==1: the thread is running.         */
+};
+
+
+
+
+
+/* Read the strip that starts from row 'first' (along the slowest
+   dimension) with its halo. */
+static gal_data_t *
+fits_img_strips_read(struct gal_fits_img_strips *strips, size_t first)
+{
+  void *blank;
+  gal_data_t *out;
+  int status=0, anyblank;
+  size_t i, start, end, *dsize;
+  long fpixel[GAL_FITS_MAX_NDIM];
+
+  /* Rows of this strip (including the halo). */
+  start = first>strips->halo ? first-strips->halo : 0;
+  end   = ( first+strips->height+strips->halo < strips->dsize[0]
+            ? first+strips->height+strips->halo
+            : strips->dsize[0] );
+
+  /* Allocate the output. */
+  dsize=gal_pointer_allocate(GAL_TYPE_SIZE_T, strips->ndim, 0, __func__,
+                             "dsize");
+  for(i=0;i<strips->ndim;++i) dsize[i]=strips->dsize[i];
+  dsize[0]=end-start;
+  out=gal_data_alloc(NULL, strips->type, strips->ndim, dsize, NULL, 0,
+                     strips->minmapsize, strips->quietmmap, NULL, NULL,
+                     NULL);
+  free(dsize);
+
+  /* The rows along the slowest dimension are contiguous in the FITS
+     file, so the strip can be read with one call. */
+  for(i=0;i<strips->ndim;++i) fpixel[i]=1;
+  fpixel[strips->ndim-1]=start+1;
+  blank=gal_blank_alloc_write(strips->type);
+  fits_read_pix(strips->fptr, gal_fits_type_to_datatype(strips->type),
+                fpixel, out->size, blank, out->array, &anyblank, &status);
+  gal_fits_io_error(status, NULL);
+  free(blank);
+
+  /* Return the strip. */
+  return out;
+}
+
+
+
+
+
+/* Function to read the next strip on a background thread. */
+static void *
+fits_img_strips_prefetch(void *in)
+{
+  struct gal_fits_img_strips *strips=(struct gal_fits_img_strips *)in;
+  strips->prefetched=fits_img_strips_read(strips, strips->next);
+  return NULL;
+}
+
+
+
+
+
+/* Prepare to read an image HDU in strips of 'height' rows along its
+   slowest dimension (for example rows of a 2D image, or slices of a 3D
+   cube), with 'halo' rows on each side. If 'prefetch' is non-zero (and
+   CFITSIO is thread-safe), each strip will be read on a background
+   thread while the previous strip is being processed. */
+struct gal_fits_img_strips *
+gal_fits_img_strips_open(char *filename, char *hdu, uint8_t type,
+                         size_t height, size_t halo, int prefetch,
+                         size_t minmapsize, int quietmmap)
+{
+  int hdutype;
+  struct gal_fits_img_strips *strips;
+
+  /* Sanity check. */
+  if(height==0)
+    error(EXIT_FAILURE, 0, "%s: the height of the strips must not be "
+          "zero", __func__);
+
+  /* Allocate the structure. */
+  errno=0;
+  strips=malloc(sizeof *strips);
+  if(strips==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'strips'",
+          __func__, sizeof *strips);
+
+  /* Open the HDU and read the image information. */
+  strips->fptr=gal_fits_hdu_open_format(filename, hdu, 0);
+  gal_fits_img_info(strips->fptr, &hdutype, &strips->ndim, &strips->dsize,
+                    NULL, NULL);
+  if(strips->ndim==0)
+    error(EXIT_FAILURE, 0, "%s (hdu: %s) has 0 dimensions", filename, hdu);
+
+  /* Set the rest of the parameters. */
+  strips->type       = type==GAL_TYPE_INVALID ? hdutype : type;
+  strips->height     = height;
+  strips->halo       = halo;
+  strips->minmapsize = minmapsize;
+  strips->quietmmap  = quietmmap;
+  strips->prefetch   = prefetch && fits_is_reentrant_safe();
+  strips->next       = 0;
+  strips->prefetched = NULL;
+  strips->running    = 0;
+  return strips;
+}
+
+
+
+
+
+/* Return the next strip of the image (that has to be freed by the
+   caller), or NULL when there are no more strips. The first row of the
+   returned dataset is row 'start' of the image and the strip's own rows
+   (without the halo) are the 'number' rows from row 'first'. Any of these
+   three pointers can be NULL if the value isn't needed. */
+gal_data_t *
+gal_fits_img_strips_next(struct gal_fits_img_strips *strips, size_t *start,
+                         size_t *first, size_t *number)
+{
+  gal_data_t *out;
+  size_t f=strips->next, dsize0=strips->dsize[0];
+
+  /* No more strips. */
+  if(f>=dsize0) return NULL;
+
+  /* Get the strip: if it is being read in the background, wait for it,
+     otherwise read it here. */
+  if(strips->running)
+    {
+      if( pthread_join(strips->thread, NULL) )
+        error(EXIT_FAILURE, 0, "%s: couldn't join the thread reading the "
+              "next strip", __func__);
+      strips->running=0;
+      out=strips->prefetched;
+      strips->prefetched=NULL;
+    }
+  else
+    out=fits_img_strips_read(strips, f);
+
+  /* Set the position of this strip and go onto the next. */
+  if(first)  *first  = f;
+  if(start)  *start  = f>strips->halo ? f-strips->halo : 0;
+  if(number) *number = f+strips->height<dsize0 ? strips->height : dsize0-f;
+  strips->next += strips->height;
+
+  /* Start reading the next strip in the background. */
+  if(strips->prefetch && strips->next<dsize0)
+    {
+      if( pthread_create(&strips->thread, NULL, fits_img_strips_prefetch,
+                         strips) )
+        error(EXIT_FAILURE, errno, "%s: couldn't create a thread to read "
+              "the next strip", __func__);
+      strips->running=1;
+    }
+
+  /* Return the strip. */
+  return out;
+}
+
+
+
+
+
+/* Close the file and free the strips structure. */
+void
+gal_fits_img_strips_close(struct gal_fits_img_strips *strips)
+{
+  int status=0;
+
+  /* If a strip is being read, wait for it and free it. */
+  if(strips->running)
+    {
+      pthread_join(strips->thread, NULL);
+      gal_data_free(strips->prefetched);
+    }
+
+  /* Close the file and free the structure. */
+  fits_close_file(strips->fptr, &status);
+  gal_fits_io_error(status, NULL);
+  free(strips->dsize);
+  free(strips);
+}
+
+
+
+
+
+/* Create an image HDU (with the given type, size and optional name, units
+   and WCS) in 'filename', but don't write any pixels into it (until they
+   are written with 'gal_fits_img_write_tile'). The returned pointer
+   should be closed by the caller (after writing all the pixels and any
+   extra keywords). Since the pixels aren't known yet, with integer types,
+   the 'BLANK' keyword will always be written. */
+fitsfile *
+gal_fits_img_write_empty(char *filename, uint8_t type, size_t ndim,
+                         size_t *dsize, struct wcsprm *wcs, char *name,
+                         char *unit)
+{
+  size_t i;
+  void *blank;
+  fitsfile *fptr;
+  int status=0;
+  long naxes[GAL_FITS_MAX_NDIM];
+
+  /* Sanity checks. */
+  if( gal_fits_name_is_fits(filename)==0 )
+    error(EXIT_FAILURE, 0, "%s: not a FITS suffix", filename);
+  if(ndim==0 || ndim>GAL_FITS_MAX_NDIM)
+    error(EXIT_FAILURE, 0, "%s: %zu dimensions are not acceptable",
+          __func__, ndim);
+  if(type==GAL_TYPE_UINT64)
+    error(EXIT_FAILURE, 0, "%s: the 'uint64' type is not yet supported "
+          "when writing an image in parts, please use 'int64'", __func__);
+
+  /* Create the image (the 'naxes' array is in the opposite order). */
+  fptr=gal_fits_open_to_write(filename);
+  for(i=0;i<ndim;++i) naxes[ndim-1-i]=dsize[i];
+  fits_create_img(fptr, gal_fits_type_to_bitpix(type), ndim, naxes,
+                  &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Remove the two comment lines put by CFITSIO (see
+     'gal_fits_img_write_to_ptr'). */
+  fits_delete_key(fptr, "COMMENT", &status);
+  fits_delete_key(fptr, "COMMENT", &status);
+  status=0;
+
+  /* The blank value of integer types. */
+  if(type!=GAL_TYPE_FLOAT32 && type!=GAL_TYPE_FLOAT64)
+    {
+      blank=gal_fits_key_img_blank(type);
+      if(fits_write_key(fptr, gal_fits_type_to_datatype(type), "BLANK",
+                        blank, "Pixels with no data.", &status) )
+        gal_fits_io_error(status, "adding the BLANK keyword");
+      free(blank);
+    }
+
+  /* Name, units and WCS. */
+  if(name) fits_write_key(fptr, TSTRING, "EXTNAME", name, "", &status);
+  if(unit) fits_write_key(fptr, TSTRING, "BUNIT", unit, "", &status);
+  if(wcs)  gal_wcs_write_in_fitsptr(fptr, wcs);
+  gal_fits_io_error(status, NULL);
+  return fptr;
+}
+
+
+
+
+
+/* Write the pixels of 'tile' into an image HDU (for example created by
+   'gal_fits_img_write_empty') from the (0-based, C order) coordinates
+   'start'. If 'start' is NULL, the position of the tile within its
+   allocated block will be used. CFITSIO will convert the values if
+   'tile' has a different type from the HDU. */
+void
+gal_fits_img_write_tile(fitsfile *fptr, gal_data_t *tile, size_t *start)
+{
+  int status=0;
+  size_t *tstart=start;
+  long fpixel[GAL_FITS_MAX_NDIM], lpixel[GAL_FITS_MAX_NDIM];
+  gal_data_t *towrite, *block=gal_tile_block(tile);
+
+  /* Sanity check. */
+  if(tile->type==GAL_TYPE_UINT64)
+    error(EXIT_FAILURE, 0, "%s: the 'uint64' type is not yet supported",
+          __func__);
+
+  /* Starting coordinates of the tile. */
+  if(tstart==NULL)
+    {
+      tstart=gal_pointer_allocate(GAL_TYPE_SIZE_T, tile->ndim, 0, __func__,
+                                  "tstart");
+      gal_tile_start_coord(tile, tstart);
+    }
+
+  /* If the input is a tile (isn't a contiguous region of memory), then
+     copy it into a contiguous region. */
+  towrite = tile==block ? tile : gal_data_copy(tile);
+
+  /* Write the pixels. */
+  fits_img_region_to_pixels(towrite->ndim, tstart, towrite->dsize, fpixel,
+                            lpixel);
+  fits_write_subset(fptr, gal_fits_type_to_datatype(towrite->type), fpixel,
+                    lpixel, towrite->array, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Clean up. */
+  if(tstart!=start) free(tstart);
+  if(towrite!=tile) gal_data_free(towrite);
+}
+
+
+
+
+
 
 
 
@@ -2951,18 +3523,450 @@ fits_tab_read_ascii_float_special(char *filename, char *hdu, fitsfile *fptr,
 
 
 
+/* Information of each column that is read in row groups. */
+struct fits_tab_rowgroup_col
+{
+  gal_data_t      *out;  /* Output dataset (already allocated).        */
+  size_t        offset;  /* Byte offset of this column in each row.    */
+  size_t         width;  /* Number of bytes of each element.           */
+  int         signflip;  /* Flip the sign bit (TZERO for unsigned).    */
+  int          hasnull;  /* A TNULL keyword exists for this column.    */
+  long long      tnull;  /* The raw (stored) blank value.              */
+};
+
+/* Parameters for scattering one group of rows on multiple threads. */
+struct fits_tab_rowgroup_params
+{
+  struct fits_tab_rowgroup_col *cols;  /* Information on each column.  */
+  size_t         numcols;  /* Number of columns in 'cols'.             */
+  unsigned char     *buf;  /* Raw bytes of the rows in this group.     */
+  size_t        rowbytes;  /* Number of bytes in each row.             */
+  size_t        firstrow;  /* Index of the group's first row.          */
+  size_t         numrows;  /* Number of rows in this group.            */
+  size_t       numslices;  /* Number of slices (one for each thread).  */
+};
+
+
+
+
+
+/* The FITS standard stores all numbers in big-endian order. Composing the
+   value from its bytes (instead of swapping them based on the host's
+   byte order) will work on any host. */
+static uint8_t
+fits_tab_rowgroup_be8(unsigned char *p)
+{
+  return p[0];
+}
+
+static uint16_t
+fits_tab_rowgroup_be16(unsigned char *p)
+{
+  return (uint16_t)p[0]<<8 | (uint16_t)p[1];
+}
+
+static uint32_t
+fits_tab_rowgroup_be32(unsigned char *p)
+{
+  return ( (uint32_t)p[0]<<24 | (uint32_t)p[1]<<16
+           | (uint32_t)p[2]<<8 | (uint32_t)p[3] );
+}
+
+static uint64_t
+fits_tab_rowgroup_be64(unsigned char *p)
+{
+  return ( (uint64_t)fits_tab_rowgroup_be32(p)<<32
+           | (uint64_t)fits_tab_rowgroup_be32(p+4) );
+}
+
+
+
+
+
+/* Read the value of a column-specific keyword (for example 'TSCAL3'),
+   return 1 if it exists and 0 if it doesn't. */
+static int
+fits_tab_rowgroup_key(fitsfile *fptr, char *prefix, size_t colnum,
+                      int datatype, void *value)
+{
+  int status=0;
+  char keyname[FLEN_KEYWORD];
+
+  sprintf(keyname, "%s%zu", prefix, colnum);
+  if( fits_read_key(fptr, datatype, keyname, value, NULL, &status) )
+    {
+      if(status==KEY_NO_EXIST) return 0;
+      gal_fits_io_error(status, NULL);
+    }
+  return 1;
+}
+
+
+
+
+
+/* Return the byte offset of each column within a row of a binary table
+   (the number of bytes in each row will be put in 'rowbytes'). If the
+   table's layout isn't as expected, NULL will be returned so the caller
+   can use CFITSIO to read each column. */
+static size_t *
+fits_tab_rowgroup_offsets(fitsfile *fptr, size_t *rowbytes)
+{
+  char tform[FLEN_VALUE];
+  long repeat, width, naxis1;
+  size_t i, numcols, *offsets;
+  int status=0, datatype, tfields;
+
+  /* Number of columns. */
+  fits_read_key(fptr, TINT, "TFIELDS", &tfields, NULL, &status);
+  gal_fits_io_error(status, NULL);
+  numcols=tfields;
+
+  /* Allocate the offsets array. */
+  offsets=gal_pointer_allocate(GAL_TYPE_SIZE_T, numcols+1, 0, __func__,
+                               "offsets");
+
+  /* Go over all the columns and add the number of bytes in each. */
+  offsets[0]=0;
+  for(i=0;i<numcols;++i)
+    {
+      if( fits_tab_rowgroup_key(fptr, "TFORM", i+1, TSTRING, tform)==0 )
+        { free(offsets); return NULL; }
+      fits_binary_tform(tform, &datatype, &repeat, &width, &status);
+      gal_fits_io_error(status, NULL);
+
+      /* Variable-length columns only keep a descriptor in the row and
+         for strings, 'width' is the width of each sub-string. */
+      if(datatype<0)
+        offsets[i+1] = offsets[i] + ( strchr(tform, 'Q') ? 16 : 8 );
+      else if(datatype==TBIT)
+        offsets[i+1] = offsets[i] + (repeat+7)/8;
+      else if(datatype==TSTRING)
+        offsets[i+1] = offsets[i] + repeat;
+      else
+        offsets[i+1] = offsets[i] + repeat*width;
+    }
+
+  /* Check the total width of each row. */
+  fits_read_key(fptr, TLONG, "NAXIS1", &naxis1, NULL, &status);
+  gal_fits_io_error(status, NULL);
+  if(offsets[numcols]!=(size_t)naxis1) { free(offsets); return NULL; }
+
+  /* Return the offsets. */
+  *rowbytes=offsets[numcols];
+  return offsets;
+}
+
+
+
+
+
+/* See if column 'colnum' (counting from 1) can be read in row groups and
+   if so, fill 'col' and return 1. Only single-valued columns of the basic
+   numeric types and strings can be read in row groups (when their values
+   don't need any scaling other than the standard offsets for unsigned
+   types). For the rest, CFITSIO will be used. */
+static int
+fits_tab_rowgroup_col_prepare(fitsfile *fptr, size_t colnum,
+                              size_t *offsets, gal_data_t *out,
+                              struct fits_tab_rowgroup_col *col)
+{
+  char tform[FLEN_VALUE];
+  long repeat, width;
+  double tscal, tzero=0.0;
+  int status=0, datatype, signflip=0;
+
+  /* Read the format of the column. */
+  fits_tab_rowgroup_key(fptr, "TFORM", colnum, TSTRING, tform);
+  fits_binary_tform(tform, &datatype, &repeat, &width, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Numeric columns. */
+  if(datatype!=TSTRING)
+    {
+      /* Only single-valued columns with the same width as the output. */
+      if( repeat!=1 || (size_t)width!=gal_type_sizeof(out->type) )
+        return 0;
+
+      /* Scaling. */
+      if( fits_tab_rowgroup_key(fptr, "TSCAL", colnum, TDOUBLE, &tscal)
+          && tscal!=1.0 )
+        return 0;
+      fits_tab_rowgroup_key(fptr, "TZERO", colnum, TDOUBLE, &tzero);
+
+      /* The output type should correspond to the stored type. With the
+         standard 'TZERO' offsets, only the sign bit should be flipped
+         (see 'fits_correct_bin_table_int_types'). */
+      switch(datatype)
+        {
+        case TBYTE:
+          if(out->type==GAL_TYPE_UINT8 && tzero==0.0) break;
+          if(out->type==GAL_TYPE_INT8 && tzero==INT8_MIN)
+            { signflip=1; break; }
+          return 0;
+
+        case TSHORT:
+          if(out->type==GAL_TYPE_INT16 && tzero==0.0) break;
+          if(out->type==GAL_TYPE_UINT16 && tzero==-(double)INT16_MIN)
+            { signflip=1; break; }
+          return 0;
+
+        case TLONG:
+          if(out->type==GAL_TYPE_INT32 && tzero==0.0) break;
+          if(out->type==GAL_TYPE_UINT32 && tzero==-(double)INT32_MIN)
+            { signflip=1; break; }
+          return 0;
+
+        case TLONGLONG:
+          if(out->type==GAL_TYPE_INT64 && tzero==0.0) break;
+          return 0;
+
+        case TFLOAT:
+          if(out->type==GAL_TYPE_FLOAT32 && tzero==0.0) break;
+          return 0;
+
+        case TDOUBLE:
+          if(out->type==GAL_TYPE_FLOAT64 && tzero==0.0) break;
+          return 0;
+
+        default:
+          return 0;
+        }
+
+      /* Blank values of integer types (similar to 'gal_fits_tab_read',
+         floating point blank values are just NaN). */
+      col->hasnull = ( datatype!=TFLOAT && datatype!=TDOUBLE
+                       && fits_tab_rowgroup_key(fptr, "TNULL", colnum,
+                                                TLONGLONG, &col->tnull) );
+      col->width=width;
+    }
+
+  /* String columns. */
+  else
+    {
+      if(out->type!=GAL_TYPE_STRING || repeat<1) return 0;
+      col->hasnull=0;
+      col->width=repeat;
+    }
+
+  /* Fill in the rest of the information and return. */
+  col->out=out;
+  col->signflip=signflip;
+  col->offset=offsets[colnum-1];
+  return 1;
+}
+
+
+
+
+
+/* Convert the raw (big-endian) values of an integer column into the
+   output type. 'UT' is the unsigned type with the same width as the
+   stored type and 'ST' is the stored type (TNULL is in the stored
+   type). */
+#define FITS_TAB_ROWGROUP_INT(OT, UT, ST, GET, MASK) {                  \
+    UT u;                                                               \
+    OT blank, *o=(OT *)(col->out->array) + p->firstrow;                 \
+    gal_blank_write(&blank, col->out->type);                            \
+    for(r=start;r<end;++r)                                              \
+      {                                                                 \
+        u=GET(p->buf + r*p->rowbytes + col->offset);                    \
+        o[r] = ( col->hasnull && (ST)u==col->tnull                      \
+                 ? blank                                                \
+                 : (OT)( col->signflip ? u^(UT)(MASK) : u ) );          \
+      }                                                                 \
+  }
+
+/* Floating point columns only need their bytes to be put in order. */
+#define FITS_TAB_ROWGROUP_FLT(OT, UT, GET) {                            \
+    UT u;                                                               \
+    OT *o=(OT *)(col->out->array) + p->firstrow;                        \
+    for(r=start;r<end;++r)                                              \
+      {                                                                 \
+        u=GET(p->buf + r*p->rowbytes + col->offset);                    \
+        memcpy(&o[r], &u, sizeof u);                                    \
+      }                                                                 \
+  }
+
+/* Each action of a thread is one slice of the rows in the group, in all
+   the columns. */
+static void *
+fits_tab_rowgroup_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct fits_tab_rowgroup_params *p=tprm->params;
+
+  char **strarr;
+  unsigned char *raw;
+  size_t i, c, r, w, start, end;
+  struct fits_tab_rowgroup_col *col;
+
+  /* Go over all the slices that are assigned to this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Rows of this slice (within the group). */
+      start = tprm->indexs[i]     * p->numrows / p->numslices;
+      end   = (tprm->indexs[i]+1) * p->numrows / p->numslices;
+
+      /* Go over the columns. */
+      for(c=0;c<p->numcols;++c)
+        {
+          col=&p->cols[c];
+          switch(col->out->type)
+            {
+            case GAL_TYPE_UINT8:
+              FITS_TAB_ROWGROUP_INT(uint8_t, uint8_t, uint8_t,
+                                    fits_tab_rowgroup_be8, 0);
+              break;
+            case GAL_TYPE_INT8:
+              FITS_TAB_ROWGROUP_INT(int8_t, uint8_t, uint8_t,
+                                    fits_tab_rowgroup_be8, 0x80);
+              break;
+            case GAL_TYPE_INT16:
+              FITS_TAB_ROWGROUP_INT(int16_t, uint16_t, int16_t,
+                                    fits_tab_rowgroup_be16, 0);
+              break;
+            case GAL_TYPE_UINT16:
+              FITS_TAB_ROWGROUP_INT(uint16_t, uint16_t, int16_t,
+                                    fits_tab_rowgroup_be16, 0x8000);
+              break;
+            case GAL_TYPE_INT32:
+              FITS_TAB_ROWGROUP_INT(int32_t, uint32_t, int32_t,
+                                    fits_tab_rowgroup_be32, 0);
+              break;
+            case GAL_TYPE_UINT32:
+              FITS_TAB_ROWGROUP_INT(uint32_t, uint32_t, int32_t,
+                                    fits_tab_rowgroup_be32, 0x80000000);
+              break;
+            case GAL_TYPE_INT64:
+              FITS_TAB_ROWGROUP_INT(int64_t, uint64_t, int64_t,
+                                    fits_tab_rowgroup_be64, 0);
+              break;
+            case GAL_TYPE_FLOAT32:
+              FITS_TAB_ROWGROUP_FLT(float, uint32_t, fits_tab_rowgroup_be32);
+              break;
+            case GAL_TYPE_FLOAT64:
+              FITS_TAB_ROWGROUP_FLT(double, uint64_t, fits_tab_rowgroup_be64);
+              break;
+
+            /* Like CFITSIO, a string that starts with a NULL character is
+               blank and the trailing white space is removed. */
+            case GAL_TYPE_STRING:
+              strarr=(char **)(col->out->array) + p->firstrow;
+              for(r=start;r<end;++r)
+                {
+                  raw=p->buf + r*p->rowbytes + col->offset;
+                  if(raw[0]=='\0')
+                    gal_checkset_allocate_copy(GAL_BLANK_STRING, &strarr[r]);
+                  else
+                    {
+                      errno=0;
+                      strarr[r]=malloc(col->width+1);
+                      if(strarr[r]==NULL)
+                        error(EXIT_FAILURE, errno, "%s: allocating %zu "
+                              "bytes for strarr[%zu]", __func__,
+                              col->width+1, r);
+                      memcpy(strarr[r], raw, col->width);
+                      strarr[r][col->width]='\0';
+                      for(w=strlen(strarr[r]); w>0 && strarr[r][w-1]==' '; --w)
+                        strarr[r][w-1]='\0';
+                    }
+                }
+              break;
+
+            default:
+              error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s "
+                    "to fix the problem. Type code %d isn't recognized",
+                    __func__, PACKAGE_BUGREPORT, col->out->type);
+            }
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Read the columns in 'cols' of a binary table in groups of contiguous
+   rows: the raw bytes of each group are read from the file only once
+   (with 'fits_read_tblbytes'), then they are converted and scattered into
+   the output columns on multiple threads. */
+static void
+fits_tab_rowgroup_read(fitsfile *fptr, struct fits_tab_rowgroup_col *cols,
+                       size_t numcols, size_t rowbytes, size_t numrows,
+                       size_t numthreads, size_t minmapsize, int quietmmap)
+{
+  int status=0;
+  size_t grouprows;
+  struct fits_tab_rowgroup_params p;
+
+  /* Each group will be at most 16 mebibytes: large enough to be read
+     efficiently, while not using too much extra memory. */
+  grouprows = 16777216 / rowbytes;
+  if(grouprows==0) grouprows=1;
+  if(grouprows>numrows) grouprows=numrows;
+
+  /* Set the constant parameters and allocate the buffer. */
+  p.cols=cols;
+  p.numcols=numcols;
+  p.rowbytes=rowbytes;
+  p.buf=gal_pointer_allocate(GAL_TYPE_UINT8, grouprows*rowbytes, 0,
+                             __func__, "p.buf");
+
+  /* Read each group and scatter it into the columns. */
+  for(p.firstrow=0; p.firstrow<numrows; p.firstrow+=p.numrows)
+    {
+      p.numrows = ( numrows-p.firstrow < grouprows
+                    ? numrows-p.firstrow : grouprows );
+      fits_read_tblbytes(fptr, p.firstrow+1, 1, p.numrows*rowbytes, p.buf,
+                         &status);
+      gal_fits_io_error(status, NULL);
+      p.numslices = numthreads < p.numrows ? numthreads : p.numrows;
+      gal_threads_spin_off(fits_tab_rowgroup_worker, &p, p.numslices,
+                           numthreads, minmapsize, quietmmap);
+    }
+
+  /* Clean up. */
+  free(p.buf);
+}
+
+
+
+
+
 /* Read the column indexs into a dataset. */
 gal_data_t *
 gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
                   gal_data_t *allcols, gal_list_sizet_t *indexll,
                   size_t minmapsize, int quietmmap)
 {
-  size_t i=0;
+  return gal_fits_tab_read_threaded(filename, hdu, numrows, allcols,
+                                    indexll, 1, minmapsize, quietmmap);
+}
+
+
+
+
+
+/* Similar to 'gal_fits_tab_read', but the values of the columns in a
+   binary table are decoded on 'numthreads' threads. */
+gal_data_t *
+gal_fits_tab_read_threaded(char *filename, char *hdu, size_t numrows,
+                           gal_data_t *allcols, gal_list_sizet_t *indexll,
+                           size_t numthreads, size_t minmapsize,
+                           int quietmmap)
+{
   void *blank;
   char **strarr;
   fitsfile *fptr;
   gal_data_t *out=NULL;
   gal_list_sizet_t *ind;
+  size_t i=0, rowbytes=0, numrg=0, *offsets;
+  struct fits_tab_rowgroup_col *rgcols=NULL;
   int isfloat, status=0, anynul=0, hdutype;
 
   /* We actually do have columns to read. */
@@ -2976,6 +3980,21 @@ gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
       if (fits_get_hdu_type(fptr, &hdutype, &status) )
         gal_fits_io_error(status, NULL);
 
+      /* In binary tables, the basic columns will be read in groups of
+         rows (see 'fits_tab_rowgroup_read'). */
+      offsets = ( hdutype==BINARY_TBL
+                  ? fits_tab_rowgroup_offsets(fptr, &rowbytes)
+                  : NULL );
+      if(offsets)
+        {
+          errno=0;
+          rgcols=calloc(gal_list_sizet_number(indexll), sizeof *rgcols);
+          if(rgcols==NULL)
+            error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
+                  "'rgcols'", __func__,
+                  gal_list_sizet_number(indexll) * sizeof *rgcols);
+        }
+
       /* Pop each index and read/store the array. */
       for(ind=indexll; ind!=NULL; ind=ind->next)
         {
@@ -2986,6 +4005,16 @@ gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
                                   allcols[ind->v].name, allcols[ind->v].unit,
                                   allcols[ind->v].comment);
 
+          /* If this column can be read in row groups, it will be read
+             after all the columns are allocated. */
+          if( offsets
+              && fits_tab_rowgroup_col_prepare(fptr, ind->v+1, offsets, out,
+                                               &rgcols[numrg]) )
+            {
+              ++numrg;
+              continue;
+            }
+
           /* For a string column, we need an allocated array for each element,
              even in binary values. This value should be stored in the
              disp_width element of the data structure, which is done
@@ -3044,6 +4073,12 @@ gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
           gal_fits_io_error(status, NULL);
         }
 
+      /* Read the columns that can be read in row groups. */
+      if(numrg)
+        fits_tab_rowgroup_read(fptr, rgcols, numrg, rowbytes, numrows,
+                               numthreads, minmapsize, quietmmap);
+      if(offsets) { free(rgcols); free(offsets); }
+
       /* Close the FITS file */
       fits_close_file(fptr, &status);
       gal_fits_io_error(status, NULL);
@@ -35,6 +35,40 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /************************************************************************/
 /*************             Low-level operators          *****************/
 /************************************************************************/
+/* Checks for a non-blank element in the left or right operands. When the
+   operand is an integer, its blank value is used ('lb' or 'rb'), but for
+   floating point operands, the blank value is NaN, which is only
+   identifiable from the fact that it isn't equal to itself. */
+#define BINARY_NB_INT_L(x) ( (x)!=lb )
+#define BINARY_NB_INT_R(x) ( (x)!=rb )
+#define BINARY_NB_FLT(x)   ( (x)==(x) )
+
+
+
+
+
+/* Loop over the elements when blank values should be checked. 'LNB' and
+   'RNB' are the names of the macros above to check if the left and right
+   elements are not blank. Each arrangement of sizes has its own loop, so
+   the conditions that don't change within the loop aren't checked on
+   every element and the compiler is free to vectorize the loops (the
+   blank check then becomes a mask on the result). */
+#define BINARY_OP_BLANK_LOOP(OP, LNB, RNB) {                            \
+    if(l->size==r->size)                                                \
+      do {*oa = (LNB(*la) && RNB(*ra)) ? *la OP *ra : ob; ++la; ++ra;}  \
+      while(++oa<of);                                                   \
+    else if(l->size==1)                                                 \
+      do {*oa = (LNB(*la) && RNB(*ra)) ? *la OP *ra : ob; ++ra;}        \
+      while(++oa<of);                                                   \
+    else                                                                \
+      do {*oa = (LNB(*la) && RNB(*ra)) ? *la OP *ra : ob; ++la;}        \
+      while(++oa<of);                                                   \
+  }
+
+
+
+
+
 /* Final step to be used by all operators and all types. */
 #define BINARY_OP_OT_RT_LT_SET(OP, OT, LT, RT) {                        \
     LT lb, *la=l->array;                                                \
@@ -45,18 +79,12 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
         gal_blank_write(&lb, l->type);                                  \
         gal_blank_write(&rb, r->type);                                  \
         gal_blank_write(&ob, o->type);                                  \
-        do                                                              \
-          {                                                             \
-            if(lb==lb && rb==rb)/* Both are integers.                */ \
-              *oa = (*la!=lb  && *ra!=rb)  ? *la OP *ra : ob ;          \
-            else if(lb==lb)     /* Only left operand is an integer.  */ \
-              *oa = (*la!=lb  && *ra==*ra) ? *la OP *ra : ob;           \
-            else                /* Only right operand is an integer. */ \
-              *oa = (*la==*la && *ra!=rb)  ? *la OP *ra : ob;           \
-            if(l->size>1) ++la;                                         \
-            if(r->size>1) ++ra;                                         \
-          }                                                             \
-        while(++oa<of);                                                 \
+        if(lb==lb && rb==rb)/* Both are integers.                */     \
+          BINARY_OP_BLANK_LOOP(OP, BINARY_NB_INT_L, BINARY_NB_INT_R)    \
+        else if(lb==lb)     /* Only left operand is an integer.  */     \
+          BINARY_OP_BLANK_LOOP(OP, BINARY_NB_INT_L, BINARY_NB_FLT)      \
+        else                /* Only right operand is an integer. */     \
+          BINARY_OP_BLANK_LOOP(OP, BINARY_NB_FLT,   BINARY_NB_INT_R)    \
       }                                                                 \
     else                                                                \
       {                                                                 \
@@ -70,6 +98,28 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/* Fast path for when both operands have the same floating point type. In
+   this case, blank values (NaN) don't need any explicit check: they are
+   propagated by the floating point standard within each element (and any
+   comparison with them is false). So the loops are kept as simple as
+   possible (with an index over independent elements) for the compiler to
+   vectorize them. */
+#define BINARY_FLT_OP_OT_IT_SET(OP, OT, IT) {                           \
+    size_t i, n=o->size;                                                \
+    OT *oa=o->array;                                                    \
+    IT lv, rv, *la=l->array, *ra=r->array;                              \
+    if(l->size==r->size)                                                \
+      for(i=0;i<n;++i) oa[i] = la[i] OP ra[i];                          \
+    else if(l->size==1)                                                 \
+      { lv=*la; for(i=0;i<n;++i) oa[i] = lv OP ra[i]; }                 \
+    else                                                                \
+      { rv=*ra; for(i=0;i<n;++i) oa[i] = la[i] OP rv; }                 \
+  }
+
+
+
+
+
 /* Blank values aren't defined for integer operators. */
 #define BINARY_INT_OP_OT_RT_LT_SET(OP, OT, LT, RT) {               \
     LT *la=l->array;                                               \
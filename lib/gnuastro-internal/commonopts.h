@@ -95,6 +95,19 @@ struct argp_option gal_commonopts_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "tablecache",
+      GAL_OPTIONS_KEY_TABLECACHE,
+      0,
+      0,
+      "Cache input tables (in native format).",
+      GAL_OPTIONS_GROUP_INPUT,
+      &cp->tablecache,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
 
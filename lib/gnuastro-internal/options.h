@@ -125,6 +125,7 @@ enum options_common_keys
   GAL_OPTIONS_KEY_INTERPONLYBLANK,
   GAL_OPTIONS_KEY_INTERPMETRIC,
   GAL_OPTIONS_KEY_INTERPNUMNGB,
+  GAL_OPTIONS_KEY_TABLECACHE,
 };
 
 
@@ -190,6 +191,7 @@ struct gal_options_common_params
   uint8_t             searchin; /* Column meta-data to match/search.      */
   uint8_t           ignorecase; /* Ignore case when matching col info.    */
   long            stdintimeout; /* Timeout (micro-seconds) for stdin.     */
+  uint8_t           tablecache; /* Cache input tables for faster reads.   */
 
   /* Output. */
   char                 *output; /* Directory containg output.             */
@@ -336,6 +338,11 @@ gal_options_stdin_error(long stdintimeout, int precedence, char *name);
 gal_list_str_t *
 gal_options_check_stdin(char *inputname, long stdintimeout, char *name);
 
+gal_data_t *
+gal_options_table_read(struct gal_options_common_params *cp, char *filename,
+                       char *hdu, gal_list_str_t *lines,
+                       gal_list_str_t *cols, size_t *colmatch);
+
 
 
 
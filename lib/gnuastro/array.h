@@ -62,20 +62,42 @@ gal_data_t *
 gal_array_read(char *filename, char *extension, gal_list_str_t *lines,
                size_t minmapsize, int quietmmap);
 
+gal_data_t *
+gal_array_read_threaded(char *filename, char *extension,
+                        gal_list_str_t *lines, size_t numthreads,
+                        size_t minmapsize, int quietmmap);
+
 gal_data_t *
 gal_array_read_to_type(char *filename, char *extension,
                        gal_list_str_t *lines, uint8_t type,
                        size_t minmapsize, int quietmmap);
 
+gal_data_t *
+gal_array_read_to_type_threaded(char *filename, char *extension,
+                                gal_list_str_t *lines, uint8_t type,
+                                size_t numthreads, size_t minmapsize,
+                                int quietmmap);
+
 gal_data_t *
 gal_array_read_one_ch(char *filename, char *extension, gal_list_str_t *lines,
                       size_t minmapsize, int quietmmap);
 
+gal_data_t *
+gal_array_read_one_ch_threaded(char *filename, char *extension,
+                               gal_list_str_t *lines, size_t numthreads,
+                               size_t minmapsize, int quietmmap);
+
 gal_data_t *
 gal_array_read_one_ch_to_type(char *filename, char *extension,
                               gal_list_str_t *lines, uint8_t type,
                               size_t minmapsize, int quietmmap);
 
+gal_data_t *
+gal_array_read_one_ch_to_type_threaded(char *filename, char *extension,
+                                       gal_list_str_t *lines, uint8_t type,
+                                       size_t numthreads, size_t minmapsize,
+                                       int quietmmap);
+
 
 __END_C_DECLS    /* From C++ preparations */
 
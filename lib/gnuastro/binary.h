@@ -70,14 +70,26 @@ gal_data_t *
 gal_binary_erode(gal_data_t *input, size_t num, int connectivity,
                  int inplace);
 
+gal_data_t *
+gal_binary_erode_threaded(gal_data_t *input, size_t num, int connectivity,
+                          int inplace, size_t numthreads);
+
 gal_data_t *
 gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
                   int inplace);
 
+gal_data_t *
+gal_binary_dilate_threaded(gal_data_t *input, size_t num, int connectivity,
+                           int inplace, size_t numthreads);
+
 gal_data_t *
 gal_binary_open(gal_data_t *input, size_t num, int connectivity,
                 int inplace);
 
+gal_data_t *
+gal_binary_open_threaded(gal_data_t *input, size_t num, int connectivity,
+                         int inplace, size_t numthreads);
+
 
 
 
@@ -89,6 +101,11 @@ size_t
 gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
                                 int connectivity);
 
+size_t
+gal_binary_connected_components_threaded(gal_data_t *binary,
+                                         gal_data_t **out, int connectivity,
+                                         size_t numthreads);
+
 gal_data_t *
 gal_binary_connected_indexs(gal_data_t *binary, int connectivity);
 
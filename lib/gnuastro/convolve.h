@@ -54,6 +54,12 @@ gal_convolve_spatial_correct_ch_edge(gal_data_t *tiles, gal_data_t *kernel,
                                      size_t numthreads, int edgecorrection,
                                      gal_data_t *tocorrect);
 
+gal_data_t *
+gal_convolve_frequency_blocks(gal_data_t *input, gal_data_t *kernel,
+                              size_t blocksize, uint8_t ffttype,
+                              size_t numthreads, size_t minmapsize,
+                              int quietmmap);
+
 
 
 __END_C_DECLS    /* From C++ preparations */
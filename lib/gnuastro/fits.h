@@ -93,6 +93,13 @@ typedef struct gal_fits_list_key_t
 
 
 
+/* To read an image in strips along its slowest dimension (see
+   'gal_fits_img_strips_open'). The structure is only used through the
+   'gal_fits_img_strips_*' functions. */
+struct gal_fits_img_strips;
+
+
+
 /* table.h needs 'gal_fits_list_key_t'. */
 #include <gnuastro/table.h>
 
@@ -263,10 +270,19 @@ gal_fits_img_info_dim(char *filename, char *hdu, size_t *ndim);
 gal_data_t *
 gal_fits_img_read(char *filename, char *hdu, size_t minmapsize, int quietmmap);
 
+gal_data_t *
+gal_fits_img_read_threaded(char *filename, char *hdu, size_t numthreads,
+                           size_t minmapsize, int quietmmap);
+
 gal_data_t *
 gal_fits_img_read_to_type(char *inputname, char *hdu, uint8_t type,
                           size_t minmapsize, int quietmmap);
 
+gal_data_t *
+gal_fits_img_read_to_type_threaded(char *inputname, char *hdu, uint8_t type,
+                                   size_t numthreads, size_t minmapsize,
+                                   int quietmmap);
+
 gal_data_t *
 gal_fits_img_read_kernel(char *filename, char *hdu, size_t minmapsize,
                          int quietmmap);
@@ -289,6 +305,30 @@ gal_fits_img_write_corr_wcs_str(gal_data_t *input, char *filename,
                                 gal_fits_list_key_t *headers,
                                 char *program_string);
 
+gal_data_t *
+gal_fits_img_read_tile(fitsfile *fptr, size_t *start, size_t *tsize,
+                       uint8_t type, size_t minmapsize, int quietmmap);
+
+struct gal_fits_img_strips *
+gal_fits_img_strips_open(char *filename, char *hdu, uint8_t type,
+                         size_t height, size_t halo, int prefetch,
+                         size_t minmapsize, int quietmmap);
+
+gal_data_t *
+gal_fits_img_strips_next(struct gal_fits_img_strips *strips, size_t *start,
+                         size_t *first, size_t *number);
+
+void
+gal_fits_img_strips_close(struct gal_fits_img_strips *strips);
+
+fitsfile *
+gal_fits_img_write_empty(char *filename, uint8_t type, size_t ndim,
+                         size_t *dsize, struct wcsprm *wcs, char *name,
+                         char *unit);
+
+void
+gal_fits_img_write_tile(fitsfile *fptr, gal_data_t *tile, size_t *start);
+
 
 
 
@@ -311,6 +351,12 @@ gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
                   gal_data_t *colinfo, gal_list_sizet_t *indexll,
                   size_t minmapsize, int quietmmap);
 
+gal_data_t *
+gal_fits_tab_read_threaded(char *filename, char *hdu, size_t numrows,
+                           gal_data_t *colinfo, gal_list_sizet_t *indexll,
+                           size_t numthreads, size_t minmapsize,
+                           int quietmmap);
+
 void
 gal_fits_tab_write(gal_data_t *cols, gal_list_str_t *comments,
                    int tableformat, char *filename, char *extname,
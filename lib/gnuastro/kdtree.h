@@ -48,6 +48,31 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 
 
 
+/* A k-d tree that is optimized for many searches. It is a balanced
+   binary tree with an implicit layout (the children of node 'i' are nodes
+   '2i+1' and '2i+2'). The points are permuted into the order of the tree
+   and each node has a contiguous range of them and the box that encloses
+   them. Nodes with at most 'bucket' points are leaves. Points with a NaN
+   coordinate are not in the tree. It can be used in any number of
+   searches (also on multiple threads at the same time). */
+typedef struct gal_kdtree_query_t
+{
+  size_t           ndim;  /* Number of dimensions.                      */
+  size_t           size;  /* Number of points in the tree.              */
+  size_t         bucket;  /* Maximum number of points in a leaf.        */
+  size_t         nnodes;  /* Number of nodes (in the implicit layout).  */
+  size_t          *perm;  /* Input row of each point (in tree order).   */
+  double        *coords;  /* Coordinates of the points: 'ndim' blocks   */
+                          /* of 'size' elements (one for each dim).     */
+  size_t         *start;  /* First point of each node (or blank).       */
+  size_t           *end;  /* One after the last point of each node.     */
+  double           *low;  /* Lowest coordinates of each node's box.     */
+  double          *high;  /* Highest coordinates of each node's box.    */
+  gal_data_t    *arrays;  /* List of datasets containing the arrays.    */
+} gal_kdtree_query_t;
+
+
+
 gal_data_t *
 gal_kdtree_create(gal_data_t *coords_raw, size_t *root);
 
@@ -55,6 +80,55 @@ size_t
 gal_kdtree_nearest_neighbour(gal_data_t *coords_raw, gal_data_t *kdtree,
                              size_t root, double *point, double *least_dist);
 
+gal_kdtree_query_t *
+gal_kdtree_query_build(gal_data_t *coords_raw, size_t numthreads,
+                       size_t minmapsize, int quietmmap);
+
+gal_kdtree_query_t *
+gal_kdtree_query_prepare(gal_data_t *coords_raw, gal_data_t *kdtree,
+                         size_t root);
+
+void
+gal_kdtree_query_free(gal_kdtree_query_t *query);
+
+size_t
+gal_kdtree_query_nearest(gal_kdtree_query_t *query, double *point,
+                         double *least_dist);
+
+size_t
+gal_kdtree_query_knn(gal_kdtree_query_t *query, double *point, size_t k,
+                     size_t *indexs, double *dists);
+
+size_t *
+gal_kdtree_query_radius(gal_kdtree_query_t *query, double *point,
+                        double radius, size_t *num);
+
+size_t *
+gal_kdtree_query_range(gal_kdtree_query_t *query, double *low,
+                       double *high, size_t *num);
+
+gal_data_t *
+gal_kdtree_query_knn_batch(gal_kdtree_query_t *query, gal_data_t *points,
+                           size_t k, size_t numthreads, size_t minmapsize,
+                           int quietmmap);
+
+gal_data_t *
+gal_kdtree_query_radius_batch(gal_kdtree_query_t *query, gal_data_t *points,
+                              double radius, int countonly,
+                              size_t numthreads, size_t minmapsize,
+                              int quietmmap);
+
+uint64_t
+gal_kdtree_checksum(gal_data_t *coords_raw);
+
+void
+gal_kdtree_write(gal_data_t *coords_raw, gal_data_t *kdtree, size_t root,
+                 char *filename, char *extname, size_t numthreads);
+
+gal_data_t *
+gal_kdtree_read(gal_data_t *coords_raw, char *filename, char *hdu,
+                size_t *root, size_t minmapsize, int quietmmap);
+
 
 
 __END_C_DECLS    /* From C++ preparations */
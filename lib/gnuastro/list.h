@@ -158,6 +158,47 @@ gal_list_sizet_free(gal_list_sizet_t *list);
 
 
 
+/****************************************************************
+ *****************     size_t (array-based)    ******************
+ ****************************************************************/
+/* When many elements are added and popped (for example in a breadth-first
+   search), the allocation and freeing of each node of 'gal_list_sizet_t'
+   will be the bottleneck. This structure keeps the elements in a circular
+   array that is only re-allocated when it is full. So new elements are
+   added to its end and they can be popped from either end. */
+typedef struct gal_list_sizet_ring_t
+{
+  size_t         *array;    /* Circular array of elements.             */
+  size_t          alloc;    /* Number of allocated elements in 'array'. */
+  size_t          first;    /* Index of the first element in 'array'.  */
+  size_t            num;    /* Number of elements in the ring.         */
+  size_t     minmapsize;    /* Minimum size to memory-map 'array'.     */
+  int         quietmmap;    /* Don't print memory-mapping information. */
+  char        *mmapname;    /* File name of the mmap (if it is used).  */
+} gal_list_sizet_ring_t;
+
+gal_list_sizet_ring_t *
+gal_list_sizet_ring_alloc(size_t initial, size_t minmapsize, int quietmmap);
+
+void
+gal_list_sizet_ring_add(gal_list_sizet_ring_t *ring, size_t value);
+
+size_t
+gal_list_sizet_ring_pop_first(gal_list_sizet_ring_t *ring);
+
+size_t
+gal_list_sizet_ring_pop_last(gal_list_sizet_ring_t *ring);
+
+size_t *
+gal_list_sizet_ring_to_array(gal_list_sizet_ring_t *ring, size_t *num);
+
+void
+gal_list_sizet_ring_free(gal_list_sizet_ring_t *ring);
+
+
+
+
+
 /****************************************************************
  *****************           float           ********************
  ****************************************************************/
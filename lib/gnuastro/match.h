@@ -50,6 +50,20 @@ gal_match_coordinates(gal_data_t *coord1, gal_data_t *coord2,
                       int inplace, size_t minmapsize, int quietmmap,
                       size_t *nummatched);
 
+gal_data_t *
+gal_match_coordinates_threaded(gal_data_t *coord1, gal_data_t *coord2,
+                               double *aperture, int sorted_by_first,
+                               int inplace, size_t numthreads,
+                               size_t minmapsize, int quietmmap,
+                               size_t *nummatched);
+
+gal_data_t *
+gal_match_kdtree(gal_data_t *coord1, gal_data_t *coord2,
+                 gal_data_t *coord1_kdtree, size_t kdtree_root,
+                 double *aperture, int sorted_by_first, int inplace,
+                 size_t numthreads, size_t minmapsize, int quietmmap,
+                 size_t *nummatched);
+
 
 
 
@@ -141,6 +141,18 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *lines,
                gal_list_str_t *cols, int searchin, int ignorecase,
                size_t minmapsize, int quietmmap, size_t *colmatch);
 
+gal_data_t *
+gal_table_read_threaded(char *filename, char *hdu, gal_list_str_t *lines,
+                        gal_list_str_t *cols, int searchin, int ignorecase,
+                        size_t numthreads, size_t minmapsize, int quietmmap,
+                        size_t *colmatch);
+
+gal_data_t *
+gal_table_read_cache(char *filename, char *hdu, gal_list_str_t *lines,
+                     gal_list_str_t *cols, int searchin, int ignorecase,
+                     size_t numthreads, size_t minmapsize, int quietmmap,
+                     size_t *colmatch);
+
 gal_list_sizet_t *
 gal_table_list_of_indexs(gal_list_str_t *cols, gal_data_t *allcols,
                          size_t numcols, int searchin, int ignorecase,
@@ -160,6 +172,13 @@ gal_table_write(gal_data_t *cols, struct gal_fits_list_key_t **keylist,
                 gal_list_str_t *comments, int tableformat, char *filename,
                 char *extname, uint8_t colinfoinstdout);
 
+void
+gal_table_write_threaded(gal_data_t *cols,
+                         struct gal_fits_list_key_t **keylist,
+                         gal_list_str_t *comments, int tableformat,
+                         char *filename, char *extname,
+                         uint8_t colinfoinstdout, size_t numthreads);
+
 void
 gal_table_write_log(gal_data_t *logll, char *program_string,
                     time_t *rawtime, gal_list_str_t *comments,
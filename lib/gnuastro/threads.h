@@ -123,6 +123,11 @@ struct gal_threads_params
   void         *params; /* Input structure for higher-level settings.    */
   size_t       *indexs; /* Indexes of actions to be done in this thread. */
   pthread_barrier_t *b; /* Pointer the barrier for all threads.          */
+
+  /* Internal (used by 'gal_threads_index_next'). */
+  void        *dynamic; /* Dynamic scheduler (NULL for static).          */
+  size_t       counter; /* Position of next action.                      */
+  size_t          last; /* End of current chunk (dynamic scheduling).    */
 };
 
 void
@@ -130,6 +135,17 @@ gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
                      size_t numactions, size_t numthreads,
                      size_t minmapsize, int quietmmap);
 
+void
+gal_threads_spin_off_dynamic(void *(*worker)(void *), void *caller_params,
+                             size_t numactions, size_t numthreads,
+                             size_t *costs);
+
+size_t
+gal_threads_index_next(struct gal_threads_params *tprm);
+
+void
+gal_threads_pool_free(void);
+
 
 __END_C_DECLS    /* From C++ preparations */
 
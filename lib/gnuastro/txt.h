@@ -95,10 +95,21 @@ gal_txt_table_read(char *filename, gal_list_str_t *lines, size_t numrows,
                    gal_data_t *colinfo, gal_list_sizet_t *indexll,
                    size_t minmapsize, int quietmmap);
 
+gal_data_t *
+gal_txt_table_read_threaded(char *filename, gal_list_str_t *lines,
+                            size_t numrows, gal_data_t *colinfo,
+                            gal_list_sizet_t *indexll, size_t numthreads,
+                            size_t minmapsize, int quietmmap);
+
 gal_data_t *
 gal_txt_image_read(char *filename, gal_list_str_t *lines, size_t minmapsize,
                    int quietmmap);
 
+gal_data_t *
+gal_txt_image_read_threaded(char *filename, gal_list_str_t *lines,
+                            size_t numthreads, size_t minmapsize,
+                            int quietmmap);
+
 gal_list_str_t *
 gal_txt_stdin_read(long timeout_microsec);
 
@@ -107,6 +118,12 @@ gal_txt_write(gal_data_t *input, struct gal_fits_list_key_t **keylist,
               gal_list_str_t *comment, char *filename,
               uint8_t colinfoinstdout);
 
+void
+gal_txt_write_threaded(gal_data_t *input,
+                       struct gal_fits_list_key_t **keylist,
+                       gal_list_str_t *comment, char *filename,
+                       uint8_t colinfoinstdout, size_t numthreads);
+
 
 
 __END_C_DECLS    /* From C++ preparations */
@@ -28,11 +28,16 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <errno.h>
 #include <error.h>
 #include <float.h>
+#include <string.h>
+#include <math.h>
 
 #include <gnuastro/data.h>
+#include <gnuastro/fits.h>
 #include <gnuastro/table.h>
 #include <gnuastro/blank.h>
+#include <gnuastro/kdtree.h>
 #include <gnuastro/pointer.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/permutation.h>
 
 
@@ -98,35 +103,6 @@ kdtree_node_swap(struct kdtree_params *p, size_t node1, size_t node2)
 
 
 
-/* Return the distance between 2 given nodes. The distance is equivalent
-   to the radius of the hypersphere having node as its center.
-
-   Return: Radial distace from given point to the node.
-*/
-static double
-kdtree_distance_find(struct kdtree_params *p, size_t node,
-                     double *point)
-{
-  size_t i;
-  double *carr;
-  double t_distance, node_distance=0;
-
-  /* For all dimensions. */
-  for(i=0; i<p->ndim; ++i)
-    {
-      carr=p->coords[i]->array;
-      t_distance=carr[node]-point[i];
-
-      node_distance += t_distance*t_distance;
-    }
-
-  return node_distance;
-}
-
-
-
-
-
 
 
 
@@ -286,45 +262,49 @@ kdtree_cleanup(struct kdtree_params *p, gal_data_t *coords_raw)
 /****************************************************************
  ********                Create KD-Tree                   *******
  ****************************************************************/
-/* Divide the array into two parts, values more than that of k'th node
-   and values less than k'th node.
+/* Order of the values in the tree: NaN values are larger than all other
+   values (so they can't break the ordering of the other values). */
+#define KDTREE_LESS(A,B) ( isnan(B) ? !isnan(A) : (A)<(B) )
+
+
+
 
-   Return: Index of the node whose value is greater than all
-           the nodes before it.
+
+/* Divide the nodes between 'node_left' and 'node_right' (inclusive) into
+   three parts based on the value of the pivot: the nodes with a smaller
+   value, the nodes with an equal value and the nodes with a larger
+   value. Because the nodes that are equal to the pivot are put in the
+   middle, this is also fast when many values are equal.
+
+   Return: The first node that is equal to the pivot, the last one is put
+           in 'node_last'.
 */
 static size_t
 kdtree_make_partition(struct kdtree_params *p, size_t node_left,
-                      size_t node_right, size_t node_k,
-                      double *coordinate)
-{
-  /* store_index is the index before which all values are smaller than
-     the value of k'th node. */
-  size_t i, store_index;
-  double k_node_value = coordinate[p->input_row[node_k]];
-
-  /* Move the k'th node to the right. */
-  kdtree_node_swap(p, node_k, node_right);
-
-  /* Move all nodes smaller than k'th node to its left and check
-     the number of elements smaller than the value present at the
-     k'th index. */
-  store_index = node_left;
-  for(i = node_left; i < node_right; ++i)
-    if(coordinate[p->input_row[i]] < k_node_value)
-      {
-        /* Move i'th node to the left side of the k'th index. */
-        kdtree_node_swap(p, store_index, i);
-
-        /* Prepare the place of next smaller node. */
-        store_index++;
-      }
-
-  /* Place k'th node after all the nodes that have lesser value
-     than it, as it was moved to the right initially. */
-  kdtree_node_swap(p, node_right, store_index);
+                      size_t node_right, double pivot,
+                      double *coordinate, size_t *node_last)
+{
+  double v;
+  size_t i=node_left;
+
+  /* The nodes before 'node_left' are smaller than the pivot and those
+     after 'node_right' are larger. The pivot is one of the values, so at
+     least one node will remain between them (and 'node_right' can't
+     underflow). */
+  while(i<=node_right)
+    {
+      v=coordinate[p->input_row[i]];
+      if( KDTREE_LESS(v, pivot) )
+        kdtree_node_swap(p, node_left++, i++);
+      else if( KDTREE_LESS(pivot, v) )
+        kdtree_node_swap(p, i, node_right--);
+      else
+        ++i;
+    }
 
-  /* Return the store_index. */
-  return store_index;
+  /* Return the range of the nodes equal to the pivot. */
+  *node_last=node_right;
+  return node_left;
 }
 
 
@@ -335,6 +315,8 @@ kdtree_make_partition(struct kdtree_params *p, size_t node_left,
    choosing the median node, we use `quickselect alogorithm` to
    find median node in linear time between the left and right node.
    This also makes the values in the current axis partially sorted.
+   The pivot is the median of the first, middle and last nodes, so
+   already sorted inputs are also fast.
 
    See `https://en.wikipedia.org/wiki/Quickselect`
    for pseudocode and more details of the algorithm.
@@ -345,7 +327,8 @@ static size_t
 kdtree_median_find(struct kdtree_params *p, size_t node_left,
                    size_t node_right, double *coordinate)
 {
-  size_t node_pivot, node_median;
+  double a, b, c, pivot;
+  size_t node_first, node_last, node_median;
 
   /* False state, this is a programming error. */
   if(node_right < node_left)
@@ -363,21 +346,28 @@ kdtree_median_find(struct kdtree_params *p, size_t node_left,
   /* The required median node between left and right node. */
   node_median = node_left+(node_right-node_left)/2;
 
-  /* Loop until the median of the current axis is returned. */
-  while(1)
+  /* Loop until the median of the current axis is in its place. */
+  while(node_right > node_left)
     {
-      /* Pivot node acts as a reference for the distance from the desired
-        (here median) node. */
-      node_pivot = kdtree_make_partition(p, node_left, node_right,
-                                         node_median, coordinate);
-      /* If median is found, break the loop and return median node. */
-      if(node_median == node_pivot) break;
-
-      /* Change the left or right node based on the position of
-         the pivot node with respect to the required median node. */
-      if(node_median < node_pivot)  node_right = node_pivot - 1;
-      else                          node_left  = node_pivot + 1;
+      /* Median of three values for the pivot. */
+      a=coordinate[p->input_row[node_left]];
+      b=coordinate[p->input_row[node_median]];
+      c=coordinate[p->input_row[node_right]];
+      pivot = ( KDTREE_LESS(a, b)
+                ? ( KDTREE_LESS(b, c) ? b : ( KDTREE_LESS(a, c) ? c : a ) )
+                : ( KDTREE_LESS(a, c) ? a : ( KDTREE_LESS(b, c) ? c : b ) ) );
+
+      /* Partition the nodes around the pivot. */
+      node_first = kdtree_make_partition(p, node_left, node_right, pivot,
+                                         coordinate, &node_last);
+
+      /* If the median is equal to the pivot, it is in its place. Otherwise,
+         continue in the part that contains the median. */
+      if     (node_median < node_first) node_right = node_first - 1;
+      else if(node_median > node_last)  node_left  = node_last  + 1;
+      else break;
     }
+
   /* Return the median node. */
   return node_median;
 }
@@ -491,65 +481,132 @@ gal_kdtree_create(gal_data_t *coords_raw, size_t *root)
 
 
 /****************************************************************
- ********          Nearest-Neighbour Search               *******
+ ********          Nearest neighbour on a k-d tree        *******
  ****************************************************************/
-/* This is a helper function which finds the nearest neighbour of
-   the given point in a kdtree. It calculates the least distance
-   from the point, and the index of that nearest node (out_nn).
+/* Return an array of pointers to the 'ndim' columns of the input list as
+   'double' arrays. Columns that aren't already 'float64' are copied into
+   'float64' datasets and these copies are added to '*copies' (to be freed
+   later). */
+static double **
+kdtree_query_columns(gal_data_t *cols, size_t ndim, gal_data_t **copies)
+{
+  size_t i;
+  double **out;
+  gal_data_t *tmp, *copy;
 
-   See `https://en.wikipedia.org/wiki/K-d_tree#Nearest_neighbour_search`
-   for more information.
-*/
+  /* Allocate the array of pointers. */
+  errno=0;
+  out=malloc(ndim*sizeof *out);
+  if(out==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'out'", __func__, ndim*sizeof *out);
+
+  /* Set the pointer to each column. */
+  for(i=0, tmp=cols; i<ndim; ++i, tmp=tmp->next)
+    {
+      if(tmp->size!=cols->size)
+        error(EXIT_FAILURE, 0, "%s: all the columns must have the same "
+              "number of rows, but column %zu has %zu rows while the "
+              "first has %zu", __func__, i+1, tmp->size, cols->size);
+      if(tmp->type==GAL_TYPE_FLOAT64)
+        out[i]=tmp->array;
+      else
+        {
+          copy=gal_data_copy_to_new_type(tmp, GAL_TYPE_FLOAT64);
+          copy->next=*copies;
+          *copies=copy;
+          out[i]=copy->array;
+        }
+    }
+
+  /* Return the array of pointers. */
+  return out;
+}
+
+
+
+
+
+/* Make sure the given k-d tree (output of 'gal_kdtree_create') can be
+   used with the given coordinates. */
 static void
-kdtree_nearest_neighbour(struct kdtree_params *p, uint32_t node_current,
-                         double *point, double *least_dist,
-                         size_t *out_nn, size_t depth)
+kdtree_check(gal_data_t *coords_raw, gal_data_t *kdtree, size_t root,
+             const char *func)
 {
-  double d, dx, dx2;
-  size_t axis=depth % p->ndim;    /* Set the working axis. */
-  double *coordinates=p->coords[axis]->array;
+  if(coords_raw==NULL || kdtree==NULL)
+    error(EXIT_FAILURE, 0, "%s: the input coordinates and k-d tree "
+          "should not be NULL", func);
+  if(kdtree->next==NULL || kdtree->next->next)
+    error(EXIT_FAILURE, 0, "%s: the input kd-tree should be 2 columns",
+          func);
+  if(kdtree->type!=GAL_TYPE_UINT32 || kdtree->next->type!=GAL_TYPE_UINT32)
+    error(EXIT_FAILURE, 0, "%s: the left and right kd-tree columns should "
+          "be uint32_t", func);
+  if(kdtree->size!=coords_raw->size || kdtree->next->size!=coords_raw->size)
+    error(EXIT_FAILURE, 0, "%s: the k-d tree columns should have the same "
+          "number of rows as the coordinates (%zu)", func,
+          coords_raw->size);
+  if(root>=coords_raw->size)
+    error(EXIT_FAILURE, 0, "%s: the root (%zu) should be smaller than the "
+          "number of rows (%zu)", func, root, coords_raw->size);
+}
 
-  /* If no subtree present, don't search further. */
-  if(node_current==GAL_BLANK_UINT32) return;
 
-  /* The distance between search point to the current node.*/
-  d = kdtree_distance_find(p, node_current, point);
 
-  /* Distance between the splitting coordinate of the search
-     point and current node. */
-  dx = coordinates[node_current]-point[axis];
 
-  /* Check if the current node is nearer than the previous
-     nearest node. */
-  if(d < *least_dist)
-    {
-      *least_dist = d;
-      *out_nn = node_current;
-    }
 
-  /* If exact match found (least distance 0), return it. */
-  if(*least_dist==0.0f) return;
+/* Parameters for the nearest neighbour search directly on the output of
+   'gal_kdtree_create'. */
+struct kdtree_nearest_params
+{
+  size_t           ndim;  /* Number of dimensions.                      */
+  double       **coords;  /* Coordinates of the nodes in each dimension.*/
+  uint32_t        *left;  /* Index of the left sub-tree of each node.   */
+  uint32_t       *right;  /* Index of the right sub-tree of each node.  */
+  double         *point;  /* The query point.                           */
+  double          least;  /* Squared distance to the nearest node.      */
+  size_t            out;  /* Index of the nearest node.                 */
+};
+
+
 
-  /* Recursively search in subtrees. */
-  kdtree_nearest_neighbour(p, dx > 0
-                              ? p->left[node_current]
-                              : p->right[node_current],
-                           point, least_dist, out_nn, depth+1);
 
-  /* Since the hyperplanes are all axis-aligned, to check if there is a
-     node in other branch which is nearer to the current node is done by a
-     simple comparison to see whether the distance between the splitting
-     coordinate (median node) of the search point and current node is
-     lesser (i.e on same side of hyperplane) than the distance (overall
-     coordinates) from the search point to the current nearest. */
-  dx2 = dx*dx;
-  if(dx2 >= *least_dist) return;
 
-  /* Recursively search other subtrees. */
-  kdtree_nearest_neighbour(p, dx > 0
-                              ? p->right[node_current]
-                              : p->left[node_current],
-                           point, least_dist, out_nn, depth+1);
+/* This is a helper function which finds the nearest neighbour of the
+   given point in a kdtree. When the distances are equal, the smaller
+   index is kept. The nearer sub-tree is searched first and the other
+   sub-tree is only searched when its splitting plane isn't farther than
+   the nearest node (along the axis of each node, the left sub-tree only
+   has values that are smaller or equal to the node's value, and the
+   right sub-tree only has larger or equal values).
+
+   See `https://en.wikipedia.org/wiki/K-d_tree#Nearest_neighbour_search`
+   for more information.
+*/
+static void
+kdtree_nearest_neighbour(struct kdtree_nearest_params *p, uint32_t node,
+                         size_t depth)
+{
+  size_t i;
+  uint32_t near, far;
+  double t, d=0, dx;
+  size_t axis=depth % p->ndim;
+
+  /* If no subtree present, don't search further. */
+  if(node==GAL_BLANK_UINT32) return;
+
+  /* Check this node (nodes with a NaN coordinate are ignored). */
+  for(i=0;i<p->ndim;++i) { t=p->coords[i][node]-p->point[i]; d+=t*t; }
+  if( d < p->least || (d==p->least && node < p->out) )
+    { p->least=d; p->out=node; }
+
+  /* Search the sub-trees (both when the node's value is NaN). */
+  dx=p->coords[axis][node]-p->point[axis];
+  if(dx>0) { near=p->left[node];  far=p->right[node]; }
+  else     { near=p->right[node]; far=p->left[node];  }
+  kdtree_nearest_neighbour(p, near, depth+1);
+  if( isnan(dx) || dx*dx <= p->least )
+    kdtree_nearest_neighbour(p, far, depth+1);
 }
 
 
@@ -558,7 +615,10 @@ kdtree_nearest_neighbour(struct kdtree_params *p, uint32_t node_current,
 
 /* High-level function used to find the nearest neighbour of a given
    point in a kd-tree. It calculates the least distance of the point
-   from the nearest node and returns the index of that node.
+   from the nearest node and returns the index of that node. For many
+   queries on the same points, it is much more efficient to prepare a
+   tree for searches once (with 'gal_kdtree_query_prepare' or
+   'gal_kdtree_query_build') and use 'gal_kdtree_query_nearest'.
 
    Return: The index of the nearest neighbour node in the kd-tree.
 */
@@ -567,28 +627,1516 @@ gal_kdtree_nearest_neighbour(gal_data_t *coords_raw, gal_data_t *kdtree,
                              size_t root, double *point,
                              double *least_dist)
 {
-  struct kdtree_params p={0};
-  size_t out_nn=GAL_BLANK_SIZE_T;
+  gal_data_t *copies=NULL;
+  struct kdtree_nearest_params p;
 
   /* Initialisation. */
-  p.left_col=kdtree;
-  *least_dist=DBL_MAX;
-  kdtree_prepare(&p, coords_raw);
+  kdtree_check(coords_raw, kdtree, root, __func__);
+  p.point=point;
+  p.least=INFINITY;
+  p.out=GAL_BLANK_SIZE_T;
+  p.left=kdtree->array;
+  p.right=kdtree->next->array;
+  p.ndim=gal_list_data_number(coords_raw);
+  p.coords=kdtree_query_columns(coords_raw, p.ndim, &copies);
+
+  /* Find the nearest neighbour. The squared distance was used until now
+     (to improve processing), its square root is the actual distance. */
+  kdtree_nearest_neighbour(&p, root, 0);
+  *least_dist = p.out==GAL_BLANK_SIZE_T ? NAN : sqrt(p.least);
+
+  /* Clean up and return. */
+  free(p.coords);
+  gal_list_data_free(copies);
+  return p.out;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ********             Tree for many searches              *******
+ ****************************************************************/
+/* The tree that is used for many searches ('gal_kdtree_query_t') is a
+   balanced binary tree in an implicit layout: the children of node 'i'
+   are nodes '2i+1' and '2i+2'. Each node has a contiguous range of the
+   points (which are permuted into the order of the tree) and the box
+   that encloses them. Nodes with at most 'bucket' points are leaves: their
+   points are checked one after the other, in a loop that the compiler can
+   vectorize (the coordinates along each dimension are contiguous). Points
+   with a NaN coordinate can never be found, so they are not kept. */
+#define KDTREE_BUCKET 32
+
+/* The searches don't use recursion, but a stack of the nodes that should
+   be searched. At each level of the tree, at most two nodes are added to
+   the stack, and the tree can't be deeper than the number of bits in
+   'size_t'. */
+#define KDTREE_STACK (2*8*sizeof(size_t)+2)
+
+/* Return 1 if the node is a leaf. */
+#define KDTREE_IS_LEAF(Q,I) ( (Q)->end[I] - (Q)->start[I] <= (Q)->bucket )
+
+/* Steps of building the tree (each done on multiple threads). */
+enum kdtree_build_steps
+{
+  KDTREE_BUILD_SPLIT,           /* Split the points of each node.       */
+  KDTREE_BUILD_COPY,            /* Copy coordinates into tree order.    */
+  KDTREE_BUILD_BOX,             /* Find the box around each node.       */
+};
+
+
+
+
+
+/* Parameters for building the tree on multiple threads. */
+struct kdtree_build_params
+{
+  int                step;  /* Step of the build ('kdtree_build_steps').*/
+  gal_kdtree_query_t   *q;  /* The tree.                                */
+  double             **in;  /* Input coordinates (in input order).      */
+  int           partition;  /* Partition the points when splitting.     */
+  size_t            level;  /* Current level of the tree.               */
+  size_t          nchunks;  /* Number of chunks of points (for copying). */
+};
+
+
+
+
+
+/* Put the points between 'lo' and 'hi' (inclusive) of the permutation in
+   an order that the 'k'-th point has the value it would have after
+   sorting, all the points before it have smaller or equal values, and all
+   the points after it have larger or equal values (the 'quickselect'
+   algorithm, with a median-of-three pivot and a partitioning that doesn't
+   slow down when many values are equal). */
+static void
+kdtree_select(size_t *perm, double *v, size_t lo, size_t hi, size_t k)
+{
+  double a, b, c, pivot;
+  size_t t, i, j, mid;
+
+  while(hi>lo)
+    {
+      /* Median of three for the pivot. */
+      mid=lo+(hi-lo)/2;
+      a=v[perm[lo]]; b=v[perm[mid]]; c=v[perm[hi]];
+      pivot = a<b ? ( b<c ? b : (a<c ? c : a) )
+                  : ( a<c ? a : (b<c ? c : b) );
+
+      /* Partition: after this loop, the values in 'lo' to 'j' are smaller
+         or equal to the pivot and those in 'i' to 'hi' are larger or
+         equal (the pivot's value is in the range, so the inner loops stop
+         within the range). Indexs are shifted by one so 'j' can't
+         underflow. */
+      i=lo+1;
+      j=hi+1;
+      while(i<=j)
+        {
+          while(v[perm[i-1]]<pivot) ++i;
+          while(v[perm[j-1]]>pivot) --j;
+          if(i<=j)
+            {
+              t=perm[i-1]; perm[i-1]=perm[j-1]; perm[j-1]=t;
+              ++i;
+              --j;
+            }
+        }
+
+      /* Continue in the part that contains 'k'. */
+      if     (k+1<=j) hi=j-1;
+      else if(k+1>=i) lo=i-1;
+      else            return;
+    }
+}
+
+
+
+
+
+/* Worker function for building the tree. */
+static void *
+kdtree_build_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct kdtree_build_params *p=tprm->params;
+  gal_kdtree_query_t *q=p->q;
+
+  double *c, *low, *high;
+  size_t i, j, d, n, s, e, mid, node, l, r;
+  size_t first=((size_t)1<<p->level)-1;
+
+  /* Go over the actions of this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      node=first+tprm->indexs[i];
+      switch(p->step)
+        {
+        /* Split the points of this node between its two children. When
+           necessary, the points are first partitioned around the median
+           along the axis of this level. */
+        case KDTREE_BUILD_SPLIT:
+          s=q->start[node];
+          e=q->end[node];
+          if(s==GAL_BLANK_SIZE_T || KDTREE_IS_LEAF(q, node)) break;
+          mid=s+(e-s)/2;
+          if(p->partition)
+            kdtree_select(q->perm, p->in[p->level % q->ndim], s, e-1, mid);
+          q->start[2*node+1]=s;   q->end[2*node+1]=mid;
+          q->start[2*node+2]=mid; q->end[2*node+2]=e;
+          break;
+
+        /* Copy this chunk of the coordinates into the tree order. */
+        case KDTREE_BUILD_COPY:
+          n=q->size;
+          s= tprm->indexs[i]    * n / p->nchunks;
+          e=(tprm->indexs[i]+1) * n / p->nchunks;
+          for(d=0;d<q->ndim;++d)
+            {
+              c=q->coords+d*n;
+              for(j=s;j<e;++j) c[j]=p->in[d][ q->perm[j] ];
+            }
+          break;
+
+        /* Find the box around the points of this node: directly from the
+           points in leaves, and from the boxes of the children in other
+           nodes. */
+        case KDTREE_BUILD_BOX:
+          if(q->start[node]==GAL_BLANK_SIZE_T) break;
+          low=q->low+node*q->ndim;
+          high=q->high+node*q->ndim;
+          if( KDTREE_IS_LEAF(q, node) )
+            for(d=0;d<q->ndim;++d)
+              {
+                low[d]=INFINITY;
+                high[d]=-INFINITY;
+                c=q->coords+d*q->size;
+                for(j=q->start[node];j<q->end[node];++j)
+                  {
+                    if(c[j]<low[d])  low[d]=c[j];
+                    if(c[j]>high[d]) high[d]=c[j];
+                  }
+              }
+          else
+            {
+              l=(2*node+1)*q->ndim;
+              r=(2*node+2)*q->ndim;
+              for(d=0;d<q->ndim;++d)
+                {
+                  low[d]  = q->low[l+d]  < q->low[r+d]
+                            ? q->low[l+d]  : q->low[r+d];
+                  high[d] = q->high[l+d] > q->high[r+d]
+                            ? q->high[l+d] : q->high[r+d];
+                }
+            }
+          break;
+
+        default:
+          error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to "
+                "fix the problem. The value %d is not recognized for "
+                "'p->step'", __func__, PACKAGE_BUGREPORT, p->step);
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
 
-  /* Use the low-level function to find th nearest neighbour. */
-  kdtree_nearest_neighbour(&p, root, point, least_dist, &out_nn, 0);
 
-  /* least_dist is the square of the distance between the nearest
-     neighbour and the point (used to improve processing).
-     Square root of that is the actual distance. */
-  *least_dist = sqrt(*least_dist);
 
-  /* For a check
-  printf("%s: root=%zu, out_nn=%zu, least_dis=%f\n",
-         __func__, root, out_nn, least_dist);
-  */
+
+/* Allocate the tree for the given permutation (input rows of the points
+   that should be in the tree, in tree order) and build it. The levels
+   of the tree are built one after the other, but all the nodes (and
+   thus, sub-trees) of each level are built on multiple threads. */
+static gal_kdtree_query_t *
+kdtree_query_build(size_t ndim, double **in, gal_data_t *perm,
+                   int partition, size_t numthreads, size_t minmapsize,
+                   int quietmmap)
+{
+  gal_kdtree_query_t *q;
+  struct kdtree_build_params p;
+  size_t i, m, dsize, nlevels=1;
+
+  /* Allocate the structure. */
+  errno=0;
+  q=malloc(sizeof *q);
+  if(q==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for 'q'",
+          __func__, sizeof *q);
+
+  /* Find the number of levels (the sizes of the nodes in each level differ
+     by at most one). */
+  q->ndim=ndim;
+  q->size=perm->size;
+  q->bucket=KDTREE_BUCKET;
+  for(m=q->size; m>q->bucket; m=(m+1)/2) ++nlevels;
+  q->nnodes=((size_t)1<<nlevels)-1;
+
+  /* Allocate the arrays (the 'perm' dataset was allocated by the caller;
+     it is the first in the list of arrays). */
+  q->arrays=perm;
+  dsize=q->size*ndim;
+  perm->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &dsize, NULL, 0,
+                            minmapsize, quietmmap, "coords", NULL,
+                            "Coordinates in tree order.");
+  perm->next->next=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &q->nnodes,
+                                  NULL, 0, minmapsize, quietmmap, "start",
+                                  NULL, "First point of node.");
+  perm->next->next->next=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1,
+                                        &q->nnodes, NULL, 0, minmapsize,
+                                        quietmmap, "end", NULL,
+                                        "One after last point of node.");
+  dsize=q->nnodes*ndim;
+  perm->next->next->next->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1,
+                                              &dsize, NULL, 0, minmapsize,
+                                              quietmmap, "low", NULL,
+                                              "Lowest coordinates of node.");
+  perm->next->next->next->next->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64,
+                                              1, &dsize, NULL, 0,
+                                              minmapsize, quietmmap, "high",
+                                              NULL, "Highest coordinates "
+                                              "of node.");
+  q->perm   = perm->array;
+  q->coords = perm->next->array;
+  q->start  = perm->next->next->array;
+  q->end    = perm->next->next->next->array;
+  q->low    = perm->next->next->next->next->array;
+  q->high   = perm->next->next->next->next->next->array;
+
+  /* Initialize the nodes: only the nodes of the tree will be set. */
+  for(i=0;i<q->nnodes;++i) q->start[i]=q->end[i]=GAL_BLANK_SIZE_T;
+  for(i=0;i<q->nnodes*ndim;++i) { q->low[i]=INFINITY; q->high[i]=-INFINITY; }
+  q->start[0]=0;
+  q->end[0]=q->size;
+
+  /* Split the nodes of each level. */
+  p.q=q;
+  p.in=in;
+  p.partition=partition;
+  p.step=KDTREE_BUILD_SPLIT;
+  for(p.level=0; p.level+1<nlevels; ++p.level)
+    gal_threads_spin_off(kdtree_build_on_thread, &p, (size_t)1<<p.level,
+                         numthreads, minmapsize, quietmmap);
+
+  /* Copy the coordinates into the order of the tree. */
+  if(q->size)
+    {
+      p.level=0;
+      p.step=KDTREE_BUILD_COPY;
+      p.nchunks = numthreads>1 ? 4*numthreads : 1;
+      if(p.nchunks>q->size) p.nchunks=q->size;
+      gal_threads_spin_off(kdtree_build_on_thread, &p, p.nchunks,
+                           numthreads, minmapsize, quietmmap);
+    }
+
+  /* Find the boxes, from the leaves up to the root. */
+  p.step=KDTREE_BUILD_BOX;
+  for(p.level=nlevels; p.level-- > 0; )
+    gal_threads_spin_off(kdtree_build_on_thread, &p, (size_t)1<<p.level,
+                         numthreads, minmapsize, quietmmap);
+
+  /* Return the tree. */
+  return q;
+}
+
+
+
+
+
+/* Allocate the permutation dataset (at least one element must be
+   allocated, even if no point can be used). */
+static gal_data_t *
+kdtree_query_perm_alloc(size_t num, size_t minmapsize, int quietmmap)
+{
+  size_t one=1;
+  gal_data_t *perm;
+
+  perm=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, num ? &num : &one, NULL,
+                      0, minmapsize, quietmmap, "perm", NULL,
+                      "Input row of point in tree order.");
+  perm->size=perm->dsize[0]=num;
+  return perm;
+}
+
+
+
+
+
+/* Return 1 if any of the coordinates of the given input row is NaN. */
+static int
+kdtree_row_blank(double **in, size_t ndim, size_t row)
+{
+  size_t d;
+  for(d=0;d<ndim;++d) if( isnan(in[d][row]) ) return 1;
+  return 0;
+}
+
+
+
+
+
+/* Build a tree for searches directly from the input coordinates (a list
+   of columns, like 'gal_kdtree_create') on multiple threads. */
+gal_kdtree_query_t *
+gal_kdtree_query_build(gal_data_t *coords_raw, size_t numthreads,
+                       size_t minmapsize, int quietmmap)
+{
+  double **in;
+  gal_data_t *perm, *copies=NULL;
+  gal_kdtree_query_t *q;
+  size_t i, *parr, ndim, num=0;
+
+  /* Basic sanity checks. */
+  if(coords_raw==NULL)
+    error(EXIT_FAILURE, 0, "%s: the input coordinates should not be NULL",
+          __func__);
+  ndim=gal_list_data_number(coords_raw);
+  in=kdtree_query_columns(coords_raw, ndim, &copies);
+
+  /* Put the rows that can be used (don't have a NaN coordinate) in the
+     permutation. */
+  for(i=0;i<coords_raw->size;++i)
+    if( kdtree_row_blank(in, ndim, i)==0 ) ++num;
+  perm=kdtree_query_perm_alloc(num, minmapsize, quietmmap);
+  parr=perm->array;
+  for(num=i=0;i<coords_raw->size;++i)
+    if( kdtree_row_blank(in, ndim, i)==0 ) parr[num++]=i;
+
+  /* Build the tree. */
+  q=kdtree_query_build(ndim, in, perm, 1, numthreads, minmapsize,
+                       quietmmap);
 
   /* Clean up and return. */
-  kdtree_cleanup(&p, coords_raw);
-  return out_nn;
+  free(in);
+  gal_list_data_free(copies);
+  return q;
+}
+
+
+
+
+
+/* Prepare a tree for searches from the output of 'gal_kdtree_create'
+   (which doesn't need to be built again). The points are put in the order
+   of the given tree (the left sub-tree, then the node, then the right
+   sub-tree, which keeps nearby points close to each other) and the nodes
+   of the new tree split this order in halves. */
+gal_kdtree_query_t *
+gal_kdtree_query_prepare(gal_data_t *coords_raw, gal_data_t *kdtree,
+                         size_t root)
+{
+  double **in;
+  gal_kdtree_query_t *q;
+  gal_data_t *perm, *copies=NULL;
+  uint32_t node, *left, *right, *stack;
+  size_t i, ndim, nstack=0, num=0, *parr;
+
+  /* Basic sanity checks. */
+  kdtree_check(coords_raw, kdtree, root, __func__);
+  left=kdtree->array;
+  right=kdtree->next->array;
+  ndim=gal_list_data_number(coords_raw);
+  in=kdtree_query_columns(coords_raw, ndim, &copies);
+
+  /* Count the rows that can be used. */
+  for(i=0;i<coords_raw->size;++i)
+    if( kdtree_row_blank(in, ndim, i)==0 ) ++num;
+  perm=kdtree_query_perm_alloc(num, coords_raw->minmapsize,
+                               coords_raw->quietmmap);
+  parr=perm->array;
+
+  /* Go over the given tree (without recursion, the stack can't be larger
+     than the number of nodes) and put the usable rows in order. */
+  stack=gal_pointer_allocate(GAL_TYPE_UINT32, coords_raw->size, 0,
+                             __func__, "stack");
+  num=0;
+  node=root;
+  while(node!=GAL_BLANK_UINT32 || nstack)
+    {
+      if(node!=GAL_BLANK_UINT32)
+        {
+          stack[nstack++]=node;
+          node=left[node];
+        }
+      else
+        {
+          node=stack[--nstack];
+          if( kdtree_row_blank(in, ndim, node)==0 )
+            {
+              if(num==perm->size)
+                error(EXIT_FAILURE, 0, "%s: the k-d tree has more nodes "
+                      "than the input rows", __func__);
+              parr[num++]=node;
+            }
+          node=right[node];
+        }
+    }
+  if(num!=perm->size)
+    error(EXIT_FAILURE, 0, "%s: the k-d tree only has %zu of the %zu "
+          "usable input rows", __func__, num, perm->size);
+
+  /* Build the tree (without partitioning). */
+  q=kdtree_query_build(ndim, in, perm, 0, 1, coords_raw->minmapsize,
+                       coords_raw->quietmmap);
+
+  /* Clean up and return. */
+  free(in);
+  free(stack);
+  gal_list_data_free(copies);
+  return q;
+}
+
+
+
+
+
+void
+gal_kdtree_query_free(gal_kdtree_query_t *query)
+{
+  if(query==NULL) return;
+  gal_list_data_free(query->arrays);
+  free(query);
+}
+
+
+
+
+
+/* Put the squared distances between 'point' and the 'num' points that
+   start at 'start' (in tree order) into 'dist'. The loop over the points
+   is the inner loop, so it can be vectorized. */
+static void
+kdtree_query_distances(gal_kdtree_query_t *q, size_t start, size_t num,
+                       double *point, double *dist)
+{
+  double t, *c;
+  size_t d, j;
+
+  for(j=0;j<num;++j) dist[j]=0;
+  for(d=0;d<q->ndim;++d)
+    {
+      c=q->coords+d*q->size+start;
+      for(j=0;j<num;++j) { t=c[j]-point[d]; dist[j]+=t*t; }
+    }
+}
+
+
+
+
+
+/* Return the smallest squared distance between the point and the box of
+   the node (zero if the point is inside the box). If 'max' isn't NULL,
+   the largest squared distance to the box is put in it. */
+static double
+kdtree_query_box_distance(gal_kdtree_query_t *q, size_t node,
+                          double *point, double *max)
+{
+  size_t d;
+  double t, a, b, out=0, far=0;
+  double *low=q->low+node*q->ndim, *high=q->high+node*q->ndim;
+
+  for(d=0;d<q->ndim;++d)
+    {
+      a=low[d]-point[d];
+      b=point[d]-high[d];
+      if(a>0)      out+=a*a;
+      else if(b>0) out+=b*b;
+      if(max) { t = -a > -b ? -a : -b; far+=t*t; }
+    }
+  if(max) *max=far;
+  return out;
+}
+
+
+
+
+
+/* If any of the coordinates of the query point is NaN, nothing can be
+   found for it. */
+static int
+kdtree_query_point_blank(gal_kdtree_query_t *q, double *point)
+{
+  size_t i;
+  for(i=0; i<q->ndim; ++i) if( isnan(point[i]) ) return 1;
+  return 0;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ********             k nearest neighbours                *******
+ ****************************************************************/
+/* The 'k' nearest neighbours are kept in a bounded max-heap: the farthest
+   of the (at most) 'k' candidates is always at the top, so each new node
+   only needs to be compared with it. The heap is kept directly in the
+   output arrays. When the distances are equal, the larger index is
+   considered farther (so the result doesn't depend on the tree's
+   structure). */
+struct kdtree_heap
+{
+  size_t             k;  /* Maximum number of elements in the heap.     */
+  size_t           num;  /* Current number of elements in the heap.     */
+  double        *dists;  /* Squared distance of each element.           */
+  size_t       *indexs;  /* Index (row) of each element.                */
+};
+
+
+
+
+
+/* Return 1 if element 'i' is farther than element 'j' of the heap. */
+#define KDTREE_HEAP_FARTHER(H,I,J)                                      \
+  (   (H)->dists[I] >  (H)->dists[J]                                    \
+   || ((H)->dists[I] == (H)->dists[J] && (H)->indexs[I] > (H)->indexs[J]) )
+
+
+
+
+
+static void
+kdtree_heap_swap(struct kdtree_heap *h, size_t i, size_t j)
+{
+  double d=h->dists[i];
+  size_t t=h->indexs[i];
+  h->dists[i]=h->dists[j];   h->indexs[i]=h->indexs[j];
+  h->dists[j]=d;             h->indexs[j]=t;
+}
+
+
+
+
+
+/* Move element 'i' down the heap (of 'num' elements) until both its
+   children are nearer than it. */
+static void
+kdtree_heap_sift_down(struct kdtree_heap *h, size_t i, size_t num)
+{
+  size_t c, f;
+
+  while( (c=2*i+1) < num )
+    {
+      f = ( c+1<num && KDTREE_HEAP_FARTHER(h, c+1, c) ) ? c+1 : c;
+      if( !KDTREE_HEAP_FARTHER(h, f, i) ) break;
+      kdtree_heap_swap(h, i, f);
+      i=f;
+    }
+}
+
+
+
+
+
+/* Add a node to the heap if it is nearer than the farthest element (or
+   if the heap isn't full yet). */
+static void
+kdtree_heap_add(struct kdtree_heap *h, double dist, size_t index)
+{
+  size_t i, parent;
+
+  /* The heap isn't full: put the new node at the end and move it up. */
+  if(h->num < h->k)
+    {
+      i=h->num++;
+      h->dists[i]=dist;
+      h->indexs[i]=index;
+      while(i)
+        {
+          parent=(i-1)/2;
+          if( !KDTREE_HEAP_FARTHER(h, i, parent) ) break;
+          kdtree_heap_swap(h, i, parent);
+          i=parent;
+        }
+    }
+
+  /* The heap is full: replace the farthest element if the new node is
+     nearer. */
+  else if( dist < h->dists[0]
+           || (dist==h->dists[0] && index < h->indexs[0]) )
+    {
+      h->dists[0]=dist;
+      h->indexs[0]=index;
+      kdtree_heap_sift_down(h, 0, h->num);
+    }
+}
+
+
+
+
+
+/* Search the tree for the 'k' nearest neighbours. Of the two children of
+   each node, the nearer one is searched first. A node is not searched when
+   the heap is full and its box is farther than the farthest element of the
+   heap. */
+static void
+kdtree_knn_search(gal_kdtree_query_t *q, double *point, struct kdtree_heap *h)
+{
+  double dl, dr, dist[KDTREE_BUCKET];
+  double sdist[KDTREE_STACK];
+  size_t j, node, nstack=0, stack[KDTREE_STACK];
+
+  /* Start with the root. */
+  stack[nstack]=0;
+  sdist[nstack++]=kdtree_query_box_distance(q, 0, point, NULL);
+
+  /* Search until there is no more node in the stack. */
+  while(nstack)
+    {
+      /* Take the last node and see if it can have a nearer point. */
+      node=stack[--nstack];
+      if( h->num==h->k && sdist[nstack] > h->dists[0] ) continue;
+
+      /* Check the points of a leaf. */
+      if( KDTREE_IS_LEAF(q, node) )
+        {
+          kdtree_query_distances(q, q->start[node],
+                                 q->end[node]-q->start[node], point, dist);
+          for(j=q->start[node];j<q->end[node];++j)
+            kdtree_heap_add(h, dist[j-q->start[node]], q->perm[j]);
+        }
+
+      /* Add the children to the stack (the nearer one last, so it is
+         searched first). */
+      else
+        {
+          dl=kdtree_query_box_distance(q, 2*node+1, point, NULL);
+          dr=kdtree_query_box_distance(q, 2*node+2, point, NULL);
+          if(dl<=dr)
+            {
+              stack[nstack]=2*node+2; sdist[nstack++]=dr;
+              stack[nstack]=2*node+1; sdist[nstack++]=dl;
+            }
+          else
+            {
+              stack[nstack]=2*node+1; sdist[nstack++]=dl;
+              stack[nstack]=2*node+2; sdist[nstack++]=dr;
+            }
+        }
+    }
+}
+
+
+
+
+
+/* Find the 'k' nearest neighbours of 'point' and put their indexs and
+   distances in 'indexs' and 'dists' (which should each have space for
+   'k' elements), sorted by increasing distance. The number of neighbours
+   that were found is returned: it is only smaller than 'k' when the tree
+   has less than 'k' points (or the point has a NaN coordinate). */
+static size_t
+kdtree_knn(gal_kdtree_query_t *q, double *point, size_t k, size_t *indexs,
+           double *dists)
+{
+  size_t i, num;
+  struct kdtree_heap h={k, 0, dists, indexs};
+
+  /* Search the tree. */
+  if( k && kdtree_query_point_blank(q, point)==0 )
+    kdtree_knn_search(q, point, &h);
+
+  /* Sort the heap in place (the farthest element is repeatedly moved to
+     the end), then convert the squared distances to distances. */
+  for(num=h.num; num>1; --num)
+    {
+      kdtree_heap_swap(&h, 0, num-1);
+      kdtree_heap_sift_down(&h, 0, num-1);
+    }
+  for(i=0;i<h.num;++i) dists[i]=sqrt(dists[i]);
+  return h.num;
+}
+
+
+
+
+
+size_t
+gal_kdtree_query_knn(gal_kdtree_query_t *query, double *point, size_t k,
+                     size_t *indexs, double *dists)
+{
+  return kdtree_knn(query, point, k, indexs, dists);
+}
+
+
+
+
+
+/* The nearest neighbour is the special case of 'k=1'. If nothing could be
+   found, 'GAL_BLANK_SIZE_T' is returned and 'least_dist' will be NaN. */
+size_t
+gal_kdtree_query_nearest(gal_kdtree_query_t *query, double *point,
+                         double *least_dist)
+{
+  size_t index;
+  if( kdtree_knn(query, point, 1, &index, least_dist) ) return index;
+  *least_dist=NAN;
+  return GAL_BLANK_SIZE_T;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ********             Radius and range searches           *******
+ ****************************************************************/
+/* Growing array to keep the indexs that were found. When 'countonly' is
+   non-zero, the indexs are not kept (only counted). */
+struct kdtree_found
+{
+  int        countonly;  /* Only count the found nodes.                 */
+  size_t           num;  /* Number of found nodes.                      */
+  size_t         alloc;  /* Allocated number of elements in 'indexs'.   */
+  size_t       *indexs;  /* Indexs of the found nodes.                  */
+};
+
+
+
+
+
+static void
+kdtree_found_add(struct kdtree_found *f, size_t index)
+{
+  size_t *tmp;
+
+  /* Only count the node. */
+  if(f->countonly) { ++f->num; return; }
+
+  /* Make sure there is space. */
+  if(f->num==f->alloc)
+    {
+      f->alloc = f->alloc ? 2*f->alloc : 64;
+      errno=0;
+      tmp=realloc(f->indexs, f->alloc*sizeof *f->indexs);
+      if(tmp==NULL)
+        error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+              "the found indexs", __func__, f->alloc*sizeof *f->indexs);
+      f->indexs=tmp;
+    }
+
+  /* Add the index. */
+  f->indexs[f->num++]=index;
+}
+
+
+
+
+
+/* Add all the points of a node. */
+static void
+kdtree_found_add_node(struct kdtree_found *f, gal_kdtree_query_t *q,
+                      size_t node)
+{
+  size_t j;
+  if(f->countonly) f->num += q->end[node]-q->start[node];
+  else
+    for(j=q->start[node];j<q->end[node];++j)
+      kdtree_found_add(f, q->perm[j]);
+}
+
+
+
+
+
+/* Find all the points that are within a squared distance of 'r2' from
+   'point'. When the whole box of a node is within the radius, all its
+   points are added without checking each one. */
+static void
+kdtree_radius_search(gal_kdtree_query_t *q, double *point, double r2,
+                     struct kdtree_found *f)
+{
+  double max, dist[KDTREE_BUCKET];
+  size_t j, node, nstack=0, stack[KDTREE_STACK];
+
+  stack[nstack++]=0;
+  while(nstack)
+    {
+      node=stack[--nstack];
+      if( kdtree_query_box_distance(q, node, point, &max) > r2 ) continue;
+      if( max<=r2 ) kdtree_found_add_node(f, q, node);
+      else if( KDTREE_IS_LEAF(q, node) )
+        {
+          kdtree_query_distances(q, q->start[node],
+                                 q->end[node]-q->start[node], point, dist);
+          for(j=q->start[node];j<q->end[node];++j)
+            if( dist[j-q->start[node]] <= r2 )
+              kdtree_found_add(f, q->perm[j]);
+        }
+      else
+        {
+          stack[nstack++]=2*node+2;
+          stack[nstack++]=2*node+1;
+        }
+    }
+}
+
+
+
+
+
+/* Find all the points that are within the box that is defined by its
+   lowest ('low') and highest ('high') coordinates. */
+static void
+kdtree_range_search(gal_kdtree_query_t *q, double *low, double *high,
+                    struct kdtree_found *f)
+{
+  double *c, *nlow, *nhigh;
+  size_t d, j, node, inside, nstack=0, stack[KDTREE_STACK];
+
+  stack[nstack++]=0;
+  while(nstack)
+    {
+      /* See if the box of the node overlaps with the given box (or is
+         completely inside it). */
+      node=stack[--nstack];
+      nlow=q->low+node*q->ndim;
+      nhigh=q->high+node*q->ndim;
+      inside=1;
+      for(d=0;d<q->ndim;++d)
+        {
+          if( !(nlow[d]<=high[d] && nhigh[d]>=low[d]) ) break;
+          if( !(nlow[d]>=low[d] && nhigh[d]<=high[d]) ) inside=0;
+        }
+      if(d<q->ndim) continue;
+
+      /* Add the points. */
+      if(inside) kdtree_found_add_node(f, q, node);
+      else if( KDTREE_IS_LEAF(q, node) )
+        for(j=q->start[node];j<q->end[node];++j)
+          {
+            for(d=0;d<q->ndim;++d)
+              {
+                c=q->coords+d*q->size;
+                if( !(c[j]>=low[d] && c[j]<=high[d]) ) break;
+              }
+            if(d==q->ndim) kdtree_found_add(f, q->perm[j]);
+          }
+      else
+        {
+          stack[nstack++]=2*node+2;
+          stack[nstack++]=2*node+1;
+        }
+    }
+}
+
+
+
+
+
+/* Return the indexs of all the nodes that are within 'radius' of 'point'
+   (including those exactly on the radius). The number of found nodes is
+   put in 'num'. If nothing is found, NULL is returned. The order of the
+   indexs is not defined. */
+size_t *
+gal_kdtree_query_radius(gal_kdtree_query_t *query, double *point,
+                        double radius, size_t *num)
+{
+  struct kdtree_found f={0, 0, 0, NULL};
+
+  if( radius>=0 && kdtree_query_point_blank(query, point)==0 )
+    kdtree_radius_search(query, point, radius*radius, &f);
+  *num=f.num;
+  return f.indexs;
+}
+
+
+
+
+
+/* Similar to 'gal_kdtree_query_radius', but for the nodes within a box
+   (including its borders). */
+size_t *
+gal_kdtree_query_range(gal_kdtree_query_t *query, double *low,
+                       double *high, size_t *num)
+{
+  struct kdtree_found f={0, 0, 0, NULL};
+
+  kdtree_range_search(query, low, high, &f);
+  *num=f.num;
+  return f.indexs;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ********          Searches for many points               *******
+ ****************************************************************/
+/* Parameters of the searches for many points on multiple threads. */
+struct kdtree_batch_params
+{
+  gal_kdtree_query_t      *q;  /* The prepared tree.                    */
+  double            **points;  /* Coordinates of the query points.      */
+  size_t             npoints;  /* Number of query points.               */
+  size_t             nchunks;  /* Number of chunks of query points.     */
+  size_t                   k;  /* Number of nearest neighbours.         */
+  double                  r2;  /* Squared radius.                       */
+  size_t             *indexs;  /* Output indexs (k-NN).                 */
+  double              *dists;  /* Output distances (k-NN).              */
+  size_t             *counts;  /* Output counts (radius).               */
+  struct kdtree_found *found;  /* Found indexs in each chunk (radius).  */
+};
+
+
+
+
+
+/* Prepare the common parameters for the searches of many points. */
+static void
+kdtree_batch_prepare(struct kdtree_batch_params *p, gal_kdtree_query_t *q,
+                     gal_data_t *points, gal_data_t **copies,
+                     size_t numthreads)
+{
+  /* Sanity check. */
+  if(points==NULL)
+    error(EXIT_FAILURE, 0, "%s: the query points should not be NULL",
+          __func__);
+  if(gal_list_data_number(points)!=q->ndim)
+    error(EXIT_FAILURE, 0, "%s: the query points have %zu dimensions "
+          "while the k-d tree has %zu", __func__,
+          gal_list_data_number(points), q->ndim);
+
+  /* Set the basic parameters. Each thread will work on a few chunks of
+     the points, so an unbalanced distribution of the points doesn't slow
+     down the whole process. */
+  p->q=q;
+  p->npoints=points->size;
+  p->points=kdtree_query_columns(points, q->ndim, copies);
+  p->nchunks = numthreads>1 ? 4*numthreads : 1;
+  if(p->nchunks>p->npoints) p->nchunks=p->npoints;
+}
+
+
+
+
+
+/* Worker function for the k nearest neighbours of many points. */
+static void *
+kdtree_knn_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct kdtree_batch_params *p=tprm->params;
+
+  double *point;
+  size_t i, j, d, c, n, start, end;
+
+  /* Allocate space for one point. */
+  point=gal_pointer_allocate(GAL_TYPE_FLOAT64, p->q->ndim, 0, __func__,
+                             "point");
+
+  /* Go over the chunks of this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      c=tprm->indexs[i];
+      start =  c    * p->npoints / p->nchunks;
+      end   = (c+1) * p->npoints / p->nchunks;
+      for(j=start;j<end;++j)
+        {
+          for(d=0;d<p->q->ndim;++d) point[d]=p->points[d][j];
+          n=kdtree_knn(p->q, point, p->k, p->indexs+j*p->k,
+                       p->dists+j*p->k);
+          for(;n<p->k;++n)
+            {
+              p->indexs[j*p->k+n]=GAL_BLANK_SIZE_T;
+              p->dists[j*p->k+n]=NAN;
+            }
+        }
+    }
+
+  /* Clean up, wait for all the other threads to finish, then return. */
+  free(point);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Find the 'k' nearest neighbours of all the points in 'points' (a list
+   of columns, one for each dimension, similar to the input of
+   'gal_kdtree_create') on 'numthreads' threads. The output is a list of
+   two 2D datasets with one row for each point and 'k' columns: the first
+   contains the indexs (sorted by distance) and the second contains the
+   distances. When less than 'k' neighbours are found, the remaining
+   elements are blank. */
+gal_data_t *
+gal_kdtree_query_knn_batch(gal_kdtree_query_t *query, gal_data_t *points,
+                           size_t k, size_t numthreads, size_t minmapsize,
+                           int quietmmap)
+{
+  size_t dsize[2];
+  gal_data_t *copies=NULL, *out;
+  struct kdtree_batch_params p={0};
+
+  /* Sanity check. */
+  if(k==0)
+    error(EXIT_FAILURE, 0, "%s: 'k' should be larger than zero", __func__);
+
+  /* Prepare the parameters and allocate the outputs. */
+  kdtree_batch_prepare(&p, query, points, &copies, numthreads);
+  p.k=k;
+  dsize[0]=p.npoints;
+  dsize[1]=k;
+  out=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 2, dsize, NULL, 0, minmapsize,
+                     quietmmap, "index", "counter",
+                     "Index of neighbour (sorted by distance).");
+  out->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 2, dsize, NULL, 0,
+                           minmapsize, quietmmap, "distance", NULL,
+                           "Distance to neighbour.");
+  p.indexs=out->array;
+  p.dists=out->next->array;
+
+  /* Do the searches. */
+  if(p.nchunks)
+    gal_threads_spin_off(kdtree_knn_on_thread, &p, p.nchunks, numthreads,
+                         minmapsize, quietmmap);
+
+  /* Clean up and return. */
+  free(p.points);
+  gal_list_data_free(copies);
+  return out;
+}
+
+
+
+
+
+/* Worker function for the radius searches of many points. */
+static void *
+kdtree_radius_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct kdtree_batch_params *p=tprm->params;
+
+  double *point;
+  struct kdtree_found *f;
+  size_t i, j, d, num, start, end;
+
+  /* Allocate space for one point. */
+  point=gal_pointer_allocate(GAL_TYPE_FLOAT64, p->q->ndim, 0, __func__,
+                             "point");
+
+  /* Go over the chunks of this thread: the indexs of all the points in a
+     chunk are kept in the chunk's growing array. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      f=&p->found[ tprm->indexs[i] ];
+      start =  tprm->indexs[i]    * p->npoints / p->nchunks;
+      end   = (tprm->indexs[i]+1) * p->npoints / p->nchunks;
+      for(j=start;j<end;++j)
+        {
+          num=f->num;
+          for(d=0;d<p->q->ndim;++d) point[d]=p->points[d][j];
+          if( kdtree_query_point_blank(p->q, point)==0 )
+            kdtree_radius_search(p->q, point, p->r2, f);
+          p->counts[j]=f->num-num;
+        }
+    }
+
+  /* Clean up, wait for all the other threads to finish, then return. */
+  free(point);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Find all the nodes within 'radius' of all the points in 'points' on
+   'numthreads' threads. The output is a list of two 1D datasets: the
+   first has the number of nodes found for each point. The second has the
+   indexs of the found nodes of all the points after each other (in the
+   order of the points): the indexs of the first point are the first
+   'counts[0]' elements, and so on. When 'countonly' is non-zero (for
+   example when only the number of neighbours is necessary) or nothing is
+   found, the second dataset is not created. */
+gal_data_t *
+gal_kdtree_query_radius_batch(gal_kdtree_query_t *query, gal_data_t *points,
+                              double radius, int countonly,
+                              size_t numthreads, size_t minmapsize,
+                              int quietmmap)
+{
+  size_t c, o, total=0;
+  gal_data_t *copies=NULL, *out;
+  struct kdtree_batch_params p={0};
+
+  /* Sanity check. */
+  if( !(radius>=0) )
+    error(EXIT_FAILURE, 0, "%s: the radius (%g) should not be negative",
+          __func__, radius);
+
+  /* Prepare the parameters and allocate the output. */
+  kdtree_batch_prepare(&p, query, points, &copies, numthreads);
+  p.r2=radius*radius;
+  out=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &p.npoints, NULL, 0,
+                     minmapsize, quietmmap, "count", "counter",
+                     "Number of nodes within the radius.");
+  p.counts=out->array;
+
+  /* Do the searches. */
+  if(p.nchunks)
+    {
+      errno=0;
+      p.found=calloc(p.nchunks, sizeof *p.found);
+      if(p.found==NULL)
+        error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+              "'p.found'", __func__, p.nchunks*sizeof *p.found);
+      for(c=0;c<p.nchunks;++c) p.found[c].countonly=countonly;
+      gal_threads_spin_off(kdtree_radius_on_thread, &p, p.nchunks,
+                           numthreads, minmapsize, quietmmap);
+      for(c=0;c<p.nchunks;++c) total+=p.found[c].num;
+    }
+
+  /* Put the indexs of all the chunks after each other. */
+  if(countonly==0 && total)
+    {
+      out->next=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &total, NULL, 0,
+                               minmapsize, quietmmap, "index", "counter",
+                               "Index of node within the radius.");
+      for(o=c=0;c<p.nchunks;++c)
+        {
+          memcpy((size_t *)(out->next->array)+o, p.found[c].indexs,
+                 p.found[c].num*sizeof *p.found[c].indexs);
+          o+=p.found[c].num;
+        }
+    }
+
+  /* Clean up and return. */
+  if(p.found)
+    for(c=0;c<p.nchunks;++c) free(p.found[c].indexs);
+  free(p.found);
+  free(p.points);
+  gal_list_data_free(copies);
+  return out;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ********            Saving and reading a k-d tree         *******
+ ****************************************************************/
+/* Names of the keywords that are written with a k-d tree. */
+#define KDTREE_KEY_ROOT "KDTROOT"
+#define KDTREE_KEY_NROW "KDTNROW"
+#define KDTREE_KEY_NDIM "KDTNDIM"
+#define KDTREE_KEY_SUM  "KDTSUM"
+
+/* Number of keywords that are read with a k-d tree. */
+#define KDTREE_NUMKEYS  4
+
+
+
+
+
+/* Return a checksum of the coordinates that were used to build a k-d
+   tree, so it can be checked if the coordinates have changed since the
+   tree was built. All the coordinates are used as 'double' values (in the
+   order of the columns): each value is mixed in with an XOR and a
+   multiplication by an odd number (from the 64-bit FNV hash). Both
+   operations are reversible, so changing any single value will always
+   change the checksum. All NaN values are considered equal. */
+uint64_t
+gal_kdtree_checksum(gal_data_t *coords_raw)
+{
+  double v;
+  uint64_t u, sum=14695981039346656037ULL;
+  gal_data_t *copies=NULL;
+  double **in;
+  size_t d, i, ndim=gal_list_data_number(coords_raw);
+
+  /* The number of dimensions and rows are also in the checksum. */
+  sum = (sum ^ ndim)             * 1099511628211ULL;
+  sum = (sum ^ coords_raw->size) * 1099511628211ULL;
+
+  /* Add the values. */
+  in=kdtree_query_columns(coords_raw, ndim, &copies);
+  for(d=0;d<ndim;++d)
+    for(i=0;i<coords_raw->size;++i)
+      {
+        v = isnan(in[d][i]) ? NAN : in[d][i];
+        memcpy(&u, &v, sizeof u);
+        sum = (sum ^ u) * 1099511628211ULL;
+      }
+
+  /* Clean up and return. */
+  free(in);
+  gal_list_data_free(copies);
+  return sum;
+}
+
+
+
+
+
+/* Write the k-d tree of the given coordinates (output of
+   'gal_kdtree_create') as a FITS binary table in the 'extname' extension
+   of 'filename'. Besides the root, the number of rows, the number of
+   dimensions and the checksum of the coordinates are written as keywords,
+   so 'gal_kdtree_read' can check if the tree can be used. */
+void
+gal_kdtree_write(gal_data_t *coords_raw, gal_data_t *kdtree, size_t root,
+                 char *filename, char *extname, size_t numthreads)
+{
+  char sum[20];
+  gal_fits_list_key_t *keylist=NULL;
+  size_t ndim=gal_list_data_number(coords_raw), nrow=coords_raw->size;
+
+  /* Basic sanity checks and the checksum. */
+  kdtree_check(coords_raw, kdtree, root, __func__);
+  sprintf(sum, "%016llx",
+          (unsigned long long)gal_kdtree_checksum(coords_raw));
+
+  /* Write the keywords and the table ('gal_table_write' frees
+     'keylist'). */
+  gal_fits_key_list_title_add(&keylist, "k-d tree parameters", 0);
+  gal_fits_key_list_add_end(&keylist, GAL_TYPE_SIZE_T, KDTREE_KEY_ROOT, 0,
+                            &root, 0, "k-d tree root index (counting "
+                            "from 0).", 0, "index", 0);
+  gal_fits_key_list_add_end(&keylist, GAL_TYPE_SIZE_T, KDTREE_KEY_NROW, 0,
+                            &nrow, 0, "Number of rows in the coordinates.",
+                            0, NULL, 0);
+  gal_fits_key_list_add_end(&keylist, GAL_TYPE_SIZE_T, KDTREE_KEY_NDIM, 0,
+                            &ndim, 0, "Number of dimensions.", 0, NULL, 0);
+  gal_fits_key_list_add_end(&keylist, GAL_TYPE_STRING, KDTREE_KEY_SUM, 0,
+                            sum, 0, "Checksum of the coordinates.", 0,
+                            NULL, 0);
+  gal_table_write_threaded(kdtree, &keylist, NULL, GAL_TABLE_FORMAT_BFITS,
+                           filename, extname, 0, numthreads);
+}
+
+
+
+
+
+/* Return 1 if the given HDU exists in the file (without aborting when
+   the file or HDU don't exist). */
+static int
+kdtree_hdu_exists(char *filename, char *hdu)
+{
+  int status=0;
+  char *ffname;
+  fitsfile *fptr;
+
+  if( asprintf(&ffname, "%s[%s#]", filename, hdu)<0 )
+    error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+  fits_open_file(&fptr, ffname, READONLY, &status);
+  free(ffname);
+  if(status) return 0;
+  fits_close_file(fptr, &status);
+  return 1;
+}
+
+
+
+
+
+/* Make sure that going down from the root, every node of the tree is
+   reached exactly once (the indexs were checked before, so they are
+   within the rows). A broken tree could otherwise make the searches go
+   into an infinite loop, or never check some of the rows. */
+static void
+kdtree_read_check_structure(gal_data_t *kdtree, size_t root,
+                            char *filename, char *hdu)
+{
+  uint8_t *reached;
+  size_t c, nstack=0, nreached=1;
+  uint32_t node, *child[2], *stack;
+  size_t nrow=kdtree->size;
+
+  /* Allocate the necessary arrays. */
+  child[0]=kdtree->array;
+  child[1]=kdtree->next->array;
+  reached=gal_pointer_allocate(GAL_TYPE_UINT8, nrow, 1, __func__,
+                               "reached");
+  stack=gal_pointer_allocate(GAL_TYPE_UINT32, nrow, 0, __func__, "stack");
+
+  /* Go down the tree: each node is only put in the stack once. */
+  reached[root]=1;
+  stack[nstack++]=root;
+  while(nstack)
+    {
+      node=stack[--nstack];
+      for(c=0;c<2;++c)
+        if(child[c][node]!=GAL_BLANK_UINT32)
+          {
+            if(reached[child[c][node]])
+              error(EXIT_FAILURE, 0, "%s (hdu %s): row %u of the k-d tree "
+                    "is reached more than once from its root", filename,
+                    hdu, child[c][node]);
+            reached[child[c][node]]=1;
+            stack[nstack++]=child[c][node];
+            ++nreached;
+          }
+    }
+
+  /* All the rows should have been reached. */
+  if(nreached!=nrow)
+    error(EXIT_FAILURE, 0, "%s (hdu %s): only %zu of the %zu rows of the "
+          "k-d tree are reached from its root", filename, hdu, nreached,
+          nrow);
+
+  /* Clean up. */
+  free(stack);
+  free(reached);
+}
+
+
+
+
+
+/* Read a k-d tree that was written by 'gal_kdtree_write' for the given
+   coordinates. If the file or HDU don't exist, or the coordinates have
+   changed since the tree was written, NULL is returned (so the tree can
+   be built again). When the tree is large, the columns will be
+   memory-mapped (see 'minmapsize'). */
+gal_data_t *
+gal_kdtree_read(gal_data_t *coords_raw, char *filename, char *hdu,
+                size_t *root, size_t minmapsize, int quietmmap)
+{
+  size_t i, nrow;
+  gal_data_t *keysll, *out, *col;
+  char sum[20], *names[KDTREE_NUMKEYS]={KDTREE_KEY_ROOT, KDTREE_KEY_NROW,
+                                        KDTREE_KEY_NDIM, KDTREE_KEY_SUM};
+  uint32_t *u, *uf;
+
+  /* If the tree doesn't exist, it should be built. */
+  if( kdtree_hdu_exists(filename, hdu)==0 ) return NULL;
+
+  /* Read the keywords. */
+  keysll=gal_data_array_calloc(KDTREE_NUMKEYS);
+  for(i=0;i<KDTREE_NUMKEYS;++i)
+    {
+      keysll[i].name=names[i];
+      keysll[i].type = ( i==KDTREE_NUMKEYS-1
+                         ? GAL_TYPE_STRING
+                         : GAL_TYPE_SIZE_T );
+      if(i<KDTREE_NUMKEYS-1) keysll[i].next=&keysll[i+1];
+    }
+  gal_fits_key_read(filename, hdu, keysll, 0, 0);
+  for(i=0;i<KDTREE_NUMKEYS;++i)
+    if(keysll[i].status)
+      error(EXIT_FAILURE, 0, "%s (hdu %s): not a k-d tree that was written "
+            "by 'gal_kdtree_write' (the '%s' keyword couldn't be read)",
+            filename, hdu, names[i]);
+
+  /* If the coordinates have changed, the tree can't be used. */
+  sprintf(sum, "%016llx",
+          (unsigned long long)gal_kdtree_checksum(coords_raw));
+  nrow=((size_t *)(keysll[1].array))[0];
+  if( nrow!=coords_raw->size
+      || ((size_t *)(keysll[2].array))[0]!=gal_list_data_number(coords_raw)
+      || strcmp(((char **)(keysll[3].array))[0], sum) )
+    {
+      for(i=0;i<KDTREE_NUMKEYS;++i) keysll[i].name=NULL;
+      gal_data_array_free(keysll, KDTREE_NUMKEYS, 1);
+      return NULL;
+    }
+  *root=((size_t *)(keysll[0].array))[0];
+  for(i=0;i<KDTREE_NUMKEYS;++i) keysll[i].name=NULL;
+  gal_data_array_free(keysll, KDTREE_NUMKEYS, 1);
+
+  /* Read the tree. */
+  out=gal_table_read(filename, hdu, NULL, NULL, GAL_TABLE_SEARCH_NAME, 0,
+                     minmapsize, quietmmap, NULL);
+
+  /* Make sure the tree is usable: a broken tree could make the searches
+     read outside the coordinates. */
+  kdtree_check(coords_raw, out, *root, __func__);
+  for(col=out; col!=NULL; col=col->next)
+    {
+      uf=(u=col->array)+col->size;
+      for(; u<uf; ++u)
+        if(*u!=GAL_BLANK_UINT32 && *u>=nrow)
+          error(EXIT_FAILURE, 0, "%s (hdu %s): the k-d tree has an index "
+                "(%u) that is larger than the number of rows (%zu)",
+                filename, hdu, *u, nrow);
+    }
+  kdtree_read_check_structure(out, *root, filename, hdu);
+
+  /* Return the tree. */
+  return out;
 }
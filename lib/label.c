@@ -167,6 +167,14 @@ gal_label_indexs(gal_data_t *labels, size_t numlabs, size_t minmapsize,
 /****************************************************************
  *****************   Over segmentation       ********************
  ****************************************************************/
+/* Initial number of elements in the lists of equal flux regions (they
+   will grow when necessary). */
+#define LABEL_QUEUE_INIT 1024
+
+
+
+
+
 /* Over-segment the region specified by its indexs into peaks and their
    respective regions (clumps). This is very similar to the immersion
    method of Vincent & Soille(1991), but here, we will not separate the
@@ -187,7 +195,7 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
 
   int hasblank;
   float *arr=values->array;
-  gal_list_sizet_t *Q=NULL, *cleanup=NULL;
+  gal_list_sizet_ring_t *Q, *cleanup;
   size_t *a, *af, ind, *dsize=values->dsize;
   size_t *dinc=gal_dimension_increment(ndim, dsize);
   int32_t n1, nlab, rlab, curlab=1, *labs=labels->array;
@@ -259,7 +267,13 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
   do labs[*a]=GAL_LABEL_INIT; while(++a<af);
 
 
-  /* Go over all the given indexs and pull out the clumps. */
+  /* Go over all the given indexs and pull out the clumps. The lists of
+     the equal flux regions are array-based, to avoid an allocation for
+     every pixel. */
+  Q=gal_list_sizet_ring_alloc(LABEL_QUEUE_INIT, values->minmapsize,
+                              values->quietmmap);
+  cleanup=gal_list_sizet_ring_alloc(LABEL_QUEUE_INIT, values->minmapsize,
+                                    values->quietmmap);
   af=(a=indexs->array)+indexs->size;
   do
     /* When regions of a constant flux or masked regions exist, some later
@@ -286,23 +300,23 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
             n1=0;
 
             /* A small sanity check. */
-            if(Q!=NULL || cleanup!=NULL)
+            if(Q->num || cleanup->num)
               error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so "
                     "we can fix this problem. 'Q' and 'cleanup' should be "
-                    "NULL but while checking the equal flux regions they "
+                    "empty but while checking the equal flux regions they "
                     "aren't", __func__, PACKAGE_BUGREPORT);
 
             /* Add this pixel to a queue. */
-            gal_list_sizet_add(&Q, *a);
-            gal_list_sizet_add(&cleanup, *a);
+            gal_list_sizet_ring_add(Q, *a);
+            gal_list_sizet_ring_add(cleanup, *a);
             labs[*a] = GAL_LABEL_TMPCHECK;
 
             /* Find all the pixels that have the same flux and are
                connected. */
-            while(Q!=NULL)
+            while(Q->num)
               {
                 /* Pop an element from the queue. */
-                ind=gal_list_sizet_pop(&Q);
+                ind=gal_list_sizet_ring_pop_last(Q);
 
                 /* Look at the neighbors and see if we already have a
                    label. */
@@ -324,8 +338,8 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
                              if( nlab==GAL_LABEL_INIT && arr[nind]==arr[*a] )
                                {
                                  labs[nind]=GAL_LABEL_TMPCHECK;
-                                 gal_list_sizet_add(&Q, nind);
-                                 gal_list_sizet_add(&cleanup, nind);
+                                 gal_list_sizet_ring_add(Q, nind);
+                                 gal_list_sizet_ring_add(cleanup, nind);
                                }
                              else
                                n1=( nlab>0
@@ -384,9 +398,9 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
             /* Give the same label to the whole connected equal flux
                region, except those that might have been on the side of
                the image and were a river pixel. */
-            while(cleanup!=NULL)
+            while(cleanup->num)
               {
-                ind=gal_list_sizet_pop(&cleanup);
+                ind=gal_list_sizet_ring_pop_last(cleanup);
                 /* If it was on the sides of the image, it has been
                    changed to a river pixel. */
                 if( labs[ ind ]==GAL_LABEL_TMPCHECK ) labs[ ind ]=rlab;
@@ -501,6 +515,8 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
   **********************************************/
 
   /* Clean up. */
+  gal_list_sizet_ring_free(cleanup);
+  gal_list_sizet_ring_free(Q);
   free(dinc);
 
   /* Return the total number of clumps. */
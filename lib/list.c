@@ -25,8 +25,10 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
+#include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <sys/mman.h>
 #include <inttypes.h>
 
 #include <gnuastro/list.h>
@@ -517,6 +519,199 @@ gal_list_sizet_free(gal_list_sizet_t *list)
 
 
 
+/****************************************************************
+ *****************     size_t (array-based)    ******************
+ ****************************************************************/
+/* Free the array of a ring. */
+static void
+list_sizet_ring_free_array(size_t *array, size_t alloc, char **mmapname,
+                           int quietmmap)
+{
+  if(*mmapname)
+    {
+      munmap(array, alloc*sizeof *array);
+      gal_pointer_mmap_free(mmapname, quietmmap);
+    }
+  else free(array);
+}
+
+
+
+
+
+/* Allocate a ring with space for 'initial' elements (it will grow when
+   necessary). If the array needs more than 'minmapsize' bytes, it will be
+   memory-mapped (see 'gal_pointer_allocate_ram_or_mmap'). */
+gal_list_sizet_ring_t *
+gal_list_sizet_ring_alloc(size_t initial, size_t minmapsize, int quietmmap)
+{
+  gal_list_sizet_ring_t *ring;
+
+  /* Allocate the structure. */
+  errno=0;
+  ring=malloc(sizeof *ring);
+  if(ring==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'ring'",
+          __func__, sizeof *ring);
+
+  /* Set the basic properties and allocate the array. */
+  ring->num=0;
+  ring->first=0;
+  ring->mmapname=NULL;
+  ring->quietmmap=quietmmap;
+  ring->minmapsize=minmapsize;
+  ring->alloc = initial ? initial : 1;
+  ring->array=gal_pointer_allocate_ram_or_mmap(GAL_TYPE_SIZE_T, ring->alloc,
+                                               0, minmapsize,
+                                               &ring->mmapname, quietmmap,
+                                               __func__, "ring->array");
+  return ring;
+}
+
+
+
+
+
+/* Double the allocated space of the ring. The elements are put at the
+   start of the new array (in their order). */
+static void
+list_sizet_ring_grow(gal_list_sizet_ring_t *ring)
+{
+  size_t *array, n1;
+  char *mmapname=NULL;
+  size_t alloc=2*ring->alloc;
+
+  /* Allocate the new space. */
+  array=gal_pointer_allocate_ram_or_mmap(GAL_TYPE_SIZE_T, alloc, 0,
+                                         ring->minmapsize, &mmapname,
+                                         ring->quietmmap, __func__, "array");
+
+  /* Copy the elements: those from 'first' to the end of the old array,
+     then those that are wrapped around to its start. */
+  n1 = ( ring->first+ring->num > ring->alloc
+         ? ring->alloc-ring->first : ring->num );
+  memcpy(array, ring->array+ring->first, n1*sizeof *array);
+  memcpy(array+n1, ring->array, (ring->num-n1)*sizeof *array);
+
+  /* Free the old array and put in the new one. */
+  list_sizet_ring_free_array(ring->array, ring->alloc, &ring->mmapname,
+                             ring->quietmmap);
+  ring->first=0;
+  ring->array=array;
+  ring->alloc=alloc;
+  ring->mmapname=mmapname;
+}
+
+
+
+
+
+/* Add a new element to the end of the ring. */
+void
+gal_list_sizet_ring_add(gal_list_sizet_ring_t *ring, size_t value)
+{
+  size_t ind;
+
+  /* Make sure there is space, then put the value after the last
+     element. */
+  if(ring->num==ring->alloc) list_sizet_ring_grow(ring);
+  ind=ring->first+ring->num;
+  ring->array[ ind<ring->alloc ? ind : ind-ring->alloc ] = value;
+  ++ring->num;
+}
+
+
+
+
+
+/* Remove the first element of the ring and return it (so the ring is a
+   first-in-first-out queue). If the ring is empty, 'GAL_BLANK_SIZE_T' is
+   returned. */
+size_t
+gal_list_sizet_ring_pop_first(gal_list_sizet_ring_t *ring)
+{
+  size_t out;
+
+  if(ring->num==0) return GAL_BLANK_SIZE_T;
+  out=ring->array[ring->first];
+  if(++ring->first==ring->alloc) ring->first=0;
+  --ring->num;
+  return out;
+}
+
+
+
+
+
+/* Remove the last element of the ring and return it (so the ring is a
+   last-in-first-out stack, similar to 'gal_list_sizet_t'). If the ring is
+   empty, 'GAL_BLANK_SIZE_T' is returned. */
+size_t
+gal_list_sizet_ring_pop_last(gal_list_sizet_ring_t *ring)
+{
+  size_t ind;
+
+  if(ring->num==0) return GAL_BLANK_SIZE_T;
+  ind=ring->first + --ring->num;
+  return ring->array[ ind<ring->alloc ? ind : ind-ring->alloc ];
+}
+
+
+
+
+
+/* Allocate an array (in RAM) and copy the elements of the ring into it
+   (from the first to the last). The number of elements is put in 'num'
+   and when the ring is empty, NULL is returned. */
+size_t *
+gal_list_sizet_ring_to_array(gal_list_sizet_ring_t *ring, size_t *num)
+{
+  size_t i, ind, *out=NULL;
+
+  *num=ring->num;
+  if(*num)
+    {
+      out=gal_pointer_allocate(GAL_TYPE_SIZE_T, *num, 0, __func__, "out");
+      for(i=0;i<*num;++i)
+        {
+          ind=ring->first+i;
+          out[i]=ring->array[ ind<ring->alloc ? ind : ind-ring->alloc ];
+        }
+    }
+  return out;
+}
+
+
+
+
+
+void
+gal_list_sizet_ring_free(gal_list_sizet_ring_t *ring)
+{
+  list_sizet_ring_free_array(ring->array, ring->alloc, &ring->mmapname,
+                             ring->quietmmap);
+  free(ring);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /****************************************************************
  *****************            Float          ********************
  ****************************************************************/
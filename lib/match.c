@@ -27,14 +27,17 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <error.h>
 #include <float.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <gsl/gsl_sort.h>
 
 #include <gnuastro/box.h>
 #include <gnuastro/list.h>
 #include <gnuastro/blank.h>
+#include <gnuastro/kdtree.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/permutation.h>
+#include <gnuastro/threads.h>
 
 
 
@@ -47,6 +50,10 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /**********************************************************************/
 /*****************   Coordinate match custom list   *******************/
 /**********************************************************************/
+/* Number of list nodes that are allocated together in each block of a
+   pool (see below). */
+#define MATCH_POOL_BLOCK 16384
+
 struct match_coordinate_sfll
 {
   float f;
@@ -58,18 +65,50 @@ struct match_coordinate_sfll
 
 
 
+/* The nodes of the lists are not allocated one by one. Each thread has
+   its own pool (a list of large blocks of nodes) and takes its nodes from
+   it. When the lists of a thread are no longer necessary, the whole pool
+   is freed at once. */
+struct match_coordinate_pool
+{
+  size_t                          used; /* Used nodes in this block.    */
+  struct match_coordinate_sfll  *nodes; /* Array of nodes.              */
+  struct match_coordinate_pool   *next; /* Previous (full) block.       */
+};
+
+
+
+
+
 static void
 match_coordinate_add_to_sfll(struct match_coordinate_sfll **list,
+                             struct match_coordinate_pool **pool,
                              size_t value, float fvalue)
 {
+  struct match_coordinate_pool *block;
   struct match_coordinate_sfll *newnode;
 
-  errno=0;
-  newnode=malloc(sizeof *newnode);
-  if(newnode==NULL)
-    error(EXIT_FAILURE, errno, "%s: new node couldn't be allocated",
-          __func__);
+  /* If the current block is full (or no block has been allocated yet),
+     allocate a new block. */
+  if(*pool==NULL || (*pool)->used==MATCH_POOL_BLOCK)
+    {
+      errno=0;
+      block=malloc(sizeof *block);
+      if(block==NULL)
+        error(EXIT_FAILURE, errno, "%s: new pool block couldn't be "
+              "allocated", __func__);
+      errno=0;
+      block->nodes=malloc(MATCH_POOL_BLOCK * sizeof *block->nodes);
+      if(block->nodes==NULL)
+        error(EXIT_FAILURE, errno, "%s: %zu bytes for nodes of new pool "
+              "block", __func__, MATCH_POOL_BLOCK * sizeof *block->nodes);
+      block->used=0;
+      block->next=*pool;
+      *pool=block;
+    }
 
+  /* Take the next node from the pool. */
+  newnode=&(*pool)->nodes[ (*pool)->used++ ];
   newnode->v=value;
   newnode->f=fvalue;
   newnode->next=*list;
@@ -81,15 +120,16 @@ match_coordinate_add_to_sfll(struct match_coordinate_sfll **list,
 
 
 static void
-match_coordinate_pop_from_sfll(struct match_coordinate_sfll **list,
-                               size_t *value, float *fvalue)
+match_coordinate_pool_free(struct match_coordinate_pool *pool)
 {
-  struct match_coordinate_sfll *tmp;
-  tmp=*list;
-  *value=tmp->v;
-  *fvalue=tmp->f;
-  *list=tmp->next;
-  free(tmp);
+  struct match_coordinate_pool *tmp;
+  while(pool!=NULL)
+    {
+      tmp=pool->next;
+      free(pool->nodes);
+      free(pool);
+      pool=tmp;
+    }
 }
 
 
@@ -214,38 +254,322 @@ match_coordinaes_sanity_check(gal_data_t *coord1, gal_data_t *coord2,
 
 
 
-/* To keep things clean, the sorting of each input array will be done in
-   this function. */
-static size_t *
-match_coordinates_prepare_sort(gal_data_t *coords, size_t minmapsize)
+/* Compare two row indexs (for 'qsort'). */
+static int
+match_coordinates_sort_size_t(const void *a, const void *b)
+{
+  size_t ta=*(size_t *)a, tb=*(size_t *)b;
+  return (ta > tb) - (ta < tb);
+}
+
+
+
+
+
+/* 'gsl_sort_index' doesn't preserve the order of equal values, so rows
+   with the same first coordinate (for example the NaN values that are
+   set to 'FLT_MAX') are put in the order of their row index. This makes
+   the sorted order unique, therefore it will not depend on the number of
+   threads that are used for sorting. */
+static void
+match_coordinates_sort_ties(size_t *perm, double *arr, size_t size)
+{
+  size_t i, j;
+
+  for(i=0;i<size;i=j)
+    {
+      for(j=i+1; j<size && arr[perm[j]]==arr[perm[i]]; ++j) {}
+      if(j-i>1)
+        qsort(perm+i, j-i, sizeof *perm, match_coordinates_sort_size_t);
+    }
+}
+
+
+
+
+
+/* Steps of sorting the coordinates on multiple threads. */
+enum match_sort_steps
+{
+  MATCH_SORT_CHUNKS,            /* Sort the first column in each chunk. */
+  MATCH_SORT_MERGE,             /* Merge pairs of sorted runs.          */
+  MATCH_SORT_GATHER,            /* Put the permuted column in 'cbuf'.   */
+  MATCH_SORT_COPY,              /* Copy 'cbuf' back into the column.    */
+};
+
+
+
+
+
+/* Parameters for sorting the coordinates on multiple threads. */
+struct match_sort_params
+{
+  int            step;  /* Step of the sorting (from 'match_sort_steps'). */
+  double         *arr;  /* First column (that is used for sorting).       */
+  size_t         *src;  /* Permutation of the current runs.               */
+  size_t         *dst;  /* Permutation after merging the runs.            */
+  size_t      *bounds;  /* First row of each chunk ('nchunks+1' elements).*/
+  size_t      nchunks;  /* Number of chunks.                              */
+  size_t          run;  /* Number of chunks in each sorted run.           */
+  gal_data_t     *col;  /* Column to apply the permutation on.            */
+  uint8_t       *cbuf;  /* Buffer to keep the permuted column.            */
+};
+
+
+
+
+
+static void *
+match_coordinates_sort_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct match_sort_params *p=(struct match_sort_params *)tprm->params;
+
+  double *arr=p->arr;
+  uint8_t *carr, *cbuf=p->cbuf;
+  size_t *src=p->src, *dst=p->dst;
+  size_t c, i, j, o, w, lo, mid, hi, n=p->nchunks;
+
+  /* Go over the actions (chunks or pairs of runs) of this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      c=tprm->indexs[i];
+      switch(p->step)
+        {
+        /* Sort the first column within this chunk (the NaN values have
+           already been replaced, see 'match_coordinates_sort_nan'). */
+        case MATCH_SORT_CHUNKS:
+          lo=p->bounds[c];
+          hi=p->bounds[c+1];
+          gsl_sort_index(src+lo, arr+lo, 1, hi-lo);
+          for(j=lo;j<hi;++j) src[j]+=lo;
+          match_coordinates_sort_ties(src+lo, arr, hi-lo);
+          break;
+
+        /* Merge the two neighboring runs into 'dst'. When the values are
+           equal, the element of the first run (with a smaller row index)
+           is taken first, so ties remain in the order of their rows. */
+        case MATCH_SORT_MERGE:
+          j=2*c*p->run;
+          lo  = p->bounds[ j ];
+          mid = p->bounds[ j+p->run   < n ? j+p->run   : n ];
+          hi  = p->bounds[ j+2*p->run < n ? j+2*p->run : n ];
+          o=lo;
+          j=mid;
+          while(lo<mid && j<hi)
+            dst[o++] = arr[src[j]] < arr[src[lo]] ? src[j++] : src[lo++];
+          while(lo<mid) dst[o++]=src[lo++];
+          while(j<hi)   dst[o++]=src[j++];
+          break;
+
+        /* Put the permuted values of this chunk of the column in the
+           buffer. */
+        case MATCH_SORT_GATHER:
+          carr=p->col->array;
+          w=gal_type_sizeof(p->col->type);
+          for(j=p->bounds[c];j<p->bounds[c+1];++j)
+            memcpy(cbuf+j*w, carr+src[j]*w, w);
+          break;
+
+        /* Copy the permuted values back into the column. */
+        case MATCH_SORT_COPY:
+          carr=p->col->array;
+          w=gal_type_sizeof(p->col->type);
+          memcpy(carr+p->bounds[c]*w, cbuf+p->bounds[c]*w,
+                 (p->bounds[c+1]-p->bounds[c])*w);
+          break;
+
+        default:
+          error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to "
+                "fix the problem. The value %d is not recognized for "
+                "'p->step'", __func__, PACKAGE_BUGREPORT, p->step);
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* 'gsl_sort_index' doesn't account for NaN elements. So before sorting,
+   the NaN values of the first column are replaced by the largest floating
+   point value (to be sorted at the end). The rows that were NaN are
+   flagged in the returned array (that is NULL when there are no NaN
+   values) and their number is put in 'numnan'. */
+static uint8_t *
+match_coordinates_sort_nan(gal_data_t *coords, size_t *numnan)
 {
   size_t i;
-  double *darr;
-  gal_data_t *tmp;
-  size_t *permutation=gal_pointer_allocate(GAL_TYPE_SIZE_T, coords->size, 0,
-                                           __func__, "permutation");
+  uint8_t *isnan1;
+  double *darr=coords->array;
+
+  *numnan=0;
+  if( gal_blank_present(coords, 1)==0 ) return NULL;
+  isnan1=gal_pointer_allocate(GAL_TYPE_UINT8, coords->size, 1, __func__,
+                              "isnan1");
+  for(i=0;i<coords->size;++i)
+    if( isnan(darr[i]) )
+      {
+        ++*numnan;
+        isnan1[i]=1;
+        darr[i]=FLT_MAX;
+      }
+  return isnan1;
+}
+
+
 
-  /* Unfortunately 'gsl_sort_index' doesn't account for NaN elements. So we
-     need to set them to the maximum possible floating point value. */
-  if( gal_blank_present(coords, 1) )
+
+
+/* The rows that were NaN have the same value as the rows that actually
+   have the largest floating point value. So in the sorted permutation,
+   move the rows that were NaN after them (keeping the order of the rows
+   in each group). Therefore the last 'numnan' sorted rows are the ones
+   that were NaN (and can be set back to NaN). */
+static void
+match_coordinates_sort_nan_last(size_t *perm, double *arr, size_t size,
+                                uint8_t *isnan1)
+{
+  size_t i, j, n=0, start, *nanrows;
+
+  /* If there were no NaN values, there is nothing to do. */
+  if(isnan1==NULL) return;
+
+  /* Find the first row with the largest value. */
+  for(start=size; start>0 && arr[perm[start-1]]==FLT_MAX; --start) {}
+
+  /* Move the rows that were NaN to the end. */
+  nanrows=gal_pointer_allocate(GAL_TYPE_SIZE_T, size-start, 0, __func__,
+                               "nanrows");
+  for(i=j=start;i<size;++i)
+    if(isnan1[perm[i]]) nanrows[n++]=perm[i];
+    else                perm[j++]=perm[i];
+  memcpy(perm+j, nanrows, n*sizeof *perm);
+  free(nanrows);
+}
+
+
+
+
+
+/* Sort the columns on multiple threads: each thread sorts some chunks of
+   the first column independently, then the sorted runs are merged in
+   pairs (each pair on one thread) until there is only one run. Finally,
+   the permutation is applied on all the columns (each thread permutes
+   some chunks of each column). */
+static size_t *
+match_coordinates_prepare_sort_threaded(gal_data_t *coords, uint8_t *isnan1,
+                                        size_t numthreads,
+                                        size_t minmapsize, int quietmmap)
+{
+  size_t i, *tmp;
+  char *mmapname=NULL;
+  struct match_sort_params p;
+  size_t maxw=0, size=coords->size;
+
+  /* Set the chunks (one for each thread). */
+  p.nchunks=numthreads;
+  p.arr=coords->array;
+  p.bounds=gal_pointer_allocate(GAL_TYPE_SIZE_T, p.nchunks+1, 0, __func__,
+                                "p.bounds");
+  for(i=0;i<=p.nchunks;++i) p.bounds[i]=i*size/p.nchunks;
+  p.src=gal_pointer_allocate(GAL_TYPE_SIZE_T, size, 0, __func__, "p.src");
+  p.dst=gal_pointer_allocate(GAL_TYPE_SIZE_T, size, 0, __func__, "p.dst");
+
+  /* Sort each chunk. */
+  p.step=MATCH_SORT_CHUNKS;
+  gal_threads_spin_off(match_coordinates_sort_on_thread, &p, p.nchunks,
+                       numthreads, minmapsize, quietmmap);
+
+  /* Merge the sorted runs until there is only one run. */
+  p.step=MATCH_SORT_MERGE;
+  for(p.run=1; p.run<p.nchunks; p.run*=2)
     {
-      darr=coords->array;
-      for(i=0;i<coords->size;++i)
-        if( isnan(darr[i]) ) darr[i]=FLT_MAX;
+      gal_threads_spin_off(match_coordinates_sort_on_thread, &p,
+                           (p.nchunks+2*p.run-1)/(2*p.run), numthreads,
+                           minmapsize, quietmmap);
+      tmp=p.src; p.src=p.dst; p.dst=tmp;
+    }
+  free(p.dst);
+  match_coordinates_sort_nan_last(p.src, p.arr, size, isnan1);
+
+  /* Apply the permutation on all the columns (using one buffer that is
+     large enough for the widest column). */
+  for(p.col=coords; p.col!=NULL; p.col=p.col->next)
+    if( gal_type_sizeof(p.col->type) > maxw )
+      maxw=gal_type_sizeof(p.col->type);
+  p.cbuf=gal_pointer_allocate_ram_or_mmap(GAL_TYPE_UINT8, size*maxw, 0,
+                                          minmapsize, &mmapname, quietmmap,
+                                          __func__, "p.cbuf");
+  for(p.col=coords; p.col!=NULL; p.col=p.col->next)
+    {
+      p.step=MATCH_SORT_GATHER;
+      gal_threads_spin_off(match_coordinates_sort_on_thread, &p, p.nchunks,
+                           numthreads, minmapsize, quietmmap);
+      p.step=MATCH_SORT_COPY;
+      gal_threads_spin_off(match_coordinates_sort_on_thread, &p, p.nchunks,
+                           numthreads, minmapsize, quietmmap);
     }
 
-  /* Get the permutation necessary to sort all the columns (based on the
-     first column). */
-  gsl_sort_index(permutation, coords->array, 1, coords->size);
+  /* Clean up and return the permutation. */
+  free(p.bounds);
+  if(mmapname) gal_pointer_mmap_free(&mmapname, quietmmap);
+  else         free(p.cbuf);
+  return p.src;
+}
 
-  /* For a check.
-  if(coords->size>1)
-    for(size_t i=0; i<coords->size; ++i) printf("%zu\n", permutation[i]);
-  */
 
-  /* Sort all the coordinates. */
-  for(tmp=coords; tmp!=NULL; tmp=tmp->next)
-    gal_permutation_apply(tmp, permutation);
+
+
+
+/* To keep things clean, the sorting of each input array will be done in
+   this function. */
+static size_t *
+match_coordinates_prepare_sort(gal_data_t *coords, size_t numthreads,
+                               size_t minmapsize, int quietmmap)
+{
+  size_t i, numnan;
+  gal_data_t *tmp;
+  uint8_t *isnan1;
+  size_t *permutation;
+  double *darr=coords->array;
+
+  /* Replace the NaN values of the first column. */
+  isnan1=match_coordinates_sort_nan(coords, &numnan);
+
+  /* When more than one thread is given (and there are enough rows), do
+     the sorting on multiple threads. */
+  if(numthreads>1 && coords->size>numthreads)
+    permutation=match_coordinates_prepare_sort_threaded(coords, isnan1,
+                                                        numthreads,
+                                                        minmapsize,
+                                                        quietmmap);
+  else
+    {
+      /* Get the permutation necessary to sort all the columns (based on
+         the first column). */
+      permutation=gal_pointer_allocate(GAL_TYPE_SIZE_T, coords->size, 0,
+                                       __func__, "permutation");
+      gsl_sort_index(permutation, coords->array, 1, coords->size);
+      match_coordinates_sort_ties(permutation, coords->array,
+                                  coords->size);
+      match_coordinates_sort_nan_last(permutation, coords->array,
+                                      coords->size, isnan1);
+
+      /* Sort all the coordinates. */
+      for(tmp=coords; tmp!=NULL; tmp=tmp->next)
+        gal_permutation_apply(tmp, permutation);
+    }
+
+  /* The rows that were NaN are now the last rows, set them back to NaN
+     (so they can't match with anything, not even with the rows of the
+     other input that are also NaN). */
+  for(i=coords->size-numnan; i<coords->size; ++i) darr[i]=NAN;
+  free(isnan1);
 
   /* For a check.
   if(coords->size>1)
@@ -269,14 +593,14 @@ match_coordinates_prepare_sort(gal_data_t *coords, size_t minmapsize)
 
 
 
-
 /* Do the preparations for matching of coordinates. */
 static void
 match_coordinates_prepare(gal_data_t *coord1, gal_data_t *coord2,
                           int sorted_by_first, int inplace, int allf64,
                           gal_data_t **A_out, gal_data_t **B_out,
                           size_t **A_perm, size_t **B_perm,
-                          size_t minmapsize)
+                          size_t numthreads, size_t minmapsize,
+                          int quietmmap)
 {
   gal_data_t *c, *tmp, *A=NULL, *B=NULL;
 
@@ -324,8 +648,10 @@ match_coordinates_prepare(gal_data_t *coord1, gal_data_t *coord2,
         }
 
       /* Sort each dataset by the first coordinate. */
-      *A_perm = match_coordinates_prepare_sort(*A_out, minmapsize);
-      *B_perm = match_coordinates_prepare_sort(*B_out, minmapsize);
+      *A_perm = match_coordinates_prepare_sort(*A_out, numthreads,
+                                                 minmapsize, quietmmap);
+      *B_perm = match_coordinates_prepare_sort(*B_out, numthreads,
+                                                 minmapsize, quietmmap);
     }
 }
 
@@ -507,243 +833,646 @@ match_coordinates_distance(double *delta, int iscircle, size_t ndim,
 
 
 
+/* Each chunk of the first catalog ('A') is processed independently on one
+   thread. */
+struct match_coordinates_chunk
+{
+  size_t      astart;  /* First row of 'A' in this chunk.                 */
+  size_t        aend;  /* One after the last row of 'A' in this chunk.    */
+  size_t        bmin;  /* Smallest row of 'B' near this chunk.            */
+  size_t        bmax;  /* One after the largest row of 'B' near chunk.    */
+  size_t       *ainb;  /* Nearest row of chunk to each row in 'bmin-bmax'.*/
+  float        *rinb;  /* Distance of each element of 'ainb'.             */
+  size_t     matched;  /* Number of rows of this chunk that are matched.  */
+  size_t     match_i;  /* First output index of matched rows.             */
+  size_t   nomatch_i;  /* First output index of non-matched rows.         */
+};
 
 
-/* Go through both catalogs and find which records/rows in the second
-   catalog (catalog b) are within the acceptable distance of each record in
-   the first (a). */
+
+
+
+/* Parameters for matching on multiple threads. */
+struct match_coordinates_params
+{
+  /* Inputs. */
+  gal_data_t           *A;  /* First catalog (sorted by first column).    */
+  gal_data_t           *B;  /* Second catalog (sorted by first column).   */
+  size_t          *A_perm;  /* Permutation to sort the first catalog.     */
+  size_t          *B_perm;  /* Permutation to sort the second catalog.    */
+  double        *aperture;  /* Aperture to match.                         */
+  size_t             ndim;  /* Number of dimensions.                      */
+
+  /* Derived from the inputs (see 'match_coordinates_sif_prepare'). */
+  double            *a[3];  /* Coordinate columns of 'A'.                 */
+  double            *b[3];  /* Coordinate columns of 'B'.                 */
+  double          dist[3];  /* Maximum distance along each dimension.     */
+  double             c[3];  /* Cosine of the aperture's angles.           */
+  double             s[3];  /* Sine of the aperture's angles.             */
+  int            iscircle;  /* If the aperture is circular.               */
+
+  /* Internal. */
+  size_t          nchunks;  /* Number of chunks in each catalog.          */
+  struct match_coordinate_sfll **bina; /* List of 'B' rows near each 'A'. */
+  struct match_coordinates_chunk *chunks; /* Information on each chunk.   */
+  size_t            *ainb;  /* Nearest row of 'A' to each row of 'B'.     */
+  float             *rinb;  /* Distance of each element of 'ainb'.        */
+  size_t           *bnear;  /* Nearest row of 'B' to each row of 'A'.     */
+  float            *rnear;  /* Distance of each element of 'bnear'.       */
+  gal_kdtree_query_t *kdquery; /* k-d tree (NULL when sweeping).         */
+  int             treeona;  /* The k-d tree is built on catalog 'a'.      */
+
+  /* Output. */
+  size_t            *aind;  /* Output permutation of first catalog.       */
+  size_t            *bind;  /* Output permutation of second catalog.      */
+  double            *rval;  /* Distance of each match.                    */
+  uint8_t       *Bmatched;  /* If each row of second catalog is matched.  */
+};
+
+
+
+
+
+/* Return the first row of the (sorted) 'b' that isn't smaller than
+   'value'. When 'value' is 'a[0][ai]-dist[0]', this is the 'blow' of
+   'ai' (see 'match_coordinates_second_in_first'). */
+static size_t
+match_coordinates_blow(double *b, size_t br, double value)
+{
+  size_t mid, low=0, high=br;
+
+  while(low<high)
+    {
+      mid = low + (high-low)/2;
+      if( b[mid] < value ) low=mid+1;
+      else                 high=mid;
+    }
+  return low;
+}
+
+
+
+
+
+/* Find the rows of catalog 'b' that are within the aperture of each row
+   in this chunk of catalog 'a' by sweeping over the (sorted) first
+   coordinate of both catalogs. */
 static void
-match_coordinates_second_in_first(gal_data_t *A, gal_data_t *B,
-                                  double *aperture,
-                                  struct match_coordinate_sfll **bina)
+match_coordinates_sweep(struct match_coordinates_params *p,
+                        struct match_coordinates_chunk *ch,
+                        struct match_coordinate_pool **pool)
 {
   /* To keep things easy to read, all variables related to catalog 1 start
      with an 'a' and things related to catalog 2 are marked with a 'b'. The
      redundant variables (those that equal a previous value) are only
      defined to make it easy to read the code.*/
-  int iscircle=0;
-  size_t i, ar=A->size, br=B->size;
-  size_t ai, bi, blow=0, prevblow=0;
-  size_t ndim=gal_list_data_number(A);
-  double r, c[3]={NAN, NAN, NAN}, s[3]={NAN, NAN, NAN};
-  double dist[3]={NAN, NAN, NAN}, delta[3]={NAN, NAN, NAN};
-  double *a[3]={NULL, NULL, NULL}, *b[3]={NULL, NULL, NULL};
-
-
-  /* Necessary preperations. */
-  match_coordinates_sif_prepare(A, B, aperture,  ndim, a, b, dist, c, s,
-                                &iscircle);
-
-  /* For each row/record of catalog 'a', make a list of the nearest records
-     in catalog b within the maximum distance. Note that both catalogs are
-     sorted by their first axis coordinate.*/
-  for(ai=0;ai<ar;++ai)
+  double r, delta[3]={NAN, NAN, NAN};
+  size_t i, ai, bi, blow, prevblow;
+  struct match_coordinate_sfll **bina=p->bina;
+  double *c=p->c, *s=p->s, *dist=p->dist, *aperture=p->aperture;
+  size_t ndim=p->ndim, br=p->B->size;
+  double **a=p->a, **b=p->b;
+
+  /* Both catalogs are sorted by their first coordinate, so the first
+     'blow' of this chunk can be found with a binary search. */
+  blow = ( ch->astart<ch->aend && !isnan(a[0][ch->astart])
+           ? match_coordinates_blow(b[0], br,
+                                    a[0][ch->astart]-dist[0])
+           : 0 );
+  prevblow=blow;
+
+  /* For each row/record of catalog 'a', make a list of the nearest
+     records in catalog b within the maximum distance. Note that both
+     catalogs are sorted by their first axis coordinate.*/
+  for(ai=ch->astart; ai<ch->aend; ++ai)
     if( !isnan(a[0][ai]) && blow<br)
       {
         /* Initialize 'bina'. */
         bina[ai]=NULL;
 
-        /* Find the first (lowest first axis value) row/record in catalog
-           'b' that is within the search radius for this record of catalog
-           'a'. 'blow' is the index of the first element to start searching
-           in the catalog 'b' for a match to 'a[][ai]' (the record in
-           catalog a that is currently being searched). 'blow' is only
-           based on the first coordinate, not the second.
+        /* Find the first (lowest first axis value) row/record in
+           catalog 'b' that is within the search radius for this record
+           of catalog 'a'. 'blow' is the index of the first element to
+           start searching in the catalog 'b' for a match to
+           'a[][ai]' (the record in catalog a that is currently being
+           searched). 'blow' is only based on the first coordinate, not
+           the second.
 
            Both catalogs are sorted by their first coordinate, so the
            'blow' to search for the next record in catalog 'a' will be
-           larger or equal to that of the previous catalog 'a' record. To
-           account for possibly large distances between the records, we do
-           a search here to change 'blow' if necessary before doing further
-           searching.*/
-        for( blow=prevblow; blow<br && b[0][blow] < a[0][ai]-dist[0]; ++blow)
+           larger or equal to that of the previous catalog 'a'
+           record. To account for possibly large distances between the
+           records, we do a search here to change 'blow' if necessary
+           before doing further searching.*/
+        for( blow=prevblow;
+             blow<br && b[0][blow] < a[0][ai]-dist[0]; ++blow)
           { /* This can be blank, the 'for' does all we need :-). */ }
 
-        /* 'blow' is now found for this 'ai' and will be used unchanged to
-           the end of the loop. So keep its value to help the search for
-           the next entry in catalog 'a'. */
+        /* 'blow' is now found for this 'ai' and will be used unchanged
+           to the end of the loop. So keep its value to help the search
+           for the next entry in catalog 'a'. */
         prevblow=blow;
 
-        /* Go through catalog 'b' (starting at 'blow') with a first axis
-           value smaller than the maximum acceptable range for 'si'. */
+        /* Go through catalog 'b' (starting at 'blow') with a first
+           axis value smaller than the maximum acceptable range for
+           'si'. */
         for( bi=blow; bi<br && b[0][bi] <= a[0][ai] + dist[0]; ++bi )
           {
             /* Only consider records with a second axis value in the
-               correct range, note that unlike the first axis, the second
-               axis is no longer sorted. so we have to do both lower and
-               higher limit checks for each item.
+               correct range, note that unlike the first axis, the
+               second axis is no longer sorted. so we have to do both
+               lower and higher limit checks for each item.
 
                Positions can have an accuracy to a much higher order of
                magnitude than the search radius. Therefore, it is
-               meaning-less to sort the second axis (after having sorted
-               the first). In other words, very rarely can two first axis
-               coordinates have EXACTLY the same floating point value as
-               each other to easily define an independent sorting in the
-               second axis. */
+               meaning-less to sort the second axis (after having
+               sorted the first). In other words, very rarely can two
+               first axis coordinates have EXACTLY the same floating
+               point value as each other to easily define an
+               independent sorting in the second axis. */
             if( ndim<2
                 || (    b[1][bi] >= a[1][ai]-dist[1]
                      && b[1][bi] <= a[1][ai]+dist[1] ) )
               {
-                /* Now, 'bi' is within the rectangular range of 'ai'. But
-                   this is not enough to consider the two objects matched
-                   for the following reasons:
+                /* Now, 'bi' is within the rectangular range of
+                   'ai'. But this is not enough to consider the two
+                   objects matched for the following reasons:
 
                    1) Until now we have avoided calculations other than
                    larger or smaller on double precision floating point
-                   variables for efficiency. So the 'bi' is within a square
-                   of side 'dist[0]*dist[1]' around 'ai' (not within a
-                   fixed radius).
+                   variables for efficiency. So the 'bi' is within a
+                   square of side 'dist[0]*dist[1]' around 'ai' (not
+                   within a fixed radius).
 
                    2) Other objects in the 'b' catalog may be closer to
                    'ai' than this 'bi'.
 
-                   3) The closest 'bi' to 'ai' might be closer to another
-                   catalog 'a' record.
+                   3) The closest 'bi' to 'ai' might be closer to
+                   another catalog 'a' record.
 
-                   To address these problems, we will use a linked list to
-                   keep the indexes of the 'b's near 'ai', along with their
-                   distance. We only add the 'bi's to this list that are
-                   within the acceptable distance.
+                   To address these problems, we will use a linked list
+                   to keep the indexes of the 'b's near 'ai', along
+                   with their distance. We only add the 'bi's to this
+                   list that are within the acceptable distance.
 
                    Since we are dealing with much fewer objects at this
                    stage, it is justified to do complex mathematical
                    operations like square root and multiplication. This
                    fixes the first problem.
 
-                   The next two problems will be solved with the list after
-                   parsing of the whole catalog is complete.*/
+                   The next two problems will be solved with the list
+                   after parsing of the whole catalog is complete.*/
                 if( ndim<3
                     || ( b[2][bi] >= a[2][ai]-dist[2]
                          && b[2][bi] <= a[2][ai]+dist[2] ) )
                   {
                     for(i=0;i<ndim;++i) delta[i]=b[i][bi]-a[i][ai];
-                    r=match_coordinates_distance(delta, iscircle, ndim,
-                                                 aperture, c, s);
+                    r=match_coordinates_distance(delta, p->iscircle,
+                                                 ndim, aperture, c, s);
                     if(r<aperture[0])
-                      match_coordinate_add_to_sfll(&bina[ai], bi, r);
+                      {
+                        match_coordinate_add_to_sfll(&bina[ai], pool,
+                                                     bi, r);
+                        if(bi< ch->bmin) ch->bmin=bi;
+                        if(bi>=ch->bmax) ch->bmax=bi+1;
+                      }
                   }
               }
           }
+      }
+}
+
+
+
+
+
+/* Return the distance between row 'ai' of catalog 'a' and row 'bi' of
+   catalog 'b' when 'bi' is within the box that encloses the aperture
+   around 'ai' and also within the aperture. Otherwise, return NaN. The
+   checks (and the distance) are done exactly like the sweep above, so
+   the k-d tree and the sweep find the same matches. */
+static double
+match_coordinates_kdtree_distance(struct match_coordinates_params *p,
+                                  size_t ai, size_t bi)
+{
+  size_t i;
+  double r, delta[3];
+  double **a=p->a, **b=p->b, *dist=p->dist;
+
+  /* Check the box around 'ai'. */
+  for(i=0;i<p->ndim;++i)
+    if( !( b[i][bi] >= a[i][ai]-dist[i] && b[i][bi] <= a[i][ai]+dist[i] ) )
+      return NAN;
+
+  /* Check the aperture. */
+  for(i=0;i<p->ndim;++i) delta[i]=b[i][bi]-a[i][ai];
+  r=match_coordinates_distance(delta, p->iscircle, p->ndim, p->aperture,
+                               p->c, p->s);
+  return r<p->aperture[0] ? r : NAN;
+}
+
+
+
+
+
+/* Find the rows of the catalog in the k-d tree that are within the box
+   that encloses the aperture around row 'row' of the other catalog ('x'
+   are its coordinate columns). The number of found rows is put in 'num'
+   and the returned array should be freed by the caller. */
+static size_t *
+match_coordinates_kdtree_box(struct match_coordinates_params *p, double **x,
+                             size_t row, size_t *num)
+{
+  size_t i;
+  double low[3], high[3];
+
+  for(i=0;i<p->ndim;++i)
+    {
+      low[i]  = x[i][row] - p->dist[i];
+      high[i] = x[i][row] + p->dist[i];
+    }
+  return gal_kdtree_query_range(p->kdquery, low, high, num);
+}
+
+
+
+
+
+/* Find the rows of catalog 'b' that are within the aperture of each row
+   in this chunk of catalog 'a' by searching the k-d tree of catalog
+   'b'. */
+static void
+match_coordinates_kdtree_search_chunk(struct match_coordinates_params *p,
+                                      struct match_coordinates_chunk *ch,
+                                      struct match_coordinate_pool **pool)
+{
+  double r;
+  size_t i, ai, bi, num, *found;
+
+  for(ai=ch->astart; ai<ch->aend; ++ai)
+    if( !isnan(p->a[0][ai]) )
+      {
+        p->bina[ai]=NULL;
+        found=match_coordinates_kdtree_box(p, p->a, ai, &num);
+        for(i=0;i<num;++i)
+          {
+            bi=found[i];
+            r=match_coordinates_kdtree_distance(p, ai, bi);
+            if( !isnan(r) )
+              {
+                match_coordinate_add_to_sfll(&p->bina[ai], pool, bi, r);
+                if(bi< ch->bmin) ch->bmin=bi;
+                if(bi>=ch->bmax) ch->bmax=bi+1;
+              }
+          }
+        free(found);
+      }
+}
+
+
+
 
-        /* If there was no objects within the acceptable distance, then the
-           linked list pointer will be NULL, so go on to the next 'ai'. */
-        if(bina[ai]==NULL)
-          continue;
 
-        /* For checking the status of affairs uncomment this block
+/* Find the nearest row of catalog 'a' (in the k-d tree) to row 'bi' of
+   catalog 'b'. Like the first step of 'match_coordinates_rearrange', when
+   the distances are equal, the smaller 'ai' is kept. */
+static void
+match_coordinates_kdtree_nearest_a(struct match_coordinates_params *p,
+                                   size_t bi, size_t *ai, float *r)
+{
+  float f;
+  double tr;
+  size_t i, num, *found;
+
+  found=match_coordinates_kdtree_box(p, p->b, bi, &num);
+  for(i=0;i<num;++i)
+    {
+      tr=match_coordinates_kdtree_distance(p, found[i], bi);
+      if( !isnan(tr) )
         {
-          struct match_coordinate_sfll *tmp;
-          printf("\n\nai: %lu:\n", ai);
-          printf("ax: %f (%f -- %f)\n", a[0][ai], a[0][ai]-dist[0],
-                 a[0][ai]+dist[0]);
-          printf("ay: %f (%f -- %f)\n", a[1][ai], a[1][ai]-dist[1],
-                 a[1][ai]+dist[1]);
-          for(tmp=bina[ai];tmp!=NULL;tmp=tmp->next)
-            printf("%lu: %f\n", tmp->v, tmp->f);
+          f=tr;
+          if( *ai==GAL_BLANK_SIZE_T || f<*r || (f==*r && found[i]<*ai) )
+            { *ai=found[i]; *r=f; }
         }
-        */
-      }
+    }
+  free(found);
 }
 
 
 
 
 
-/* In 'match_coordinates_second_in_first', we made an array of lists, here
-   we want to reverse that list to fix the second two issues that were
-   discussed there. */
-void
-match_coordinates_rearrange(gal_data_t *A, gal_data_t *B,
-                            struct match_coordinate_sfll **bina)
+/* When the k-d tree is built on catalog 'a', each thread searches the
+   tree for the rows in its chunks of catalog 'b'. The result is directly
+   the nearest 'ai' to each 'bi' (the first step of
+   'match_coordinates_rearrange'). */
+static void *
+match_coordinates_kdtree_on_a(void *in_prm)
 {
-  size_t bi;
-  float *fp, *fpf, r, *ainb;
-  size_t ai, ar=A->size, br=B->size;
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct match_coordinates_params *p=tprm->params;
+
+  size_t i, bi, bstart, bend, br=p->B->size;
 
-  /* Allocate the space for 'ainb' and initialize it to NaN (since zero is
-     meaningful) in this context (both for indexs and also for
-     floats). This is a two column array that will keep the distance and
-     index of the closest element in catalog 'a' for each element in
-     catalog b. */
-  errno=0; ainb=calloc(2*br, sizeof *ainb);
-  if(ainb==NULL)
-    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'ainb'", __func__,
-          br*sizeof *ainb);
-  fpf=(fp=ainb)+2*br; do *fp++=NAN; while(fp<fpf);
+  /* Go over all the chunks of catalog 'b' for this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      bstart =  tprm->indexs[i]    * br / p->nchunks;
+      bend   = (tprm->indexs[i]+1) * br / p->nchunks;
+      for(bi=bstart; bi<bend; ++bi)
+        {
+          p->ainb[bi]=GAL_BLANK_SIZE_T;
+          if( !isnan(p->b[0][bi]) )
+            match_coordinates_kdtree_nearest_a(p, bi, &p->ainb[bi],
+                                               &p->rinb[bi]);
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* When the k-d tree was built on catalog 'a', the range of 'bi's that are
+   near each chunk of catalog 'a' (needed in the second step of
+   'match_coordinates_rearrange') are found from the nearest 'ai' to each
+   'bi'. */
+static void
+match_coordinates_kdtree_chunk_ranges(struct match_coordinates_params *p)
+{
+  struct match_coordinates_chunk *ch;
+  size_t k, ai, bi, low, high, mid;
+
+  /* Initialize the chunks. */
+  for(k=0;k<p->nchunks;++k)
+    {
+      ch=&p->chunks[k];
+      ch->bmin=GAL_BLANK_SIZE_T;
+      ch->bmax=0;
+      ch->ainb=NULL;
+      ch->rinb=NULL;
+    }
 
-  /* Go over each object in catalog 'a' and re-distribute the near objects,
-     to find which ones in catalog 'a' are within the search radius of
-     catalog b in a sorted manner. Note that we only need the 'ai' with the
-     minimum distance to 'bi', the rest are junk.*/
-  for( ai=0; ai<ar; ++ai )
-    while( bina[ai] )	/* As long as its not NULL.            */
+  /* Find the chunk of each nearest 'ai' (with a binary search over the
+     chunks) and update its range. */
+  for(bi=0;bi<p->B->size;++bi)
+    if( (ai=p->ainb[bi])!=GAL_BLANK_SIZE_T )
       {
-	/* Pop out a 'bi' and its distance to this 'ai' from 'bina'. */
-	match_coordinate_pop_from_sfll(&bina[ai], &bi, &r);
-
-	/* If nothing has been put here (the isnan condition below is
-	   true), or something exists (the isnan is false, and so it
-	   will check the second OR test) with a distance that is
-	   larger than this distance then just put this value in. */
-	if( isnan(ainb[bi*2]) || r<ainb[bi*2+1] )
-	  {
-	    ainb[bi*2  ] = ai;
-	    ainb[bi*2+1] = r;
-	  }
+        low=0;
+        high=p->nchunks;
+        while(high-low>1)
+          {
+            mid = low + (high-low)/2;
+            if( p->chunks[mid].astart <= ai ) low=mid;
+            else                              high=mid;
+          }
+        ch=&p->chunks[low];
+        if(bi< ch->bmin) ch->bmin=bi;
+        if(bi>=ch->bmax) ch->bmax=bi+1;
       }
 
+  /* Chunks without any nearby 'bi'. */
+  for(k=0;k<p->nchunks;++k)
+    if(p->chunks[k].bmin==GAL_BLANK_SIZE_T)
+      p->chunks[k].bmin=p->chunks[k].bmax=0;
+}
+
+
+
+
+
+/* Go through both catalogs and find which records/rows in the second
+   catalog (catalog b) are within the acceptable distance of each record in
+   the first (a). Each thread does this for some contiguous chunks of
+   catalog 'a' (with a sweep or in the k-d tree of catalog 'b'), then it
+   keeps the nearest record of the chunk to each record of catalog 'b' (in
+   'chunk->ainb', needed for the first step of
+   'match_coordinates_rearrange'). */
+static void *
+match_coordinates_second_in_first(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct match_coordinates_params *p=tprm->params;
+
+  size_t j, ci, ai;
+  struct match_coordinate_pool *pool;
+  struct match_coordinates_chunk *ch;
+  struct match_coordinate_sfll **bina=p->bina, *tmp;
+
+  /* Go over all the chunks of this thread. */
+  for(ci=0; tprm->indexs[ci]!=GAL_BLANK_SIZE_T; ++ci)
+    {
+      /* Initialize the chunk. */
+      pool=NULL;
+      ch=&p->chunks[ tprm->indexs[ci] ];
+      ch->bmin=GAL_BLANK_SIZE_T;
+      ch->bmax=0;
+
+      /* Find the nearby rows of catalog 'b' for each row of this
+         chunk. */
+      if(p->kdquery) match_coordinates_kdtree_search_chunk(p, ch, &pool);
+      else           match_coordinates_sweep(p, ch, &pool);
+
+      /* Keep the nearest 'ai' of this chunk to each 'bi'. If nothing has
+         been put there yet or the existing distance is larger than this
+         distance then just put this value in. Since 'ai' increases, for
+         equal distances, the smaller 'ai' is kept. */
+      if(ch->bmin<ch->bmax)
+        {
+          ch->ainb=gal_pointer_allocate(GAL_TYPE_SIZE_T, ch->bmax-ch->bmin,
+                                        0, __func__, "ch->ainb");
+          ch->rinb=gal_pointer_allocate(GAL_TYPE_FLOAT32, ch->bmax-ch->bmin,
+                                        0, __func__, "ch->rinb");
+          for(j=0;j<ch->bmax-ch->bmin;++j) ch->ainb[j]=GAL_BLANK_SIZE_T;
+          for(ai=ch->astart; ai<ch->aend; ++ai)
+            for(tmp=bina[ai]; tmp!=NULL; tmp=tmp->next)
+              {
+                j=tmp->v-ch->bmin;
+                if( ch->ainb[j]==GAL_BLANK_SIZE_T || tmp->f<ch->rinb[j] )
+                  {
+                    ch->ainb[j]=ai;
+                    ch->rinb[j]=tmp->f;
+                  }
+              }
+        }
+      else
+        {
+          ch->bmin=ch->bmax=0;
+          ch->ainb=NULL;
+          ch->rinb=NULL;
+        }
+
+      /* The lists of this chunk are no longer necessary. */
+      for(ai=ch->astart; ai<ch->aend; ++ai) bina[ai]=NULL;
+      match_coordinate_pool_free(pool);
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* First step of re-arranging: each thread is responsible for a contiguous
+   chunk of catalog 'b' and finds the nearest 'ai' to each 'bi' from the
+   nearest ones that were found in each chunk of catalog 'a'. The chunks
+   are checked in order (and only a smaller distance replaces an existing
+   one), so the result doesn't depend on the number of threads. */
+static void *
+match_coordinates_rearrange_b(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct match_coordinates_params *p=tprm->params;
+
+  struct match_coordinates_chunk *ch;
+  size_t i, k, bi, low, high, bstart, bend, br=p->B->size;
+
+  /* Go over all the chunks of catalog 'b' for this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Range of rows in this chunk of catalog 'b'. */
+      bstart =  tprm->indexs[i]    * br / p->nchunks;
+      bend   = (tprm->indexs[i]+1) * br / p->nchunks;
+      for(bi=bstart; bi<bend; ++bi) p->ainb[bi]=GAL_BLANK_SIZE_T;
+
+      /* Parse the nearest 'ai' of all chunks of catalog 'a'. */
+      for(k=0;k<p->nchunks;++k)
+        {
+          ch=&p->chunks[k];
+          low  = ch->bmin > bstart ? ch->bmin : bstart;
+          high = ch->bmax < bend   ? ch->bmax : bend;
+          for(bi=low; bi<high; ++bi)
+            if( ch->ainb[bi-ch->bmin]!=GAL_BLANK_SIZE_T
+                && ( p->ainb[bi]==GAL_BLANK_SIZE_T
+                     || ch->rinb[bi-ch->bmin] < p->rinb[bi] ) )
+              {
+                p->ainb[bi]=ch->ainb[bi-ch->bmin];
+                p->rinb[bi]=ch->rinb[bi-ch->bmin];
+              }
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Second step of re-arranging: each thread goes over the 'bi's that are
+   near its chunks of catalog 'a' and for each 'ai', only keeps the 'bi'
+   that is closest to it. Since 'bi' increases, for equal distances, the
+   smaller 'bi' is kept. */
+static void *
+match_coordinates_rearrange_a(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct match_coordinates_params *p=tprm->params;
+
+  size_t i, ai, bi;
+  struct match_coordinates_chunk *ch;
+
+  /* Go over all the chunks of catalog 'a' for this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Initialize the nearest 'bi' of this chunk. */
+      ch=&p->chunks[ tprm->indexs[i] ];
+      for(ai=ch->astart; ai<ch->aend; ++ai) p->bnear[ai]=GAL_BLANK_SIZE_T;
+
+      /* All the 'bi's that are near this chunk are within 'bmin' and
+         'bmax'. */
+      for(bi=ch->bmin; bi<ch->bmax; ++bi)
+        {
+          ai=p->ainb[bi];
+          if( ai!=GAL_BLANK_SIZE_T && ai>=ch->astart && ai<ch->aend
+              && ( p->bnear[ai]==GAL_BLANK_SIZE_T
+                   || p->rinb[bi] < p->rnear[ai] ) )
+            {
+              p->bnear[ai]=bi;
+              p->rnear[ai]=p->rinb[bi];
+            }
+        }
+
+      /* Count the number of matched rows in this chunk (needed to know
+         where the outputs of this chunk should be written). */
+      ch->matched=0;
+      for(ai=ch->astart; ai<ch->aend; ++ai)
+        if(p->bnear[ai]!=GAL_BLANK_SIZE_T) ++ch->matched;
+
+      /* The nearest 'ai's of this chunk are no longer necessary. */
+      if(ch->ainb) { free(ch->ainb); free(ch->rinb); }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* In 'match_coordinates_second_in_first', we made an array of lists (and
+   from it, the nearest 'ai' of each chunk to each 'bi'), here we want to
+   reverse that list to fix the second two issues that were discussed
+   there: first find the nearest 'ai' to each 'bi', then only keep the
+   nearest 'bi' for each 'ai'. */
+static void
+match_coordinates_rearrange(struct match_coordinates_params *p,
+                            size_t numthreads, size_t minmapsize,
+                            int quietmmap)
+{
+  size_t br=p->B->size;
+
+  /* Find the nearest 'ai' to each 'bi'. When the k-d tree was built on
+     catalog 'a', this has already been done while searching the tree. */
+  if(p->ainb==NULL)
+    {
+      p->ainb=gal_pointer_allocate(GAL_TYPE_SIZE_T, br, 0, __func__,
+                                   "p->ainb");
+      p->rinb=gal_pointer_allocate(GAL_TYPE_FLOAT32, br, 0, __func__,
+                                   "p->rinb");
+      gal_threads_spin_off(match_coordinates_rearrange_b, p, p->nchunks,
+                           numthreads, minmapsize, quietmmap);
+    }
+
   /* For checking the status of affairs uncomment this block
   {
+    size_t bi;
     printf("\n\nFilled ainb:\n");
     for(bi=0;bi<br;++bi)
-      if( !isnan(ainb[bi*2]) )
-	printf("bi: %lu: %.0f, %f\n", bi, ainb[bi*2], ainb[bi*2+1]);
+      if( p->ainb[bi]!=GAL_BLANK_SIZE_T )
+	printf("bi: %lu: %zu, %f\n", bi, p->ainb[bi], p->rinb[bi]);
   }
   */
 
-  /* Re-fill the bina array, but this time only with the 'bi' that is
-     closest to it. Note that bina was fully set to NULL after popping all
-     the elements in the loop above.*/
-  for( bi=0; bi<br; ++bi )
-    if( !isnan(ainb[bi*2]) )
-      {
-	/* Just to keep the same terminology as before and easier
-	   reading.*/
-	r=ainb[bi*2+1];
-	ai=(size_t)(ainb[bi*2]);
-
-	/* Check if this is the first time we are associating a 'bi' to
-	   this 'ai'. If so, then just allocate a single element
-	   list. Otherwise, see if the distance is closer or not. If so,
-	   replace the values in the single node. */
-	if( bina[ai] )
-	  {
-	    /* If the distance of this record is smaller than the existing
-	       entry, then replace the values. */
-	    if( r < bina[ai]->f )
-	      {
-		bina[ai]->f=r;
-		bina[ai]->v=bi;
-	      }
-	  }
-	else
-          match_coordinate_add_to_sfll(&bina[ai], bi, r);
-      }
+  /* Keep the closest 'bi' to each 'ai'. */
+  gal_threads_spin_off(match_coordinates_rearrange_a, p, p->nchunks,
+                       numthreads, minmapsize, quietmmap);
 
   /* For checking the status of affairs uncomment this block
   {
-    size_t bi, counter=0;
-    double *a[2]={A->array, A->next->array};
-    double *b[2]={B->array, B->next->array};
+    size_t ai, bi, counter=0;
+    double *a[2]={p->A->array, p->A->next->array};
+    double *b[2]={p->B->array, p->B->next->array};
     printf("Rearranged bina:\n");
-    for(ai=0;ai<ar;++ai)
-      if(bina[ai])
+    for(ai=0;ai<p->A->size;++ai)
+      if(p->bnear[ai]!=GAL_BLANK_SIZE_T)
         {
           ++counter;
-          bi=bina[ai]->v;
+          bi=p->bnear[ai];
           printf("A_%lu (%.8f, %.8f) <--> B_%lu (%.8f, %.8f):\n\t%f\n",
                  ai, a[0][ai], a[1][ai], bi, b[0][bi], b[1][bi],
-                 bina[ai]->f);
+                 p->rnear[ai]);
         }
     printf("\n-----------\nMatched: %zu\n", counter);
   }
@@ -751,7 +1480,57 @@ match_coordinates_rearrange(gal_data_t *A, gal_data_t *B,
   */
 
   /* Clean up */
-  free(ainb);
+  free(p->ainb);
+  free(p->rinb);
+}
+
+
+
+
+
+/* Write the output permutations of each chunk of the first catalog. */
+static void *
+match_coordinates_output_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct match_coordinates_params *p=tprm->params;
+
+  size_t i, ai, bi, match_i, nomatch_i;
+  struct match_coordinates_chunk *ch;
+
+  /* Go over all the chunks of catalog 'a' for this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      ch=&p->chunks[ tprm->indexs[i] ];
+      match_i=ch->match_i;
+      nomatch_i=ch->nomatch_i;
+      for(ai=ch->astart; ai<ch->aend; ++ai)
+        {
+          /* A match was found. */
+          if( (bi=p->bnear[ai])!=GAL_BLANK_SIZE_T )
+            {
+              /* Note that the permutation keeps the original indexs. */
+              p->rval[ match_i   ] = p->rnear[ai];
+              p->aind[ match_i   ] = p->A_perm ? p->A_perm[ai] : ai;
+              p->bind[ match_i++ ] = p->B_perm ? p->B_perm[bi] : bi;
+
+              /* Set a '1' for this object in the second catalog. This
+                 will later be used to find which rows didn't match to fill
+                 in the output. Each 'bi' is matched with only one 'ai', so
+                 no other thread writes in this element. */
+              p->Bmatched[ p->B_perm ? p->B_perm[bi] : bi ] = 1;
+            }
+
+          /* No match found. At this stage, we can only fill the indexs of
+             the first input. The second input needs to be matched
+             afterwards.*/
+          else p->aind[ nomatch_i++ ] = p->A_perm ? p->A_perm[ai] : ai;
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
 }
 
 
@@ -760,20 +1539,18 @@ match_coordinates_rearrange(gal_data_t *A, gal_data_t *B,
 
 /* The matching has been done, write the output. */
 static gal_data_t *
-gal_match_coordinates_output(gal_data_t *A, gal_data_t *B, size_t *A_perm,
-                             size_t *B_perm,
-                             struct match_coordinate_sfll **bina,
-                             size_t minmapsize, int quietmmap)
+gal_match_coordinates_output(struct match_coordinates_params *p,
+                             size_t numthreads, size_t minmapsize,
+                             int quietmmap)
 {
-  float r;
-  double *rval;
+  size_t k, bi;
   gal_data_t *out;
-  uint8_t *Bmatched;
-  size_t ai, bi, nummatched=0;
-  size_t *aind, *bind, match_i, nomatch_i;
+  struct match_coordinates_chunk *ch;
+  gal_data_t *A=p->A, *B=p->B;
+  size_t nummatched=0, nomatch_i;
 
   /* Find how many matches there were in total */
-  for(ai=0;ai<A->size;++ai) if(bina[ai]) ++nummatched;
+  for(k=0;k<p->nchunks;++k) nummatched+=p->chunks[k].matched;
 
 
   /* If there aren't any matches, return NULL. */
@@ -797,63 +1574,52 @@ gal_match_coordinates_output(gal_data_t *A, gal_data_t *B, size_t *A_perm,
   /* Allocate the 'Bmatched' array which is a flag for which rows of the
      second catalog were matched. The columns that had a match will get a
      value of one while we are parsing them below. */
-  Bmatched=gal_pointer_allocate(GAL_TYPE_UINT8, B->size, 1, __func__,
-                                "Bmatched");
+  p->Bmatched=gal_pointer_allocate(GAL_TYPE_UINT8, B->size, 1, __func__,
+                                   "p->Bmatched");
 
 
-  /* Initialize the indexs. We want the first 'nummatched' indexs in both
-     outputs to be the matching rows. The non-matched rows should start to
-     be indexed after the matched ones. So the first non-matched index is
-     at the index 'nummatched'. */
-  match_i   = 0;
-  nomatch_i = nummatched;
+  /* Initialize the indexs of each chunk. We want the first 'nummatched'
+     indexs in both outputs to be the matching rows. The non-matched rows
+     should start to be indexed after the matched ones. So the first
+     non-matched index is at the index 'nummatched'. */
+  for(k=0;k<p->nchunks;++k)
+    {
+      ch=&p->chunks[k];
+      ch->match_i   = k ? ch[-1].match_i   + ch[-1].matched : 0;
+      ch->nomatch_i = ( k
+                        ? ( ch[-1].nomatch_i
+                            + (ch[-1].aend-ch[-1].astart) - ch[-1].matched )
+                        : nummatched );
+    }
 
 
   /* Fill in the output arrays. */
-  aind = out->array;
-  bind = out->next->array;
-  rval = out->next->next->array;
-  for(ai=0;ai<A->size;++ai)
-    {
-      /* A match was found. */
-      if(bina[ai])
-        {
-          /* Note that the permutation keeps the original indexs. */
-          match_coordinate_pop_from_sfll(&bina[ai], &bi, &r);
-          rval[ match_i   ] = r;
-          aind[ match_i   ] = A_perm ? A_perm[ai] : ai;
-          bind[ match_i++ ] = B_perm ? B_perm[bi] : bi;
-
-          /* Set a '1' for this object in the second catalog. This will
-             later be used to find which rows didn't match to fill in the
-             output.. */
-          Bmatched[ B_perm ? B_perm[bi] : bi ] = 1;
-        }
-
-      /* No match found. At this stage, we can only fill the indexs of the
-         first input. The second input needs to be matched afterwards.*/
-      else aind[ nomatch_i++ ] = A_perm ? A_perm[ai] : ai;
-    }
+  p->aind = out->array;
+  p->bind = out->next->array;
+  p->rval = out->next->next->array;
+  gal_threads_spin_off(match_coordinates_output_on_thread, p, p->nchunks,
+                       numthreads, minmapsize, quietmmap);
 
 
   /* Complete the second input's permutation. */
   nomatch_i=nummatched;
   for(bi=0;bi<B->size;++bi)
-    if( Bmatched[bi] == 0 )
-      bind[ nomatch_i++ ] = bi;
+    if( p->Bmatched[bi] == 0 )
+      p->bind[ nomatch_i++ ] = bi;
 
 
   /* For a check
   printf("\nFirst input's permutation:\n");
   for(ai=0;ai<A->size;++ai)
-    printf("%s%zu\n", ai<nummatched?"  ":"* ", aind[ai]+1);
+    printf("%s%zu\n", ai<nummatched?"  ":"* ", p->aind[ai]+1);
   printf("\nSecond input's permutation:\n");
   for(bi=0;bi<B->size;++bi)
-    printf("%s%zu\n", bi<nummatched?"  ":"* ", bind[bi]+1);
+    printf("%s%zu\n", bi<nummatched?"  ":"* ", p->bind[bi]+1);
   exit(0);
   */
 
   /* Return the output. */
+  free(p->Bmatched);
   return out;
 }
 
@@ -879,6 +1645,203 @@ gal_match_coordinates_output(gal_data_t *A, gal_data_t *B, size_t *A_perm,
 /********************************************************************/
 /*************            Coordinate matching           *************/
 /********************************************************************/
+/* Do the matching with the sweep (when 'usekdtree==0') or a k-d tree (see
+   the comments of 'gal_match_coordinates' and 'gal_match_kdtree'). */
+/* A k-d tree that is given for the first catalog (for example, read from
+   a file) was built on the rows in the input order, but the matching is
+   done on the sorted rows. So the indexs of the tree (and its root) are
+   changed to the sorted rows. */
+static gal_data_t *
+match_coordinates_kdtree_sorted(gal_data_t *kdtree, size_t *perm,
+                                size_t *root, size_t minmapsize,
+                                int quietmmap)
+{
+  uint32_t *in, *o;
+  gal_data_t *out=NULL, *col, *ocol;
+  size_t i, *inv, n=kdtree->size;
+
+  /* Inverse of the permutation: the sorted row of each input row. */
+  inv=gal_pointer_allocate(GAL_TYPE_SIZE_T, n, 0, __func__, "inv");
+  for(i=0;i<n;++i) inv[perm[i]]=i;
+
+  /* Make the new (left and right) columns. */
+  for(col=kdtree; col!=NULL; col=col->next)
+    {
+      ocol=gal_data_alloc(NULL, GAL_TYPE_UINT32, 1, &kdtree->size, NULL, 0,
+                          minmapsize, quietmmap, NULL, NULL, NULL);
+      in=col->array;
+      o=ocol->array;
+      for(i=0;i<n;++i)
+        o[i] = ( in[perm[i]]==GAL_BLANK_UINT32
+                 ? GAL_BLANK_UINT32
+                 : inv[ in[perm[i]] ] );
+      gal_list_data_add(&out, ocol);
+    }
+  gal_list_data_reverse(&out);
+
+  /* Clean up and return. */
+  *root=inv[*root];
+  free(inv);
+  return out;
+}
+
+
+
+
+
+static gal_data_t *
+match_coordinates_internal(gal_data_t *coord1, gal_data_t *coord2,
+                           gal_data_t *coord1_kdtree, size_t kdtree_root,
+                           double *aperture, int sorted_by_first,
+                           int inplace, int usekdtree, size_t numthreads,
+                           size_t minmapsize, int quietmmap,
+                           size_t *nummatched)
+{
+  int allf64=1;
+  size_t k, root;
+  gal_data_t *out, *sorted;
+  struct match_coordinates_params p={0};
+
+  /* Do a small sanity check and make the preparations. After this point,
+     we'll call the two arrays 'a' and 'b'.*/
+  match_coordinaes_sanity_check(coord1, coord2, aperture, inplace,
+                                &allf64);
+  if(coord1_kdtree)
+    {
+      if( coord1_kdtree->next==NULL || coord1_kdtree->next->next
+          || coord1_kdtree->type!=GAL_TYPE_UINT32
+          || coord1_kdtree->next->type!=GAL_TYPE_UINT32 )
+        error(EXIT_FAILURE, 0, "%s: the k-d tree of the first input should "
+              "have two 'uint32' columns (the output of "
+              "'gal_kdtree_create')", __func__);
+      if( coord1_kdtree->size!=coord1->size
+          || coord1_kdtree->next->size!=coord1->size
+          || kdtree_root>=coord1->size )
+        error(EXIT_FAILURE, 0, "%s: the k-d tree of the first input "
+              "doesn't correspond to it: it has %zu rows (and root %zu), "
+              "but the first input has %zu rows", __func__,
+              coord1_kdtree->size, kdtree_root, coord1->size);
+    }
+  match_coordinates_prepare(coord1, coord2, sorted_by_first, inplace, allf64,
+                            &p.A, &p.B, &p.A_perm, &p.B_perm, numthreads,
+                            minmapsize, quietmmap);
+  p.aperture=aperture;
+  p.ndim=gal_list_data_number(p.A);
+  match_coordinates_sif_prepare(p.A, p.B, aperture, p.ndim, p.a, p.b,
+                                p.dist, p.c, p.s, &p.iscircle);
+
+
+  /* Divide the first catalog into chunks. With more than one thread, we
+     will use more chunks than threads, so the threads that finish earlier
+     (for example where the catalogs are sparse) can take more chunks. */
+  p.nchunks = numthreads>1 ? 4*numthreads : 1;
+  if(p.nchunks>p.A->size) p.nchunks = p.A->size ? p.A->size : 1;
+  errno=0;
+  p.chunks=malloc(p.nchunks * sizeof *p.chunks);
+  if(p.chunks==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'p.chunks'", __func__,
+          p.nchunks * sizeof *p.chunks);
+  for(k=0;k<p.nchunks;++k)
+    {
+      p.chunks[k].astart =  k    * p.A->size / p.nchunks;
+      p.chunks[k].aend   = (k+1) * p.A->size / p.nchunks;
+    }
+
+
+  /* When a k-d tree was given for the first catalog, it is used (with
+     its indexs changed to the sorted rows if necessary) to prepare the
+     tree for the searches. Otherwise, build the tree for the searches on
+     the larger catalog (on multiple threads). In both cases, the points
+     of the tree are the rows of the sorted catalog. */
+  if(coord1_kdtree)
+    {
+      p.treeona=1;
+      root=kdtree_root;
+      sorted = ( p.A_perm
+                 ? match_coordinates_kdtree_sorted(coord1_kdtree, p.A_perm,
+                                                   &root, minmapsize,
+                                                   quietmmap)
+                 : NULL );
+      p.kdquery=gal_kdtree_query_prepare(p.A, sorted?sorted:coord1_kdtree,
+                                         root);
+      if(sorted) gal_list_data_free(sorted);
+    }
+  else if(usekdtree)
+    {
+      p.treeona = p.A->size > p.B->size;
+      p.kdquery=gal_kdtree_query_build(p.treeona ? p.A : p.B, numthreads,
+                                       minmapsize, quietmmap);
+    }
+
+
+  /* When the tree is on the first catalog, each thread searches the tree
+     for the rows in its chunks of the second catalog. Otherwise, find all
+     records in 'b' that match each 'a' (possibly duplicate), with a sweep
+     or with the tree on the second catalog. */
+  if(p.treeona)
+    {
+      p.ainb=gal_pointer_allocate(GAL_TYPE_SIZE_T, p.B->size, 0, __func__,
+                                  "p.ainb");
+      p.rinb=gal_pointer_allocate(GAL_TYPE_FLOAT32, p.B->size, 0, __func__,
+                                  "p.rinb");
+      gal_threads_spin_off(match_coordinates_kdtree_on_a, &p, p.nchunks,
+                           numthreads, minmapsize, quietmmap);
+      match_coordinates_kdtree_chunk_ranges(&p);
+    }
+  else
+    {
+      /* Allocate the 'bina' array (an array of lists). Let's call the
+         first catalog 'a' and the second 'b'. This array has 'a->size'
+         elements (pointers) and for each, it keeps a list of 'b' elements
+         that are nearest to it. */
+      errno=0;
+      p.bina=calloc(p.A->size, sizeof *p.bina);
+      if(p.bina==NULL)
+        error(EXIT_FAILURE, errno, "%s: %zu bytes for 'bina'", __func__,
+              p.A->size*sizeof *p.bina);
+
+      /* All records in 'b' that match each 'a' (possibly duplicate). */
+      gal_threads_spin_off(match_coordinates_second_in_first, &p, p.nchunks,
+                           numthreads, minmapsize, quietmmap);
+      free(p.bina);
+    }
+
+
+  /* Two re-arrangings will fix the issue. */
+  p.bnear=gal_pointer_allocate(GAL_TYPE_SIZE_T, p.A->size, 0, __func__,
+                               "p.bnear");
+  p.rnear=gal_pointer_allocate(GAL_TYPE_FLOAT32, p.A->size, 0, __func__,
+                               "p.rnear");
+  match_coordinates_rearrange(&p, numthreads, minmapsize, quietmmap);
+
+
+  /* The match is done, write the output. */
+  out=gal_match_coordinates_output(&p, numthreads, minmapsize, quietmmap);
+
+
+  /* Clean up. */
+  free(p.bnear);
+  free(p.rnear);
+  free(p.chunks);
+  gal_kdtree_query_free(p.kdquery);
+  if(p.A!=coord1)
+    {
+      gal_list_data_free(p.A);
+      gal_list_data_free(p.B);
+    }
+  if(p.A_perm) free(p.A_perm);
+  if(p.B_perm) free(p.B_perm);
+
+
+  /* Set 'nummatched' and return output. */
+  *nummatched = out ?  out->next->next->size : 0;
+  return out;
+}
+
+
+
+
+
 /* Match two positions: the two inputs ('coord1' and 'coord2') should be
    lists of coordinates (each is a list of datasets). To speed up the
    search, this function will sort the inputs by their first column. If
@@ -904,55 +1867,56 @@ gal_match_coordinates(gal_data_t *coord1, gal_data_t *coord2,
                       int inplace, size_t minmapsize, int quietmmap,
                       size_t *nummatched)
 {
-  int allf64=1;
-  gal_data_t *A, *B, *out;
-  size_t *A_perm=NULL, *B_perm=NULL;
-  struct match_coordinate_sfll **bina;
-
-  /* Do a small sanity check and make the preparations. After this point,
-     we'll call the two arrays 'a' and 'b'.*/
-  match_coordinaes_sanity_check(coord1, coord2, aperture, inplace,
-                                &allf64);
-  match_coordinates_prepare(coord1, coord2, sorted_by_first, inplace, allf64,
-                            &A, &B, &A_perm, &B_perm, minmapsize);
-
+  return match_coordinates_internal(coord1, coord2, NULL, 0, aperture,
+                                    sorted_by_first, inplace, 0, 1,
+                                    minmapsize, quietmmap, nummatched);
+}
 
-  /* Allocate the 'bina' array (an array of lists). Let's call the first
-     catalog 'a' and the second 'b'. This array has 'a->size' elements
-     (pointers) and for each, it keeps a list of 'b' elements that are
-     nearest to it. */
-  errno=0;
-  bina=calloc(A->size, sizeof *bina);
-  if(bina==NULL)
-    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'bina'", __func__,
-          A->size*sizeof *bina);
 
 
-  /* All records in 'b' that match each 'a' (possibly duplicate). */
-  match_coordinates_second_in_first(A, B, aperture, bina);
 
 
-  /* Two re-arrangings will fix the issue. */
-  match_coordinates_rearrange(A, B, bina);
+/* Similar to 'gal_match_coordinates', but the sorting, the search and the
+   output are all done on 'numthreads' threads: the first catalog is
+   divided into contiguous chunks that are processed independently and
+   the results of the chunks are merged in order. Therefore the output
+   doesn't depend on the number of threads. */
+gal_data_t *
+gal_match_coordinates_threaded(gal_data_t *coord1, gal_data_t *coord2,
+                               double *aperture, int sorted_by_first,
+                               int inplace, size_t numthreads,
+                               size_t minmapsize, int quietmmap,
+                               size_t *nummatched)
+{
+  return match_coordinates_internal(coord1, coord2, NULL, 0, aperture,
+                                    sorted_by_first, inplace, 0, numthreads,
+                                    minmapsize, quietmmap, nummatched);
+}
 
 
-  /* The match is done, write the output. */
-  out=gal_match_coordinates_output(A, B, A_perm, B_perm, bina, minmapsize,
-                                   quietmmap);
 
 
-  /* Clean up. */
-  free(bina);
-  if(A!=coord1)
-    {
-      gal_list_data_free(A);
-      gal_list_data_free(B);
-    }
-  if(A_perm) free(A_perm);
-  if(B_perm) free(B_perm);
 
+/* Similar to 'gal_match_coordinates', but the nearby rows are found with
+   a k-d tree (built on the larger catalog) instead of a sweep over the
+   first coordinate. When the first coordinate of the inputs is degenerate
+   (for example both catalogs are in a narrow strip along the first
+   coordinate), the sweep has to check too many rows, but the k-d tree
+   isn't affected. The output is identical to 'gal_match_coordinates'.
 
-  /* Set 'nummatched' and return output. */
-  *nummatched = out ?  out->next->next->size : 0;
-  return out;
+   If the k-d tree of the first catalog (in its input order) is already
+   available (output of 'gal_kdtree_create', for example read from a file
+   with 'gal_kdtree_read'), it can be given with 'coord1_kdtree' and
+   'kdtree_root', and it will be used instead of building a new tree. */
+gal_data_t *
+gal_match_kdtree(gal_data_t *coord1, gal_data_t *coord2,
+                 gal_data_t *coord1_kdtree, size_t kdtree_root,
+                 double *aperture, int sorted_by_first, int inplace,
+                 size_t numthreads, size_t minmapsize, int quietmmap,
+                 size_t *nummatched)
+{
+  return match_coordinates_internal(coord1, coord2, coord1_kdtree,
+                                    kdtree_root, aperture, sorted_by_first,
+                                    inplace, 1, numthreads, minmapsize,
+                                    quietmmap, nummatched);
 }
@@ -1872,6 +1872,27 @@ gal_options_check_stdin(char *inputname, long stdintimeout, char *name)
 
 
 
+/* Read the requested columns of a table with the common options (the
+   cache of the table is used when '--tablecache' is given). */
+gal_data_t *
+gal_options_table_read(struct gal_options_common_params *cp, char *filename,
+                       char *hdu, gal_list_str_t *lines,
+                       gal_list_str_t *cols, size_t *colmatch)
+{
+  return ( cp->tablecache
+           ? gal_table_read_cache(filename, hdu, lines, cols, cp->searchin,
+                                  cp->ignorecase, cp->numthreads,
+                                  cp->minmapsize, cp->quietmmap, colmatch)
+           : gal_table_read_threaded(filename, hdu, lines, cols,
+                                     cp->searchin, cp->ignorecase,
+                                     cp->numthreads, cp->minmapsize,
+                                     cp->quietmmap, colmatch) );
+}
+
+
+
+
+
 
 
 
@@ -269,6 +269,210 @@ gal_statistics_mean_std(gal_data_t *input)
 
 
 
+/* Finding the median or a quantile doesn't need a full sort of the
+   dataset: only the elements at the desired positions (in the sorted
+   order) are necessary. The functions below use selection ('nth_element'
+   in C++), which is linear in the number of elements (on average). They
+   can also select several positions at once: after the first position is
+   selected, all the elements before it are smaller (or equal) and all the
+   elements after it are larger (or equal). So the remaining positions are
+   selected in each side separately.
+
+   The selection algorithm is Hoare's/Wirth's with a median-of-three
+   pivot. To avoid the quadratic worst-case of this algorithm, when a
+   region hasn't shrunk after many iterations, it will be sorted (similar
+   to 'introsort', hence "introselect"). Small regions are also sorted
+   with insertion sort (which is faster for them). */
+#define STATISTICS_SELECT_INSERTION 16
+#define STATISTICS_SELECT_STACK     130    /* 2 x (64 bits) + 2. */
+
+#define SELECT_MULTI(IT, QSORT_F) {                                     \
+    IT v, t, *a=data->array;                                            \
+    size_t lo, hi, kl, kh, km, k, l, h, i, j, depth, sn=0;              \
+    size_t stack[4*STATISTICS_SELECT_STACK];                            \
+                                                                        \
+    /* Put the full range (and all the positions) on the stack. */      \
+    stack[0]=0; stack[1]=data->size; stack[2]=0; stack[3]=numk;         \
+    sn=1;                                                               \
+                                                                        \
+    /* Parse the stack. */                                              \
+    while(sn)                                                           \
+      {                                                                 \
+        /* Pop the last range from the stack. */                        \
+        --sn;                                                           \
+        lo=stack[4*sn];   hi=stack[4*sn+1];                             \
+        kl=stack[4*sn+2]; kh=stack[4*sn+3];                             \
+        if(kl>=kh) continue;                                            \
+                                                                        \
+        /* Select the middle position in this range. */                 \
+        km=(kl+kh)/2;                                                   \
+        k=kpos[km];                                                     \
+        l=lo;                                                           \
+        h=hi;                                                           \
+        depth=2*sizeof(size_t)*8;                                       \
+        while(h-l>1)                                                    \
+          {                                                             \
+            /* Small or stubborn region: sort it. */                    \
+            if(h-l<=STATISTICS_SELECT_INSERTION)                        \
+              {                                                         \
+                for(i=l+1;i<h;++i)                                      \
+                  {                                                     \
+                    t=a[i];                                             \
+                    for(j=i; j>l && a[j-1]>t; --j) a[j]=a[j-1];         \
+                    a[j]=t;                                             \
+                  }                                                     \
+                break;                                                  \
+              }                                                         \
+            if(depth--==0)                                              \
+              {                                                         \
+                qsort(a+l, h-l, sizeof *a, QSORT_F);                    \
+                break;                                                  \
+              }                                                         \
+                                                                        \
+            /* Median of three pivot. */                                \
+            i=l+(h-l)/2;                                                \
+            if(a[i]<a[l])   { t=a[i]; a[i]=a[l];   a[l]=t;   }          \
+            if(a[h-1]<a[l]) { t=a[h-1]; a[h-1]=a[l]; a[l]=t; }          \
+            if(a[h-1]<a[i]) { t=a[h-1]; a[h-1]=a[i]; a[i]=t; }          \
+            v=a[i];                                                     \
+                                                                        \
+            /* Partition: after this, all elements in '[l,j]' are */    \
+            /* smaller or equal, and all in '[i,h)' are larger or  */   \
+            /* equal to the pivot. Note that 'j' may become smaller */  \
+            /* than 'l' (and wrap around) only when 'i' is 'l'. */      \
+            i=l; j=h-1;                                                 \
+            do                                                          \
+              {                                                         \
+                while(a[i]<v) ++i;                                      \
+                while(v<a[j]) --j;                                      \
+                if(i<=j)                                                \
+                  {                                                     \
+                    t=a[i]; a[i]=a[j]; a[j]=t;                          \
+                    ++i; if(j==l) break; --j;                           \
+                  }                                                     \
+              }                                                         \
+            while(i<=j);                                                \
+                                                                        \
+            /* Continue in the region that contains 'k'. */             \
+            if(k<i && k>j) break;        /* Equal to pivot: found! */   \
+            else if(k<=j) h=j+1;                                        \
+            else          l=i;                                          \
+          }                                                             \
+                                                                        \
+        /* Put the two sides on the stack. */                           \
+        stack[4*sn]=lo;     stack[4*sn+1]=k;                            \
+        stack[4*sn+2]=kl;   stack[4*sn+3]=km;   ++sn;                   \
+        stack[4*sn]=k+1;    stack[4*sn+1]=hi;                           \
+        stack[4*sn+2]=km+1; stack[4*sn+3]=kh;   ++sn;                   \
+      }                                                                 \
+  }
+
+/* Re-order the elements of 'data' (which must not have any blank values)
+   such that the elements at the 'numk' positions given in 'kpos' are
+   identical to the sorted array. 'kpos' must be sorted (increasing) and
+   must not have repeated values. */
+static void
+statistics_select_multi(gal_data_t *data, size_t *kpos, size_t numk)
+{
+  if(data->size==0 || numk==0) return;
+  switch(data->type)
+    {
+    case GAL_TYPE_UINT8:   SELECT_MULTI(uint8_t,  gal_qsort_uint8_i);   break;
+    case GAL_TYPE_INT8:    SELECT_MULTI(int8_t,   gal_qsort_int8_i);    break;
+    case GAL_TYPE_UINT16:  SELECT_MULTI(uint16_t, gal_qsort_uint16_i);  break;
+    case GAL_TYPE_INT16:   SELECT_MULTI(int16_t,  gal_qsort_int16_i);   break;
+    case GAL_TYPE_UINT32:  SELECT_MULTI(uint32_t, gal_qsort_uint32_i);  break;
+    case GAL_TYPE_INT32:   SELECT_MULTI(int32_t,  gal_qsort_int32_i);   break;
+    case GAL_TYPE_UINT64:  SELECT_MULTI(uint64_t, gal_qsort_uint64_i);  break;
+    case GAL_TYPE_INT64:   SELECT_MULTI(int64_t,  gal_qsort_int64_i);   break;
+    case GAL_TYPE_FLOAT32: SELECT_MULTI(float,    gal_qsort_float32_i); break;
+    case GAL_TYPE_FLOAT64: SELECT_MULTI(double,   gal_qsort_float64_i); break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, data->type);
+    }
+
+  /* The elements have been re-ordered, so if the dataset was sorted, it
+     isn't any more. */
+  data->flag |=  GAL_DATA_FLAG_SORT_CH;
+  data->flag &= ~GAL_DATA_FLAG_SORTED_I;
+  data->flag &= ~GAL_DATA_FLAG_SORTED_D;
+}
+
+
+
+
+
+/* For sorting the selection positions. */
+static int
+statistics_sort_size_t_i(const void *a, const void *b)
+{
+  size_t ta=*(size_t *)a, tb=*(size_t *)b;
+  return (ta > tb) - (ta < tb);
+}
+
+
+
+
+
+/* Return 1 if the dataset is already flagged as sorted. */
+static int
+statistics_flagged_sorted(gal_data_t *data)
+{
+  return ( (data->flag & GAL_DATA_FLAG_SORT_CH)
+           && (data->flag & (GAL_DATA_FLAG_SORTED_I
+                             | GAL_DATA_FLAG_SORTED_D)) );
+}
+
+
+
+
+
+/* Prepare a dataset to find order statistics (median or quantiles): the
+   output will be contiguous with no blank values. If it is sorted, it will
+   be flagged as sorted (and shouldn't be modified when 'inplace==0'),
+   otherwise, its elements can be re-ordered when 'reorder' is non-zero:
+   when 'inplace' is also zero, it will be a copy of the input. */
+static gal_data_t *
+statistics_no_blank_for_select(gal_data_t *input, int inplace, int reorder)
+{
+  gal_data_t *contig, *noblank;
+
+  /* Empty datasets and datasets that are already known to be sorted can
+     be treated like before. */
+  if( input->size==0
+      || (input->block==NULL && statistics_flagged_sorted(input)) )
+    return gal_statistics_no_blank_sorted(input, inplace);
+
+  /* If this is a tile, first copy it into a contiguous patch of memory
+     (that we can freely modify). */
+  if(input->block) { contig=gal_data_copy(input); inplace=1; }
+  else               contig=input;
+
+  /* Remove the blank values (if there are any). */
+  if( gal_blank_present(contig, 1) )
+    {
+      noblank = inplace ? contig : gal_data_copy(contig);
+      gal_blank_remove(noblank);
+    }
+  else noblank=contig;
+
+  /* If the dataset is already sorted, there is no need for selection (the
+     check will stop at the first unsorted element, so its cheap). */
+  if(noblank->size && gal_statistics_is_sorted(noblank, 1))
+    return noblank;
+
+  /* We will need to re-order the elements, so if we are still on the
+     input, make a copy. */
+  return ( reorder && noblank==input && inplace==0
+           ? gal_data_copy(noblank)
+           : noblank );
+}
+
+
+
+
+
 /* The input is a sorted array with no blank values, we want the median
    value to be put inside the already allocated space which is pointed to
    by 'median'. It is in the same type as the input. */
@@ -309,19 +513,29 @@ statistics_median_in_sorted_no_blank(gal_data_t *sorted, void *median)
 
 /* Return the median value of the dataset in the same type as the input as
    a one element dataset. If the 'inplace' flag is set, the input data
-   structure will be modified: it will have no blank values and will be
-   sorted (increasing). */
+   structure will be modified: it will have no blank values and its
+   elements may be re-ordered (it will not necessarily be sorted). */
 gal_data_t *
 gal_statistics_median(gal_data_t *input, int inplace)
 {
-  size_t dsize=1;
-  gal_data_t *nbs=gal_statistics_no_blank_sorted(input, inplace);;
+  size_t dsize=1, kpos[2];
+  gal_data_t *nbs=statistics_no_blank_for_select(input, inplace, 1);
   gal_data_t *out=gal_data_alloc(NULL, nbs->type, 1, &dsize, NULL, 1, -1,
                                  1, NULL, NULL, NULL);
 
-  /* Write the median. */
+  /* Write the median. If the dataset isn't sorted, select the middle
+     element(s) so they are in the same place as a sorted array. */
   if(nbs->size)
-    statistics_median_in_sorted_no_blank(nbs, out->array);
+    {
+      if( statistics_flagged_sorted(nbs)==0 )
+        {
+          kpos[0]=nbs->size/2-1;
+          kpos[1]=nbs->size/2;
+          if(nbs->size%2) statistics_select_multi(nbs, kpos+1, 1);
+          else            statistics_select_multi(nbs, kpos,   2);
+        }
+      statistics_median_in_sorted_no_blank(nbs, out->array);
+    }
   else
     gal_blank_write(out->array, out->type);
 
@@ -377,15 +591,18 @@ gal_statistics_quantile(gal_data_t *input, double quantile, int inplace)
   void *blank;
   int increasing;
   size_t dsize=1, index;
-  gal_data_t *nbs=gal_statistics_no_blank_sorted(input, inplace);
+  gal_data_t *nbs=statistics_no_blank_for_select(input, inplace, 1);
   gal_data_t *out=gal_data_alloc(NULL, nbs->type, 1, &dsize,
                                  NULL, 1, -1, 1, NULL, NULL, NULL);
 
   /* Only continue processing if there are non-blank elements. */
   if(nbs->size)
     {
-      /* Set the increasing value. */
-      increasing = nbs->flag & GAL_DATA_FLAG_SORTED_I;
+      /* Set the increasing value (when the dataset isn't sorted, it will
+         be treated like an increasing array after selection). */
+      increasing = ( statistics_flagged_sorted(nbs)
+                     ? nbs->flag & GAL_DATA_FLAG_SORTED_I
+                     : 1 );
 
       /* Find the index of the quantile, note that if it sorted in
          decreasing order, then we'll need to get the index of the inverse
@@ -403,9 +620,13 @@ gal_statistics_quantile(gal_data_t *input, double quantile, int inplace)
           free(blank);
         }
       else
-        memcpy(out->array,
-               gal_pointer_increment(nbs->array, index, nbs->type),
-               gal_type_sizeof(nbs->type));
+        {
+          if( statistics_flagged_sorted(nbs)==0 )
+            statistics_select_multi(nbs, &index, 1);
+          memcpy(out->array,
+                 gal_pointer_increment(nbs->array, index, nbs->type),
+                 gal_type_sizeof(nbs->type));
+        }
     }
   else
     gal_blank_write(out->array, out->type);
@@ -419,6 +640,80 @@ gal_statistics_quantile(gal_data_t *input, double quantile, int inplace)
 
 
 
+/* Return a dataset with the same type as the input that has the values at
+   all the quantiles that are given in 'quantiles' (which must have a
+   'float64' type). This is much faster than calling
+   'gal_statistics_quantile' for each quantile on unsorted data, because
+   all the quantiles are selected together. */
+gal_data_t *
+gal_statistics_quantile_multi(gal_data_t *input, gal_data_t *quantiles,
+                              int inplace)
+{
+  int increasing;
+  double *q=quantiles->array;
+  gal_data_t *nbs, *out=NULL;
+  size_t i, j, numk, *index, *kpos;
+  size_t width=gal_type_sizeof(input->type);
+
+  /* Sanity check. */
+  if(quantiles->type!=GAL_TYPE_FLOAT64)
+    error(EXIT_FAILURE, 0, "%s: 'quantiles' must have a 'float64' type",
+          __func__);
+
+  /* Prepare the output and the dataset to select from. */
+  nbs=statistics_no_blank_for_select(input, inplace, 1);
+  out=gal_data_alloc(NULL, nbs->type, 1, &quantiles->size, NULL, 0, -1, 1,
+                     NULL, NULL, NULL);
+
+  /* If there are no usable elements, all the quantiles are blank. */
+  if(nbs->size==0)
+    {
+      for(i=0;i<out->size;++i)
+        gal_blank_write(gal_pointer_increment(out->array, i, out->type),
+                        out->type);
+      if(nbs!=input) gal_data_free(nbs);
+      return out;
+    }
+
+  /* Find the index of each quantile (see 'gal_statistics_quantile'). */
+  increasing = ( statistics_flagged_sorted(nbs)
+                 ? nbs->flag & GAL_DATA_FLAG_SORTED_I
+                 : 1 );
+  index=gal_pointer_allocate(GAL_TYPE_SIZE_T, quantiles->size, 0, __func__,
+                             "index");
+  for(i=0;i<quantiles->size;++i)
+    index[i]=gal_statistics_quantile_index(nbs->size,
+                                           increasing ? q[i] : 1.0f-q[i]);
+
+  /* When the dataset isn't sorted, select all the indexs at once. */
+  if( statistics_flagged_sorted(nbs)==0 )
+    {
+      /* Sort the positions and remove repeated ones. */
+      kpos=gal_pointer_allocate(GAL_TYPE_SIZE_T, quantiles->size, 0,
+                                __func__, "kpos");
+      memcpy(kpos, index, quantiles->size*sizeof *kpos);
+      qsort(kpos, quantiles->size, sizeof *kpos, statistics_sort_size_t_i);
+      for(i=numk=1;i<quantiles->size;++i)
+        if(kpos[i]!=kpos[numk-1]) kpos[numk++]=kpos[i];
+      statistics_select_multi(nbs, kpos, numk);
+      free(kpos);
+    }
+
+  /* Write the values into the output. */
+  for(j=0;j<quantiles->size;++j)
+    memcpy(gal_pointer_increment(out->array, j, out->type),
+           gal_pointer_increment(nbs->array, index[j], nbs->type), width);
+
+  /* Clean up and return. */
+  free(index);
+  if(nbs!=input) gal_data_free(nbs);
+  return out;
+}
+
+
+
+
+
 /* Return the index of the (first) point in the sorted dataset that has the
    closest value to 'value' (which has to be the same type as the 'input'
    dataset). */
@@ -454,14 +749,33 @@ gal_statistics_quantile(gal_data_t *input, double quantile, int inplace)
     /* Set the difference if the value is actually in the range. */     \
     if(parsed && a<af) index = a-r;                                     \
   }
-size_t
-gal_statistics_quantile_function_index(gal_data_t *input,
-                                       gal_data_t *invalue, int inplace)
+/* When the dataset isn't sorted, we don't need to sort it to find the
+   index of the quantile function: the index (in the sorted array) is the
+   number of elements that are smaller or equal to the value, and the
+   nearest element is either the largest of those elements or the smallest
+   element that is larger than the value. Like the sorted case, when the
+   value is smaller than the minimum or larger (or equal) to the maximum,
+   no index will be set ('below' will be set to 1 in the former case). */
+#define STATS_QFUNC_IND_UNSORTED(IT) {                                  \
+    size_t c=0;                                                         \
+    int hasle=0, hasgt=0;                                               \
+    IT *a=nbs->array, *af=a+nbs->size, v=*((IT *)(value->array));       \
+    IT le=0, gt=0;                                                      \
+    do                                                                  \
+      if(*a<=v) { ++c; if(hasle==0 || *a>le) { le=*a; hasle=1; } }      \
+      else      {      if(hasgt==0 || *a<gt) { gt=*a; hasgt=1; } }      \
+    while(++a<af);                                                      \
+    if(c==0) *below=1;                                                  \
+    else if(c<nbs->size) index = v-le < gt-v ? c-1 : c;                 \
+  }
+static size_t
+statistics_quantile_function_index_nbs(gal_data_t *nbs, gal_data_t *invalue,
+                                       int *below)
 {
   int parsed=0;
   gal_data_t *value;
   size_t index=GAL_BLANK_SIZE_T;
-  gal_data_t *nbs=gal_statistics_no_blank_sorted(input, inplace);
+  int sorted=statistics_flagged_sorted(nbs);
 
   /* Make sure the value has the same type. */
   if(invalue->size>1)
@@ -472,24 +786,45 @@ gal_statistics_quantile_function_index(gal_data_t *input,
             : gal_data_copy_to_new_type(invalue, nbs->type) );
 
   /* Only continue processing if we have non-blank elements. */
+  *below=0;
   if(nbs->size)
-    /* Find the result: */
-    switch(nbs->type)
-      {
-      case GAL_TYPE_UINT8:     STATS_QFUNC_IND( uint8_t  );     break;
-      case GAL_TYPE_INT8:      STATS_QFUNC_IND( int8_t   );     break;
-      case GAL_TYPE_UINT16:    STATS_QFUNC_IND( uint16_t );     break;
-      case GAL_TYPE_INT16:     STATS_QFUNC_IND( int16_t  );     break;
-      case GAL_TYPE_UINT32:    STATS_QFUNC_IND( uint32_t );     break;
-      case GAL_TYPE_INT32:     STATS_QFUNC_IND( int32_t  );     break;
-      case GAL_TYPE_UINT64:    STATS_QFUNC_IND( uint64_t );     break;
-      case GAL_TYPE_INT64:     STATS_QFUNC_IND( int64_t  );     break;
-      case GAL_TYPE_FLOAT32:   STATS_QFUNC_IND( float    );     break;
-      case GAL_TYPE_FLOAT64:   STATS_QFUNC_IND( double   );     break;
-      default:
-        error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
-              __func__, nbs->type);
-      }
+    {
+      /* Find the result: */
+      if(sorted)
+        switch(nbs->type)
+          {
+          case GAL_TYPE_UINT8:     STATS_QFUNC_IND( uint8_t  );     break;
+          case GAL_TYPE_INT8:      STATS_QFUNC_IND( int8_t   );     break;
+          case GAL_TYPE_UINT16:    STATS_QFUNC_IND( uint16_t );     break;
+          case GAL_TYPE_INT16:     STATS_QFUNC_IND( int16_t  );     break;
+          case GAL_TYPE_UINT32:    STATS_QFUNC_IND( uint32_t );     break;
+          case GAL_TYPE_INT32:     STATS_QFUNC_IND( int32_t  );     break;
+          case GAL_TYPE_UINT64:    STATS_QFUNC_IND( uint64_t );     break;
+          case GAL_TYPE_INT64:     STATS_QFUNC_IND( int64_t  );     break;
+          case GAL_TYPE_FLOAT32:   STATS_QFUNC_IND( float    );     break;
+          case GAL_TYPE_FLOAT64:   STATS_QFUNC_IND( double   );     break;
+          default:
+            error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+                  __func__, nbs->type);
+          }
+      else
+        switch(nbs->type)
+          {
+          case GAL_TYPE_UINT8:   STATS_QFUNC_IND_UNSORTED( uint8_t  ); break;
+          case GAL_TYPE_INT8:    STATS_QFUNC_IND_UNSORTED( int8_t   ); break;
+          case GAL_TYPE_UINT16:  STATS_QFUNC_IND_UNSORTED( uint16_t ); break;
+          case GAL_TYPE_INT16:   STATS_QFUNC_IND_UNSORTED( int16_t  ); break;
+          case GAL_TYPE_UINT32:  STATS_QFUNC_IND_UNSORTED( uint32_t ); break;
+          case GAL_TYPE_INT32:   STATS_QFUNC_IND_UNSORTED( int32_t  ); break;
+          case GAL_TYPE_UINT64:  STATS_QFUNC_IND_UNSORTED( uint64_t ); break;
+          case GAL_TYPE_INT64:   STATS_QFUNC_IND_UNSORTED( int64_t  ); break;
+          case GAL_TYPE_FLOAT32: STATS_QFUNC_IND_UNSORTED( float    ); break;
+          case GAL_TYPE_FLOAT64: STATS_QFUNC_IND_UNSORTED( double   ); break;
+          default:
+            error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+                  __func__, nbs->type);
+          }
+    }
   else
     {
       error(0, 0, "%s: no non-blank elements. The quantile function is not "
@@ -499,6 +834,23 @@ gal_statistics_quantile_function_index(gal_data_t *input,
 
   /* Clean up and return. */
   if(value!=invalue) gal_data_free(value);
+  return index;
+}
+
+
+
+
+
+size_t
+gal_statistics_quantile_function_index(gal_data_t *input,
+                                       gal_data_t *invalue, int inplace)
+{
+  int below;
+  size_t index;
+  gal_data_t *nbs=statistics_no_blank_for_select(input, inplace, 0);
+
+  /* Find the index and clean up. */
+  index=statistics_quantile_function_index_nbs(nbs, invalue, &below);
   if(nbs!=input) gal_data_free(nbs);
   return index;
 }
@@ -524,8 +876,9 @@ gal_statistics_quantile_function(gal_data_t *input, gal_data_t *value,
                                  int inplace)
 {
   double *d;
+  int below;
   size_t ind, dsize=1;
-  gal_data_t *nbs=gal_statistics_no_blank_sorted(input, inplace);
+  gal_data_t *nbs=statistics_no_blank_for_select(input, inplace, 0);
   gal_data_t *out=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &dsize,
                                  NULL, 1, -1, 1, NULL, NULL, NULL);
 
@@ -534,13 +887,12 @@ gal_statistics_quantile_function(gal_data_t *input, gal_data_t *value,
     error(EXIT_FAILURE, 0, "%s: the 'value' argument must only have "
           "one element", __func__);
 
-  /* Calculate the index of the value. */
-  ind=gal_statistics_quantile_function_index(input, value, inplace);
-  //printf("ind: %zu (%zu)\n", ind, input->size);
-
   /* Only continue processing if there are non-blank values. */
   if(nbs->size)
     {
+      /* Calculate the index of the value. */
+      ind=statistics_quantile_function_index_nbs(nbs, value, &below);
+
       /* Note that counting of the index starts from 0, so for the quantile
          we should divided by (size - 1). */
       d=out->array;
@@ -548,22 +900,25 @@ gal_statistics_quantile_function(gal_data_t *input, gal_data_t *value,
         {
           /* See if the value is larger or smaller than the input's minimum
              or maximum. */
-          switch(nbs->type)
-            {
-            case GAL_TYPE_UINT8:     STATS_QFUNC( uint8_t  );     break;
-            case GAL_TYPE_INT8:      STATS_QFUNC( int8_t   );     break;
-            case GAL_TYPE_UINT16:    STATS_QFUNC( uint16_t );     break;
-            case GAL_TYPE_INT16:     STATS_QFUNC( int16_t  );     break;
-            case GAL_TYPE_UINT32:    STATS_QFUNC( uint32_t );     break;
-            case GAL_TYPE_INT32:     STATS_QFUNC( int32_t  );     break;
-            case GAL_TYPE_UINT64:    STATS_QFUNC( uint64_t );     break;
-            case GAL_TYPE_INT64:     STATS_QFUNC( int64_t  );     break;
-            case GAL_TYPE_FLOAT32:   STATS_QFUNC( float    );     break;
-            case GAL_TYPE_FLOAT64:   STATS_QFUNC( double   );     break;
-            default:
-              error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
-                    __func__, nbs->type);
-            }
+          if( statistics_flagged_sorted(nbs) )
+            switch(nbs->type)
+              {
+              case GAL_TYPE_UINT8:     STATS_QFUNC( uint8_t  );     break;
+              case GAL_TYPE_INT8:      STATS_QFUNC( int8_t   );     break;
+              case GAL_TYPE_UINT16:    STATS_QFUNC( uint16_t );     break;
+              case GAL_TYPE_INT16:     STATS_QFUNC( int16_t  );     break;
+              case GAL_TYPE_UINT32:    STATS_QFUNC( uint32_t );     break;
+              case GAL_TYPE_INT32:     STATS_QFUNC( int32_t  );     break;
+              case GAL_TYPE_UINT64:    STATS_QFUNC( uint64_t );     break;
+              case GAL_TYPE_INT64:     STATS_QFUNC( int64_t  );     break;
+              case GAL_TYPE_FLOAT32:   STATS_QFUNC( float    );     break;
+              case GAL_TYPE_FLOAT64:   STATS_QFUNC( double   );     break;
+              default:
+                error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+                      __func__, nbs->type);
+              }
+          else
+            d[0] = below ? -INFINITY : INFINITY;
         }
       else
         d[0] = (double)ind / ((double)(nbs->size - 1));
@@ -2161,30 +2516,54 @@ gal_statistics_cfp(gal_data_t *input, gal_data_t *bins, int normalize)
   (if it isn't sorted). Afterwards, it will recursively change the starting
   point of the array and its size, calcluating the basic statistics in each
   round to define the new starting point and size.
+
+  Since the array is sorted, the new starting point and size can be found
+  with a binary search. The sum and sum of squares are calculated over the
+  remaining elements in each round: sums over the full array can't be
+  used (by subtracting the sums of the clipped elements), because the
+  clipped outliers can be so large that the difference would only be
+  round-off errors. To avoid loosing precision in the sum of squares, the
+  values are shifted by the median of the remaining elements before
+  summation (the standard deviation doesn't change with a shift).
 */
+#define SIGCLIP_SUMS(IT) {                                              \
+    IT *a=nbs->array;                                                   \
+    ref=a[size/2];                                                      \
+    for(i=0;i<size;++i)                                                 \
+      {                                                                 \
+        d=a[i]-ref;                                                     \
+        sum  += d;                                                      \
+        sum2 += d*d;                                                    \
+      }                                                                 \
+  }
+
 #define SIGCLIP(IT) {                                                   \
-    IT *a  = nbs->array, *af = a  + nbs->size;                          \
-    IT *bf = nbs->array, *b  = bf + nbs->size - 1;                      \
+    IT *a=nbs_array;                                                    \
+    double lo=*med - (multip * std), hi=*med + (multip * std);          \
+    size_t l, h, m, end=start+size;                                     \
+    int increasing = nbs->flag & GAL_DATA_FLAG_SORTED_I;                \
                                                                         \
-    /* Remove all out-of-range elements from the start of the array. */ \
-    if( nbs->flag & GAL_DATA_FLAG_SORTED_I )                            \
-      do if( *a > (*med - (multip * *std)) )                            \
-           { start=a; break; }                                          \
-      while(++a<af);                                                    \
-    else                                                                \
-      do if( *a < (*med + (multip * *std)) )                            \
-           { start=a; break; }                                          \
-      while(++a<af);                                                    \
+    /* First element that is within the range (from the start). */      \
+    l=start; h=end;                                                     \
+    while(l<h)                                                          \
+      {                                                                 \
+        m=l+(h-l)/2;                                                    \
+        if( increasing ? a[m]>lo : a[m]<hi ) h=m; else l=m+1;           \
+      }                                                                 \
+    newstart=l;                                                         \
                                                                         \
-    /* Remove all out-of-range elements from the end of the array. */   \
-    if( nbs->flag & GAL_DATA_FLAG_SORTED_I )                            \
-      do if( *b < (*med + (multip * *std)) )                            \
-           { size=b-a+1; break; }                                       \
-      while(--b>=bf);                                                   \
-    else                                                                \
-      do if( *b > (*med - (multip * *std)) )                            \
-           { size=b-a+1; break; }                                       \
-      while(--b>=bf);                                                   \
+    /* One after the last element that is within the range. */          \
+    l=newstart; h=end;                                                  \
+    while(l<h)                                                          \
+      {                                                                 \
+        m=l+(h-l)/2;                                                    \
+        if( increasing ? a[m]<hi : a[m]>lo ) l=m+1; else h=m;           \
+      }                                                                 \
+    newend=l;                                                           \
+                                                                        \
+    /* Only change the range when there is an element within it. */     \
+    if(newstart<end && newend>newstart)                                 \
+      { start=newstart; size=newend-newstart; }                         \
   }
 
 gal_data_t *
@@ -2192,14 +2571,14 @@ gal_statistics_sigma_clip(gal_data_t *input, float multip, float param,
                           int inplace, int quiet)
 {
   float *oa;
-  void *start, *nbs_array;
-  double *med, *mean, *std;
+  void *nbs_array;
   uint8_t type=gal_tile_block(input)->type;
   uint8_t bytolerance = param>=1.0f ? 0 : 1;
   double oldmed=NAN, oldmean=NAN, oldstd=NAN;
-  size_t num=0, one=1, four=4, size, oldsize;
-  gal_data_t *fcopy, *median_i, *median_d, *out, *meanstd;
+  double *med, mean, std, sum, sum2, var, ref=0.0f, d;
+  gal_data_t *fcopy, *median_i, *median_d, *out;
   gal_data_t *nbs=gal_statistics_no_blank_sorted(input, inplace);
+  size_t i, num=0, one=1, four=4, size, start, newstart, newend;
   size_t maxnum = param>=1.0f ? param : GAL_STATISTICS_SIG_CLIP_MAX_CONVERGE;
 
 
@@ -2276,14 +2655,14 @@ gal_statistics_sigma_clip(gal_data_t *input, float multip, float param,
       /* Do the clipping, but first initialize the values that will be
          changed during the clipping: the start of the array and the
          array's size. */
+      start=0;
       size=nbs->size;
-      start=nbs->array;
       while(num<maxnum && size)
         {
           /* Find the average and Standard deviation, note that both
              'start' and 'size' will be different in the next round. */
-          nbs->array = start;
-          nbs->size = oldsize = size;
+          nbs->array = gal_pointer_increment(nbs_array, start, type);
+          nbs->size = size;
 
           /* For a detailed check, just correct the type).
           if(!quiet)
@@ -2295,20 +2674,39 @@ gal_statistics_sigma_clip(gal_data_t *input, float multip, float param,
             }
           */
 
-          /* Find the mean, median and standard deviation. */
-          meanstd=gal_statistics_mean_std(nbs);
+          /* Find the mean and standard deviation of the remaining
+             elements (like 'gal_statistics_mean_std', with a single
+             element, the standard deviation is zero by definition). */
+          sum=sum2=0.0f;
+          switch(type)
+            {
+            case GAL_TYPE_UINT8:     SIGCLIP_SUMS( uint8_t  );   break;
+            case GAL_TYPE_INT8:      SIGCLIP_SUMS( int8_t   );   break;
+            case GAL_TYPE_UINT16:    SIGCLIP_SUMS( uint16_t );   break;
+            case GAL_TYPE_INT16:     SIGCLIP_SUMS( int16_t  );   break;
+            case GAL_TYPE_UINT32:    SIGCLIP_SUMS( uint32_t );   break;
+            case GAL_TYPE_INT32:     SIGCLIP_SUMS( int32_t  );   break;
+            case GAL_TYPE_UINT64:    SIGCLIP_SUMS( uint64_t );   break;
+            case GAL_TYPE_INT64:     SIGCLIP_SUMS( int64_t  );   break;
+            case GAL_TYPE_FLOAT32:   SIGCLIP_SUMS( float    );   break;
+            case GAL_TYPE_FLOAT64:   SIGCLIP_SUMS( double   );   break;
+            default:
+              error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+                    __func__, type);
+            }
+          mean = ref + sum/size;
+          var  = (sum2-sum*sum/size)/size;
+          std  = size>1 && var>0.0f ? sqrt(var) : 0.0f;
+
+          /* Find the median. */
           statistics_median_in_sorted_no_blank(nbs, median_i->array);
           median_d=gal_data_copy_to_new_type(median_i, GAL_TYPE_FLOAT64);
-
-          /* Put them in usable (with a type) pointers. */
-          mean = meanstd->array;
           med  = median_d->array;
-          std  = &((double *)(meanstd->array))[1];
 
           /* If the user wanted to view the steps, show it to them. */
           if(!quiet)
             printf("%-8zu %-10zu %-15g %-15g %-15g\n",
-                   num+1, size, *med, *mean, *std);
+                   num+1, size, *med, mean, std);
 
           /* If we are to work by tolerance, then check if we should jump
              out of the loop. Normally, 'oldstd' should be larger than std,
@@ -2321,16 +2719,16 @@ gal_statistics_sigma_clip(gal_data_t *input, float multip, float param,
              tolerance (because it will be infinity and thus lager than the
              requested tolerance level value).*/
           if( bytolerance && num>0 )
-            if( *std==0 || ((oldstd - *std) / *std) < param )
+            if( std==0 || ((oldstd - std) / std) < param )
               {
-                if(*std==0) {oldmed=*med; oldstd=*std; oldmean=*mean;}
-                gal_data_free(meanstd);   gal_data_free(median_d);
+                if(std==0) {oldmed=*med; oldstd=std; oldmean=mean;}
+                gal_data_free(median_d);
                 break;
               }
 
           /* Clip all the elements outside of the desired range: since the
              array is sorted, this means to just change the starting
-             pointer and size of the array. */
+             index and size of the array. */
           switch(type)
             {
             case GAL_TYPE_UINT8:     SIGCLIP( uint8_t  );   break;
@@ -2351,12 +2749,11 @@ gal_statistics_sigma_clip(gal_data_t *input, float multip, float param,
           /* Set the values from this round in the old elements, so the
              next round can compare with, and return then if necessary. */
           oldmed =  *med;
-          oldstd  = *std;
-          oldmean = *mean;
+          oldstd  = std;
+          oldmean = mean;
           ++num;
 
           /* Clean up: */
-          gal_data_free(meanstd);
           gal_data_free(median_d);
         }
 
@@ -25,9 +25,13 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
+#include <fcntl.h>
 #include <regex.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <gnuastro/git.h>
 #include <gnuastro/txt.h>
@@ -391,6 +395,476 @@ gal_table_list_of_indexs(gal_list_str_t *cols, gal_data_t *allcols,
 
 
 
+/* Table cache: when requested, the full table is written into a
+   "sidecar" file (in the same directory as the input, see
+   'table_cache_name') the first time it is read. In later reads of the
+   same table, the columns are directly copied from that file, without
+   any parsing (for plain text tables) or byte-swapping (for FITS tables).
+
+   The cache file has the native byte-order and contains these parts:
+
+     - One 'struct table_cache_header'.
+     - One 'struct table_cache_column' for each column.
+     - The name, unit and comment strings of the columns (each ending
+       with a '\0').
+     - The data of each column (starting at an 8-byte boundary). For
+       string columns, the strings are put after each other (each ending
+       with a '\0').
+
+   The cache is only used when the size and modification time of the
+   input (and its 'DATASUM' keyword for FITS tables) are identical to the
+   values that were stored when the cache was written. */
+#define TABLE_CACHE_MAGIC  "GALTBC1"
+#define TABLE_CACHE_ENDIAN 0x0102030405060708ULL
+#define TABLE_CACHE_SUFFIX ".gtcache"
+
+struct table_cache_header
+{
+  char          magic[8];  /* Identifier of the cache ('TABLE_CACHE_MAGIC').*/
+  uint64_t        endian;  /* To check the byte-order.                    */
+  uint64_t       srcsize;  /* Size of the input file (in bytes).          */
+  int64_t       mtimesec;  /* Modification time of input (seconds).       */
+  int64_t      mtimensec;  /* Modification time of input (nano-seconds).  */
+  char      datasum[24];  /* Value of 'DATASUM' keyword (FITS only).     */
+  uint64_t       numcols;  /* Number of columns.                          */
+  uint64_t       numrows;  /* Number of rows.                             */
+};
+
+struct table_cache_column
+{
+  int32_t           type;  /* Type of the column.                         */
+  int32_t       disp_fmt;  /* Display format.                             */
+  int32_t     disp_width;  /* Display width.                              */
+  int32_t disp_precision;  /* Display precision.                          */
+  uint64_t          name;  /* Offset of name string (0: no name).         */
+  uint64_t          unit;  /* Offset of unit string (0: no unit).         */
+  uint64_t       comment;  /* Offset of comment string (0: no comment).   */
+  uint64_t          data;  /* Offset of the column's data.                */
+  uint64_t      numblank;  /* Number of blank elements in the column.     */
+};
+
+
+
+
+
+/* Name of the cache file of the given table: it is a hidden file in the
+   same directory as the input. For FITS files, the HDU is also added to
+   the name. */
+static char *
+table_cache_name(char *filename, char *hdu)
+{
+  char *c, *out, *dir, *notdir, *hdustr=NULL;
+
+  /* Set the HDU string (any '/' will be replaced with '_'). */
+  if( gal_fits_name_is_fits(filename) )
+    {
+      if( asprintf(&hdustr, "_%s", hdu ? hdu : "1")<0 )
+        error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+      for(c=hdustr; *c!='\0'; ++c) if(*c=='/') *c='_';
+    }
+
+  /* Build the name. */
+  dir=gal_checkset_dir_part(filename);
+  notdir=gal_checkset_not_dir_part(filename);
+  if( asprintf(&out, "%s.%s%s%s", dir, notdir, hdustr ? hdustr : "",
+               TABLE_CACHE_SUFFIX)<0 )
+    error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+
+  /* Clean up and return. */
+  if(hdustr) free(hdustr);
+  free(notdir);
+  free(dir);
+  return out;
+}
+
+
+
+
+
+/* Fill the source-validation elements of the header from the input
+   table. If the input can't be used for a cache, return 0. */
+static int
+table_cache_source(char *filename, char *hdu,
+                   struct table_cache_header *head)
+{
+  int status=0;
+  struct stat st;
+  fitsfile *fptr;
+  char datasum[FLEN_VALUE];
+
+  /* Size and modification time. */
+  if( stat(filename, &st) || !S_ISREG(st.st_mode) ) return 0;
+  memset(head, 0, sizeof *head);
+  head->srcsize=st.st_size;
+  head->mtimesec=st.st_mtim.tv_sec;
+  head->mtimensec=st.st_mtim.tv_nsec;
+
+  /* The 'DATASUM' keyword of a FITS table (if it exists). */
+  if( gal_fits_name_is_fits(filename) )
+    {
+      fptr=gal_fits_hdu_open(filename, hdu, READONLY);
+      if( fits_read_key(fptr, TSTRING, "DATASUM", datasum, NULL, &status)
+          ==0 )
+        strncpy(head->datasum, datasum, sizeof head->datasum - 1);
+      status=0;
+      fits_close_file(fptr, &status);
+      gal_fits_io_error(status, NULL);
+    }
+  return 1;
+}
+
+
+
+
+
+/* The types that can be stored in the cache. */
+static int
+table_cache_type_ok(int32_t type)
+{
+  return ( (type>=GAL_TYPE_UINT8 && type<=GAL_TYPE_COMPLEX64)
+           || type==GAL_TYPE_STRING );
+}
+
+
+
+
+
+/* Make sure the string that starts at 'offset' is within the cache
+   ('offset==0' is used when there is no string). */
+static int
+table_cache_str_ok(char *map, size_t mapsize, uint64_t offset)
+{
+  return ( offset==0
+           || ( offset<mapsize
+                && memchr(map+offset, '\0', mapsize-offset)!=NULL ) );
+}
+
+
+
+
+
+/* Make sure everything that will be read from the cache (other than the
+   strings of string columns, that are checked while they are read) is
+   within the cache and has a known type. The cache may be truncated or
+   corrupt (for example if the disk was full when it was written), in
+   this case, it should just be treated as a stale cache. */
+static int
+table_cache_check(char *map, size_t mapsize)
+{
+  size_t i, numcols, numrows;
+  struct table_cache_column *ccols;
+  struct table_cache_header *head=(struct table_cache_header *)map;
+
+  /* The number of columns and rows. */
+  numcols=head->numcols;
+  numrows=head->numrows;
+  if( numcols==0 || numrows==0
+      || numcols > (mapsize - sizeof *head)/sizeof *ccols )
+    return 0;
+
+  /* Check each column. */
+  ccols=(struct table_cache_column *)(map + sizeof *head);
+  for(i=0;i<numcols;++i)
+    {
+      if( table_cache_type_ok(ccols[i].type)==0
+          || table_cache_str_ok(map, mapsize, ccols[i].name)==0
+          || table_cache_str_ok(map, mapsize, ccols[i].unit)==0
+          || table_cache_str_ok(map, mapsize, ccols[i].comment)==0
+          || ccols[i].data > mapsize )
+        return 0;
+      if( ccols[i].type!=GAL_TYPE_STRING
+          && ( numrows > ( (mapsize - ccols[i].data)
+                           / gal_type_sizeof(ccols[i].type) ) ) )
+        return 0;
+    }
+
+  /* Everything is fine. */
+  return 1;
+}
+
+
+
+
+
+/* Read the requested columns from the cache of the table. If there is no
+   cache, or it doesn't correspond to the input (or is broken), return
+   NULL. */
+static gal_data_t *
+table_cache_read(char *filename, char *hdu, gal_list_str_t *cols,
+                 int searchin, int ignorecase, size_t minmapsize,
+                 int quietmmap, size_t *colmatch)
+{
+  int fd;
+  struct stat st;
+  char *map, *name;
+  char **strarr, *str, *end;
+  gal_list_sizet_t *indexll, *ind;
+  struct table_cache_column *ccols;
+  struct table_cache_header src, *head;
+  gal_data_t *allcols, *out=NULL;
+  size_t i, numcols, numrows, mapsize, datasize;
+
+  /* Get the properties of the input. */
+  if( table_cache_source(filename, hdu, &src)==0 ) return NULL;
+
+  /* Open and map the cache file. */
+  name=table_cache_name(filename, hdu);
+  fd=open(name, O_RDONLY);
+  free(name);
+  if(fd==-1) return NULL;
+  if( fstat(fd, &st) || st.st_size<sizeof *head )
+    { close(fd); return NULL; }
+  mapsize=st.st_size;
+  map=mmap(NULL, mapsize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map==MAP_FAILED) return NULL;
+
+  /* Make sure the cache corresponds to the input and can be read. */
+  head=(struct table_cache_header *)map;
+  if( memcmp(head->magic, TABLE_CACHE_MAGIC, sizeof head->magic)
+      || head->endian!=TABLE_CACHE_ENDIAN
+      || head->srcsize!=src.srcsize
+      || head->mtimesec!=src.mtimesec
+      || head->mtimensec!=src.mtimensec
+      || strncmp(head->datasum, src.datasum, sizeof head->datasum)
+      || table_cache_check(map, mapsize)==0 )
+    { munmap(map, mapsize); return NULL; }
+  numcols=head->numcols;
+  numrows=head->numrows;
+  ccols=(struct table_cache_column *)(map + sizeof *head);
+
+  /* Build the column information (like 'gal_table_info'). */
+  allcols=gal_data_array_calloc(numcols);
+  for(i=0;i<numcols;++i)
+    {
+      allcols[i].type=ccols[i].type;
+      allcols[i].disp_fmt=ccols[i].disp_fmt;
+      allcols[i].disp_width=ccols[i].disp_width;
+      allcols[i].disp_precision=ccols[i].disp_precision;
+      if(ccols[i].name)
+        gal_checkset_allocate_copy(map+ccols[i].name, &allcols[i].name);
+      if(ccols[i].unit)
+        gal_checkset_allocate_copy(map+ccols[i].unit, &allcols[i].unit);
+      if(ccols[i].comment)
+        gal_checkset_allocate_copy(map+ccols[i].comment,
+                                   &allcols[i].comment);
+    }
+
+  /* Find the requested columns, then copy each one (the list is built in
+     reverse, so the output has the same order as the requested
+     columns). */
+  indexll=gal_table_list_of_indexs(cols, allcols, numcols, searchin,
+                                   ignorecase, filename, hdu, colmatch);
+  gal_list_sizet_reverse(&indexll);
+  for(ind=indexll; ind!=NULL; ind=ind->next)
+    {
+      /* Allocate the column (string columns are cleared, so they can be
+         freed if a string isn't complete). */
+      i=ind->v;
+      gal_list_data_add_alloc(&out, NULL, ccols[i].type, 1, &numrows, NULL,
+                              ccols[i].type==GAL_TYPE_STRING, minmapsize,
+                              quietmmap, allcols[i].name, allcols[i].unit,
+                              allcols[i].comment);
+      out->disp_fmt=ccols[i].disp_fmt;
+      out->disp_width=ccols[i].disp_width;
+      out->disp_precision=ccols[i].disp_precision;
+
+      /* Copy the values. Each string has to end within the cache,
+         otherwise, the cache is broken and shouldn't be used. */
+      if(out->type==GAL_TYPE_STRING)
+        {
+          strarr=out->array;
+          end=map+mapsize;
+          str=map+ccols[i].data;
+          for(datasize=0; datasize<numrows; ++datasize)
+            {
+              if( str>=end || memchr(str, '\0', end-str)==NULL )
+                {
+                  gal_list_data_free(out);
+                  out=NULL;
+                  break;
+                }
+              gal_checkset_allocate_copy(str, &strarr[datasize]);
+              str+=strlen(str)+1;
+            }
+          if(out==NULL) break;
+        }
+      else
+        memcpy(out->array, map+ccols[i].data,
+               numrows*gal_type_sizeof(out->type));
+
+      /* The number of blank elements is already known. */
+      out->flag |= GAL_DATA_FLAG_BLANK_CH;
+      if(ccols[i].numblank) out->flag |= GAL_DATA_FLAG_HASBLANK;
+      else                  out->flag &= ~GAL_DATA_FLAG_HASBLANK;
+    }
+
+  /* Clean up and return. */
+  for(i=0;i<numcols;++i)
+    gal_data_free_contents(&allcols[i]);
+  gal_list_sizet_free(indexll);
+  munmap(map, mapsize);
+  free(allcols);
+  return out;
+}
+
+
+
+
+
+/* Write a string into the cache file (with its '\0'). */
+static void
+table_cache_write_str(FILE *fp, char *str, uint64_t *offset)
+{
+  size_t len=strlen(str)+1;
+  if( fwrite(str, 1, len, fp)!=len )
+    error(EXIT_FAILURE, errno, "%s: couldn't write %zu bytes", __func__,
+          len);
+  *offset+=len;
+}
+
+
+
+
+
+/* Read the full table and write it into its cache. If the cache can't be
+   created (for example the directory of the input isn't writable), this
+   function will return 0 and no cache will be used. */
+static int
+table_cache_write(char *filename, char *hdu, size_t numthreads,
+                  size_t minmapsize, int quietmmap)
+{
+  FILE *fp;
+  int fd, success=1;
+  struct stat st;
+  char *name, *tmpname;
+  size_t i, j, numcols;
+  gal_data_t *table, *col;
+  struct table_cache_header head;
+  struct table_cache_column *ccols;
+  char **strarr, zeros[8]={0,0,0,0,0,0,0,0};
+  uint64_t offset, pad, datasize, numrows;
+
+  /* Get the properties of the input. */
+  if( table_cache_source(filename, hdu, &head)==0 ) return 0;
+
+  /* Read the full table. */
+  table=gal_table_read_threaded(filename, hdu, NULL, NULL,
+                                GAL_TABLE_SEARCH_NAME, 0, numthreads,
+                                minmapsize, quietmmap, NULL);
+  if(table==NULL) return 0;
+  numrows=table->size;
+  numcols=gal_list_data_number(table);
+  if(numrows==0) { gal_list_data_free(table); return 0; }
+  for(col=table; col!=NULL; col=col->next)
+    if( table_cache_type_ok(col->type)==0 )
+      { gal_list_data_free(table); return 0; }
+
+  /* Open a temporary file (to be renamed to the final name when it is
+     complete, so parallel reads never see a partial cache). */
+  name=table_cache_name(filename, hdu);
+  if( asprintf(&tmpname, "%s.XXXXXX", name)<0 )
+    error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+  fd=mkstemp(tmpname);
+  if(fd==-1 || stat(filename, &st) || fchmod(fd, st.st_mode & 0666) )
+    {
+      if(fd!=-1) { close(fd); remove(tmpname); }
+      free(name);
+      free(tmpname);
+      gal_list_data_free(table);
+      return 0;
+    }
+  fp=fdopen(fd, "w");
+  if(fp==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't open", tmpname);
+
+  /* Set the header and the offsets of the strings. */
+  memcpy(head.magic, TABLE_CACHE_MAGIC, sizeof head.magic);
+  head.endian=TABLE_CACHE_ENDIAN;
+  head.numcols=numcols;
+  head.numrows=numrows;
+  errno=0;
+  ccols=calloc(numcols, sizeof *ccols);
+  if(ccols==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'ccols'",
+          __func__, numcols*sizeof *ccols);
+  offset=sizeof head + numcols*sizeof *ccols;
+  for(i=0, col=table; col!=NULL; ++i, col=col->next)
+    {
+      ccols[i].type=col->type;
+      ccols[i].disp_fmt=col->disp_fmt;
+      ccols[i].disp_width=col->disp_width;
+      ccols[i].disp_precision=col->disp_precision;
+      ccols[i].numblank=gal_blank_number(col, 1);
+      if(col->name)    { ccols[i].name=offset;   offset+=strlen(col->name)+1;}
+      if(col->unit)    { ccols[i].unit=offset;   offset+=strlen(col->unit)+1;}
+      if(col->comment)
+        { ccols[i].comment=offset; offset+=strlen(col->comment)+1; }
+    }
+
+  /* Set the offsets of the data (each starting on an 8-byte boundary). */
+  for(i=0, col=table; col!=NULL; ++i, col=col->next)
+    {
+      offset += (8 - offset%8)%8;
+      ccols[i].data=offset;
+      if(col->type==GAL_TYPE_STRING)
+        for(strarr=col->array, j=0; j<numrows; ++j)
+          offset+=strlen(strarr[j])+1;
+      else
+        offset+=numrows*gal_type_sizeof(col->type);
+    }
+
+  /* Write the header, column information and strings. */
+  if( fwrite(&head, sizeof head, 1, fp)!=1
+      || fwrite(ccols, sizeof *ccols, numcols, fp)!=numcols )
+    error(EXIT_FAILURE, errno, "%s: couldn't write the header", tmpname);
+  offset=sizeof head + numcols*sizeof *ccols;
+  for(col=table; col!=NULL; col=col->next)
+    {
+      if(col->name)    table_cache_write_str(fp, col->name,    &offset);
+      if(col->unit)    table_cache_write_str(fp, col->unit,    &offset);
+      if(col->comment) table_cache_write_str(fp, col->comment, &offset);
+    }
+
+  /* Write the data of each column. */
+  for(col=table; col!=NULL; col=col->next)
+    {
+      pad=(8 - offset%8)%8;
+      if( pad && fwrite(zeros, 1, pad, fp)!=pad )
+        error(EXIT_FAILURE, errno, "%s: couldn't write padding", tmpname);
+      offset+=pad;
+      if(col->type==GAL_TYPE_STRING)
+        for(strarr=col->array, j=0; j<numrows; ++j)
+          table_cache_write_str(fp, strarr[j], &offset);
+      else
+        {
+          datasize=numrows*gal_type_sizeof(col->type);
+          if( fwrite(col->array, 1, datasize, fp)!=datasize )
+            error(EXIT_FAILURE, errno, "%s: couldn't write %zu bytes",
+                  tmpname, (size_t)datasize);
+          offset+=datasize;
+        }
+    }
+
+  /* Close the file and put it in its final name. */
+  if( fclose(fp) || rename(tmpname, name) )
+    {
+      remove(tmpname);
+      success=0;
+    }
+
+  /* Clean up and return. */
+  gal_list_data_free(table);
+  free(tmpname);
+  free(ccols);
+  free(name);
+  return success;
+}
+
+
+
+
+
 /* Read the specified columns in a table (named 'filename') into a linked
    list of data structures. If the file is FITS, then 'hdu' will also be
    used, otherwise, 'hdu' is ignored. The information to search for columns
@@ -411,6 +885,23 @@ gal_data_t *
 gal_table_read(char *filename, char *hdu, gal_list_str_t *lines,
                gal_list_str_t *cols, int searchin, int ignorecase,
                size_t minmapsize, int quietmmap, size_t *colmatch)
+{
+  return gal_table_read_threaded(filename, hdu, lines, cols, searchin,
+                                 ignorecase, 1, minmapsize, quietmmap,
+                                 colmatch);
+}
+
+
+
+
+
+/* Similar to 'gal_table_read', but using 'numthreads' threads to read
+   the table (see 'gal_fits_tab_read_threaded'). */
+gal_data_t *
+gal_table_read_threaded(char *filename, char *hdu, gal_list_str_t *lines,
+                        gal_list_str_t *cols, int searchin, int ignorecase,
+                        size_t numthreads, size_t minmapsize, int quietmmap,
+                        size_t *colmatch)
 {
   int tableformat;
   gal_list_sizet_t *indexll;
@@ -441,14 +932,16 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *lines,
   switch(tableformat)
     {
     case GAL_TABLE_FORMAT_TXT:
-      out=gal_txt_table_read(filename, lines, numrows, allcols, indexll,
-                             minmapsize, quietmmap);
+      out=gal_txt_table_read_threaded(filename, lines, numrows, allcols,
+                                      indexll, numthreads, minmapsize,
+                                      quietmmap);
       break;
 
     case GAL_TABLE_FORMAT_AFITS:
     case GAL_TABLE_FORMAT_BFITS:
-      out=gal_fits_tab_read(filename, hdu, numrows, allcols, indexll,
-                            minmapsize, quietmmap);
+      out=gal_fits_tab_read_threaded(filename, hdu, numrows, allcols,
+                                     indexll, numthreads, minmapsize,
+                                     quietmmap);
       break;
 
     default:
@@ -470,6 +963,43 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *lines,
 
 
 
+/* Similar to 'gal_table_read', but the columns are read from a cache of
+   the table (see 'table_cache_name'). If the cache doesn't exist yet (or
+   doesn't correspond to the input), the full table is read and written
+   into the cache, then the columns are read from it. When the table is
+   not a file or the cache can't be used, the table is read with
+   'gal_table_read_threaded'. */
+gal_data_t *
+gal_table_read_cache(char *filename, char *hdu, gal_list_str_t *lines,
+                     gal_list_str_t *cols, int searchin, int ignorecase,
+                     size_t numthreads, size_t minmapsize, int quietmmap,
+                     size_t *colmatch)
+{
+  gal_data_t *out;
+
+  if(filename)
+    {
+      out=table_cache_read(filename, hdu, cols, searchin, ignorecase,
+                           minmapsize, quietmmap, colmatch);
+      if(out) return out;
+      if( table_cache_write(filename, hdu, numthreads, minmapsize,
+                            quietmmap) )
+        {
+          out=table_cache_read(filename, hdu, cols, searchin, ignorecase,
+                               minmapsize, quietmmap, colmatch);
+          if(out) return out;
+        }
+    }
+
+  return gal_table_read_threaded(filename, hdu, lines, cols, searchin,
+                                 ignorecase, numthreads, minmapsize,
+                                 quietmmap, colmatch);
+}
+
+
+
+
+
 
 
 
@@ -529,6 +1059,23 @@ void
 gal_table_write(gal_data_t *cols, struct gal_fits_list_key_t **keylist,
                 gal_list_str_t *comments, int tableformat, char *filename,
                 char *extname, uint8_t colinfoinstdout)
+{
+  gal_table_write_threaded(cols, keylist, comments, tableformat, filename,
+                           extname, colinfoinstdout, 1);
+}
+
+
+
+
+
+/* Similar to 'gal_table_write', but a plain text table will be formatted
+   on 'numthreads' threads. */
+void
+gal_table_write_threaded(gal_data_t *cols,
+                         struct gal_fits_list_key_t **keylist,
+                         gal_list_str_t *comments, int tableformat,
+                         char *filename, char *extname,
+                         uint8_t colinfoinstdout, size_t numthreads)
 {
   /* If a filename was given, then the tableformat is relevant and must be
      used. When the filename is empty, a text table must be printed on the
@@ -539,11 +1086,13 @@ gal_table_write(gal_data_t *cols, struct gal_fits_list_key_t **keylist,
         gal_fits_tab_write(cols, comments, tableformat, filename, extname,
                            keylist);
       else
-        gal_txt_write(cols, keylist, comments, filename, colinfoinstdout);
+        gal_txt_write_threaded(cols, keylist, comments, filename,
+                               colinfoinstdout, numthreads);
     }
   else
     /* Write to standard output. */
-    gal_txt_write(cols, keylist, comments, filename, colinfoinstdout);
+    gal_txt_write_threaded(cols, keylist, comments, filename,
+                           colinfoinstdout, numthreads);
 }
 
 
@@ -263,6 +263,269 @@ gal_threads_attr_barrier_init(pthread_attr_t *attr, pthread_barrier_t *b,
 
 
 
+/*******************************************************************/
+/************        Persistent pool of threads       **************/
+/*******************************************************************/
+/* Creating and destroying threads (and the barrier to wait for them) on
+   every call to 'gal_threads_spin_off' is expensive: high-level programs
+   like NoiseChisel and Segment call it many times for every input. So the
+   first time that multiple threads are requested, a pool of threads is
+   created and kept waiting (on a condition variable) for later
+   jobs. Each job is an array of 'struct gal_threads_params' (one for each
+   requested thread) and the threads of the pool (along with the calling
+   thread) take the elements of this array until all are done.
+
+   There is only one pool in the whole process. If it is already busy
+   (for example 'gal_threads_spin_off' is called within a worker
+   function, or from another thread of the caller), we will fall back to
+   spinning off new threads for that job. */
+struct threads_pool
+{
+  size_t                  numthreads; /* Number of threads in the pool. */
+  pthread_t                     *ids; /* IDs of the pool's threads.     */
+  pthread_mutex_t              mutex; /* Mutex to protect this struct.  */
+  pthread_cond_t             jobcond; /* Signal that a new job is ready.*/
+  pthread_cond_t            donecond; /* Signal that a job is finished. */
+  size_t                  generation; /* Counter of submitted jobs.     */
+  int                       shutdown; /* ==1: threads should return.    */
+
+  void           *(*worker)(void *); /* Worker function of this job.   */
+  struct gal_threads_params    *prm; /* Parameters for each element.   */
+  size_t                     numprm; /* Number of elements in 'prm'.   */
+  size_t                       next; /* Next element to be started.    */
+  size_t                  remaining; /* Elements not yet finished.     */
+};
+
+static struct threads_pool *threads_pool=NULL;
+static int threads_pool_busy=0;
+static pthread_mutex_t threads_pool_lock=PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+
+/* Run the unfinished elements of the current job. This is called by all
+   the threads of the pool and also the calling thread, so it has to be
+   called when 'pool->mutex' is locked. Note that 'pool->worker' and
+   'pool->prm' will not change until 'pool->remaining' becomes zero, so
+   they can safely be read after unlocking. */
+static void
+threads_pool_do_job(struct threads_pool *pool)
+{
+  size_t i;
+
+  while(pool->next < pool->numprm)
+    {
+      i=pool->next++;
+      pthread_mutex_unlock(&pool->mutex);
+      pool->worker(&pool->prm[i]);
+      pthread_mutex_lock(&pool->mutex);
+      if(--pool->remaining==0)
+        pthread_cond_broadcast(&pool->donecond);
+    }
+}
+
+
+
+
+
+/* Function that each thread of the pool runs until the pool is freed. */
+static void *
+threads_pool_thread(void *in_pool)
+{
+  struct threads_pool *pool=(struct threads_pool *)in_pool;
+  size_t generation;
+
+  pthread_mutex_lock(&pool->mutex);
+  generation=pool->generation;
+  while(1)
+    {
+      /* Wait until a new job is submitted (or the pool is being freed).*/
+      while(pool->generation==generation && pool->shutdown==0)
+        pthread_cond_wait(&pool->jobcond, &pool->mutex);
+      if(pool->shutdown) break;
+
+      /* Do the job. */
+      generation=pool->generation;
+      threads_pool_do_job(pool);
+    }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+
+
+
+
+/* Make sure the pool has (at least) 'numthreads' threads. Note that the
+   thread that submits a job also works on it, so the pool only needs
+   'numthreads-1' threads of its own. This function is only called when
+   'threads_pool_lock' is locked and the pool isn't busy. */
+static void
+threads_pool_prepare(size_t numthreads)
+{
+  int err;
+  size_t i, numnew=numthreads-1;
+  struct threads_pool *pool=threads_pool;
+
+  /* If the pool doesn't exist yet, allocate and initialize it. */
+  if(pool==NULL)
+    {
+      errno=0;
+      pool=threads_pool=malloc(sizeof *pool);
+      if(pool==NULL)
+        error(EXIT_FAILURE, errno, "%s: %zu bytes for 'pool'", __func__,
+              sizeof *pool);
+      pool->ids=NULL;
+      pool->prm=NULL;
+      pool->worker=NULL;
+      pool->shutdown=0;
+      pool->numthreads=0;
+      pool->generation=0;
+      pool->numprm=pool->next=pool->remaining=0;
+      err=pthread_mutex_init(&pool->mutex, NULL);
+      if(err) error(EXIT_FAILURE, err, "%s: initializing mutex", __func__);
+      err=pthread_cond_init(&pool->jobcond, NULL);
+      if(err) error(EXIT_FAILURE, err, "%s: initializing cond", __func__);
+      err=pthread_cond_init(&pool->donecond, NULL);
+      if(err) error(EXIT_FAILURE, err, "%s: initializing cond", __func__);
+    }
+
+  /* If the pool already has enough threads, then just return. */
+  if(pool->numthreads>=numnew) return;
+
+  /* Add the necessary threads. */
+  errno=0;
+  pool->ids=realloc(pool->ids, numnew*sizeof *pool->ids);
+  if(pool->ids==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'pool->ids'", __func__,
+          numnew*sizeof *pool->ids);
+  for(i=pool->numthreads;i<numnew;++i)
+    {
+      err=pthread_create(&pool->ids[i], NULL, threads_pool_thread, pool);
+      if(err)
+        error(EXIT_FAILURE, err, "%s: can't create thread %zu", __func__, i);
+    }
+  pool->numthreads=numnew;
+}
+
+
+
+
+
+/* Try to reserve the pool for a job with 'numthreads' threads. If the pool
+   is already busy, return 0. */
+static int
+threads_pool_reserve(size_t numthreads)
+{
+  int out=0;
+
+  pthread_mutex_lock(&threads_pool_lock);
+  if(threads_pool_busy==0)
+    {
+      threads_pool_prepare(numthreads);
+      threads_pool_busy=out=1;
+    }
+  pthread_mutex_unlock(&threads_pool_lock);
+  return out;
+}
+
+
+
+
+
+/* Run 'worker' on all the 'numprm' elements of 'prm' using the pool and
+   return when all have finished. The pool must have been reserved
+   before calling this function. */
+static void
+threads_pool_run(void *(*worker)(void *), struct gal_threads_params *prm,
+                 size_t numprm)
+{
+  struct threads_pool *pool=threads_pool;
+
+  /* Submit the job and wake up the threads. */
+  pthread_mutex_lock(&pool->mutex);
+  pool->prm=prm;
+  pool->next=0;
+  pool->worker=worker;
+  pool->numprm=pool->remaining=numprm;
+  ++pool->generation;
+  pthread_cond_broadcast(&pool->jobcond);
+
+  /* This thread should also contribute, then wait for the others. */
+  threads_pool_do_job(pool);
+  while(pool->remaining)
+    pthread_cond_wait(&pool->donecond, &pool->mutex);
+  pool->prm=NULL;
+  pool->worker=NULL;
+  pthread_mutex_unlock(&pool->mutex);
+
+  /* Release the pool for later jobs. */
+  pthread_mutex_lock(&threads_pool_lock);
+  threads_pool_busy=0;
+  pthread_mutex_unlock(&threads_pool_lock);
+}
+
+
+
+
+
+/* Stop all the threads of the pool and free it. The pool will be
+   re-created on the next call to 'gal_threads_spin_off' with more than
+   one thread. This should not be called while a job is running. The pool
+   isn't owned by any library function: it is the caller's job to free it
+   when no more jobs will be submitted (Gnuastro's programs do this in
+   their final clean up). */
+void
+gal_threads_pool_free(void)
+{
+  size_t i;
+  struct threads_pool *pool;
+
+  /* Detach the pool from the global pointer. */
+  pthread_mutex_lock(&threads_pool_lock);
+  if(threads_pool_busy)
+    error(EXIT_FAILURE, 0, "%s: the pool of threads is busy", __func__);
+  pool=threads_pool;
+  threads_pool=NULL;
+  pthread_mutex_unlock(&threads_pool_lock);
+  if(pool==NULL) return;
+
+  /* Tell the threads to return and wait for them. */
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown=1;
+  pthread_cond_broadcast(&pool->jobcond);
+  pthread_mutex_unlock(&pool->mutex);
+  for(i=0;i<pool->numthreads;++i)
+    pthread_join(pool->ids[i], NULL);
+
+  /* Clean up. */
+  pthread_cond_destroy(&pool->donecond);
+  pthread_cond_destroy(&pool->jobcond);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->ids);
+  free(pool);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /*******************************************************************/
 /************     Run a function on multiple threads  **************/
 /*******************************************************************/
@@ -332,84 +595,135 @@ gal_threads_attr_barrier_init(pthread_attr_t *attr, pthread_barrier_t *b,
 
       $ grep -r gal_threads_spin_off ./
 */
-void
-gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
-                     size_t numactions, size_t numthreads,
-                     size_t minmapsize, int quietmmap)
+/* Run 'worker' on the 'num' elements of 'prm' (each on one thread) and
+   return when all are finished. When possible, the pool of threads is
+   used, otherwise, new threads are spun off. */
+static void
+threads_run(void *(*worker)(void *), struct gal_threads_params *prm,
+            size_t num, size_t numthreads)
 {
   int err;
+  size_t i;
   pthread_t t;          /* All thread ids saved in this, not used. */
-  char *mmapname=NULL;
   pthread_attr_t attr;
   pthread_barrier_t b;
-  struct gal_threads_params *prm;
-  size_t i, *indexs, thrdcols, numbarriers;
-
-  /* If there are no actions, then just return. */
-  if(numactions==0) return;
-
-  /* Sanity check. */
-  if(numthreads==0)
-    error(EXIT_FAILURE, 0, "%s: the number of threads ('numthreads') "
-          "cannot be zero", __func__);
-
-  /* Allocate the array of parameters structure structures. */
-  errno=0;
-  prm=malloc(numthreads*sizeof *prm);
-  if(prm==NULL)
-    {
-      fprintf(stderr, "%zu bytes could not be allocated for prm.",
-              numthreads*sizeof *prm);
-      exit(EXIT_FAILURE);
-    }
-
-  /* Distribute the actions into the threads: */
-  mmapname=gal_threads_dist_in_threads(numactions, numthreads, minmapsize,
-                                       quietmmap, &indexs, &thrdcols);
 
   /* Do the job: when only one thread is necessary, there is no need to
      spin off one thread, just call the workerfunction directly (spinning
      off threads is expensive). This is for the generic thread spinner
      function, not this simple function where 'numthreads' is a
      constant. */
-  if(numthreads==1)
+  if(num==1)
     {
-      prm[0].id=0;
       prm[0].b=NULL;
-      prm[0].indexs=indexs;
-      prm[0].params=caller_params;
       worker(&prm[0]);
     }
+
+  /* Submit the job to the pool of threads. Since the pool itself waits
+     for all the workers to finish, no barrier is necessary. */
+  else if( threads_pool_reserve(numthreads) )
+    {
+      for(i=0;i<num;++i) prm[i].b=NULL;
+      threads_pool_run(worker, prm, num);
+    }
+
+  /* The pool is busy (for example this is a nested call), so spin off
+     new threads for this job. */
   else
     {
       /* Initialize the attributes. Note that this running thread
          (that spinns off the nt threads) is also a thread, so the
          number the barriers should be one more than the number of
          threads spinned off. */
-      numbarriers = (numactions<numthreads ? numactions : numthreads) + 1;
-      gal_threads_attr_barrier_init(&attr, &b, numbarriers);
+      gal_threads_attr_barrier_init(&attr, &b, num+1);
 
       /* Spin off the threads: */
-      for(i=0;i<numthreads;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            prm[i].id=i;
-            prm[i].b=&b;
-            prm[i].params=caller_params;
-            prm[i].indexs=&indexs[i*thrdcols];
-            err=pthread_create(&t, &attr, worker, &prm[i]);
-            if(err)
-              {
-                fprintf(stderr, "can't create thread %zu", i);
-                exit(EXIT_FAILURE);
-              }
-          }
+      for(i=0;i<num;++i)
+        {
+          prm[i].b=&b;
+          err=pthread_create(&t, &attr, worker, &prm[i]);
+          if(err)
+            {
+              fprintf(stderr, "can't create thread %zu", i);
+              exit(EXIT_FAILURE);
+            }
+        }
 
       /* Wait for all threads to finish and free the spaces. */
       pthread_barrier_wait(&b);
       pthread_attr_destroy(&attr);
       pthread_barrier_destroy(&b);
     }
+}
+
+
+
+
+
+/* Allocate the array of parameters for each thread. */
+static struct gal_threads_params *
+threads_params_alloc(size_t numthreads, void *caller_params)
+{
+  size_t i;
+  struct gal_threads_params *prm;
+
+  /* Allocate the array of parameters structure structures. */
+  errno=0;
+  prm=malloc(numthreads*sizeof *prm);
+  if(prm==NULL)
+    {
+      fprintf(stderr, "%zu bytes could not be allocated for prm.",
+              numthreads*sizeof *prm);
+      exit(EXIT_FAILURE);
+    }
+
+  /* Initialize the generic elements. */
+  for(i=0;i<numthreads;++i)
+    {
+      prm[i].id=i;
+      prm[i].b=NULL;
+      prm[i].indexs=NULL;
+      prm[i].dynamic=NULL;
+      prm[i].params=caller_params;
+      prm[i].counter=prm[i].last=0;
+    }
+  return prm;
+}
+
+
+
+
+
+void
+gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
+                     size_t numactions, size_t numthreads,
+                     size_t minmapsize, int quietmmap)
+{
+  char *mmapname=NULL;
+  struct gal_threads_params *prm;
+  size_t i, *indexs, thrdcols;
+
+  /* If there are no actions, then just return. */
+  if(numactions==0) return;
+
+  /* Sanity check. */
+  if(numthreads==0)
+    error(EXIT_FAILURE, 0, "%s: the number of threads ('numthreads') "
+          "cannot be zero", __func__);
+
+  /* Allocate the array of parameters structure structures. */
+  prm=threads_params_alloc(numthreads, caller_params);
+
+  /* Distribute the actions into the threads: */
+  mmapname=gal_threads_dist_in_threads(numactions, numthreads, minmapsize,
+                                       quietmmap, &indexs, &thrdcols);
+
+  /* Set the indexs of each thread and run the job. Note that the actions
+     are distributed from the first thread, so when there are fewer
+     actions than threads, the last threads will not have any. */
+  for(i=0;i<numthreads && indexs[i*thrdcols]!=GAL_BLANK_SIZE_T;++i)
+    prm[i].indexs=&indexs[i*thrdcols];
+  threads_run(worker, prm, i, numthreads);
 
   /* If 'mmapname' is NULL, then 'indexs' is in RAM and we can safely
      'free' it. However, when its not NULL, then the space for 'indexs' has
@@ -421,3 +735,230 @@ gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
   /* Clean up. */
   free(prm);
 }
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*******************************************************************/
+/************           Dynamic scheduling            **************/
+/*******************************************************************/
+/* With 'gal_threads_spin_off', the actions are distributed between the
+   threads before starting the job. When the actions have very different
+   costs (for example a few very large objects in a crowded field), the
+   thread that gets the most expensive actions will keep all the others
+   waiting. With dynamic scheduling, each thread takes a chunk of the
+   (remaining) actions when it is done with its previous chunk.
+
+   The chunks are "guided": each chunk contains roughly a '1/(2 x
+   numthreads)' fraction of the remaining cost. So the first chunks are
+   large (to decrease the number of times the threads have to lock the
+   mutex) and they gradually become smaller to balance the load at the
+   end. When the caller gives the cost of each action, the actions are
+   sorted by decreasing cost so the most expensive actions are started
+   first (and they will usually be in a chunk of their own). */
+struct threads_dynamic
+{
+  pthread_mutex_t  mutex;  /* Mutex to protect 'next'.                */
+  size_t            next;  /* Position of next action to be given.    */
+  size_t             num;  /* Total number of actions.                */
+  size_t      numthreads;  /* Number of threads.                      */
+  size_t          *order;  /* Order of actions (NULL: no costs given).*/
+  size_t            *cum;  /* Cumulative cost (in 'order').           */
+};
+
+
+
+
+
+/* For sorting the actions by their cost. */
+struct threads_cost
+{
+  size_t  cost;
+  size_t index;
+};
+
+static int
+threads_cost_sort_d(const void *a, const void *b)
+{
+  struct threads_cost *A=(struct threads_cost *)a;
+  struct threads_cost *B=(struct threads_cost *)b;
+
+  /* When the costs are equal, keep the original order (so the order is
+     reproducible). */
+  if(A->cost!=B->cost) return A->cost > B->cost ? -1 : 1;
+  else                 return (A->index > B->index) - (A->index < B->index);
+}
+
+
+
+
+
+/* Prepare the 'order' and 'cum' arrays of the dynamic scheduler. */
+static void
+threads_dynamic_order(struct threads_dynamic *dyn, size_t *costs)
+{
+  size_t i;
+  struct threads_cost *tc;
+
+  /* Allocate the necessary arrays. */
+  errno=0;
+  tc=malloc(dyn->num*sizeof *tc);
+  if(tc==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'tc'", __func__,
+          dyn->num*sizeof *tc);
+  dyn->order=gal_pointer_allocate(GAL_TYPE_SIZE_T, dyn->num, 0, __func__,
+                                  "dyn->order");
+  dyn->cum=gal_pointer_allocate(GAL_TYPE_SIZE_T, dyn->num+1, 0, __func__,
+                                "dyn->cum");
+
+  /* Sort the actions by decreasing cost. */
+  for(i=0;i<dyn->num;++i) { tc[i].cost=costs[i]; tc[i].index=i; }
+  qsort(tc, dyn->num, sizeof *tc, threads_cost_sort_d);
+
+  /* Fill the order and cumulative cost arrays. */
+  dyn->cum[0]=0;
+  for(i=0;i<dyn->num;++i)
+    {
+      dyn->order[i]=tc[i].index;
+      dyn->cum[i+1]=dyn->cum[i]+tc[i].cost;
+    }
+
+  /* Clean up. */
+  free(tc);
+}
+
+
+
+
+
+/* Find the end of the next chunk (starting from 'dyn->next'). This is
+   called when the mutex is locked. */
+static size_t
+threads_dynamic_chunk_end(struct threads_dynamic *dyn)
+{
+  size_t start=dyn->next, low, high, mid, target;
+
+  /* Without any costs, all actions have the same cost. */
+  if(dyn->cum==NULL)
+    {
+      target=(dyn->num-start)/(2*dyn->numthreads);
+      return start + (target ? target : 1);
+    }
+
+  /* Find the smallest end position that covers the target cost. Note that
+     the end position is always larger than 'start'. */
+  target=(dyn->cum[dyn->num]-dyn->cum[start])/(2*dyn->numthreads);
+  target=dyn->cum[start] + (target ? target : 1);
+  low=start+1;
+  high=dyn->num;
+  while(low<high)
+    {
+      mid=low+(high-low)/2;
+      if(dyn->cum[mid]>=target) high=mid; else low=mid+1;
+    }
+  return low;
+}
+
+
+
+
+
+/* Return the index of the next action that the thread should work on. When
+   there are no more actions, 'GAL_BLANK_SIZE_T' will be returned. This
+   function can be used in both the static ('gal_threads_spin_off') and
+   dynamic ('gal_threads_spin_off_dynamic') scheduling, so the worker
+   function can be independent of the scheduling. */
+size_t
+gal_threads_index_next(struct gal_threads_params *tprm)
+{
+  size_t pos;
+  struct threads_dynamic *dyn=tprm->dynamic;
+
+  /* Static scheduling: the indexs of this thread are already
+     available. */
+  if(dyn==NULL)
+    return ( tprm->indexs[tprm->counter]==GAL_BLANK_SIZE_T
+             ? GAL_BLANK_SIZE_T
+             : tprm->indexs[tprm->counter++] );
+
+  /* Dynamic scheduling: if the previous chunk is finished, get a new
+     chunk. */
+  if(tprm->counter==tprm->last)
+    {
+      pthread_mutex_lock(&dyn->mutex);
+      if(dyn->next<dyn->num)
+        {
+          tprm->counter=dyn->next;
+          tprm->last=dyn->next=threads_dynamic_chunk_end(dyn);
+        }
+      pthread_mutex_unlock(&dyn->mutex);
+      if(tprm->counter==tprm->last) return GAL_BLANK_SIZE_T;
+    }
+
+  /* Return the action at this position. */
+  pos=tprm->counter++;
+  return dyn->order ? dyn->order[pos] : pos;
+}
+
+
+
+
+
+/* Similar to 'gal_threads_spin_off', but with dynamic scheduling (see the
+   comments above 'struct threads_dynamic'). The worker function should get
+   the action indexs with 'gal_threads_index_next'. If 'costs' is not NULL,
+   it should have 'numactions' elements with an estimate of the cost of
+   each action (for example the area of an object). */
+void
+gal_threads_spin_off_dynamic(void *(*worker)(void *), void *caller_params,
+                             size_t numactions, size_t numthreads,
+                             size_t *costs)
+{
+  size_t i, num;
+  struct threads_dynamic dyn;
+  struct gal_threads_params *prm;
+
+  /* If there are no actions, then just return. */
+  if(numactions==0) return;
+
+  /* Sanity check. */
+  if(numthreads==0)
+    error(EXIT_FAILURE, 0, "%s: the number of threads ('numthreads') "
+          "cannot be zero", __func__);
+
+  /* Initialize the scheduler. */
+  dyn.next=0;
+  dyn.order=dyn.cum=NULL;
+  dyn.num=numactions;
+  dyn.numthreads=numthreads;
+  if(costs && numthreads>1) threads_dynamic_order(&dyn, costs);
+  pthread_mutex_init(&dyn.mutex, NULL);
+
+  /* Prepare the thread parameters and run the job. */
+  num = numactions<numthreads ? numactions : numthreads;
+  prm=threads_params_alloc(num, caller_params);
+  for(i=0;i<num;++i) prm[i].dynamic=&dyn;
+  threads_run(worker, prm, num, numthreads);
+
+  /* Clean up. */
+  pthread_mutex_destroy(&dyn.mutex);
+  free(dyn.order);
+  free(dyn.cum);
+  free(prm);
+}
@@ -23,6 +23,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <config.h>
 
 #include <math.h>
+#include <float.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <errno.h>
@@ -30,12 +31,16 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <gnuastro/txt.h>
 #include <gnuastro/list.h>
 #include <gnuastro/units.h>
 #include <gnuastro/blank.h>
 #include <gnuastro/table.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/checkset.h>
 #include <gnuastro-internal/tableintern.h>
@@ -717,6 +722,88 @@ gal_txt_image_info(char *filename, gal_list_str_t *lines, size_t *numimg,
 /************************************************************************/
 /***************             Read a txt table             ***************/
 /************************************************************************/
+/* Powers of ten that can be exactly represented in a 'double'. */
+static const double txt_pow10[]={1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,
+                                 1e7,  1e8,  1e9,  1e10, 1e11, 1e12, 1e13,
+                                 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+                                 1e21, 1e22};
+
+
+
+
+
+/* Read a floating point number from 'token'. When all the significant
+   digits (as an integer) and the power of ten are exactly representable
+   in a 'double', the correctly rounded result is just a single
+   multiplication or division (this covers almost all numbers in
+   astronomical catalogs). Otherwise (or when the token isn't a plain
+   decimal number), 'strtod' is used. Therefore the returned value and
+   'tailptr' are always identical to 'strtod'. */
+static double
+txt_strtod(char *token, char **tailptr)
+{
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD==0
+  double out;
+  char *c=token;
+  uint64_t m=0;
+  long e10=0, exponent=0;
+  size_t ndigits=0, nread=0;
+  int negative=0, expnegative=0;
+
+  /* Sign. */
+  if(*c=='-') { negative=1; ++c; } else if(*c=='+') ++c;
+
+  /* Digits before and after the decimal point. Leading zeros aren't
+     significant, and more than 19 significant digits don't fit in
+     'uint64_t'. */
+  for(; isdigit(*c); ++c, ++nread)
+    if(m || *c!='0')
+      {
+        if(++ndigits>19) return strtod(token, tailptr);
+        m = m*10 + (*c-'0');
+      }
+  if(*c=='.')
+    for(++c; isdigit(*c); ++c, ++nread, --e10)
+      if(m || *c!='0')
+        {
+          if(++ndigits>19) return strtod(token, tailptr);
+          m = m*10 + (*c-'0');
+        }
+  if(nread==0) return strtod(token, tailptr);
+
+  /* Exponent. */
+  if(*c=='e' || *c=='E')
+    {
+      ++c;
+      if(*c=='-') { expnegative=1; ++c; } else if(*c=='+') ++c;
+      if( !isdigit(*c) ) return strtod(token, tailptr);
+      for(; isdigit(*c); ++c)
+        if(exponent<100000) exponent = exponent*10 + (*c-'0');
+      e10 += expnegative ? -exponent : exponent;
+    }
+
+  /* Only use the result when the whole token was a number that can be
+     calculated exactly. */
+  if( *c!='\0' ) return strtod(token, tailptr);
+  if(m==0) out=0.0;
+  else if( m<=(1ULL<<53) && e10>=-22 && e10<=22 )
+    out = e10<0 ? (double)m/txt_pow10[-e10] : (double)m*txt_pow10[e10];
+  else return strtod(token, tailptr);
+
+  /* Return the final value. */
+  *tailptr=c;
+  return negative ? -out : out;
+#else
+  /* The floating point operations may use a higher precision than
+     'double', so the result may not be exact. */
+  return strtod(token, tailptr);
+#endif
+}
+
+
+
+
+
 static void
 txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
                size_t i, char *filename, size_t lineno, size_t colnum)
@@ -831,7 +918,7 @@ txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
              condition check (even '=='). If it isn't NaN, then we can
              compare the values. */
         case GAL_TYPE_FLOAT32:
-          f[i]=strtod(token, &tailptr);
+          f[i]=txt_strtod(token, &tailptr);
           if( (*tailptr=='h' || *tailptr=='d') && isdigit(*(tailptr+1)) )
             {
               f[i] = ( *tailptr=='h'
@@ -849,7 +936,7 @@ txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
            in these cases, they are actually coordinates (RA for first, Dec
            for second). */
         case GAL_TYPE_FLOAT64:
-          d[i]=strtod(token, &tailptr);
+          d[i]=txt_strtod(token, &tailptr);
           if( (*tailptr=='h' || *tailptr=='d') && isdigit(*(tailptr+1)) )
             {
               d[i] = ( *tailptr=='h'
@@ -1024,10 +1111,226 @@ txt_fill(char *in_line, char **tokens, size_t maxcolnum,
 
 
 
+/* Parameters for reading the data rows on multiple threads. */
+struct txt_read_params
+{
+  char        *filename;  /* Name of input file (NULL for 'lines').      */
+  char             *map;  /* Memory-mapped contents of 'filename'.       */
+  char        **linearr;  /* Array of input lines (when 'map==NULL').    */
+  size_t        *starts;  /* Start of each chunk (byte or line index).   */
+  size_t      *numlines;  /* Number of lines before each chunk.          */
+  size_t       *numrows;  /* Number of data rows before each chunk.      */
+  size_t      maxcolnum;  /* Largest column number that is necessary.    */
+  gal_data_t      *info;  /* Information of the columns/image.           */
+  gal_data_t       *out;  /* Output dataset(s).                          */
+  int            format;  /* Format of the output (table or image).      */
+  int             count;  /* Only count the lines and data rows.         */
+};
+
+
+
+
+
+static void *
+txt_read_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct txt_read_params *p=(struct txt_read_params *)tprm->params;
+
+  char *end, *line, *buf=NULL, **tokens=NULL;
+  size_t i, c, pos, len, nlines, nrows, buflen=0;
+
+  /* Each thread needs its own array of tokens. */
+  if(p->count==0)
+    {
+      errno=0;
+      tokens=calloc(p->maxcolnum+1, sizeof *tokens);
+      if(tokens==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'tokens'",
+              __func__, (p->maxcolnum+1)*sizeof *tokens);
+    }
+
+  /* Go over all the chunks that were assigned to this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      c=tprm->indexs[i];
+      nlines=nrows=0;
+      pos=p->starts[c];
+      while(pos<p->starts[c+1])
+        {
+          /* Put the next line of a memory-mapped file into the buffer
+             (which also has space for a new-line and '\0', even if the
+             file's last line doesn't end with a new-line). */
+          if(p->map)
+            {
+              end=memchr(p->map+pos, '\n', p->starts[c+1]-pos);
+              len = end ? end-(p->map+pos) : p->starts[c+1]-pos;
+              if(len+2>buflen)
+                {
+                  buflen=len+2;
+                  errno=0;
+                  buf=realloc(buf, buflen);
+                  if(buf==NULL)
+                    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes "
+                          "for 'buf'", __func__, buflen);
+                }
+              memcpy(buf, p->map+pos, len);
+              buf[len]='\n';
+              buf[len+1]='\0';
+              line=buf;
+              pos+=len+1;
+            }
+          else line=p->linearr[pos++];
+
+          /* Count (or parse) the line. */
+          ++nlines;
+          if( gal_txt_line_stat(line) == GAL_TXT_LINESTAT_DATAROW )
+            {
+              if(p->count==0)
+                txt_fill(line, tokens, p->maxcolnum, p->info, p->out,
+                         p->numrows[c]+nrows, p->filename,
+                         p->numlines[c]+nlines, p->map!=NULL, p->format);
+              ++nrows;
+            }
+        }
+
+      /* When counting, keep the number of lines and data rows in this
+         chunk (they will be converted to cumulative values later). */
+      if(p->count)
+        {
+          p->numlines[c+1]=nlines;
+          p->numrows[c+1]=nrows;
+        }
+    }
+
+  /* Clean up, wait until all other threads finish, then return. */
+  free(buf);
+  free(tokens);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Read the data rows of the input on multiple threads. The input (a
+   memory-mapped file or the array of already-read lines) is broken into
+   chunks of complete lines. In a first pass, the number of lines and data
+   rows in each chunk are counted, so in the second pass every chunk knows
+   where its rows should be written in the (already allocated) output.
+
+   When the file can't be memory-mapped (for example it is empty or isn't
+   a regular file), this function will return 0 so the caller reads it
+   serially. */
+static int
+txt_read_threaded(char *filename, gal_list_str_t *lines, gal_data_t *info,
+                  gal_data_t *out, size_t numrows, size_t maxcolnum,
+                  size_t numthreads, size_t minmapsize, int quietmmap,
+                  int format)
+{
+  int fd;
+  char *end;
+  struct stat st;
+  gal_list_str_t *tmp;
+  struct txt_read_params p;
+  size_t c, s, total, numchunks;
+
+  /* Set the basic parameters. */
+  p.map=NULL;
+  p.info=info;
+  p.linearr=NULL;
+  p.format=format;
+  p.filename=filename;
+  p.maxcolnum=maxcolnum;
+  p.out=out;
+
+  /* Prepare the input. */
+  if(filename)
+    {
+      fd=open(filename, O_RDONLY);
+      if(fd==-1) return 0;
+      if( fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size==0 )
+        { close(fd); return 0; }
+      p.map=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if(p.map==MAP_FAILED) return 0;
+      total=st.st_size;
+    }
+  else
+    {
+      total=gal_list_str_number(lines);
+      errno=0;
+      p.linearr=malloc(total*sizeof *p.linearr);
+      if(p.linearr==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
+              "'p.linearr'", __func__, total*sizeof *p.linearr);
+      for(c=0, tmp=lines; tmp!=NULL; tmp=tmp->next) p.linearr[c++]=tmp->v;
+    }
+
+  /* Break the input into chunks (a few for each thread, so the threads
+     that finish sooner can take more). The chunks of a file have to start
+     at the start of a line. */
+  numchunks = 4*numthreads < total ? 4*numthreads : total;
+  errno=0;
+  p.starts=malloc((numchunks+1)*sizeof *p.starts);
+  p.numrows=calloc(numchunks+1, sizeof *p.numrows);
+  p.numlines=calloc(numchunks+1, sizeof *p.numlines);
+  if(p.starts==NULL || p.numrows==NULL || p.numlines==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate the chunk "
+          "information", __func__);
+  p.starts[0]=0;
+  for(c=1;c<numchunks;++c)
+    {
+      s=c*total/numchunks;
+      if(p.map)
+        {
+          if(s<p.starts[c-1]) s=p.starts[c-1];
+          end=memchr(p.map+s, '\n', total-s);
+          s = end ? end-p.map+1 : total;
+        }
+      p.starts[c]=s;
+    }
+  p.starts[numchunks]=total;
+
+  /* Count the lines and data rows in each chunk and make them
+     cumulative. */
+  p.count=1;
+  gal_threads_spin_off(txt_read_on_thread, &p, numchunks, numthreads,
+                       minmapsize, quietmmap);
+  for(c=0;c<numchunks;++c)
+    {
+      p.numrows[c+1]  += p.numrows[c];
+      p.numlines[c+1] += p.numlines[c];
+    }
+  if(p.numrows[numchunks]>numrows)
+    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix the "
+          "problem. The number of data rows (%zu) is more than the number "
+          "found when reading the table's information (%zu)",
+          __func__, PACKAGE_BUGREPORT, p.numrows[numchunks], numrows);
+
+  /* Parse the data rows. */
+  p.count=0;
+  gal_threads_spin_off(txt_read_on_thread, &p, numchunks, numthreads,
+                       minmapsize, quietmmap);
+
+  /* Clean up and return. */
+  if(p.map) munmap(p.map, total);
+  free(p.numlines);
+  free(p.linearr);
+  free(p.numrows);
+  free(p.starts);
+  return 1;
+}
+
+
+
+
+
 static gal_data_t *
 txt_read(char *filename, gal_list_str_t *lines, size_t *dsize,
-         gal_data_t *info, gal_list_sizet_t *indexll, size_t minmapsize,
-         int quietmmap, int format)
+         gal_data_t *info, gal_list_sizet_t *indexll, size_t numthreads,
+         size_t minmapsize, int quietmmap, int format)
 {
   FILE *fp;
   int test;
@@ -1120,7 +1423,13 @@ txt_read(char *filename, gal_list_str_t *lines, size_t *dsize,
     error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'tokens'",
           __func__, (maxcolnum+1)*sizeof *tokens);
 
-  if(filename)
+  /* When there are rows to read and more than one thread is requested,
+     parse the rows in parallel. */
+  if( numthreads>1 && dsize[0]
+      && txt_read_threaded(filename, lines, info, out, dsize[0], maxcolnum,
+                           numthreads, minmapsize, quietmmap, format) )
+    free(line);
+  else if(filename)
     {
       /* Open the file. */
       errno=0;
@@ -1168,8 +1477,24 @@ gal_txt_table_read(char *filename, gal_list_str_t *lines, size_t numrows,
                    gal_data_t *colinfo, gal_list_sizet_t *indexll,
                    size_t minmapsize, int quietmmap)
 {
-  return txt_read(filename, lines, &numrows, colinfo, indexll, minmapsize,
-                  quietmmap, TXT_FORMAT_TABLE);
+  return txt_read(filename, lines, &numrows, colinfo, indexll, 1,
+                  minmapsize, quietmmap, TXT_FORMAT_TABLE);
+}
+
+
+
+
+
+/* Similar to 'gal_txt_table_read', but the rows are parsed on
+   'numthreads' threads. */
+gal_data_t *
+gal_txt_table_read_threaded(char *filename, gal_list_str_t *lines,
+                            size_t numrows, gal_data_t *colinfo,
+                            gal_list_sizet_t *indexll, size_t numthreads,
+                            size_t minmapsize, int quietmmap)
+{
+  return txt_read(filename, lines, &numrows, colinfo, indexll, numthreads,
+                  minmapsize, quietmmap, TXT_FORMAT_TABLE);
 }
 
 
@@ -1179,6 +1504,21 @@ gal_txt_table_read(char *filename, gal_list_str_t *lines, size_t numrows,
 gal_data_t *
 gal_txt_image_read(char *filename, gal_list_str_t *lines, size_t minmapsize,
                    int quietmmap)
+{
+  return gal_txt_image_read_threaded(filename, lines, 1, minmapsize,
+                                     quietmmap);
+}
+
+
+
+
+
+/* Similar to 'gal_txt_image_read', but the rows are parsed on
+   'numthreads' threads. */
+gal_data_t *
+gal_txt_image_read_threaded(char *filename, gal_list_str_t *lines,
+                            size_t numthreads, size_t minmapsize,
+                            int quietmmap)
 {
   size_t numimg, dsize[2];
   gal_data_t *img, *imginfo;
@@ -1188,8 +1528,8 @@ gal_txt_image_read(char *filename, gal_list_str_t *lines, size_t minmapsize,
   imginfo=gal_txt_image_info(filename, lines, &numimg, dsize);
 
   /* Read the table. */
-  img=txt_read(filename, lines, dsize, imginfo, indexll, minmapsize,
-               quietmmap, TXT_FORMAT_IMAGE);
+  img=txt_read(filename, lines, dsize, imginfo, indexll, numthreads,
+               minmapsize, quietmmap, TXT_FORMAT_IMAGE);
 
   /* Clean up and return. */
   gal_data_free(imginfo);
@@ -1394,41 +1734,327 @@ make_fmts_for_printf(gal_data_t *datall, int leftadjust, size_t *len)
 
 
 
+/* Number of rows that are formatted into each block when writing. */
+#define TXT_WRITE_BLOCK_ROWS 10000
+
+/* The values of each column are either written with 'snprintf' or with
+   the faster (but identical) dedicated functions below. */
+enum txt_write_methods
+{
+  TXT_WRITE_PRINTF,
+  TXT_WRITE_SIGNED,
+  TXT_WRITE_UNSIGNED,
+  TXT_WRITE_STRING,
+};
+
+/* Information for writing each column. */
+struct txt_write_col
+{
+  void           *array;  /* Array of the column's values.               */
+  int              type;  /* Type of the column.                         */
+  char             *fmt;  /* Full 'printf' format of the column.         */
+  size_t          width;  /* Minimum width (only for fast methods).      */
+  int            method;  /* Method of writing (from 'txt_write_methods').*/
+};
+
+/* A growing buffer that keeps the formatted rows of one block. */
+struct txt_write_buf
+{
+  char             *buf;  /* Formatted rows.                             */
+  size_t            len;  /* Number of used bytes in 'buf'.              */
+  size_t           size;  /* Number of allocated bytes in 'buf'.         */
+};
+
+/* Parameters for formatting the rows on multiple threads. */
+struct txt_write_params
+{
+  struct txt_write_col *cols;  /* Information of each column.            */
+  size_t            numcols;  /* Number of columns in one row.           */
+  size_t           rowwidth;  /* Elements in one row (0: 1D columns).    */
+  size_t            numrows;  /* Total number of rows.                   */
+  size_t           firstrow;  /* First row of this round of blocks.      */
+  struct txt_write_buf *bufs; /* One buffer for each block of the round. */
+};
+
+
+
+
+
+/* Make sure there are at least 'n' free bytes in the buffer. */
 static void
-txt_print_value(FILE *fp, void *array, int type, size_t ind, char *fmt)
+txt_write_reserve(struct txt_write_buf *b, size_t n)
+{
+  if(b->len+n <= b->size) return;
+  b->size = 2*(b->len+n);
+  errno=0;
+  b->buf=realloc(b->buf, b->size);
+  if(b->buf==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'b->buf'",
+          __func__, b->size);
+}
+
+
+
+
+
+/* Format one value with 'snprintf'. */
+static int
+txt_snprint_value(char *str, size_t size, void *array, int type, size_t ind,
+                  char *fmt)
 {
   switch(type)
     {
       /* Numerical types. */
-    case GAL_TYPE_UINT8:   fprintf(fp, fmt, ((uint8_t *) array)[ind]); break;
-    case GAL_TYPE_INT8:    fprintf(fp, fmt, ((int8_t *)  array)[ind]); break;
-    case GAL_TYPE_UINT16:  fprintf(fp, fmt, ((uint16_t *)array)[ind]); break;
-    case GAL_TYPE_INT16:   fprintf(fp, fmt, ((int16_t *) array)[ind]); break;
-    case GAL_TYPE_UINT32:  fprintf(fp, fmt, ((uint32_t *)array)[ind]); break;
-    case GAL_TYPE_INT32:   fprintf(fp, fmt, ((int32_t *) array)[ind]); break;
-    case GAL_TYPE_UINT64:  fprintf(fp, fmt, ((uint64_t *)array)[ind]); break;
-    case GAL_TYPE_INT64:   fprintf(fp, fmt, ((int64_t *) array)[ind]); break;
-    case GAL_TYPE_FLOAT32: fprintf(fp, fmt, ((float *)   array)[ind]); break;
-    case GAL_TYPE_FLOAT64: fprintf(fp, fmt, ((double *)  array)[ind]); break;
-
-      /* Special consideration for strings. */
-    case GAL_TYPE_STRING:
-      if( !strcmp( ((char **)array)[ind], GAL_BLANK_STRING ) )
-        fprintf(fp, fmt, GAL_BLANK_STRING);
-      else
-        fprintf(fp, fmt, ((char **)array)[ind]);
-      break;
-
+    case GAL_TYPE_UINT8:   return snprintf(str, size, fmt,
+                                           ((uint8_t *) array)[ind]);
+    case GAL_TYPE_INT8:    return snprintf(str, size, fmt,
+                                           ((int8_t *)  array)[ind]);
+    case GAL_TYPE_UINT16:  return snprintf(str, size, fmt,
+                                           ((uint16_t *)array)[ind]);
+    case GAL_TYPE_INT16:   return snprintf(str, size, fmt,
+                                           ((int16_t *) array)[ind]);
+    case GAL_TYPE_UINT32:  return snprintf(str, size, fmt,
+                                           ((uint32_t *)array)[ind]);
+    case GAL_TYPE_INT32:   return snprintf(str, size, fmt,
+                                           ((int32_t *) array)[ind]);
+    case GAL_TYPE_UINT64:  return snprintf(str, size, fmt,
+                                           ((uint64_t *)array)[ind]);
+    case GAL_TYPE_INT64:   return snprintf(str, size, fmt,
+                                           ((int64_t *) array)[ind]);
+    case GAL_TYPE_FLOAT32: return snprintf(str, size, fmt,
+                                           ((float *)   array)[ind]);
+    case GAL_TYPE_FLOAT64: return snprintf(str, size, fmt,
+                                           ((double *)  array)[ind]);
+    case GAL_TYPE_STRING:  return snprintf(str, size, fmt,
+                                           ((char **)   array)[ind]);
     default:
       error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
             __func__, type);
     }
+
+  /* Control should not reach here. */
+  return 0;
+}
+
+
+
+
+
+/* Write one value of a column into the buffer. The dedicated methods
+   give exactly the same output as the '%-Nd', '%-Nu' or '%-Ns' formats
+   (followed by a single space) that are written by
+   'make_fmts_for_printf'. */
+static void
+txt_write_value(struct txt_write_buf *b, struct txt_write_col *col,
+                size_t ind)
+{
+  int n;
+  uint64_t u=0;
+  char digits[24], *c, *str;
+  size_t start=b->len, len=0;
+
+  switch(col->method)
+    {
+    case TXT_WRITE_SIGNED:
+    case TXT_WRITE_UNSIGNED:
+      /* Read the value as a 64-bit integer. */
+      switch(col->type)
+        {
+        case GAL_TYPE_UINT8:  u=((uint8_t  *)col->array)[ind];          break;
+        case GAL_TYPE_UINT16: u=((uint16_t *)col->array)[ind];          break;
+        case GAL_TYPE_UINT32: u=((uint32_t *)col->array)[ind];          break;
+        case GAL_TYPE_UINT64: u=((uint64_t *)col->array)[ind];          break;
+        case GAL_TYPE_INT8:   u=(int64_t)((int8_t  *)col->array)[ind];  break;
+        case GAL_TYPE_INT16:  u=(int64_t)((int16_t *)col->array)[ind];  break;
+        case GAL_TYPE_INT32:  u=(int64_t)((int32_t *)col->array)[ind];  break;
+        case GAL_TYPE_INT64:  u=(int64_t)((int64_t *)col->array)[ind];  break;
+        default:
+          error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to "
+                "fix the problem. Type code %d is not an integer", __func__,
+                PACKAGE_BUGREPORT, col->type);
+        }
+
+      /* Write the digits from the end, then copy them into the buffer
+         (with the sign when necessary). */
+      txt_write_reserve(b, 25+col->width);
+      if( col->method==TXT_WRITE_SIGNED && (int64_t)u<0 )
+        {
+          b->buf[b->len++]='-';
+          u=-u;
+        }
+      c=digits+sizeof digits;
+      do { *--c = '0' + u%10; u/=10; } while(u);
+      len=digits+sizeof digits-c;
+      memcpy(b->buf+b->len, c, len);
+      b->len+=len;
+      break;
+
+    case TXT_WRITE_STRING:
+      str=((char **)col->array)[ind];
+      len=strlen(str);
+      txt_write_reserve(b, len+col->width+1);
+      memcpy(b->buf+b->len, str, len);
+      b->len+=len;
+      break;
+
+    default:
+      txt_write_reserve(b, 64);
+      n=txt_snprint_value(b->buf+b->len, b->size-b->len, col->array,
+                          col->type, ind, col->fmt);
+      if(n>=b->size-b->len)
+        {
+          txt_write_reserve(b, n+1);
+          n=txt_snprint_value(b->buf+b->len, b->size-b->len, col->array,
+                              col->type, ind, col->fmt);
+        }
+      b->len+=n;
+      return;
+    }
+
+  /* Pad the value to the column's width and put the separating space. */
+  len=b->len-start;
+  if(len<col->width)
+    {
+      memset(b->buf+b->len, ' ', col->width-len);
+      b->len+=col->width-len;
+    }
+  b->buf[b->len++]=' ';
+}
+
+
+
+
+
+/* Format a block of rows into its buffer. */
+static void *
+txt_write_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct txt_write_params *p=(struct txt_write_params *)tprm->params;
+
+  struct txt_write_buf *b;
+  size_t i, j, row, first, last;
+
+  /* Go over all the blocks that were assigned to this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Set the range of rows in this block. */
+      b=&p->bufs[tprm->indexs[i]];
+      first=p->firstrow + tprm->indexs[i]*TXT_WRITE_BLOCK_ROWS;
+      last = ( first+TXT_WRITE_BLOCK_ROWS < p->numrows
+               ? first+TXT_WRITE_BLOCK_ROWS : p->numrows );
+
+      /* Format the rows: in a 2D dataset, all the elements of a row use
+         the same (first) column information. */
+      b->len=0;
+      for(row=first; row<last; ++row)
+        {
+          for(j=0;j<p->numcols;++j)
+            if(p->rowwidth) txt_write_value(b, p->cols, row*p->rowwidth+j);
+            else            txt_write_value(b, &p->cols[j], row);
+          txt_write_reserve(b, 1);
+          b->buf[b->len++]='\n';
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
 }
 
 
 
 
 
+/* Write all the rows of the input. The rows are formatted in blocks (on
+   'numthreads' threads) into separate buffers and each buffer is then
+   written to the output with a single 'fwrite'. To keep the memory
+   bounded, this is done in rounds of 'numthreads' blocks. */
+static void
+txt_write_rows(FILE *fp, gal_data_t *input, char **fmts, size_t numthreads)
+{
+  char *f;
+  gal_data_t *data;
+  size_t i, numblocks;
+  struct txt_write_params p;
+
+  /* Set the basic parameters. */
+  p.numcols=0;
+  for(data=input;data!=NULL;data=data->next) ++p.numcols;
+  if(input->ndim==2)
+    {
+      p.numcols=p.rowwidth=input->dsize[1];
+      p.numrows=input->dsize[0];
+    }
+  else
+    {
+      p.rowwidth=0;
+      p.numrows=input->size;
+    }
+
+  /* Allocate the column information and the buffers. */
+  errno=0;
+  p.cols=malloc( (input->ndim==2 ? 1 : p.numcols) * sizeof *p.cols );
+  p.bufs=calloc(numthreads, sizeof *p.bufs);
+  if(p.cols==NULL || p.bufs==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate the column "
+          "information or buffers", __func__);
+
+  /* Set the information of each column. The dedicated methods are only
+     used when there is no precision in the format (the format ends with
+     the conversion character and a space). */
+  i=0;
+  for(data=input;data!=NULL;data=data->next)
+    {
+      f=fmts[i*FMTS_COLS];
+      p.cols[i].type=data->type;
+      p.cols[i].array=data->array;
+      p.cols[i].fmt=f;
+      p.cols[i].width = data->disp_width>0 ? data->disp_width : 0;
+      if( strchr(f, '.') ) p.cols[i].method=TXT_WRITE_PRINTF;
+      else
+        switch( f[strlen(f)-2] )
+          {
+          case 'd': p.cols[i].method=TXT_WRITE_SIGNED;   break;
+          case 'u': p.cols[i].method=TXT_WRITE_UNSIGNED; break;
+          case 's': p.cols[i].method=TXT_WRITE_STRING;   break;
+          default:  p.cols[i].method=TXT_WRITE_PRINTF;
+          }
+      ++i;
+    }
+
+  /* Format and write the rows in rounds. */
+  for(p.firstrow=0; p.firstrow<p.numrows;
+      p.firstrow+=numthreads*TXT_WRITE_BLOCK_ROWS)
+    {
+      /* Number of blocks in this round. */
+      numblocks=( p.numrows-p.firstrow + TXT_WRITE_BLOCK_ROWS-1 )
+        / TXT_WRITE_BLOCK_ROWS;
+      if(numblocks>numthreads) numblocks=numthreads;
+
+      /* Format the blocks. */
+      gal_threads_spin_off(txt_write_on_thread, &p, numblocks, numthreads,
+                           input->minmapsize, input->quietmmap);
+
+      /* Write the buffers in order. */
+      errno=0;
+      for(i=0;i<numblocks;++i)
+        if( fwrite(p.bufs[i].buf, 1, p.bufs[i].len, fp)!=p.bufs[i].len )
+          error(EXIT_FAILURE, errno, "%s: couldn't write %zu bytes",
+                __func__, p.bufs[i].len);
+    }
+
+  /* Clean up. */
+  for(i=0;i<numthreads;++i) free(p.bufs[i].buf);
+  free(p.bufs);
+  free(p.cols);
+}
+
+
+
+
+
+
 static void
 txt_write_metadata(FILE *fp, gal_data_t *datall, char **fmts)
 {
@@ -1568,11 +2194,27 @@ void
 gal_txt_write(gal_data_t *input, struct gal_fits_list_key_t **keylist,
               gal_list_str_t *comment, char *filename,
               uint8_t colinfoinstdout)
+{
+  gal_txt_write_threaded(input, keylist, comment, filename, colinfoinstdout,
+                         1);
+}
+
+
+
+
+
+/* Similar to 'gal_txt_write', but the rows will be formatted on
+   'numthreads' threads. */
+void
+gal_txt_write_threaded(gal_data_t *input,
+                       struct gal_fits_list_key_t **keylist,
+                       gal_list_str_t *comment, char *filename,
+                       uint8_t colinfoinstdout, size_t numthreads)
 {
   FILE *fp;
   char **fmts;
   gal_list_str_t *strt;
-  size_t i, j, num=0, fmtlen;
+  size_t i, num=0, fmtlen;
   gal_data_t *data, *next2d=NULL;
 
   /* Make sure input is valid. */
@@ -1664,25 +2306,12 @@ gal_txt_write(gal_data_t *input, struct gal_fits_list_key_t **keylist,
          the basic text formatting (like extra white space to keep the
          columns under each other). */
       else
-        for(i=0;i<input->size;++i)                        /* Row.    */
-          {
-            j=0;
-            for(data=input;data!=NULL;data=data->next)    /* Column. */
-              txt_print_value(fp, data->array, data->type, i,
-                            fmts[j++ * FMTS_COLS]);
-            fprintf(fp, "\n");
-          }
+        txt_write_rows(fp, input, fmts, numthreads);
       break;
 
 
     case 2:
-      for(i=0;i<input->dsize[0];++i)
-        {
-          for(j=0;j<input->dsize[1];++j)
-            txt_print_value(fp, input->array, input->type,
-                            i*input->dsize[1]+j, fmts[0]);
-          fprintf(fp, "\n");
-        }
+      txt_write_rows(fp, input, fmts, numthreads);
       break;
 
 
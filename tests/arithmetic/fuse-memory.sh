@@ -0,0 +1,85 @@
+# Check that a long chain of element-wise operators doesn't keep all its
+# operands in memory (they are fused into one expression, see
+# 'bin/arithmetic/fuse.c').
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2020, Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+#
+# The input is a 2000x2000 (16MB) image that is used as 40 operands of
+# the chain (so keeping all of them would need 640MB). The memory of the
+# program is limited to 300MB: the chain should be evaluated when its
+# leaves become too large, so it should easily fit.
+prog=arithmetic
+execname=../bin/$prog/ast$prog
+mkprof=../bin/mkprof/astmkprof
+cat=$topsrc/tests/mkprof/mkprofcat1.txt
+img=fuse-memory-in.fits
+maxmem=300000
+numop=40
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are
+# three types of dependencies:
+#
+#   - The executables were not made (for example due to a configure
+#     option).
+#
+#   - Catalog doesn't exist (problem in tarball release).
+#
+#   - The shell can't limit the virtual memory of its processes.
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $mkprof   ]; then echo "$mkprof not created.";   exit 77; fi
+if [ ! -f $cat      ]; then echo "$cat does not exist.";   exit 77; fi
+if ! (ulimit -v $maxmem) 2> /dev/null; then
+    echo "Memory can't be limited with 'ulimit -v'."; exit 77;
+fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The input image is built with MakeProfiles (its name is the same as
+# 'mkprof/mosaic1.sh', so it is renamed).
+$mkprof $cat --mergedsize=2000,2000 --oversample=1 \
+    && mv 0_mkprofcat1.fits $img
+if [ ! -f $img ]; then echo "$img could not be made."; exit 99; fi
+
+# Build the chain of operands: 'img img + img + ... img +'.
+chain=$img
+i=1
+while [ $i -lt $numop ]; do chain="$chain $img +"; i=$((i+1)); done
+
+# 'check_with_program' (for example Valgrind) needs much more memory than
+# the program itself, so it isn't used here.
+(ulimit -v $maxmem; $execname $chain -g1 --numthreads=1 \
+                              --output=fuse-memory.fits)
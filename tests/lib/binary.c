@@ -0,0 +1,223 @@
+/*********************************************************************
+A test program to check the multi-threaded binary operations of Gnuastro.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2020, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gnuastro/binary.h"
+#include "gnuastro/threads.h"
+
+
+/* Number of threads to check (the first is the single-threaded
+   reference). */
+#define NUMTHREADS 5
+static size_t numthreads[NUMTHREADS]={1, 2, 3, 4, 7};
+
+
+
+
+
+/* Fill the dataset with pseudo-random values (so the test is
+   reproducible on all systems): roughly 'fraction' of the elements will be
+   1, and the rest 0. When 'other' is non-zero, some elements will have a
+   value of 2 (that should not be changed by erosion and dilation). */
+static gal_data_t *
+random_binary(size_t ndim, size_t *dsize, double fraction, int other,
+              uint32_t seed)
+{
+  size_t i;
+  double r;
+  uint8_t *arr;
+  gal_data_t *out=gal_data_alloc(NULL, GAL_TYPE_UINT8, ndim, dsize, NULL,
+                                 0, -1, 1, NULL, NULL, NULL);
+
+  arr=out->array;
+  for(i=0;i<out->size;++i)
+    {
+      seed = seed*1664525 + 1013904223;
+      r = (seed>>8) / 16777216.0f;
+      arr[i] = ( other && r>0.99 ) ? 2 : ( r<fraction ? 1 : 0 );
+    }
+  return out;
+}
+
+
+
+
+
+/* Simple erosion ('d0e1==1') or dilation ('d0e1==0') of a 2D dataset for
+   comparison: each pass is done on a copy of the previous pass. */
+static void
+reference_erode_dilate(gal_data_t *data, size_t num, int connectivity,
+                       int d0e1)
+{
+  uint8_t f, b, *in, *out=data->array;
+  size_t n, i, j, ni, nj, h=data->dsize[0], w=data->dsize[1];
+  long di, dj;
+
+  f = d0e1 ? 0 : 1;
+  b = d0e1 ? 1 : 0;
+  in=malloc(data->size);
+  if(in==NULL) { fprintf(stderr, "allocation failed.\n"); exit(1); }
+
+  for(n=0;n<num;++n)
+    {
+      memcpy(in, out, data->size);
+      for(i=0;i<h;++i)
+        for(j=0;j<w;++j)
+          if(in[i*w+j]==b)
+            for(di=-1;di<=1;++di)
+              for(dj=-1;dj<=1;++dj)
+                {
+                  if( (di==0 && dj==0)
+                      || (connectivity==1 && di && dj) ) continue;
+                  ni=i+di;
+                  nj=j+dj;
+                  if(ni<h && nj<w && in[ni*w+nj]==f) out[i*w+j]=f;
+                }
+    }
+  free(in);
+}
+
+
+
+
+
+/* Check the labels of the multi-threaded connected components with the
+   single-threaded ones. */
+static int
+check_labels(size_t ndim, size_t *dsize, int connectivity, double fraction)
+{
+  size_t t, n, nref;
+  gal_data_t *binary, *ref=NULL, *lab;
+
+  binary=random_binary(ndim, dsize, fraction, 0, 1);
+  nref=gal_binary_connected_components(binary, &ref, connectivity);
+  for(t=1;t<NUMTHREADS;++t)
+    {
+      lab=NULL;
+      n=gal_binary_connected_components_threaded(binary, &lab, connectivity,
+                                                  numthreads[t]);
+      if( n!=nref || memcmp(lab->array, ref->array,
+                            ref->size*gal_type_sizeof(ref->type)) )
+        {
+          fprintf(stderr, "%zuD labels (connectivity %d) on %zu threads "
+                  "are different from one thread (%zu and %zu labels).\n",
+                  ndim, connectivity, numthreads[t], n, nref);
+          return 1;
+        }
+      gal_data_free(lab);
+    }
+  printf("%zuD labels (connectivity %d, %zu labels): identical on all "
+         "threads.\n", ndim, connectivity, nref);
+  gal_data_free(binary);
+  gal_data_free(ref);
+  return 0;
+}
+
+
+
+
+
+/* Check the erosion and dilation with the simple implementation above on
+   all the numbers of threads. */
+static int
+check_morphology(size_t *dsize, size_t num, int connectivity, int d0e1,
+                 int other)
+{
+  size_t t;
+  gal_data_t *input, *ref, *out;
+  double f=0.5/((2*num+1)*(2*num+1));
+
+  /* The fraction of the foreground is set based on the number of
+     erosions or dilations, so the output isn't fully 0 or 1. */
+  input=random_binary(2, dsize, d0e1 ? 1-f : f, other, 2);
+  ref=gal_data_copy(input);
+  reference_erode_dilate(ref, num, connectivity, d0e1);
+  for(t=0;t<NUMTHREADS;++t)
+    {
+      out = ( d0e1
+              ? gal_binary_erode_threaded(input, num, connectivity, 0,
+                                          numthreads[t])
+              : gal_binary_dilate_threaded(input, num, connectivity, 0,
+                                           numthreads[t]) );
+      if( memcmp(out->array, ref->array, ref->size) )
+        {
+          fprintf(stderr, "%zu %s (connectivity %d) of %zux%zu on %zu "
+                  "threads is different from the reference.\n", num,
+                  d0e1 ? "erosions" : "dilations", connectivity, dsize[0],
+                  dsize[1], numthreads[t]);
+          return 1;
+        }
+      gal_data_free(out);
+    }
+  printf("%zu %s (connectivity %d) of %zux%zu: identical to the "
+         "reference on all threads.\n", num, d0e1 ? "erosions" : "dilations",
+         connectivity, dsize[0], dsize[1]);
+  gal_data_free(input);
+  gal_data_free(ref);
+  return 0;
+}
+
+
+
+
+
+/* Check the multi-threaded connected component labeling and the
+   bit-packed erosion and dilation against their single-threaded (or
+   simple) implementations. The labels have to be identical for any
+   number of threads. The datasets are large enough to be labeled on
+   multiple threads and their width is not a multiple of 64 (so the
+   bit-packed erosion and dilation also have partial words). Some
+   datasets have values of 2 (that should remain unchanged) and 40
+   erosions or dilations will use the distance transform. */
+int
+main(void)
+{
+  int c, d0e1, fail=0;
+  size_t i, num[3]={1, 3, 40};
+  size_t dsize2[2]={613, 701}, dsize3[3]={71, 67, 73};
+  size_t msize[2][2]={ {67, 131}, {300, 517} };
+
+  /* Connected components. */
+  for(c=1;c<=2;++c)
+    {
+      fail |= check_labels(2, dsize2, c, 0.55);
+      fail |= check_labels(2, dsize2, c, 0.3);
+    }
+  for(c=1;c<=3;++c)
+    fail |= check_labels(3, dsize3, c, 0.3);
+
+  /* Erosion and dilation. */
+  for(d0e1=0;d0e1<=1;++d0e1)
+    for(c=1;c<=2;++c)
+      for(i=0;i<3;++i)
+        {
+          fail |= check_morphology(msize[0], num[i], c, d0e1, 0);
+          fail |= check_morphology(msize[1], num[i], c, d0e1, 0);
+          fail |= check_morphology(msize[1], num[i], c, d0e1, 1);
+        }
+
+  /* Clean up and return. */
+  gal_threads_pool_free();
+  return fail ? EXIT_FAILURE : EXIT_SUCCESS;
+}
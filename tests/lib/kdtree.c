@@ -0,0 +1,583 @@
+/*********************************************************************
+A test program to check the k-d tree and the matching of Gnuastro.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2020, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <math.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gnuastro/match.h"
+#include "gnuastro/kdtree.h"
+#include "gnuastro/threads.h"
+
+
+/* Number of threads to check (the first is the single-threaded
+   reference). */
+#define NUMTHREADS 4
+static size_t numthreads[NUMTHREADS]={1, 2, 4, 7};
+
+
+/* Kinds of coordinates for the tests. */
+enum coord_kinds
+{
+  COORD_RANDOM,                 /* Random values.                       */
+  COORD_CONSTANT,               /* Constant first coordinate.           */
+  COORD_GRID,                   /* Few distinct (repeated) values.      */
+};
+
+
+/* Pseudo-random value between 0 and 1 (so the test is reproducible on
+   all systems). */
+#define RANDOM(S) ( ( (S) = (S)*1664525 + 1013904223 ) >> 8 ) / 16777216.0
+
+
+
+
+
+/* Make 'ndim' 'float64' columns of 'size' rows. When 'nanfrac' is
+   non-zero, roughly that fraction of the rows will have a NaN in one of
+   their coordinates. */
+static gal_data_t *
+make_coords(size_t ndim, size_t size, int kind, double nanfrac,
+            uint32_t seed)
+{
+  size_t d, i;
+  double *arr;
+  gal_data_t *out=NULL, *col;
+
+  /* Allocate the columns (the first column should be at the top of the
+     list). */
+  for(d=ndim;d>0;--d)
+    {
+      col=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &size, NULL, 0, -1, 1,
+                         NULL, NULL, NULL);
+      col->next=out;
+      out=col;
+    }
+
+  /* Fill the coordinates. */
+  for(d=0, col=out; col!=NULL; ++d, col=col->next)
+    {
+      arr=col->array;
+      for(i=0;i<size;++i)
+        switch(kind)
+          {
+          case COORD_RANDOM:   arr[i] = 100*RANDOM(seed);               break;
+          case COORD_CONSTANT: arr[i] = d ? 100*RANDOM(seed) : 50;      break;
+          case COORD_GRID:     arr[i] = floor(10*RANDOM(seed));         break;
+          default:
+            fprintf(stderr, "%s: kind %d not recognized.\n", __func__,
+                    kind);
+            exit(EXIT_FAILURE);
+          }
+    }
+
+  /* Put NaN in some rows (on different dimensions). */
+  if(nanfrac>0)
+    for(i=0;i<size;++i)
+      if( RANDOM(seed) < nanfrac )
+        {
+          col=out;
+          for(d=i%ndim; d>0; --d) col=col->next;
+          ((double *)(col->array))[i]=NAN;
+        }
+  return out;
+}
+
+
+
+
+
+/* The point in row 'row' of 'coords'. */
+static void
+get_point(gal_data_t *coords, size_t row, double *point)
+{
+  size_t d=0;
+  gal_data_t *col;
+  for(col=coords; col!=NULL; col=col->next)
+    point[d++]=((double *)(col->array))[row];
+}
+
+
+
+
+
+/* Squared distance of row 'row' to the point (calculated like the k-d
+   tree, so there is no round-off difference). */
+static double
+dist2(gal_data_t *coords, size_t row, double *point)
+{
+  size_t d=0;
+  double t, out=0;
+  gal_data_t *col;
+  for(col=coords; col!=NULL; col=col->next)
+    { t=((double *)(col->array))[row]-point[d++]; out+=t*t; }
+  return out;
+}
+
+
+
+
+
+/* The 'k' nearest neighbours by brute force (only rows with a smaller
+   distance, or an equal distance and a smaller index, are before each
+   row). Return the number that was found. */
+static size_t
+brute_knn(gal_data_t *coords, double *point, size_t k, size_t *indexs,
+          double *dists)
+{
+  double d;
+  size_t i, j, n=0;
+
+  for(i=0;i<coords->size;++i)
+    {
+      d=dist2(coords, i, point);
+      if(isnan(d)) continue;
+      for(j=n; j>0 && dists[j-1]>d; --j)
+        if(j<k) { indexs[j]=indexs[j-1]; dists[j]=dists[j-1]; }
+      if(j<k)
+        {
+          indexs[j]=i;
+          dists[j]=d;
+          if(n<k) ++n;
+        }
+    }
+  for(i=0;i<n;++i) dists[i]=sqrt(dists[i]);
+  return n;
+}
+
+
+
+
+
+/* Compare the indexs found by the tree (that can be in any order) with
+   the rows that are in the radius ('radius>0') or box by brute force. */
+static int
+check_found(gal_data_t *coords, double *point, double radius, double *low,
+            double *high, size_t *found, size_t num, char *msg)
+{
+  gal_data_t *col;
+  double v, r2=radius*radius;
+  size_t d, i, n=0, in, ndim=gal_list_data_number(coords);
+  unsigned char *flag=calloc(coords->size, 1);
+
+  if(flag==NULL) { fprintf(stderr, "allocation failed.\n"); exit(1); }
+  for(i=0;i<num;++i)
+    if( found[i]>=coords->size || flag[found[i]]++ )
+      {
+        fprintf(stderr, "%s: index %zu is wrong or repeated.\n", msg,
+                found[i]);
+        free(flag);
+        return 1;
+      }
+  for(i=0;i<coords->size;++i)
+    {
+      if(radius>0) in = dist2(coords, i, point) <= r2;
+      else
+        for(in=1, d=0, col=coords; d<ndim; ++d, col=col->next)
+          {
+            v=((double *)(col->array))[i];
+            if( !(v>=low[d] && v<=high[d]) ) in=0;
+          }
+      if(in!=flag[i])
+        {
+          fprintf(stderr, "%s: row %zu is %s.\n", msg, i,
+                  in ? "not found" : "wrongly found");
+          free(flag);
+          return 1;
+        }
+      n+=in;
+    }
+  free(flag);
+  return n!=num;
+}
+
+
+
+
+
+/* Build a k-d tree with 'gal_kdtree_create' and check it (the nearest
+   neighbours with it and with a search tree that is prepared from it,
+   which also makes sure that all the usable rows are in the tree once)
+   against a brute force search. */
+static int
+check_create(size_t ndim, size_t size, int kind, double nanfrac)
+{
+  char msg[200];
+  gal_data_t *coords, *tree;
+  gal_kdtree_query_t *query;
+  double bd, td, qd, point[3];
+  size_t i, root, bi, ti, qi, nq=200;
+
+  sprintf(msg, "gal_kdtree_create (%zuD, %zu rows, kind %d, %g NaN)",
+          ndim, size, kind, nanfrac);
+  coords=make_coords(ndim, size, kind, nanfrac, 3);
+  tree=gal_kdtree_create(coords, &root);
+  query=gal_kdtree_query_prepare(coords, tree, root);
+  for(i=0;i<nq;++i)
+    {
+      get_point(coords, i*(size/nq), point);
+      point[ndim-1]+=0.37;
+      if( brute_knn(coords, point, 1, &bi, &bd)==0 ) continue;
+      ti=gal_kdtree_nearest_neighbour(coords, tree, root, point, &td);
+      qi=gal_kdtree_query_nearest(query, point, &qd);
+      if(ti!=bi || td!=bd || qi!=bi || qd!=bd)
+        {
+          fprintf(stderr, "%s: nearest to %g, %g is %zu (%g) and %zu (%g) "
+                  "but should be %zu (%g).\n", msg, point[0], point[1], ti,
+                  td, qi, qd, bi, bd);
+          return 1;
+        }
+    }
+  printf("%s: correct.\n", msg);
+  gal_kdtree_query_free(query);
+  gal_list_data_free(tree);
+  gal_list_data_free(coords);
+  return 0;
+}
+
+
+
+
+
+/* Check the searches of a tree for searches (built on all the numbers of
+   threads) against brute force. */
+static int
+check_queries(size_t ndim, size_t size, int kind, double nanfrac)
+{
+  char msg[200];
+  gal_data_t *coords, *points, *knn, *rad, *ref, *refrad;
+  gal_kdtree_query_t *query;
+  double low[3], high[3], point[3], bd[10], qd[10];
+  size_t t, i, j, d, n, bn, num, bi[10], qi[10], *found, *start;
+  size_t k=10, nq=150, nusable=0;
+
+  coords=make_coords(ndim, size, kind, nanfrac, 5);
+  points=make_coords(ndim, nq, kind, 0.05, 7);
+  for(i=0;i<size;++i)
+    {
+      get_point(coords, i, point);
+      for(d=0;d<ndim;++d) if( isnan(point[d]) ) break;
+      if(d==ndim) ++nusable;
+    }
+
+  ref=refrad=NULL;
+  for(t=0;t<NUMTHREADS;++t)
+    {
+      sprintf(msg, "k-d tree searches (%zuD, %zu rows, kind %d, %g NaN, "
+              "%zu threads)", ndim, size, kind, nanfrac, numthreads[t]);
+      query=gal_kdtree_query_build(coords, numthreads[t], -1, 1);
+      if(query->size!=nusable)
+        {
+          fprintf(stderr, "%s: %zu points in the tree (should be %zu).\n",
+                  msg, query->size, nusable);
+          return 1;
+        }
+
+      /* Single points. */
+      for(i=0;i<nq;++i)
+        {
+          get_point(points, i, point);
+
+          /* k nearest neighbours. */
+          bn=brute_knn(coords, point, k, bi, bd);
+          n=gal_kdtree_query_knn(query, point, k, qi, qd);
+          if( n!=bn || memcmp(qi, bi, n*sizeof *qi)
+              || memcmp(qd, bd, n*sizeof *qd) )
+            {
+              fprintf(stderr, "%s: wrong k nearest neighbours of point "
+                      "%zu.\n", msg, i);
+              return 1;
+            }
+
+          /* Radius. */
+          found=gal_kdtree_query_radius(query, point, 7.5, &num);
+          if( check_found(coords, point, 7.5, NULL, NULL, found, num,
+                          msg) )
+            return 1;
+          free(found);
+
+          /* Range. */
+          for(d=0;d<ndim;++d)
+            { low[d]=point[d]-3-d; high[d]=point[d]+2+d; }
+          found=gal_kdtree_query_range(query, low, high, &num);
+          if( check_found(coords, point, 0, low, high, found, num, msg) )
+            return 1;
+          free(found);
+        }
+
+      /* Many points at once (compared with the single point searches
+         above on one thread). */
+      knn=gal_kdtree_query_knn_batch(query, points, k, numthreads[t], -1, 1);
+      rad=gal_kdtree_query_radius_batch(query, points, 7.5, 0,
+                                        numthreads[t], -1, 1);
+      if(ref==NULL)
+        {
+          ref=knn;
+          refrad=rad;
+          for(i=0;i<nq;++i)
+            {
+              get_point(points, i, point);
+              n=gal_kdtree_query_knn(query, point, k, qi, qd);
+              for(j=0;j<k;++j)
+                if( j<n
+                    ? ( ((size_t *)(knn->array))[i*k+j]!=qi[j]
+                        || ((double *)(knn->next->array))[i*k+j]!=qd[j] )
+                    : ((size_t *)(knn->array))[i*k+j]!=GAL_BLANK_SIZE_T )
+                  {
+                    fprintf(stderr, "%s: batch k nearest neighbours of "
+                            "point %zu are wrong.\n", msg, i);
+                    return 1;
+                  }
+            }
+          start=rad->next ? rad->next->array : NULL;
+          for(i=0;i<nq;++i)
+            {
+              get_point(points, i, point);
+              num=((size_t *)(rad->array))[i];
+              if( check_found(coords, point, 7.5, NULL, NULL, start, num,
+                              msg) )
+                return 1;
+              start+=num;
+            }
+        }
+      else
+        {
+          if( memcmp(knn->array, ref->array, knn->size*sizeof(size_t))
+              || memcmp(knn->next->array, ref->next->array,
+                        knn->size*sizeof(double))
+              || memcmp(rad->array, refrad->array,
+                        rad->size*sizeof(size_t))
+              || (rad->next==NULL) != (refrad->next==NULL)
+              || ( rad->next && rad->next->size!=refrad->next->size ) )
+            {
+              fprintf(stderr, "%s: batch searches are different from one "
+                      "thread.\n", msg);
+              return 1;
+            }
+          gal_list_data_free(knn);
+          gal_list_data_free(rad);
+        }
+      gal_kdtree_query_free(query);
+    }
+
+  /* Clean up. */
+  printf("k-d tree searches (%zuD, %zu rows, kind %d, %g NaN): correct on "
+         "all threads.\n", ndim, size, kind, nanfrac);
+  gal_list_data_free(ref);
+  gal_list_data_free(refrad);
+  gal_list_data_free(points);
+  gal_list_data_free(coords);
+  return 0;
+}
+
+
+
+
+
+/* Return 1 if the two outputs of the matching functions are different. */
+static int
+match_different(gal_data_t *a, size_t na, gal_data_t *b, size_t nb)
+{
+  if(na!=nb || (a==NULL) != (b==NULL)) return 1;
+  if(a==NULL) return 0;
+  return ( memcmp(a->array, b->array, na*sizeof(size_t))
+           || memcmp(a->next->array, b->next->array, na*sizeof(size_t))
+           || memcmp(a->next->next->array, b->next->next->array,
+                     na*sizeof(double)) );
+}
+
+
+
+
+
+/* Match two catalogs with the sweep on one thread, and check it with the
+   sweep and the k-d tree (built internally or given for the first
+   catalog) on all the numbers of threads. */
+static int
+check_match(size_t size1, size_t size2, int kind)
+{
+  gal_data_t *c1, *c2, *ref, *out, *tree;
+  size_t t, root, nref, nout;
+  double aperture[3]={0.5, 1, 0};
+
+  c1=make_coords(2, size1, kind, 0, 11);
+  c2=make_coords(2, size2, kind, 0, 13);
+  tree=gal_kdtree_create(c1, &root);
+  ref=gal_match_coordinates(c1, c2, aperture, 0, 0, -1, 1, &nref);
+  for(t=0;t<NUMTHREADS;++t)
+    {
+      out=gal_match_coordinates_threaded(c1, c2, aperture, 0, 0,
+                                         numthreads[t], -1, 1, &nout);
+      if( match_different(ref, nref, out, nout) )
+        {
+          fprintf(stderr, "Match of %zu and %zu rows (kind %d) on %zu "
+                  "threads is different from one thread.\n", size1, size2,
+                  kind, numthreads[t]);
+          return 1;
+        }
+      gal_list_data_free(out);
+
+      out=gal_match_kdtree(c1, c2, NULL, 0, aperture, 0, 0, numthreads[t],
+                           -1, 1, &nout);
+      if( match_different(ref, nref, out, nout) )
+        {
+          fprintf(stderr, "Match of %zu and %zu rows (kind %d) with a k-d "
+                  "tree on %zu threads is different from the sweep.\n",
+                  size1, size2, kind, numthreads[t]);
+          return 1;
+        }
+      gal_list_data_free(out);
+
+      out=gal_match_kdtree(c1, c2, tree, root, aperture, 0, 0,
+                           numthreads[t], -1, 1, &nout);
+      if( match_different(ref, nref, out, nout) )
+        {
+          fprintf(stderr, "Match of %zu and %zu rows (kind %d) with the "
+                  "k-d tree of the first on %zu threads is different from "
+                  "the sweep.\n", size1, size2, kind, numthreads[t]);
+          return 1;
+        }
+      gal_list_data_free(out);
+    }
+  printf("Match of %zu and %zu rows (kind %d, %zu matched): identical on "
+         "all threads and with a k-d tree.\n", size1, size2, kind, nref);
+  gal_list_data_free(tree);
+  gal_list_data_free(ref);
+  gal_list_data_free(c1);
+  gal_list_data_free(c2);
+  return 0;
+}
+
+
+
+
+
+/* Rows with a NaN first coordinate (in both inputs) should not match
+   with anything, but rows that actually have the largest floating point
+   value (that is used in place of NaN for sorting) should match with
+   each other. */
+static int
+check_match_blank(void)
+{
+  double *x1, *y1, *x2, *y2;
+  gal_data_t *c1, *c2, *out;
+  size_t t, m, i, n1=300, n2=200, nout, *p1, *p2;
+  double aperture[3]={0.5, 1, 0};
+  size_t nans[2]={40, 30}, maxs[2][2]={ {57, 63}, {101, 150} };
+
+  /* Both catalogs are at random positions. The first rows of both have a
+     NaN first coordinate and two rows of each have the largest value. */
+  c1=make_coords(2, n1, COORD_RANDOM, 0, 17);
+  c2=make_coords(2, n2, COORD_RANDOM, 0, 19);
+  x1=c1->array; y1=c1->next->array;
+  x2=c2->array; y2=c2->next->array;
+  for(i=0;i<nans[0];++i) x1[i]=NAN;
+  for(i=0;i<nans[1];++i) x2[i]=NAN;
+  for(m=0;m<2;++m)
+    {
+      x1[maxs[m][0]]=x2[maxs[m][1]]=FLT_MAX;
+      y1[maxs[m][0]]=y2[maxs[m][1]]=10+20*m;
+    }
+
+  /* Check the outputs on all the threads (with the sweep and k-d tree). */
+  for(t=0;t<2*NUMTHREADS;++t)
+    {
+      out = ( t<NUMTHREADS
+              ? gal_match_coordinates_threaded(c1, c2, aperture, 0, 0,
+                                               numthreads[t], -1, 1, &nout)
+              : gal_match_kdtree(c1, c2, NULL, 0, aperture, 0, 0,
+                                 numthreads[t-NUMTHREADS], -1, 1, &nout) );
+      p1=out->array;
+      p2=out->next->array;
+      for(i=0;i<nout;++i)
+        if( p1[i]<nans[0] || p2[i]<nans[1] )
+          {
+            fprintf(stderr, "Rows %zu and %zu (at least one has a NaN "
+                    "coordinate) have been matched (%s, %zu threads).\n",
+                    p1[i], p2[i], t<NUMTHREADS ? "sweep" : "k-d tree",
+                    numthreads[t%NUMTHREADS]);
+            return 1;
+          }
+      for(m=0;m<2;++m)
+        {
+          for(i=0;i<nout;++i)
+            if( p1[i]==maxs[m][0] && p2[i]==maxs[m][1] ) break;
+          if(i==nout)
+            {
+              fprintf(stderr, "Rows %zu and %zu (with the largest value) "
+                      "have not been matched (%s, %zu threads).\n",
+                      maxs[m][0], maxs[m][1],
+                      t<NUMTHREADS ? "sweep" : "k-d tree",
+                      numthreads[t%NUMTHREADS]);
+              return 1;
+            }
+        }
+      gal_list_data_free(out);
+    }
+  printf("Match with NaN and the largest values: correct.\n");
+  gal_list_data_free(c1);
+  gal_list_data_free(c2);
+  return 0;
+}
+
+
+
+
+
+/* Check the k-d tree (its construction, searches and matching) against
+   brute force and the sweep (on one thread). Some of the inputs have a
+   constant first coordinate or many equal values (that should not slow
+   down the construction of the tree) and some have NaN values in some of
+   their rows (that should be ignored). */
+int
+main(void)
+{
+  int kind, fail=0;
+
+  /* Construction of the tree with 'gal_kdtree_create'. */
+  for(kind=COORD_RANDOM; kind<=COORD_GRID; ++kind)
+    {
+      fail |= check_create(2, 200000, kind, 0);
+      fail |= check_create(3, 20000, kind, 0.05);
+    }
+
+  /* Searches. */
+  for(kind=COORD_RANDOM; kind<=COORD_GRID; ++kind)
+    {
+      fail |= check_queries(2, 3000, kind, 0);
+      fail |= check_queries(2, 3000, kind, 0.1);
+      fail |= check_queries(3, 2000, kind, 0.1);
+    }
+
+  /* Matching. */
+  for(kind=COORD_RANDOM; kind<=COORD_CONSTANT; ++kind)
+    {
+      fail |= check_match(5000, 3000, kind);
+      fail |= check_match(2000, 6000, kind);
+    }
+  fail |= check_match_blank();
+
+  /* Clean up and return. */
+  gal_threads_pool_free();
+  return fail ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+/*********************************************************************
+A test program to check the sigma-clipping of Gnuastro.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2020, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gnuastro/statistics.h"
+
+
+/* Number of elements with a scatter of one and number of outliers. */
+#define NUMGOOD 20000
+#define NUMBAD  300
+
+
+/* Pseudo-random value between 0 and 1 (so the test is reproducible on
+   all systems). */
+#define RANDOM(S) ( ( (S) = (S)*1664525 + 1013904223 ) >> 8 ) / 16777216.0
+
+
+
+
+
+/* Compare two floats. */
+static int
+sort_float_increasing(const void *a, const void *b)
+{
+  float ta=*(float *)a, tb=*(float *)b;
+  return (ta > tb) - (ta < tb);
+}
+
+
+
+
+
+/* A simple implementation of the sigma-clipping (on a sorted array) for
+   comparison: the mean and standard deviation of each round are found in
+   two passes over the remaining elements. The output has the same
+   format as 'gal_statistics_sigma_clip'. */
+static void
+reference_sigma_clip(float *a, size_t size, float multip, float param,
+                     double *out)
+{
+  double med, mean, std, s, lo, hi;
+  size_t i, num=0, start=0, end=size, ns, ne;
+  double oldmed=NAN, oldmean=NAN, oldstd=NAN;
+  size_t maxnum = param>=1.0f ? param : GAL_STATISTICS_SIG_CLIP_MAX_CONVERGE;
+
+  while(num<maxnum && end>start)
+    {
+      /* Basic statistics of this round. */
+      size=end-start;
+      med = ( size%2
+              ? a[start+size/2]
+              : (float)((a[start+size/2-1]+a[start+size/2])/2.0f) );
+      for(s=0, i=start;i<end;++i) s+=a[i];
+      mean=s/size;
+      for(s=0, i=start;i<end;++i) s+=(a[i]-mean)*(a[i]-mean);
+      std = size>1 ? sqrt(s/size) : 0;
+
+      /* Convergence. */
+      if( param<1.0f && num>0 && ( std==0 || (oldstd-std)/std < param ) )
+        {
+          if(std==0) { oldmed=med; oldstd=std; oldmean=mean; }
+          break;
+        }
+
+      /* Clip. */
+      lo=med-multip*std;
+      hi=med+multip*std;
+      for(ns=start; ns<end && !(a[ns]>lo); ++ns) {}
+      for(ne=ns; ne<end && a[ne]<hi; ++ne) {}
+      if(ne>ns) { start=ns; end=ne; }
+      oldmed=med; oldstd=std; oldmean=mean;
+      ++num;
+    }
+  out[0]=end-start;
+  out[1]=oldmed;
+  out[2]=oldmean;
+  out[3]=oldstd;
+  if( param<1.0f && num==maxnum ) out[0]=out[1]=out[2]=out[3]=NAN;
+}
+
+
+
+
+
+/* Sigma-clip the data with the library and the reference and compare the
+   outputs. */
+static int
+check_sigma_clip(gal_data_t *data, float multip, float param)
+{
+  int i;
+  float *o;
+  double ref[4];
+  gal_data_t *out;
+  char *names[4]={"number", "median", "mean", "STD"};
+
+  out=gal_statistics_sigma_clip(data, multip, param, 0, 1);
+  reference_sigma_clip(data->array, data->size, multip, param, ref);
+  o=out->array;
+  for(i=0;i<4;++i)
+    if( fabs(o[i]-ref[i]) > 1e-4*(fabs(ref[i])>1 ? fabs(ref[i]) : 1) )
+      {
+        fprintf(stderr, "Sigma-clipping (%g, %g): %s is %g, but should be "
+                "%g.\n", multip, param, names[i], o[i], ref[i]);
+        return 1;
+      }
+  if( !(o[3]>0.8 && o[3]<1.2) )
+    {
+      fprintf(stderr, "Sigma-clipping (%g, %g): the standard deviation "
+              "(%g) should be near one.\n", multip, param, o[3]);
+      return 1;
+    }
+  printf("Sigma-clipping (%g, %g): %g elements with a median of %g, mean "
+         "of %g and STD of %g (correct).\n", multip, param, o[0], o[1],
+         o[2], o[3]);
+  gal_data_free(out);
+  return 0;
+}
+
+
+
+
+
+/* Sigma-clip data with a scatter of one (around a large value) that has
+   a few extreme outliers on both sides: the outliers should be clipped in
+   the first round and the standard deviation in the next rounds should
+   only be from the remaining elements (not the round-off errors of the
+   outliers). */
+int
+main(void)
+{
+  int j, fail=0;
+  float *arr;
+  gal_data_t *data;
+  uint32_t seed=1;
+  size_t i, size=NUMGOOD+NUMBAD;
+
+  /* Make the data (approximately Gaussian, from the sum of 12 uniform
+     random values). */
+  data=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1, &size, NULL, 0, -1, 1,
+                      NULL, NULL, NULL);
+  arr=data->array;
+  for(i=0;i<size;++i)
+    if(i%((NUMGOOD+NUMBAD)/NUMBAD)==0)
+      arr[i] = i%2 ? -1e12 : 3e12;
+    else
+      {
+        arr[i]=1000-6;
+        for(j=0;j<12;++j) arr[i]+=RANDOM(seed);
+      }
+
+  /* The reference needs a sorted array (the library will sort it
+     internally). */
+  qsort(arr, size, sizeof *arr, sort_float_increasing);
+
+  /* Check a fixed number of clips and clipping by tolerance. */
+  fail |= check_sigma_clip(data, 3, 5);
+  fail |= check_sigma_clip(data, 3, 0.1);
+  fail |= check_sigma_clip(data, 2.5, 0.2);
+
+  /* Clean up and return. */
+  gal_data_free(data);
+  return fail ? EXIT_FAILURE : EXIT_SUCCESS;
+}
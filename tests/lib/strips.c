@@ -0,0 +1,244 @@
+/*********************************************************************
+A test program to check reading and writing FITS images in parts.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2020, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gnuastro/fits.h"
+#include "gnuastro/tile.h"
+
+
+/* Name of the file that is written and read in this test. */
+#define FILENAME "strips.fits"
+
+
+/* The value of each pixel is determined by its position, so the pixels
+   can be checked after reading any part of the image. */
+#define PIXEL(R,C) ( (R)*1000.0f + (C) )
+
+
+
+
+
+/* Make sure the 'tsize' region starting at 'start' of the image is in
+   'data' (that must have a 'float32' type). */
+static int
+check_region(gal_data_t *data, size_t *start, size_t *tsize, char *msg)
+{
+  size_t i, j;
+  float *arr=data->array;
+
+  if( data->type!=GAL_TYPE_FLOAT32 || data->ndim!=2
+      || data->dsize[0]!=tsize[0] || data->dsize[1]!=tsize[1] )
+    {
+      fprintf(stderr, "%s: wrong type or size.\n", msg);
+      return 1;
+    }
+  for(i=0;i<tsize[0];++i)
+    for(j=0;j<tsize[1];++j)
+      if( arr[i*tsize[1]+j] != PIXEL(start[0]+i, start[1]+j) )
+        {
+          fprintf(stderr, "%s: pixel (%zu, %zu) of the image is %g (it "
+                  "should be %g).\n", msg, start[0]+i, start[1]+j,
+                  arr[i*tsize[1]+j], PIXEL(start[0]+i, start[1]+j));
+          return 1;
+        }
+  return 0;
+}
+
+
+
+
+
+/* Write the image into the first HDU as four tiles of a full image in
+   memory (so their positions are found from their block) and into the
+   second HDU as separate strips (with their positions given
+   explicitly). */
+static void
+write_image(size_t *dsize)
+{
+  float *arr;
+  fitsfile *fptr;
+  int status=0;
+  size_t i, j, h=7, start[2]={0,0}, ssize[2];
+  gal_data_t *image, *tile, *tiles, *strip;
+  size_t minmax[16]={ 0,  0,  49, 40,   0,  41, 49, 92,
+                      50, 0, 156, 10,  50, 11, 156, 92 };
+
+  /* The full image in memory. */
+  image=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 2, dsize, NULL, 0, -1, 1,
+                       NULL, NULL, NULL);
+  arr=image->array;
+  for(i=0;i<dsize[0];++i)
+    for(j=0;j<dsize[1];++j)
+      arr[i*dsize[1]+j]=PIXEL(i, j);
+
+  /* First HDU: write the tiles (in reverse order). */
+  tiles=gal_tile_series_from_minmax(image, minmax, 4);
+  fptr=gal_fits_img_write_empty(FILENAME, GAL_TYPE_FLOAT32, 2, dsize, NULL,
+                                "TILES", NULL);
+  for(i=4;i>0;--i)
+    {
+      tile=&tiles[i-1];
+      gal_fits_img_write_tile(fptr, tile, NULL);
+    }
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Second HDU: write strips of 'h' rows (the last is shorter). */
+  fptr=gal_fits_img_write_empty(FILENAME, GAL_TYPE_FLOAT32, 2, dsize, NULL,
+                                "STRIPS", NULL);
+  for(start[0]=0; start[0]<dsize[0]; start[0]+=h)
+    {
+      ssize[0] = start[0]+h<dsize[0] ? h : dsize[0]-start[0];
+      ssize[1] = dsize[1];
+      strip=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 2, ssize, NULL, 0, -1, 1,
+                           NULL, NULL, NULL);
+      arr=strip->array;
+      for(i=0;i<ssize[0];++i)
+        for(j=0;j<ssize[1];++j)
+          arr[i*ssize[1]+j]=PIXEL(start[0]+i, j);
+      gal_fits_img_write_tile(fptr, strip, start);
+      gal_data_free(strip);
+    }
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Clean up. */
+  gal_data_array_free(tiles, 4, 0);
+  gal_data_free(image);
+}
+
+
+
+
+
+/* Read the image in strips and make sure each strip (with its halo) has
+   the correct values and that all the rows are covered once. */
+static int
+check_strips(char *hdu, size_t *dsize, size_t height, size_t halo,
+             int prefetch)
+{
+  char msg[100];
+  gal_data_t *strip;
+  struct gal_fits_img_strips *strips;
+  size_t start, first, number, next=0, tstart[2]={0,0}, tsize[2];
+
+  sprintf(msg, "HDU %s in strips of %zu rows (halo %zu, prefetch %d)",
+          hdu, height, halo, prefetch);
+  strips=gal_fits_img_strips_open(FILENAME, hdu, GAL_TYPE_FLOAT32, height,
+                                  halo, prefetch, -1, 1);
+  while( (strip=gal_fits_img_strips_next(strips, &start, &first, &number)) )
+    {
+      /* Check the position of the strip. */
+      if( first!=next || number==0 || first+number>dsize[0]
+          || start != (first>halo ? first-halo : 0)
+          || start+strip->dsize[0] != ( first+number+halo<dsize[0]
+                                        ? first+number+halo : dsize[0] ) )
+        {
+          fprintf(stderr, "%s: wrong position of the strip from row "
+                  "%zu.\n", msg, first);
+          return 1;
+        }
+
+      /* Check the pixels. */
+      tstart[0]=start;
+      tsize[0]=strip->dsize[0];
+      tsize[1]=dsize[1];
+      if( check_region(strip, tstart, tsize, msg) ) return 1;
+      next=first+number;
+      gal_data_free(strip);
+    }
+  gal_fits_img_strips_close(strips);
+
+  /* Make sure all the rows were read. */
+  if(next!=dsize[0])
+    {
+      fprintf(stderr, "%s: only %zu rows (of %zu) were read.\n", msg, next,
+              dsize[0]);
+      return 1;
+    }
+  return 0;
+}
+
+
+
+
+
+/* Read a region of the image and check its pixels. */
+static int
+check_tile(char *hdu, size_t *start, size_t *tsize)
+{
+  int status=0, out;
+  char msg[100];
+  fitsfile *fptr;
+  gal_data_t *tile;
+
+  sprintf(msg, "HDU %s region of %zux%zu from (%zu, %zu)", hdu, tsize[0],
+          tsize[1], start[0], start[1]);
+  fptr=gal_fits_hdu_open_format(FILENAME, hdu, 0);
+  tile=gal_fits_img_read_tile(fptr, start, tsize, GAL_TYPE_INVALID, -1, 1);
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+  out=check_region(tile, start, tsize, msg);
+  gal_data_free(tile);
+  return out;
+}
+
+
+
+
+
+/* Write an image in parts (tiles and strips) and read it back in strips
+   (with and without a halo and reading in the background) and in
+   arbitrary regions. */
+int
+main(void)
+{
+  int prefetch, fail=0;
+  char *hdus[2]={"1", "2"};
+  size_t h, i, j, dsize[2]={157, 93};
+  size_t heights[4]={1, 10, 64, 500}, halos[3]={0, 3, 20};
+  size_t starts[3][2]={ {0, 0}, {17, 5}, {120, 80} };
+  size_t tsizes[3][2]={ {157, 93}, {60, 31}, {37, 13} };
+
+  /* Write the image. */
+  unlink(FILENAME);
+  write_image(dsize);
+
+  /* Check the two HDUs. */
+  for(i=0;i<2;++i)
+    {
+      for(h=0;h<4;++h)
+        for(j=0;j<3;++j)
+          for(prefetch=0;prefetch<=1;++prefetch)
+            fail |= check_strips(hdus[i], dsize, heights[h], halos[j],
+                                 prefetch);
+      for(j=0;j<3;++j)
+        fail |= check_tile(hdus[i], starts[j], tsizes[j]);
+    }
+
+  /* Report the result. */
+  if(fail==0)
+    printf("Image written in tiles and strips is read correctly.\n");
+  return fail ? EXIT_FAILURE : EXIT_SUCCESS;
+}
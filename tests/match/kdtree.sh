@@ -0,0 +1,95 @@
+# Match the two input catalogs with a k-d tree (on multiple threads) and
+# make sure the result is identical to the default matching (on one
+# thread). The trees of both inputs are also kept in different HDUs of one
+# file and read from it.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2020, Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=match
+execname=../bin/$prog/ast$prog
+cat1=$topsrc/tests/$prog/positions-1.txt
+cat2=$topsrc/tests/$prog/positions-2.txt
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+$check_with_program $execname $cat1 $cat2 --aperture=0.5 --ccol1=2,3  \
+                              --ccol2=2,3 --outcols=a1,b1 --numthreads=1 \
+                              --output=match-sweep.txt
+$check_with_program $execname $cat1 $cat2 --aperture=0.5 --ccol1=2,3  \
+                              --ccol2=2,3 --outcols=a1,b1 --numthreads=3 \
+                              --kdtree --output=match-kdtree.txt
+
+# Keep the trees of the two inputs in two HDUs of one file. When a tree is
+# built again (because its input has changed), the other HDU should remain
+# (so it is read in the last command).
+rm -f match-kdtree.fits
+$check_with_program $execname $cat1 $cat2 --aperture=0.5 --ccol1=2,3  \
+                              --ccol2=2,3 --outcols=a1,b1             \
+                              --kdtreefile=match-kdtree.fits          \
+                              --kdtreehdu=FIRST --output=match-kdt1.txt
+$check_with_program $execname $cat2 $cat1 --aperture=0.5 --ccol1=2,3  \
+                              --ccol2=2,3 --outcols=b1,a1             \
+                              --kdtreefile=match-kdtree.fits          \
+                              --kdtreehdu=SECOND --output=match-kdt2.txt
+$check_with_program $execname $cat2 $cat1 --aperture=0.5 --ccol1=2,3  \
+                              --ccol2=2,3 --outcols=b1,a1             \
+                              --kdtreefile=match-kdtree.fits          \
+                              --kdtreehdu=FIRST --output=match-kdt3.txt
+$check_with_program $execname $cat2 $cat1 --aperture=0.5 --ccol1=2,3  \
+                              --ccol2=2,3 --outcols=b1,a1             \
+                              --kdtreefile=match-kdtree.fits          \
+                              --kdtreehdu=SECOND --output=match-kdt4.txt \
+                              > match-kdt4-stdout.txt
+
+# All the outputs should be identical and the last tree should have been
+# read from the file.
+cmp match-sweep.txt match-kdtree.txt                  \
+    && cmp match-sweep.txt match-kdt1.txt             \
+    && cmp match-kdt2.txt match-kdt3.txt              \
+    && cmp match-kdt2.txt match-kdt4.txt              \
+    && grep "k-d tree read from" match-kdt4-stdout.txt
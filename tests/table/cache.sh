@@ -0,0 +1,88 @@
+# Read a table through its cache, also when the cache is broken.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2020, Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=table
+input=binary-table.fits
+table=cache-table.fits
+cache=.cache-table.fits_1.gtcache
+execname=../bin/$prog/ast$prog
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $input    ]; then echo "$input doesn't exist.";  exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like 'Valgrind' or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+#
+# The table is first read without a cache. It is then read with the
+# cache: once to write it and once from it. Finally the cache is
+# truncated, then its column information is overwritten: in both cases it
+# should be ignored (and re-written), so the output must always be the
+# same.
+cp $input $table
+rm -f $cache
+$check_with_program $execname $table --hdu=1 --output=cache-ref.txt
+$check_with_program $execname $table --hdu=1 --tablecache \
+                    --output=cache-write.txt
+if [ ! -f $cache ]; then echo "$cache not created."; exit 1; fi
+$check_with_program $execname $table --hdu=1 --tablecache \
+                    --output=cache-read.txt
+
+head -c 200 $cache > cache-tmp && mv cache-tmp $cache
+$check_with_program $execname $table --hdu=1 --tablecache \
+                    --output=cache-truncated.txt
+
+head -c 400 /dev/zero | tr '\0' '\377' \
+    | dd of=$cache bs=1 seek=80 conv=notrunc 2> /dev/null
+$check_with_program $execname $table --hdu=1 --tablecache \
+                    --output=cache-overwritten.txt
+
+for f in cache-write.txt cache-read.txt cache-truncated.txt \
+         cache-overwritten.txt; do
+    if ! cmp -s cache-ref.txt $f; then
+        echo "$f is different from cache-ref.txt"; exit 1
+    fi
+done